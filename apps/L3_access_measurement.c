@@ -4,8 +4,12 @@
  * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
  */
 
-#include "../lib/memory-utils.c"
-#include "../lib/cache-utils.c"
+#define _GNU_SOURCE
+#include "../lib/memory-utils.h"
+#include "../lib/cache-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
 #include <sched.h>
 #include <inttypes.h>
 #include <stdlib.h>
@@ -43,8 +47,9 @@ int main(int argc, char **argv) {
 
 	int coreID;
 	sscanf (argv[1],"%d",&coreID);
-	if(coreID > NUMBER_CORES*2-1 || coreID < 0){
-		printf("Wrong Core! CoreID should be less than %d and more than 0!\n", NUMBER_CORES);
+	const struct cpu_topology *topology=topology_get();
+	if(coreID < 0 || (topology!=NULL && (coreID >= topology->nCpus || !topology->online[coreID]))){
+		printf("Wrong Core! CoreID should be an online CPU (see /sys/devices/system/cpu/online)!\n");
 		exit(1);   
 	}
 
@@ -61,8 +66,22 @@ int main(int argc, char **argv) {
 	 */
 	CorePin(0);
 
-	/* Get a 1GB-hugepage */
-	void *buffer = create_buffer();
+	/* Get a 1GB-hugepage: chunks are found by adding offsets to the physical address of the buffer */
+	struct buffer buf;
+	int error=create_buffer_sized(&buf, PAGE_SIZE_1GB, PAGE_SIZE_1GB);
+	if(error) {
+		printf("Failed to allocate memory for buffer: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(buf.page_size!=PAGE_SIZE_1GB) {
+		printf("A 1GB-hugepage is required!\n");
+		exit(1);
+	}
+	void *buffer = buf.addr;
+
+	/* MSRs of core 0 are used for finding the slices */
+	struct msr_device msr;
+	msr_init(&msr, 0);
 
 	/* Calculate the physical address of the buffer */
 	uint64_t bufPhyAddr = get_physical_address(buffer);
@@ -98,7 +117,11 @@ int main(int argc, char **argv) {
 	int j=0,k=0;
 
 	/* Find first chunk */
-	unsigned long long offset = sliceFinder_uncore(buffer,desiredSlice);
+	uint64_t offset;
+	if((error=sliceFinder_uncore(&msr,buffer,desiredSlice,&offset))) {
+		printf("Failed to find the slice: %s\n", sa_strerror(error));
+		exit(1);
+	}
 
 	totalChunks[0]=buffer+offset;
 	totalChunksPhysical[0]= bufPhyAddr+offset;
@@ -111,7 +134,7 @@ int main(int argc, char **argv) {
 	/* Find next chunks which are residing in the desired slice and the same sets in L3/L2/L1*/
 	for(i=1;i<nTotalChunks; i++) {
 		offset=L3_INDEX_STRIDE;
-		while(desiredSlice!=calculateSlice_uncore(totalChunks[i-1]+offset) || index1!=indexCalculator(totalChunksPhysical[i-1]+offset,1) || index2!=indexCalculator(totalChunksPhysical[i-1]+offset,2) || index3!=indexCalculator(totalChunksPhysical[i-1]+offset,3)) {
+		while(desiredSlice!=calculateSlice_uncore(&msr,totalChunks[i-1]+offset) || index1!=indexCalculator(totalChunksPhysical[i-1]+offset,1) || index2!=indexCalculator(totalChunksPhysical[i-1]+offset,2) || index3!=indexCalculator(totalChunksPhysical[i-1]+offset,3)) {
 			offset+=L3_INDEX_STRIDE;
 		}
 		totalChunks[i]=totalChunks[i-1]+offset;
@@ -120,7 +143,7 @@ int main(int argc, char **argv) {
 
 	/* validate chunks: whether they are on the desired slice or not */
 	for(i=0;i<nTotalChunks;i++) {
-		if(desiredSlice!=calculateSlice_uncore(totalChunks[i])) {
+		if(desiredSlice!=calculateSlice_uncore(&msr,totalChunks[i])) {
 			printf("Error!");
 			exit(EXIT_FAILURE);
 		}
@@ -129,6 +152,12 @@ int main(int argc, char **argv) {
 	/* Ping program to coreID */
     CorePin(coreID);
 
+	/* Calibrate the timer on the measuring core */
+	timing_print(stderr);
+	struct timing_hist memoryHist, llcHist;
+	timing_hist_init(&memoryHist);
+	timing_hist_init(&llcHist);
+
 	unsigned char *slice;
 
 	for(k=0;k<READ_TIMES;k++) {
@@ -148,54 +177,38 @@ int main(int argc, char **argv) {
 			}
 		}
 
-		register uint64_t time1, time2;
-		unsigned cycles_high, cycles_low, cycles_high1, cycles_low1;
-		unsigned int val=0;
+		uint64_t time1, time2;
+		volatile unsigned int val=0;
 
 		/* Read Array: Gives Memory Access Time*/
 		for(i=0; i<nTotalChunks;i=i+stride) {
-			asm volatile ("CPUID\n\t"
-				"RDTSC\n\t"
-				"mov %%edx, %0\n\t"
-				"mov %%eax, %1\n\t": "=r" (cycles_high), "=r" (cycles_low):: "rax", "rbx", "rcx", "rdx");
+			time1=timing_start();
 			/* Measured operation */
-			val=*(unsigned int*)totalChunks[i];
-
-			asm volatile ("RDTSCP\n\t"
-				"mov %%edx, %0\n\t"
-				"mov %%eax, %1\n\t"
-				"CPUID\n\t": "=r" (cycles_high1), "=r" (cycles_low1):: "rax", "rbx", "rcx", "rdx");
-			time1= (((uint64_t)cycles_high << 32) | cycles_low);
-			time2= (((uint64_t)cycles_high1 << 32) | cycles_low1);
-			/* Print Memory Access Time */
-			//printf("%lu\n", time2-time1);
+			val=*(volatile unsigned int*)totalChunks[i];
+			time2=timing_stop();
+			timing_hist_record(&memoryHist, timing_cycles(time1, time2));
 		}
 
 		/* Gives LLC Access Time*/
 		for(i=0; i<nL2Chunks;i=i+stride) {
 			slice=totalChunks[i];
-			asm volatile ("CPUID\n\t"
-				"RDTSC\n\t"
-				"mov %%edx, %0\n\t"
-				"mov %%eax, %1\n\t": "=r" (cycles_high), "=r" (cycles_low):: "rax", "rbx", "rcx", "rdx");
-
+			time1=timing_start();
 			/* Measured operation */
-			val=*slice;
-
-			asm volatile ("RDTSCP\n\t"
-				"mov %%edx, %0\n\t"
-				"mov %%eax, %1\n\t"
-				"CPUID\n\t": "=r" (cycles_high1), "=r" (cycles_low1):: "rax", "rbx", "rcx", "rdx");
-			time1= (((uint64_t)cycles_high << 32) | cycles_low);
-			time2= (((uint64_t)cycles_high1 << 32) | cycles_low1);
-			/* Print LLC Access Time */
-			printf("%lu\n", time2-time1);
+			val=*(volatile unsigned char*)slice;
+			time2=timing_stop();
+			/* Print LLC Access Time (cycles, without the timer overhead) */
+			printf("%lu\n", timing_cycles(time1, time2));
+			timing_hist_record(&llcHist, timing_cycles(time1, time2));
 		}
 
 	}
 
+	/* Summary on stderr, so stdout keeps one sample per line */
+	timing_hist_print(stderr, "Memory", &memoryHist);
+	timing_hist_print(stderr, "LLC", &llcHist);
+
 	/* Free the buffers */
-	free_buffer(buffer);
+	free_buffer_sized(&buf);
 	free(totalChunks);
 	free(totalChunksPhysical);
 
@@ -0,0 +1,86 @@
+#
+# Benchmark driver: run slice_bench with every layout on every sample workload
+# (workload/sample/Uniform and workload/sample/Zipf-s0.99) and print a CSV table with
+# the mean throughput, its 95% confidence interval, and the speedup over noslice with its 95% confidence interval
+#
+# Usage: sudo ./bench_driver.sh [runs] [number_threads] [core_set] > results.csv
+# The layouts can be chosen with LAYOUTS (default: "noslice slice spill"); noslice is the baseline of the speedup.
+#
+# Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology
+#
+
+
+runs=${1:-10}
+threads=$2
+core_set=$3
+layouts=${LAYOUTS:-"noslice slice spill"}
+app_dir=$(dirname $0)
+sample_dir=$app_dir/../workload/sample
+
+if [ ! -x $app_dir/build/slice_bench ]
+then
+	echo "Build slice_bench first: make slice_bench"
+	exit 1
+fi
+if [ $runs -lt 2 ]
+then
+	echo "At least 2 runs are required for the confidence intervals"
+	exit 1
+fi
+
+echo "distribution,workload,size_KB,layout,threads,runs,mean_ops_per_s,ci95_ops_per_s,speedup,speedup_ci95"
+for distribution in Uniform Zipf-s0.99
+do
+	#Smallest working set first, e.g., UN-size-32KB-number-512.txt
+	for workload in $(ls $sample_dir/$distribution | sort -t- -k3 -n)
+	do
+		size_kb=$(echo $workload | grep -oE "size-[0-9]+" | grep -oE "[0-9]+")
+		results=""
+		for layout in $layouts
+		do
+			results+=$($app_dir/build/slice_bench -l $layout -r $runs ${threads:+-n $threads} ${core_set:+-c $core_set} \
+				$sample_dir/$distribution/$workload 2>/dev/null)$'\n'
+		done
+
+		#slice_bench prints layout,threads,lines,run,ops_per_s for every run
+		echo "$results" | awk -F, -v distribution=$distribution -v workload=$workload -v size_kb=$size_kb '
+		#Two-sided 95% quantile of the t-distribution
+		function t95(df) {
+			split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 2.201 2.179 2.160 2.145 2.131 2.120 2.110 2.101 2.093 2.086 2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ")
+			return (df <= 30) ? t[df] : 1.96
+		}
+		NF == 5 {
+			if (!($1 in n)) {
+				order[++nLayouts] = $1
+			}
+			n[$1]++
+			sum[$1] += $5
+			sumSquares[$1] += $5 * $5
+			threads[$1] = $2
+		}
+		END {
+			for (i = 1; i <= nLayouts; i++) {
+				l = order[i]
+				mean[l] = sum[l] / n[l]
+				variance = (n[l] > 1) ? (sumSquares[l] - n[l] * mean[l] * mean[l]) / (n[l] - 1) : 0
+				sd[l] = (variance > 0) ? sqrt(variance) : 0
+			}
+			for (i = 1; i <= nLayouts; i++) {
+				l = order[i]
+				ci = (n[l] > 1) ? t95(n[l] - 1) * sd[l] / sqrt(n[l]) : 0
+				speedup = ""
+				speedupCi = ""
+				#Ratio of the means, with the confidence interval of the delta method
+				if (("noslice" in mean) && mean["noslice"] > 0 && mean[l] > 0) {
+					b = "noslice"
+					ratio = mean[l] / mean[b]
+					se = ratio * sqrt((sd[l] / mean[l]) ^ 2 / n[l] + (sd[b] / mean[b]) ^ 2 / n[b])
+					df = ((n[l] < n[b]) ? n[l] : n[b]) - 1
+					speedup = sprintf("%.4f", ratio)
+					speedupCi = sprintf("%.4f", (df > 0) ? t95(df) * se : 0)
+				}
+				printf "%s,%s,%s,%s,%s,%d,%.0f,%.0f,%s,%s\n", distribution, workload, size_kb, l, threads[l], n[l], mean[l], ci, speedup, speedupCi
+			}
+		}'
+	done
+done
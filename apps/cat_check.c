@@ -0,0 +1,158 @@
+/*
+ * This program checks lib/cat-utils.h against a mock resctrl tree in a temporary directory (no CAT hardware
+ * or root needed): it splits the ways of the mock cache among workers, applies every worker's class of service
+ * and compares the files written to the tree with the expected schemata, CPUs and tasks.
+ * Unusable masks and splits must be rejected. With -k, the mock tree is kept for inspection.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/cat-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define CBM_MASK 0xfffff			/* 20 ways, as on the Xeon E5-2667 v3 */
+#define NUMBER_WORKERS 4
+#define WAYS_PER_WORKER 2
+
+static char root[CAT_ROOT_LENGTH];
+
+/*
+ * Write a file of the mock tree
+ */
+
+void WriteFile(const char *file, const char *value) {
+
+	char path[CAT_PATH_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s", root, file);
+	FILE *fileptr = fopen(path, "w");
+	if(fileptr == NULL || fputs(value, fileptr) == EOF || fclose(fileptr) == EOF) {
+		printf("Cannot write %s\n", path);
+		exit(1);
+	}
+}
+
+/*
+ * Compare a file of a group with the expected value, then remove it (so that the group can be removed)
+ */
+
+void CheckFile(const char *group, const char *file, const char *expected) {
+
+	char path[CAT_PATH_LENGTH], value[CAT_GROUP_LENGTH] = "";
+	snprintf(path, sizeof(path), "%s/%s/%s", root, group, file);
+	FILE *fileptr = fopen(path, "r");
+	if(fileptr == NULL || fgets(value, sizeof(value), fileptr) == NULL || strcmp(value, expected) != 0) {
+		printf("%s: expected \"%s\", found \"%s\"\n", path, expected, value);
+		exit(1);
+	}
+	fclose(fileptr);
+	unlink(path);
+}
+
+/*
+ * Check the result of a call
+ */
+
+void Expect(const char *call, int error, int expected) {
+	if(error != expected) {
+		printf("%s returned \"%s\" instead of \"%s\"\n", call, sa_strerror(error), sa_strerror(expected));
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Options: keep the mock tree (-k)
+	 */
+
+	int keep=0, option, wrong=0;
+	while((option=getopt(argc, argv, "k"))!=-1) {
+		if(option=='k') {
+			keep=1;
+		} else {
+			wrong=1;
+		}
+	}
+	if(wrong || argc-optind!=0){
+		printf("Wrong Input!\n");
+		printf("Enter: %s [-k]\n", argv[0]);
+		exit(1);
+	}
+
+	/* Mock tree: only the info files that resctrl provides; the group files are created when written */
+	char info[CAT_PATH_LENGTH], value[CAT_GROUP_LENGTH];
+	snprintf(root, sizeof(root), "/tmp/cat_check.XXXXXX");
+	if(mkdtemp(root)==NULL) {
+		printf("Cannot create the mock resctrl tree\n");
+		exit(1);
+	}
+	snprintf(info, sizeof(info), "%s/info", root);
+	mkdir(info, 0755);
+	snprintf(info, sizeof(info), "%s/info/L3", root);
+	mkdir(info, 0755);
+	snprintf(value, sizeof(value), "%x\n", CBM_MASK);
+	WriteFile("info/L3/cbm_mask", value);
+	WriteFile("info/L3/min_cbm_bits", "2\n");
+	cat_set_root(root);
+
+	/* Masks */
+	Expect("cat_check_mask(0)", cat_check_mask(0), SA_ERR_INVALID);
+	Expect("cat_check_mask(0x5)", cat_check_mask(0x5), SA_ERR_INVALID);
+	Expect("cat_check_mask(0x4)", cat_check_mask(0x4), SA_ERR_INVALID);
+	Expect("cat_check_mask(0x300000)", cat_check_mask(0x300000), SA_ERR_INVALID);
+	Expect("cat_check_mask(0x3c)", cat_check_mask(0x3c), SA_OK);
+
+	/* Splits */
+	uint64_t masks[NUMBER_WORKERS];
+	int i;
+	Expect("cat_split_ways(0 workers)", cat_split_ways(0, WAYS_PER_WORKER, masks), SA_ERR_INVALID);
+	Expect("cat_split_ways(-1 workers)", cat_split_ways(-1, WAYS_PER_WORKER, masks), SA_ERR_INVALID);
+	Expect("cat_split_ways(0 ways)", cat_split_ways(NUMBER_WORKERS, 0, masks), SA_ERR_INVALID);
+	Expect("cat_split_ways(21 ways)", cat_split_ways(1, 21, masks), SA_ERR_INVALID);
+	Expect("cat_split_ways()", cat_split_ways(NUMBER_WORKERS, WAYS_PER_WORKER, masks), SA_OK);
+	for(i=0;i<NUMBER_WORKERS;i++) {
+		if(masks[i]!=(3ULL << (i*WAYS_PER_WORKER))) {
+			printf("Worker %d got the ways %llx\n", i, (unsigned long long)masks[i]);
+			exit(1);
+		}
+	}
+
+	/* Every worker gets its group with its ways, its CPU and the calling thread */
+	char expected[CAT_GROUP_LENGTH];
+	for(i=0;i<NUMBER_WORKERS;i++) {
+		struct cat_worker w;
+		cat_worker_init(&w, i, i, 0, masks[i]);
+		Expect("cat_worker_apply()", cat_worker_apply(&w), SA_OK);
+		snprintf(expected, sizeof(expected), "L3:0=%llx\n", (unsigned long long)masks[i]);
+		CheckFile(w.group, "schemata", expected);
+		snprintf(expected, sizeof(expected), "%d\n", i);
+		CheckFile(w.group, "cpus_list", expected);
+		snprintf(expected, sizeof(expected), "%d\n", (int)syscall(SYS_gettid));
+		CheckFile(w.group, "tasks", expected);
+		Expect("cat_worker_release()", cat_worker_release(&w), SA_OK);
+	}
+
+	/* Without a tree, nothing can be configured */
+	cat_set_root("/nonexistent");
+	Expect("cat_split_ways(no resctrl)", cat_split_ways(NUMBER_WORKERS, WAYS_PER_WORKER, masks), SA_ERR_RESCTRL);
+
+	if(!keep) {
+		snprintf(info, sizeof(info), "%s/info/L3/cbm_mask", root);
+		unlink(info);
+		snprintf(info, sizeof(info), "%s/info/L3/min_cbm_bits", root);
+		unlink(info);
+		snprintf(info, sizeof(info), "%s/info/L3", root);
+		rmdir(info);
+		snprintf(info, sizeof(info), "%s/info", root);
+		rmdir(info);
+		rmdir(root);
+	}
+	printf("cat_check: OK (%d workers on %s)\n", NUMBER_WORKERS, root);
+	return 0;
+}
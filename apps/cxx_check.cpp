@@ -0,0 +1,162 @@
+/*
+ * This program checks the C++ interface of the library:
+ * - lib/slice-allocator.hpp: standard containers with SliceAllocator<T> and std::pmr containers with
+ *   SliceMemoryResource must place their elements on the requested slice (nodes entirely, large blocks
+ *   with their first line, see arena-utils.h)
+ * - lib/slice-hash.hpp: the compile-time models and the runtime dispatcher must agree with the hash functions
+ *   of cache-utils.c on random physical addresses (its static_asserts run when this program is compiled)
+ * Reading physical addresses requires root (only for the allocator).
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include "../lib/slice-allocator.hpp"
+#include "../lib/slice-hash.hpp"
+#include "../lib/cache-utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#define NUMBER_ELEMENTS 1000
+#define NUMBER_ADDRESSES 1000000
+#define ADDRESS_BITS 40				/* Physical addresses of up to 1TB */
+
+static sa_context_t *ctx;
+
+/*
+ * Check that the line of an element is on the slice
+ */
+
+void CheckSlice(const char *container, const void *element, int slice) {
+	int actual = sa_slice_of(ctx, element);
+	if(actual != slice) {
+		printf("%s: element %p is on slice %d instead of %d (%s)\n", container, element, actual, slice,
+			actual < 0 ? sa_strerror(actual) : "wrong slice");
+		exit(1);
+	}
+}
+
+/*
+ * Containers with SliceAllocator<T> on a slice
+ */
+
+void CheckAllocator(int slice) {
+
+	sliceaware::SliceAllocator<uint64_t> allocator(slice, ctx);
+
+	/* The array of a vector: its first line is on the slice */
+	std::vector<uint64_t, sliceaware::SliceAllocator<uint64_t>> v(allocator);
+	for(int i=0;i<NUMBER_ELEMENTS;i++) {
+		v.push_back(i);
+	}
+	CheckSlice("std::vector", v.data(), slice);
+
+	/* Nodes (rebound allocators) lie entirely on the slice */
+	std::list<uint64_t, sliceaware::SliceAllocator<uint64_t>> l(allocator);
+	for(int i=0;i<NUMBER_ELEMENTS;i++) {
+		l.push_back(i);
+	}
+	for(const uint64_t &element : l) {
+		CheckSlice("std::list", &element, slice);
+	}
+
+	std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+		sliceaware::SliceAllocator<std::pair<const int, int>>> m(0, std::hash<int>(), std::equal_to<int>(),
+		sliceaware::SliceAllocator<std::pair<const int, int>>(slice, ctx));
+	for(int i=0;i<NUMBER_ELEMENTS;i++) {
+		m[i] = i;
+	}
+	for(const auto &element : m) {
+		CheckSlice("std::unordered_map", &element, slice);
+	}
+}
+
+/*
+ * std::pmr containers with SliceMemoryResource on a slice
+ */
+
+void CheckMemoryResource(int slice) {
+
+	sliceaware::SliceMemoryResource resource(slice, ctx);
+
+	std::pmr::vector<int> v(&resource);
+	for(int i=0;i<NUMBER_ELEMENTS;i++) {
+		v.push_back(i);
+	}
+	CheckSlice("std::pmr::vector", v.data(), slice);
+
+	std::pmr::list<int> l(&resource);
+	for(int i=0;i<NUMBER_ELEMENTS;i++) {
+		l.push_back(i);
+	}
+	for(const int &element : l) {
+		CheckSlice("std::pmr::list", &element, slice);
+	}
+}
+
+/*
+ * Compile-time Haswell model and runtime dispatcher against cache-utils.c
+ */
+
+void CheckHash() {
+
+	using Haswell = sliceaware::SliceHash<sliceaware::HaswellE5_2667v3>;
+	struct hash_model model;
+	uint64_t x = 88172645463325252ULL;
+
+	hash_model_haswell(&model);
+	const sliceaware::HashOps &ops = sliceaware::hash_ops();
+	for(int i=0;i<NUMBER_ADDRESSES;i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		uint64_t pa = x & ((1ULL << ADDRESS_BITS) - 1);
+		int slice = calculateSlice_HF_haswell(pa);
+		int desiredSlice = (int)(x >> 61);
+		if(Haswell::slice(pa) != slice || hash_model_slice(&model, pa) != slice ||
+			Haswell::virtual_slice(pa) != slice || Haswell::set_index(pa) != ((pa >> 6) & 2047)) {
+			printf("SliceHash<HaswellE5_2667v3>: %llx is on slice %d instead of %d\n", (unsigned long long)pa,
+				Haswell::slice(pa), slice);
+			exit(1);
+		}
+		if(i % 64 == 0 && Haswell::next_line(pa, desiredSlice) != sliceFinder_HF_haswell(pa, desiredSlice)) {
+			printf("SliceHash<HaswellE5_2667v3>: wrong next line of slice %d after %llx\n", desiredSlice,
+				(unsigned long long)pa);
+			exit(1);
+		}
+		/* The dispatcher must use the compile-time model of the running CPU */
+		if(ops.hasHash && (ops.slice(pa) != slice || ops.next_line(pa, slice) != 0)) {
+			printf("hash_ops() (%s): %llx is on slice %d instead of %d\n", ops.name, (unsigned long long)pa,
+				ops.slice(pa), slice);
+			exit(1);
+		}
+	}
+	if(!ops.hasHash && (ops.slice != nullptr || ops.next_line != nullptr)) {
+		printf("hash_ops() (%s): functions of an unknown hash function\n", ops.name);
+		exit(1);
+	}
+	printf("cxx_check: SliceHash and hash_ops() (%s) OK on %d addresses\n", ops.name, NUMBER_ADDRESSES);
+}
+
+int main() {
+
+	CheckHash();
+
+	int error;
+	if((error=sa_context_create(&ctx, nullptr))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	int nSlices=sa_number_slices(ctx);
+	for(int slice=0;slice<nSlices;slice++) {
+		CheckAllocator(slice);
+		CheckMemoryResource(slice);
+	}
+	printf("cxx_check: SliceAllocator and SliceMemoryResource OK on %d slices\n", nSlices);
+
+	sa_context_destroy(ctx);
+	return 0;
+}
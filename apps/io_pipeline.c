@@ -0,0 +1,341 @@
+/*
+ * This program streams a file through a read-parse pipeline on pinned cores by using io_uring.
+ * Every core reads the whole file with a queue of buffers and parses the records (numbers) right after each read.
+ * The buffers are:
+ * - slice: made of cache lines mapped to the slice of the core, read with IORING_OP_READV
+ * - noslice: ordinary contiguous buffers, read with IORING_OP_READV (one segment), i.e., the same path as slice
+ *   except for the placement of the data
+ * - fixed: ordinary contiguous buffers registered with io_uring and read with IORING_OP_READ_FIXED
+ * With all, the three modes run one after the other and the speedup of slice over noslice is printed.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/io-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define NUMBER_CORES 8
+#define DEFAULT_BUFFER_KB 16
+#define DEFAULT_QUEUE_DEPTH 8
+#define DEFAULT_PASSES 10
+
+#define MODE_SLICE 0
+#define MODE_NOSLICE 1
+#define MODE_FIXED 2
+#define NUMBER_MODES 3
+
+static const char *modeNames[] = {"slice", "noslice", "fixed"};
+
+/* Thread argument */
+struct arg_struct {
+	int coreID;					/* CPU of the thread */
+	const char *input_file;		/* File to stream */
+	int mode;					/* Slice-local, contiguous or registered buffers */
+	sa_context_t *ctx;			/* Context providing the slice-local lines */
+	size_t bufferSize;
+	unsigned queueDepth;
+	int passes;
+	double MBps;				/* Result: read + parse throughput */
+};
+
+/* Parser state, kept across buffers since records can span them */
+struct parser {
+	uint64_t value;
+	int inNumber;
+	unsigned long long nRecords;
+	uint64_t checksum;
+};
+
+/* Printf mutex */
+static pthread_mutex_t printf_mutex;
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Parse the first size bytes of a buffer: whitespace-separated decimal numbers
+ */
+
+void Parse(struct parser *p, struct io_buffer *buf, size_t size) {
+
+	int s;
+	size_t i;
+
+	for(s=0; s<buf->nSegments && size>0; s++) {
+		const unsigned char *data = buf->iov[s].iov_base;
+		size_t len = (buf->iov[s].iov_len < size) ? buf->iov[s].iov_len : size;
+		for(i=0; i<len; i++) {
+			unsigned char c = data[i];
+			if(c>='0' && c<='9') {
+				p->value = p->value*10 + (c-'0');
+				p->inNumber = 1;
+			} else if(p->inNumber) {
+				p->checksum += p->value;
+				p->nRecords++;
+				p->value = 0;
+				p->inNumber = 0;
+			}
+		}
+		size -= len;
+	}
+}
+
+/*
+ * Function to be called by each thread
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = (struct arg_struct*) arguments;
+	int coreID = args->coreID;
+	unsigned b;
+	int pass, error;
+
+	CorePin(coreID);
+
+	int fd = open(args->input_file, O_RDONLY);
+	struct stat st;
+	if(fd<0 || fstat(fd, &st)<0) {
+		printf("Cannot open %s\n", args->input_file);
+		exit(1);
+	}
+	uint64_t fileSize = st.st_size;
+
+	/* The buffers are allocated by the consuming core */
+	struct io_ring ring;
+	struct io_buffer_pool pool;
+	if((error=io_ring_init(&ring, args->queueDepth))) {
+		printf("Failed to create the ring: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(args->mode==MODE_SLICE) {
+		error=io_pool_init_slice(&pool, args->ctx, sa_cpu_slice(coreID), args->queueDepth, args->bufferSize);
+	} else {
+		error=io_pool_init_contiguous(&pool, args->queueDepth, args->bufferSize);
+	}
+	/* Only the fixed mode registers its buffers (IORING_OP_READ_FIXED) */
+	if(error || (args->mode==MODE_FIXED && (error=io_pool_register(&pool, &ring)))) {
+		printf("Failed to create the buffers: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	/* Completion status of each buffer: result of the read, or -1 while in flight, and the offset it reads */
+	int *result = malloc(args->queueDepth*sizeof(*result));
+	uint64_t *offsets = malloc(args->queueDepth*sizeof(*offsets));
+	struct parser parser;
+	uint64_t start=0, end, parseStart;
+	struct timing_hist parseHist;
+	timing_hist_init(&parseHist);
+
+	/* The first pass warms up the page cache and is not measured */
+	for(pass=0; pass<=args->passes; pass++) {
+		if(pass==1) {
+			start = timing_start();
+		}
+		memset(&parser, 0, sizeof(parser));
+		uint64_t nextRead = 0;
+		unsigned long long seq = 0, parsed = 0;
+
+		/* Fill the queue: chunk seq of the file is read into buffer seq % queueDepth */
+		for(b=0; b<args->queueDepth && nextRead<fileSize; b++, seq++) {
+			result[b] = -1;
+			offsets[b] = nextRead;
+			io_prep_read(&ring, &pool, b, fd, nextRead, b);
+			nextRead += pool.bufferSize;
+		}
+		io_ring_submit(&ring, 0);
+
+		/* Parse the chunks in file order, and reuse each buffer for the next chunk right away */
+		while(parsed < seq) {
+			b = parsed % args->queueDepth;
+			while(result[b] < 0) {
+				struct io_uring_cqe cqe;
+				if((error=io_ring_wait(&ring, &cqe))) {
+					printf("Failed to wait for a read: %s\n", sa_strerror(error));
+					exit(1);
+				}
+				/* A failed or short read (other than the end of the file) would skew the checksum and the throughput */
+				uint64_t expected = fileSize - offsets[cqe.user_data];
+				if(expected > pool.bufferSize) {
+					expected = pool.bufferSize;
+				}
+				if(cqe.res < 0) {
+					printf("Failed to read %s at %" PRIu64 ": %s\n", args->input_file, offsets[cqe.user_data], strerror(-cqe.res));
+					exit(1);
+				}
+				if((uint64_t)cqe.res != expected) {
+					printf("Short read of %s at %" PRIu64 ": %d of %" PRIu64 " Bytes\n", args->input_file,
+						offsets[cqe.user_data], cqe.res, expected);
+					exit(1);
+				}
+				result[cqe.user_data] = cqe.res;
+			}
+			parseStart = timing_start();
+			Parse(&parser, &pool.buffers[b], result[b]);
+			if(pass>0) {
+				timing_hist_record(&parseHist, timing_cycles(parseStart, timing_stop()));
+			}
+			parsed++;
+			if(nextRead < fileSize) {
+				result[b] = -1;
+				offsets[b] = nextRead;
+				io_prep_read(&ring, &pool, b, fd, nextRead, b);
+				io_ring_submit(&ring, 0);
+				nextRead += pool.bufferSize;
+				seq++;
+			}
+		}
+		/* The last record */
+		if(parser.inNumber) {
+			parser.checksum += parser.value;
+			parser.nRecords++;
+		}
+	}
+	end = timing_stop();
+
+	double seconds = timing_seconds(timing_cycles(start, end));
+	args->MBps = (double)fileSize*args->passes/seconds/(1024*1024);
+
+	pthread_mutex_lock(&printf_mutex);
+	printf("Core %d (%s): %.1f MB/s, %.0f records/s, %llu records, checksum %" PRIu64 "\n", args->coreID, modeNames[args->mode], args->MBps,
+		parser.nRecords*args->passes/seconds, parser.nRecords, parser.checksum);
+	char label[64];
+	snprintf(label, sizeof(label), "Core %d parse of a buffer", args->coreID);
+	timing_hist_print(stdout, label, &parseHist);
+	pthread_mutex_unlock(&printf_mutex);
+
+	free(result);
+	free(offsets);
+	io_pool_destroy(&pool);
+	io_ring_exit(&ring);
+	close(fd);
+	pthread_exit(NULL);
+}
+
+/*
+ * Run the pipeline on the cores with one kind of buffers and return the total throughput in MB/s
+ */
+
+double RunMode(int mode, const char *input_file, const int *cpus, int nCores, size_t bufferKB, unsigned queueDepth, int passes) {
+
+	sa_context_t *ctx=NULL;
+	int error;
+	if(mode==MODE_SLICE && (error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	struct arg_struct args[NUMBER_CORES];
+	pthread_t threads[NUMBER_CORES];
+	int t,rc;
+
+	/* Create threads */
+	for(t=0; t<nCores; t++){
+		args[t].coreID = cpus[t];
+		args[t].input_file = input_file;
+		args[t].mode = mode;
+		args[t].ctx = ctx;
+		args[t].bufferSize = bufferKB*1024;
+		args[t].queueDepth = queueDepth;
+		args[t].passes = passes;
+		rc = pthread_create(&threads[t], NULL, Run_Exp, (void *)&args[t]);
+		if (rc){
+			printf("ERROR; return code from pthread_create() is %d\n", rc);
+			exit(1);
+		}
+	}
+
+	double total=0;
+	for(t=0; t<nCores; t++){
+		pthread_join(threads[t], NULL);
+		total += args[t].MBps;
+	}
+	printf("Total (%s buffers of %zu KB, queue depth %u): %.1f MB/s\n", modeNames[mode], bufferKB, queueDepth, total);
+
+	sa_context_destroy(ctx);
+	return total;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: should contain the file, the number of cores and the buffer type
+	 */
+
+	if(argc<4 || argc>7){
+		printf("Wrong Input! File, number of cores and buffer type should be passed as input!\n");
+		printf("Enter: %s <file> <number_cores> <slice|noslice|fixed|all> [buffer_KB] [queue_depth] [passes]\n", argv[0]);
+		exit(1);
+	}
+
+	const char *input_file=argv[1];
+	int nCores=atoi(argv[2]);
+	if(nCores<1 || nCores>NUMBER_CORES) {
+		printf("Wrong number of cores! It should be between 1 and %d!\n", NUMBER_CORES);
+		exit(1);
+	}
+	int mode;
+	for(mode=NUMBER_MODES-1;mode>=0 && strcmp(argv[3], modeNames[mode])!=0;mode--);
+	if(mode<0 && strcmp(argv[3], "all")!=0) {
+		printf("Wrong buffer type! It should be slice, noslice, fixed or all!\n");
+		exit(1);
+	}
+	size_t bufferKB = (argc>4) ? strtoul(argv[4], NULL, 10) : DEFAULT_BUFFER_KB;
+	unsigned queueDepth = (argc>5) ? strtoul(argv[5], NULL, 10) : DEFAULT_QUEUE_DEPTH;
+	int passes = (argc>6) ? atoi(argv[6]) : DEFAULT_PASSES;
+	if(bufferKB==0 || bufferKB*1024 > IO_MAX_SEGMENTS*LINE || queueDepth==0 || passes<1) {
+		printf("Wrong buffer size, queue depth or passes! Buffers can have at most %d KB\n", IO_MAX_SEGMENTS*LINE/1024);
+		exit(1);
+	}
+
+	/* Cores: the first ones of the default core set, i.e., one per physical core of socket 0 */
+	int cpus[TOPOLOGY_MAX_CPUS];
+	const struct cpu_topology *topology=topology_get();
+	int nCpus=(topology!=NULL) ? topology_select(topology, NULL, cpus, TOPOLOGY_MAX_CPUS) : 0;
+	if(nCpus<nCores) {
+		printf("Wrong number of cores! Socket 0 has %d cores!\n", nCpus);
+		exit(1);
+	}
+
+	/* Pin the program to the first core for initialization */
+	CorePin(cpus[0]);
+	pthread_mutex_init(&printf_mutex, NULL);
+	timing_print(stdout);
+
+	if(mode>=0) {
+		RunMode(mode, input_file, cpus, nCores, bufferKB, queueDepth, passes);
+		return 0;
+	}
+
+	/* Slice-local buffers are compared with contiguous buffers on the same READV path */
+	double total[NUMBER_MODES];
+	for(mode=0; mode<NUMBER_MODES; mode++) {
+		total[mode]=RunMode(mode, input_file, cpus, nCores, bufferKB, queueDepth, passes);
+	}
+	printf("Speedup of slice over noslice (both IORING_OP_READV): %.2f\n", total[MODE_SLICE]/total[MODE_NOSLICE]);
+	return 0;
+}
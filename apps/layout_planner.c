@@ -0,0 +1,95 @@
+/*
+ * This program plans a hot/cold layout (lib/plan-utils.h) from an access pattern or a sampled access profile:
+ * items are ranked by their number of accesses, the hottest ones are placed on the slice of the core, the
+ * next ones on the closest other slices (up to a share of their capacity), and the rest in plain memory.
+ * It writes the remap table that slice_bench applies with "-l plan -P <remap_table>".
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/plan-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_SLICES 2			/* Primary slice and the closest other slice */
+#define DEFAULT_FILL 0.75			/* Share of the capacity of a slice given to the hot items */
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the access pattern (or profile) and the remap table to write
+	 * Options: the core whose slices are the tiers, a latency table (see lib/latency-utils.h), the number of slices,
+	 * the share of their capacity to fill and the minimum number of accesses of an item placed on a slice
+	 */
+
+	const char *tablePath=NULL;
+	int core=0, nSlices=DEFAULT_SLICES, option, wrong=0;
+	double fill=DEFAULT_FILL;
+	unsigned long long minCount=1;
+	while((option=getopt(argc, argv, "c:t:s:f:m:"))!=-1) {
+		if(option=='c') {
+			core=atoi(optarg);
+		} else if(option=='t') {
+			tablePath=optarg;
+		} else if(option=='s') {
+			nSlices=atoi(optarg);
+		} else if(option=='f') {
+			fill=atof(optarg);
+		} else if(option=='m') {
+			minCount=strtoull(optarg, NULL, 10);
+		} else {
+			wrong=1;
+		}
+	}
+	if(wrong || argc-optind!=2 || nSlices<1 || fill<=0 || fill>1){
+		printf("Wrong Input! An access pattern (or profile) and the remap table to write should be passed as input!\n");
+		printf("Enter: %s [-c core] [-t latency_table] [-s slices] [-f fill (0-1]] [-m min_accesses] <access_pattern_or_profile> <remap_table>\n", argv[0]);
+		exit(1);
+	}
+
+	int error;
+	struct latency_table table;
+	if(tablePath!=NULL && (error=latency_table_load(&table, tablePath))) {
+		printf("Failed to load the latency table: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	struct spill_policy policy;
+	if((error=spill_policy_init(&policy, SPILL_FILL, core, tablePath ? &table : NULL, nSlices))) {
+		printf("Failed to set up the slices of core %d: %s\n", core, sa_strerror(error));
+		exit(1);
+	}
+
+	unsigned long long *counts, nItems;
+	if((error=plan_profile_load(argv[optind], &counts, &nItems))) {
+		printf("Failed to read %s: %s\n", argv[optind], sa_strerror(error));
+		exit(1);
+	}
+	if(nItems==0) {
+		printf("Empty access pattern!\n");
+		exit(1);
+	}
+
+	struct layout_plan plan;
+	if((error=plan_build(&plan, counts, nItems, &policy, fill, minCount))) {
+		printf("Failed to plan the layout: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	int i;
+	printf("Plan of %llu items (%llu KB) for core %d, slices", nItems, nItems*LINE/1024, core);
+	for(i=0;i<policy.nSlices;i++) {
+		printf(" %d", policy.slices[i]);
+	}
+	printf(", %.0f%% of their capacity\n", fill*100);
+	plan_print(stdout, &plan);
+
+	if((error=plan_save(&plan, argv[optind+1]))) {
+		printf("Failed to write %s: %s\n", argv[optind+1], sa_strerror(error));
+		exit(1);
+	}
+
+	plan_destroy(&plan);
+	free(counts);
+	return 0;
+}
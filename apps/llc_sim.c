@@ -0,0 +1,192 @@
+/*
+ * This program estimates the LLC hit rate and average access latency of the slice-aware (slice) and normal (noslice)
+ * layouts with the LLC simulator of lib/llcsim-utils.h, so it needs neither the target CPU nor MSR access.
+ * Every simulated core reads its own lines according to an access pattern (e.g., Uniform or Zipf), as
+ * poormans_multicore_slice and poormans_multicore_noslice do, with the accesses of the cores interleaved.
+ * Alternatively, it replays a recorded trace of physical addresses ("<core> <hex address>" per line).
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/llcsim-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_PASSES 10
+
+/*
+ * Read the access pattern: one line index per access
+ */
+
+static unsigned long long* ReadPattern(const char *file, unsigned long long *size, unsigned long long *nLines) {
+
+	FILE *fileptr = fopen(file, "r");
+	unsigned long long capacity = 4096, index, *pattern = malloc(capacity*sizeof(*pattern));
+
+	if(fileptr == NULL || pattern == NULL) {
+		printf("Cannot read %s\n", file);
+		exit(1);
+	}
+	*size = 0;
+	*nLines = 0;
+	while(fscanf(fileptr, "%llu", &index) == 1) {
+		if(*size == capacity) {
+			capacity *= 2;
+			if((pattern = realloc(pattern, capacity*sizeof(*pattern))) == NULL) {
+				printf("Failed to allocate the pattern\n");
+				exit(1);
+			}
+		}
+		pattern[(*size)++] = index;
+		if(index >= *nLines) {
+			*nLines = index+1;
+		}
+	}
+	fclose(fileptr);
+	return pattern;
+}
+
+/*
+ * Simulate one layout: a warm-up pass, then the measured passes
+ * Returns the average latency
+ */
+
+static double Simulate(struct llc_sim *s, int useSlice, int nCores, const unsigned long long *pattern,
+	unsigned long long size, unsigned long long nLines, int passes) {
+
+	uint64_t **pas = malloc(nCores*sizeof(*pas));
+	unsigned long long i, hits = 0, misses = 0;
+	double latency = 0;
+	int c, p, error;
+
+	llcsim_flush(s);
+	for(c=0;c<nCores;c++) {
+		pas[c] = malloc(nLines*sizeof(**pas));
+		if(pas[c] == NULL) {
+			printf("Failed to allocate the layout\n");
+			exit(1);
+		}
+		if(!useSlice) {
+			llcsim_layout_contiguous(c, pas[c], nLines);
+		} else if((error=llcsim_layout_slice(s, c, c, pas[c], nLines))) {
+			printf("Failed to lay out the lines of core %d: %s\n", c, sa_strerror(error));
+			exit(1);
+		}
+	}
+
+	for(p=0;p<=passes;p++) {
+		if(p==1) {
+			llcsim_reset_stats(s);
+		}
+		for(i=0;i<size;i++) {
+			for(c=0;c<nCores;c++) {
+				llcsim_access(s, c, pas[c][pattern[i]]);
+			}
+		}
+	}
+
+	llcsim_print(stdout, useSlice ? "slice" : "noslice", s, nCores);
+	for(c=0;c<nCores;c++) {
+		hits += s->cores[c].hits;
+		misses += s->cores[c].misses;
+		latency += s->cores[c].latency;
+		free(pas[c]);
+	}
+	free(pas);
+	return (hits+misses) ? latency/(hits+misses) : 0;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: an access pattern file or a trace (-T)
+	 * Options: the number of simulated cores, a latency table (cycles, see lib/latency-utils.h), a hash model,
+	 * the memory latency, the geometry of the slices and the number of passes over the pattern
+	 */
+
+	const char *tablePath=NULL, *modelPath=NULL, *tracePath=NULL;
+	int nCores=NUMBER_VIRTUAL_SLICES, nSets=0, nWays=0, passes=DEFAULT_PASSES, option, wrong=0;
+	double memoryLatency=-1;
+	while((option=getopt(argc, argv, "n:t:m:M:s:w:p:T:"))!=-1) {
+		if(option=='n') {
+			nCores=atoi(optarg);
+		} else if(option=='t') {
+			tablePath=optarg;
+		} else if(option=='m') {
+			modelPath=optarg;
+		} else if(option=='M') {
+			memoryLatency=atof(optarg);
+		} else if(option=='s') {
+			nSets=atoi(optarg);
+		} else if(option=='w') {
+			nWays=atoi(optarg);
+		} else if(option=='p') {
+			passes=atoi(optarg);
+		} else if(option=='T') {
+			tracePath=optarg;
+		} else {
+			wrong=1;
+		}
+	}
+	if(wrong || (tracePath==NULL && argc-optind!=1) || (tracePath!=NULL && argc-optind!=0) || passes<1){
+		printf("Wrong Input! An access pattern file or a trace should be passed as input!\n");
+		printf("Enter: %s [-n cores] [-t latency_table] [-m hash_model] [-M memory_latency] [-s sets] [-w ways] [-p passes] <access_pattern_file | -T trace_file>\n", argv[0]);
+		exit(1);
+	}
+
+	int error;
+	struct latency_table table;
+	struct hash_model model;
+	if(tablePath!=NULL && (error=latency_table_load(&table, tablePath))) {
+		printf("Failed to load the latency table: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(modelPath!=NULL && (error=hash_model_load(&model, modelPath))) {
+		printf("Failed to load the hash model: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	struct llc_sim s;
+	if((error=llcsim_init(&s, modelPath ? &model : NULL, tablePath ? &table : NULL, nSets, nWays, memoryLatency))) {
+		printf("Failed to set up the simulator: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	printf("LLC: %s, %d slices of %d sets x %d ways (%.2f MB), memory latency %.0f cycles\n", s.model.name,
+		s.nSlices, s.nSets, s.nWays, (double)s.nSlices*s.nSets*s.nWays*LINE/(1024*1024), s.memoryLatency);
+
+	if(tracePath!=NULL) {
+		int nAccesses=llcsim_replay_trace(&s, tracePath);
+		if(nAccesses<0) {
+			printf("Failed to replay %s: %s\n", tracePath, sa_strerror(nAccesses));
+			exit(1);
+		}
+		llcsim_print(stdout, "trace", &s, s.table.nCores);
+		llcsim_destroy(&s);
+		return 0;
+	}
+
+	if(nCores<1 || nCores>s.table.nCores || nCores>s.table.nSlices) {
+		printf("Wrong number of cores! It should be between 1 and %d (cores of the latency table)!\n", s.table.nCores);
+		exit(1);
+	}
+	unsigned long long size, nLines;
+	unsigned long long *pattern=ReadPattern(argv[optind], &size, &nLines);
+	if(size==0) {
+		printf("Empty access pattern!\n");
+		exit(1);
+	}
+	printf("Pattern: %llu accesses to %llu lines (%llu KB) per core, %d cores, %d passes\n", size, nLines,
+		nLines*LINE/1024, nCores, passes);
+
+	double noslice=Simulate(&s, 0, nCores, pattern, size, nLines, passes);
+	double slice=Simulate(&s, 1, nCores, pattern, size, nLines, passes);
+	printf("Average latency: slice %.1f cycles, noslice %.1f cycles, speedup %.3f\n", slice, noslice,
+		slice>0 ? noslice/slice : 0);
+
+	free(pattern);
+	llcsim_destroy(&s);
+	return 0;
+}
@@ -4,8 +4,11 @@
  * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
  */
 
-#include "../lib/memory-utils.c"
-#include "../lib/cache-utils.c"
+#define _GNU_SOURCE
+#include "../lib/memory-utils.h"
+#include "../lib/cache-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <sched.h>
 #include <inttypes.h>
 
@@ -31,28 +34,45 @@ int main(int argc, char **argv) {
 	CPU_SET(mask, &my_set);
 	sched_setaffinity(0, sizeof(cpu_set_t), &my_set);
 
+	/* MSRs of core 0 are used for finding the slices */
+	struct msr_device msr;
+	msr_init(&msr, 0);
+
 	/* Create a buffer with some data in it */
-	void **bufferList=malloc(HUGEPAGE_NUM*sizeof(*bufferList));
+	struct buffer *bufferList=malloc(HUGEPAGE_NUM*sizeof(*bufferList));
 	int k=0;
 	for(k=0;k<HUGEPAGE_NUM;k++) {
-		bufferList[k] = create_buffer();
+		/* Each buffer should be a single (physically contiguous) 1GB-hugepage */
+		int error=create_buffer_sized(&bufferList[k], PAGE_SIZE_1GB, PAGE_SIZE_1GB);
+		if(error) {
+			printf("Failed to allocate memory for buffer: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		if(bufferList[k].page_size!=PAGE_SIZE_1GB) {
+			printf("A 1GB-hugepage is required!\n");
+			exit(1);
+		}
 	}
 
 	for(k=0;k<HUGEPAGE_NUM;k++) {
 		/* Get physical address of the buffer */
-		uint64_t physical_address=get_physical_address(bufferList[k]);
+		uint64_t physical_address=get_physical_address(bufferList[k].addr);
 
 		/* Iterate through the 1GB-page */
 		uint64_t offset=0;
-		uint8_t slice_number=0;
+		int slice_number=0;
 		char bits[5+1];
-		while(offset<1024*1024*1024) {
+		while(offset<PAGE_SIZE_1GB) {
 
 			/* Print Physical Address */
 			printf("%lx\t",physical_address+offset);
 
 			/* Find the slice number */
-			slice_number=calculateSlice_uncore(bufferList[k]+offset);
+			slice_number=calculateSlice_uncore(&msr, bufferList[k].addr+offset);
+			if(slice_number<0) {
+				printf("Failed to find the slice: %s\n", sa_strerror(slice_number));
+				exit(1);
+			}
 
 			/* Print the slice number */
 			printf("%d\t",slice_number);
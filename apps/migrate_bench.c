@@ -0,0 +1,259 @@
+/*
+ * This program emulates connection tables that are rebalanced among the cores at run time, with the objects
+ * (connections) of lib/migrate-utils.h:
+ * - static: every group of connections stays on the slice of the core that handled it first
+ * - migrate: a background thread moves the connections to the slice of the core that mostly reads them
+ * Thread t handles group (t + phase) % threads, i.e., all groups move to another core in every phase.
+ * Threads read random connections of their group in short read-side sections, and after every section they
+ * update a counter of the last connection under its lock. After the run, the counters are checked, so that
+ * updates lost by a migration would be noticed.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/migrate-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUMBER_CORES 8				/* Default number of threads */
+#define DEFAULT_OBJECTS 16384		/* Connections per group (1MB) */
+#define DEFAULT_PHASES 4
+#define DEFAULT_INTERVAL 10000		/* Microseconds between two scans */
+#define OPERATIONS_PER_PHASE (16*1024*1024ULL)	/* Per thread */
+#define SECTION_LENGTH 16			/* Accesses per read-side section */
+
+#define MODE_STATIC 0
+#define MODE_MIGRATE 1
+#define NUMBER_MODES 2
+
+static const char *modeNames[] = {"static", "migrate"};
+
+/* A connection: one cache line */
+struct connection {
+	uint64_t id;
+	uint64_t count;					/* Updates under the lock of the object */
+	uint64_t state[6];
+};
+
+/* Thread argument */
+struct arg_struct {
+	int thread;
+	int cpu;
+	int nThreads;
+	int phases;
+	struct migr_reader *reader;
+	double *opsPerSecond;			/* Result of each phase */
+	unsigned long long *migrations;	/* Migrations at the end of each phase (thread 0) */
+	unsigned long long writes;
+	unsigned long long errors;		/* Connections read with the wrong id */
+	uint64_t sum;
+};
+
+static struct migr_space space;
+static struct migr_object **objects;
+static unsigned long long nObjects;	/* Per group */
+static pthread_barrier_t barrier;
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Function to be called by each thread
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = arguments;
+	uint64_t start, x = 88172645463325252ULL + args->thread;
+	unsigned long long i, first, index;
+	int p, a;
+
+	CorePin(args->cpu);
+
+	for(p=0;p<args->phases;p++) {
+		first = ((args->thread + p) % args->nThreads) * nObjects;
+		pthread_barrier_wait(&barrier);
+		start = timing_start();
+		for(i=0;i<OPERATIONS_PER_PHASE;i+=SECTION_LENGTH) {
+			migr_read_lock(args->reader);
+			for(a=0;a<SECTION_LENGTH;a++) {
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				index = first + x % nObjects;
+				struct connection *c = migr_deref(args->reader, objects[index]);
+				args->errors += (c->id != index);
+				args->sum += c->state[a % 6];
+			}
+			migr_read_unlock(args->reader);
+			struct connection *c = migr_write_lock(objects[index]);
+			c->count++;
+			migr_write_unlock(objects[index]);
+			args->writes++;
+		}
+		args->opsPerSecond[p] = OPERATIONS_PER_PHASE / timing_seconds(timing_cycles(start, timing_stop()));
+		pthread_barrier_wait(&barrier);
+		if(args->thread == 0) {
+			args->migrations[p] = __atomic_load_n(&space.nMigrations, __ATOMIC_RELAXED);
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the mode (static or migrate)
+	 * Options: the cores to run on (a core set of topology-utils.h), the number of threads, the connections of
+	 * every group, the number of phases and the interval between two scans of the migration in microseconds
+	 */
+
+	const char *coreSet=NULL;
+	int nThreads=0, phases=DEFAULT_PHASES, mode=-1, option, wrong=0;
+	unsigned long intervalUs=DEFAULT_INTERVAL;
+	nObjects=DEFAULT_OBJECTS;
+	while((option=getopt(argc, argv, "c:n:o:p:i:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else if(option=='o') {
+			nObjects=strtoull(optarg, NULL, 10);
+		} else if(option=='p') {
+			phases=atoi(optarg);
+		} else if(option=='i') {
+			intervalUs=strtoul(optarg, NULL, 10);
+		} else {
+			wrong=1;
+		}
+	}
+	if(!wrong && argc-optind==1) {
+		for(mode=NUMBER_MODES-1;mode>=0 && strcmp(argv[optind], modeNames[mode])!=0;mode--);
+		wrong=(mode<0);
+	}
+	if(wrong || argc-optind!=1 || nThreads<0 || nObjects==0 || phases<1 || intervalUs==0){
+		printf("Wrong Input! The mode should be passed as input!\n");
+		printf("Enter: %s [-c core_set] [-n number_threads] [-o connections_per_group] [-p phases] [-i interval_us] <static|migrate>\n", argv[0]);
+		exit(1);
+	}
+
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
+	timing_print(stderr);
+
+	sa_context_t *ctx;
+	int t, p, error;
+	if((error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if((error=migr_init(&space, ctx, nThreads, 0, 0, 0))) {
+		printf("Failed to set up the migration: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	/* Group g starts on the slice of thread g, which handles it in the first phase */
+	unsigned long long i;
+	if((objects=malloc(nThreads*nObjects*sizeof(*objects)))==NULL) {
+		printf("Failed to allocate the connections\n");
+		exit(1);
+	}
+	for(i=0;i<nThreads*nObjects;i++) {
+		if((error=migr_alloc(&space, sizeof(struct connection), sa_cpu_slice(cpus[i/nObjects]), &objects[i]))) {
+			printf("Failed to allocate the connections: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		((struct connection*)objects[i]->ptr)->id=i;
+	}
+
+	struct arg_struct *args=calloc(nThreads, sizeof(*args));
+	pthread_t *threads=malloc(nThreads*sizeof(*threads));
+	unsigned long long *migrations=calloc(phases, sizeof(*migrations));
+	pthread_barrier_init(&barrier, NULL, nThreads);
+	if(mode==MODE_MIGRATE && (error=migr_start(&space, intervalUs))) {
+		printf("Failed to start the migration: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	for(t=0;t<nThreads;t++) {
+		args[t].thread=t;
+		args[t].cpu=cpus[t];
+		args[t].nThreads=nThreads;
+		args[t].phases=phases;
+		args[t].reader=migr_reader_init(&space, t, cpus[t]);
+		args[t].opsPerSecond=malloc(phases*sizeof(double));
+		args[t].migrations=migrations;
+		if(args[t].reader==NULL || args[t].opsPerSecond==NULL) {
+			printf("Failed to set up thread %d\n", t);
+			exit(1);
+		}
+		if(pthread_create(&threads[t], NULL, Run_Exp, &args[t])) {
+			printf("Failed to create thread %d\n", t);
+			exit(1);
+		}
+	}
+
+	unsigned long long writes=0, errors=0, count=0;
+	for(t=0;t<nThreads;t++) {
+		pthread_join(threads[t], NULL);
+		writes+=args[t].writes;
+		errors+=args[t].errors;
+	}
+	migr_stop(&space);
+
+	printf("mode,threads,connections,phase,ops_per_s,migrations\n");
+	for(p=0;p<phases;p++) {
+		double total=0;
+		for(t=0;t<nThreads;t++) {
+			total+=args[t].opsPerSecond[p];
+		}
+		printf("%s,%d,%llu,%d,%.0f,%llu\n", modeNames[mode], nThreads, nThreads*nObjects, p, total, migrations[p]);
+	}
+	for(i=0;i<nThreads*nObjects;i++) {
+		count+=((struct connection*)objects[i]->ptr)->count;
+	}
+	fprintf(stderr, "%llu scans, %llu migrations (%llu without memory), %llu updates, %llu counted, %llu wrong reads\n",
+		space.nScans, space.nMigrations, space.nFailed, writes, count, errors);
+	if(count!=writes || errors) {
+		printf("Connections were corrupted by the migration!\n");
+		exit(1);
+	}
+
+	migr_destroy(&space);
+	sa_context_destroy(ctx);
+	return 0;
+}
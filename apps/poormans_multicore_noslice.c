@@ -1,19 +1,24 @@
 /* 
- * This program initialize 8 threads, one per core, and read/write from/to memory regions based on normal memory allocation.
+ * This program initialize one thread per core (8 by default, see -c and -n), and read/write from/to memory regions based on normal memory allocation.
  * The reading/writing operations will be done according to the input pattern (e.g., Uniform or Zipf)
  *
  * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
  */
 
-#include "../lib/memory-utils.c"
-#include "../lib/cache-utils.c"
+#define _GNU_SOURCE
+#include "../lib/memory-utils.h"
+#include "../lib/cache-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
 #include <sched.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <time.h>
 #include <pthread.h>
+#include <unistd.h>
 
-#define NUMBER_CORES 8
+#define NUMBER_CORES 8			/* Default number of threads */
 #define READ_TIMES 10000
 #define PRINT_TIMES 10
 
@@ -55,9 +60,6 @@ void* Run_Exp(void *arguments) {
 	unsigned long long size = args -> size;
 	void **totalChunks = args -> totalChunks;
 	const char * access_pattern = args -> access_pattern;
-	#ifdef HASWELL
-		coreID*=2; /* This is related to core numbering of our system, i.e., cores 0,2,4,6,8,10,12,14 are located on socket 0 */
-	#endif
 
 	unsigned long long  i=0,k=0;
 	int j=0;
@@ -115,14 +117,16 @@ void* Run_Exp(void *arguments) {
 		}
 	}
 
-	clock_t start;
-	clock_t end;
-	float seconds;
-	float TPS;
+	/* Time per pass over the pattern, without the timer overhead */
+	uint64_t start, end, passStart;
+	double seconds, TPS;
+	struct timing_hist passHist;
+	timing_hist_init(&passHist);
 
 	for(j=0;j<PRINT_TIMES;j++) {
-		start = clock();
+		start = timing_start();
 		for(k=0;k<READ_TIMES;k++) {
+			passStart = timing_start();
 
 			for(i=0; i<size;i=i+stride) {
 				//__builtin_prefetch(totalChunks[i+1], 0, 0); /* Uncomment for SW Prefetching */
@@ -130,14 +134,22 @@ void* Run_Exp(void *arguments) {
 				read_var=slice[0];	/* Read Latency */
 				//slice[0]=30;		/* Write Latency */
 			}
+			timing_hist_record(&passHist, timing_cycles(passStart, timing_stop()));
 		}
-		end = clock();
-		seconds = (float)(end-start)/CLOCKS_PER_SEC;
+		end = timing_stop();
+		seconds = timing_seconds(timing_cycles(start, end));
 		TPS=size*READ_TIMES/seconds;
 		pthread_mutex_lock(&printf_mutex);
 		printf("%llu\n", (unsigned long long)TPS);
 		pthread_mutex_unlock(&printf_mutex);
 	}
+
+	/* Latency distribution of the passes on stderr, so stdout keeps one TPS per line */
+	char label[64];
+	snprintf(label, sizeof(label), "Core %d pass of %llu reads", coreID, size);
+	pthread_mutex_lock(&printf_mutex);
+	timing_hist_print(stderr, label, &passHist);
+	pthread_mutex_unlock(&printf_mutex);
 		
 	/* Free the buffers */
 	// free_buffer(buffer);
@@ -151,52 +163,85 @@ int main(int argc, char **argv) {
 
 	/*
 	 * Check arguments: should contain size and access pattern filename
+	 * Options: the cores to run on (a core set of topology-utils.h, e.g., "all", "smt" or "0,2,4-7")
+	 * and the number of threads (the first ones of the core set)
 	 */
 
-	if(argc!=3){
+	const char *coreSet=NULL;
+	int nThreads=0, option;
+	while((option=getopt(argc, argv, "c:n:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else {
+			nThreads=-1;
+			break;
+		}
+	}
+	if(argc-optind!=2){
 		printf("Wrong Input! Size and access pattern filename should be passed as input!\n");
-		printf("Enter: %s <size> <input_access_pattern>\n", argv[0]);
+		printf("Enter: %s [-c core_set] [-n number_threads] <size> <input_access_pattern>\n", argv[0]);
 		exit(1);
 	}
+	argc-=optind-1;
+	argv+=optind-1;
 
 	unsigned long long nTotalChunks;
 	sscanf (argv[1],"%llu",&nTotalChunks);
-	if(nTotalChunks < 0){
+	if(nTotalChunks == 0){
 		printf("Wrong size! Size should be more than 0!\n");
 		exit(1);   
 	}
 
 	const char * input_file=argv[2];
 
-    struct arg_struct args[NUMBER_CORES];
-	pthread_t threads[NUMBER_CORES];
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads<0 || nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	/* Thread arguments outlive main() (threads keep running after pthread_exit) */
+	struct arg_struct *args=malloc(nThreads*sizeof(*args));
+	pthread_t *threads=malloc(nThreads*sizeof(*threads));
 	int t,rc;
-	/* Pin the program to core 0 for initialization */
-	CorePin(0);
+	/* Pin the program to the first core for initialization */
+	CorePin(cpus[0]);
 	pthread_mutex_init(&printf_mutex, NULL);
+	/* Calibrate the timer before the threads use it */
+	timing_print(stderr);
 
 	/* Initialize arrays for different cores */
 	int i=0,c=0;
-	for(c=0;c<NUMBER_CORES;c++) {
-
-		/* Get a 1GB-hugepage */
-		void *buffer = create_buffer();
-		/* Calculate the physical address of the buffer */
-		uint64_t bufPhyAddr = get_physical_address(buffer);
-		/* Stride: To avoid prefetching */
-		unsigned long long stride=1;
-		/* Address to different chunks being mapped to the desired slice - Each 64 Byte (Virtual Address) */
+	for(c=0;c<nThreads;c++) {
+
+		/* Get a buffer that fits the chunks (hugepage-backed) */
+		struct buffer buf;
+		int error=create_buffer_sized(&buf, nTotalChunks*LINE, PAGE_SIZE_AUTO);
+		if(error) {
+			printf("Failed to allocate memory for buffer: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		void *buffer = buf.addr;
+		/* Address to different chunks - Each 64 Byte (Virtual Address) */
 		void ** totalChunks=malloc(nTotalChunks*sizeof(*totalChunks));
-		/* Physical Address of chunks */
-		unsigned long long *totalChunksPhysical=malloc(nTotalChunks*sizeof(*totalChunksPhysical));
 
 		totalChunks[0]=buffer;
-		totalChunksPhysical[0]= bufPhyAddr;
 
 		/* Find next cachelines*/
 		for(i=1;i<nTotalChunks; i++) {
 			totalChunks[i]=totalChunks[i-1]+64;
-			totalChunksPhysical[i]=totalChunksPhysical[i-1]+64;
 			//if(i%1000==0) printf("FoundChunks:%llu/%llu\n",i,nTotalChunks);
 		}
 		args[c].totalChunks=totalChunks;
@@ -204,9 +249,9 @@ int main(int argc, char **argv) {
 	}
 
 	/* Create threads */
-	for(t=0; t<NUMBER_CORES; t++){
+	for(t=0; t<nThreads; t++){
        //printf("In main: creating thread %d\n", t);
-       args[t].coreID = t;
+       args[t].coreID = cpus[t];
        args[t].size = nTotalChunks;
        args[t].access_pattern = input_file;
        rc = pthread_create(&threads[t], NULL, Run_Exp, (void *)&args[t]);
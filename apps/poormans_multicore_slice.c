@@ -1,32 +1,47 @@
 /* 
- * This program initialize 8 threads, one per core, and read/write from/to memory regions that are mapped to appropriate LLC slices.
+ * This program initialize one thread per core (8 by default, see -c and -n), and read/write from/to memory regions that are mapped to appropriate LLC slices.
  * The reading/writing operations will be done according to the input pattern (e.g., Uniform or Zipf)
+ * Optionally, each core only gets lines from a given number of L3 sets in its slice (coloring mode),
+ * or the lines are discovered in the background while the threads already run on the lines found so far (incremental mode).
  *
  * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
  */
 
 
-#include "../lib/memory-utils.c"
-#include "../lib/cache-utils.c"
+#define _GNU_SOURCE
+#include "../lib/coloring-utils.h"
+#include "../lib/discovery-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
 #include <sched.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <unistd.h>
 
-#define NUMBER_CORES 8
+#define NUMBER_CORES 8			/* Default number of threads */
 #define READ_TIMES 10000
 #define PRINT_TIMES 10
+#define DISCOVERY_BATCH 4096	/* Incremental mode: lines discovered per core at a time */
+#define DISCOVERY_THREADS 2		/* Incremental mode: background threads, each serving a range of slices */
 
 
 /* Thread argument */
 struct arg_struct {
 	void **totalChunks;			/* Pointer to the allocated memory region */
-	int coreID;					/* Core ID */
+	int coreID;					/* CPU of the thread */
 	unsigned long long size;	/* Size of the the allocated memory region */
 	const char* access_pattern;	/* Name of the file which contains the access pattern */
+	struct discovery *d;		/* Incremental mode: discovery filling list (NULL -> all chunks are ready) */
+	struct line_list *list;
 };
 
+/* Start of the program, for the time to the first operation */
+static struct timespec program_start;
+
 /* Printf mutex */
 static pthread_mutex_t printf_mutex;
 
@@ -57,9 +72,9 @@ void* Run_Exp(void *arguments) {
 	unsigned long long size = args -> size;
 	void **totalChunks = args -> totalChunks;
 	const char * access_pattern = args -> access_pattern;
-	#ifdef HASWELL
-		coreID*=2; /* This is related to core numbering of our system, i.e., cores 0,2,4,6,8,10,12,14 are located on socket 0 */
-	#endif
+	struct discovery *d = args -> d;
+	/* Chunks that can be used: the working set grows while the chunks are discovered */
+	unsigned long long ready = size;
 	unsigned long long  i=0,k=0;
 	int j=0;
 	unsigned char read_var=0;
@@ -99,8 +114,18 @@ void* Run_Exp(void *arguments) {
 
 	unsigned char *slice;
 
+	/* Incremental mode: wait for the first batch only */
+	if(d != NULL) {
+		int error=discovery_wait(d, args->list, (size < DISCOVERY_BATCH) ? size : DISCOVERY_BATCH);
+		if(error) {
+			fprintf(stderr, "Failed to discover chunks of slice %d: %s\n", args->list->slice, sa_strerror(error));
+			exit(1);
+		}
+		ready = discovery_ready(args->list);
+	}
+
 	/* Fill Arrays */
-	for(i=0; i<size;i++) {
+	for(i=0; i<ready;i++) {
 		slice=totalChunks[i];
 		for(j=0;j<64;j++) {
 			slice[j]=10;
@@ -108,36 +133,62 @@ void* Run_Exp(void *arguments) {
 	}
 
 	/* Flush Array */
-	for(i=0; i<size;i++) {
+	for(i=0; i<ready;i++) {
 		slice=totalChunks[i];
 		for(j=0;j<64;j++) {
 			_mm_clflush(&slice[j]);
 		}
 	}
 
-	clock_t start;
-	clock_t end;
-	float seconds;
-	float TPS;
+	/* Time per pass over the pattern, without the timer overhead */
+	uint64_t start, end, passStart;
+	double seconds, TPS;
+	struct timing_hist passHist;
+	timing_hist_init(&passHist);
+
+	if(d != NULL) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		pthread_mutex_lock(&printf_mutex);
+		printf("Core %d: first operation after %.3f ms with %llu of %llu chunks\n", args->coreID,
+			(now.tv_sec-program_start.tv_sec)*1e3+(now.tv_nsec-program_start.tv_nsec)/1e6, ready, size);
+		pthread_mutex_unlock(&printf_mutex);
+	}
 
 	for(j=0;j<PRINT_TIMES;j++) {
-		start = clock();
+		start = timing_start();
 		for(k=0;k<READ_TIMES;k++) {
+			passStart = timing_start();
+			if(ready < size) {
+				ready = discovery_ready(args->list);
+			}
 
 			for(i=0; i<size;i=i+stride) {
 				//__builtin_prefetch(totalChunks[i+1], 0, 0); /* Uncomment for SW Prefetching */
-				slice=totalChunks[pattern[i]];
+				unsigned long long index = pattern[i];
+				if(index >= ready) {
+					index %= ready;	/* Chunks that are not discovered yet are replaced by the ones found so far */
+				}
+				slice=totalChunks[index];
 				read_var=slice[0];	/* Read Latency */
 				//slice[0]=30;		/* Write Latency */
 			}
+			timing_hist_record(&passHist, timing_cycles(passStart, timing_stop()));
 		}
-		end = clock();
-		seconds = (float)(end-start)/CLOCKS_PER_SEC;
+		end = timing_stop();
+		seconds = timing_seconds(timing_cycles(start, end));
 		TPS=size*READ_TIMES/seconds;
 		pthread_mutex_lock(&printf_mutex);
 		printf("%llu\n", (unsigned long long)TPS);
 		pthread_mutex_unlock(&printf_mutex);
 	}
+
+	/* Latency distribution of the passes on stderr, so stdout keeps one TPS per line */
+	char label[64];
+	snprintf(label, sizeof(label), "Core %d pass of %llu reads", coreID, size);
+	pthread_mutex_lock(&printf_mutex);
+	timing_hist_print(stderr, label, &passHist);
+	pthread_mutex_unlock(&printf_mutex);
 		
 	/* Free the buffers */
 	// free_buffer(buffer);
@@ -151,78 +202,165 @@ int main(int argc, char **argv) {
 
 	/*
 	 * Check arguments: should contain size and access pattern filename
+	 * and optionally the number of L3 sets per core (coloring mode) or "incremental".
+	 * Options: the cores to run on (a core set of topology-utils.h, e.g., "all", "smt" or "0,2,4-7")
+	 * and the number of threads (the first ones of the core set)
 	 */
 
-	if(argc!=3){
+	const char *coreSet=NULL;
+	int nThreads=0, option;
+	while((option=getopt(argc, argv, "c:n:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else {
+			nThreads=-1;
+			break;
+		}
+	}
+	if(argc-optind!=2 && argc-optind!=3){
 		printf("Wrong Input! Size and access pattern filename should be passed as input!\n");
-		printf("Enter: %s <size> <access_pattern_file>\n", argv[0]);
+		printf("Enter: %s [-c core_set] [-n number_threads] <size> <access_pattern_file> [sets_per_core|incremental]\n", argv[0]);
 		exit(1);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &program_start);
+	argc-=optind-1;
+	argv+=optind-1;
 
 	unsigned long long nTotalChunks;
 	sscanf (argv[1],"%llu",&nTotalChunks);
-	if(nTotalChunks < 0){
+	if(nTotalChunks == 0){
 		printf("Wrong size! Size should be more than 0!\n");
 		exit(1);   
 	}
 
 	const char * input_file=argv[2];
 
-    struct arg_struct args[NUMBER_CORES];
-	pthread_t threads[NUMBER_CORES];
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads<0 || nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	unsigned long long setsPerCore=0;
+	int incremental=(argc==4 && strcmp(argv[3], "incremental")==0);
+	if(argc==4 && !incremental) {
+		sscanf (argv[3],"%llu",&setsPerCore);
+		if(setsPerCore == 0 || setsPerCore > L3_SETS_PER_SLICE){
+			printf("Wrong number of sets! It should be between 1 and %d!\n", L3_SETS_PER_SLICE);
+			exit(1);
+		}
+	}
+
+	/* Thread arguments and the discovery of the incremental mode outlive main() (threads keep running after pthread_exit) */
+	struct arg_struct *args=malloc(nThreads*sizeof(*args));
+	pthread_t *threads=malloc(nThreads*sizeof(*threads));
+	int *slices=malloc(nThreads*sizeof(*slices));
+	struct line_list *lists=malloc(nThreads*sizeof(*lists));
+	static struct discovery discovery;
 	int t,rc;
-	/* Pin the program to core 0 for initialization (polling) */
-	CorePin(0);
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
 
 	pthread_mutex_init(&printf_mutex, NULL);
+	/* Calibrate the timer before the threads use it */
+	timing_print(stderr);
 
 	/* Initialize arrays for different cores */
-	int i=0,c=0;
-	for(c=0;c<NUMBER_CORES;c++) {
-		int desiredSlice=c;
-
-		/* Get a 1GB-hugepage */
-		void *buffer = create_buffer();
-		/* Calculate the physical address of the buffer */
-		uint64_t bufPhyAddr = get_physical_address(buffer);
-		/* Stride: To avoid prefetching */
-		unsigned long long stride=1;
-		/* Address to different chunks being mapped to the desired slice - Each 64 Byte (Virtual Address) */
-		void ** totalChunks=malloc(nTotalChunks*sizeof(*totalChunks));
-		/* Physical Address of chunks */
-		unsigned long long *totalChunksPhysical=malloc(nTotalChunks*sizeof(*totalChunksPhysical));
-
-		/* Find first chunk */
-		#ifdef SKYLAKE
-			unsigned long long offset = virtualSliceFinder_uncore(buffer,desiredSlice);
-		#else
-			unsigned long long offset = sliceFinder_HF_haswell(bufPhyAddr,desiredSlice);
-		#endif
-
-		totalChunks[0]=buffer+offset;
-		totalChunksPhysical[0]= bufPhyAddr+offset;
-
-
-		/* Find next chunks which are residing in the desired slice*/
-		for(i=1;i<nTotalChunks; i++) {
-			offset=64;
-			#ifdef SKYLAKE
-				offset+=virtualSliceFinder_uncore(totalChunks[i-1]+offset,desiredSlice);
-			#else
-				offset+=sliceFinder_HF_haswell(totalChunksPhysical[i-1]+offset,desiredSlice);
-			#endif
-			totalChunks[i]=totalChunks[i-1]+offset;
-			totalChunksPhysical[i]=totalChunksPhysical[i-1]+offset;
-			//if(i%1000==0) printf("FoundChunks:%llu/%llu\n",i,nTotalChunks);
+	int c=0;
+	/* Address to different chunks being mapped to the desired slice of each core - Each 64 Byte (Virtual Address) */
+	for(c=0;c<nThreads;c++) {
+		args[c].totalChunks=malloc(nTotalChunks*sizeof(*args[c].totalChunks));
+		args[c].d=NULL;
+		/* SMT siblings share the slice of their core */
+		slices[c]=sa_cpu_slice(cpus[c]);
+	}
+
+	if(setsPerCore!=0) {
+		/* Coloring mode: every core gets setsPerCore sets of its slice, spread evenly over the sets */
+		struct msr_device msr;
+		struct hugepage_pool pool;
+		struct color_allocator ca;
+		msr_init(&msr, 0);
+		hugepage_pool_init(&pool, PAGE_SIZE_AUTO, 0);
+		if(color_allocator_init(&ca, &pool, &msr, hash_model_active(), nThreads)) {
+			fprintf(stderr, "Failed to initialize the allocator\n");
+			exit(1);
+		}
+		for(c=0;c<nThreads;c++) {
+			int tenant = color_add_tenant(&ca, slices[c], setsPerCore);
+			int error=SA_ERR_EXHAUSTED;
+			if(tenant < 0) {
+				fprintf(stderr, "Core %d: %llu more sets do not fit in slice %d\n", cpus[c], setsPerCore, slices[c]);
+				exit(1);
+			}
+			if(nTotalChunks > color_tenant_capacity(&ca, tenant)) {
+				fprintf(stderr, "Core %d: %llu chunks do not fit in %llu sets, expect conflict misses\n",
+					cpus[c], nTotalChunks, setsPerCore);
+			}
+			if(color_alloc_lines(&ca, tenant, args[c].totalChunks, nTotalChunks, &error)!=nTotalChunks) {
+				fprintf(stderr, "Failed to allocate chunks: %s\n", sa_strerror(error));
+				exit(1);
+			}
+		}
+		color_allocator_destroy(&ca);
+	} else if(incremental) {
+		/*
+		 * Same as the default mode, but the chunks are found in the background, DISCOVERY_BATCH per core at a time,
+		 * and every thread starts as soon as its first batch is ready
+		 */
+		sa_context_t *ctx;
+		int error=sa_context_create(&ctx, NULL);
+		if(error) {
+			fprintf(stderr, "Failed to create the context: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		for(c=0;c<nThreads;c++) {
+			lists[c].slice=slices[c];
+			lists[c].lines=args[c].totalChunks;
+			lists[c].nLines=nTotalChunks;
+			lists[c].nReady=0;
+			args[c].d=&discovery;
+			args[c].list=&lists[c];
+		}
+		if((error=discovery_start(&discovery, ctx, lists, nThreads, DISCOVERY_THREADS, DISCOVERY_BATCH))) {
+			fprintf(stderr, "Failed to start the discovery: %s\n", sa_strerror(error));
+			exit(1);
+		}
+	} else {
+		/*
+		 * Every page of the context is classified once and its chunks are distributed among all slices,
+		 * so only about NUMBER_SLICES*nTotalChunks*64 Bytes are needed instead of a buffer per core.
+		 */
+		sa_context_t *ctx;
+		int error=sa_context_create(&ctx, NULL);
+		if(error) {
+			fprintf(stderr, "Failed to create the context: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		for(c=0;c<nThreads;c++) {
+			if((error=sa_alloc_lines(ctx, slices[c], args[c].totalChunks, nTotalChunks))) {
+				fprintf(stderr, "Failed to allocate chunks of slice %d: %s\n", slices[c], sa_strerror(error));
+				exit(1);
+			}
 		}
-		args[c].totalChunks=totalChunks;
-		//printf("Array %d initialized!\n",c);
 	}
 
 	/* Create threads */
-	for(t=0; t<NUMBER_CORES; t++){
+	for(t=0; t<nThreads; t++){
        //printf("In main: creating thread %d\n", t);
-       args[t].coreID = t;
+       args[t].coreID = cpus[t];
        args[t].size = nTotalChunks;
        args[t].access_pattern = input_file;
        rc = pthread_create(&threads[t], NULL, Run_Exp, (void *)&args[t]);
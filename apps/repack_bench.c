@@ -0,0 +1,220 @@
+/*
+ * This program repacks an array of records into slice-local lines with lib/repack-utils.h and compares
+ * random reads of the original array with reads of the copy:
+ * - core: all records go to the slice of the first core
+ * - partition: the records are partitioned over the slices of the cores by a hash of their index (e.g., flows)
+ * It reports the time of the repacking (including the allocation of the lines; with or without non-temporal stores, see -S) and the mean time of a read
+ * of the original array, of the copy through the remap accessor (repack_get()) and, on every core,
+ * of the records of its own part (repack_part_get()). The copy is checked against the original array.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/repack-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define NUMBER_CORES 8				/* Default number of parts */
+#define DEFAULT_RECORDS (256*1024)
+#define DEFAULT_RECORD_SIZE 16
+#define NUMBER_READS (16*1024*1024ULL)
+
+#define MODE_CORE 0
+#define MODE_PARTITION 1
+#define NUMBER_MODES 2
+
+static const char *modeNames[] = {"core", "partition"};
+static const char *streamNames[] = {"never", "always"};
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Part of a record: a multiplicative hash of its index
+ */
+
+int Key(const void *record, size_t index, void *arg) {
+	(void)record;
+	return (int)((((uint32_t)index * 2654435761U) >> 8) % *(int*)arg);
+}
+
+/*
+ * Mean time of a random read in ns: of the original array (repack NULL), through the remap accessor (part < 0),
+ * or of the records of a part
+ */
+
+double Read(const char *records, size_t nRecords, size_t recordSize, const struct repack *r, int part, uint64_t *sum) {
+
+	uint64_t start, x = 88172645463325252ULL;
+	size_t n = (r == NULL || part < 0) ? nRecords : r->parts[part].nRecords;
+	unsigned long long i;
+	const char *record;
+
+	start = timing_start();
+	for(i=0;i<NUMBER_READS;i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		if(r == NULL) {
+			record = records + (x % n) * recordSize;
+		} else if(part < 0) {
+			record = repack_get(r, x % n);
+		} else {
+			record = repack_part_get(r, part, x % n);
+		}
+		*sum += record[x % recordSize];
+	}
+	return timing_ns(timing_cycles(start, timing_stop())) / NUMBER_READS;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the mode (core or partition)
+	 * Options: the cores (a core set of topology-utils.h), the number of parts, the number of records, the size of
+	 * a record in Bytes and the copy mode (never or always non-temporal stores; by default, depending on the size)
+	 */
+
+	const char *coreSet=NULL;
+	int nParts=0, mode=-1, stream=REPACK_STREAM_AUTO, option, wrong=0;
+	size_t nRecords=DEFAULT_RECORDS, recordSize=DEFAULT_RECORD_SIZE;
+	while((option=getopt(argc, argv, "c:n:r:s:S:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nParts=atoi(optarg);
+		} else if(option=='r') {
+			nRecords=strtoull(optarg, NULL, 10);
+		} else if(option=='s') {
+			recordSize=strtoull(optarg, NULL, 10);
+		} else if(option=='S') {
+			for(stream=REPACK_STREAM_ALWAYS;stream>=REPACK_STREAM_NEVER && strcmp(optarg, streamNames[stream])!=0;stream--);
+			wrong=(stream<REPACK_STREAM_NEVER);
+		} else {
+			wrong=1;
+		}
+	}
+	if(!wrong && argc-optind==1) {
+		for(mode=NUMBER_MODES-1;mode>=0 && strcmp(argv[optind], modeNames[mode])!=0;mode--);
+		wrong=(mode<0);
+	}
+	if(wrong || argc-optind!=1 || nParts<0 || nRecords==0 || recordSize==0 || recordSize>LINE){
+		printf("Wrong Input! The mode should be passed as input!\n");
+		printf("Enter: %s [-c core_set] [-n number_parts] [-r records] [-s record_size (at most %d)] [-S never|always] <core|partition>\n", argv[0], LINE);
+		exit(1);
+	}
+
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(mode==MODE_CORE) {
+		nParts=1;
+	} else if(nParts==0) {
+		nParts=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nParts>nCpus) {
+		printf("Wrong number of parts! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
+	timing_print(stderr);
+
+	size_t i, b;
+	char *records=malloc(nRecords*recordSize);
+	if(records==NULL) {
+		printf("Failed to allocate the records\n");
+		exit(1);
+	}
+	for(i=0;i<nRecords;i++) {
+		for(b=0;b<recordSize;b++) {
+			records[i*recordSize+b]=(char)(i*31+b);
+		}
+	}
+
+	sa_context_t *ctx;
+	struct repack r;
+	uint64_t start, stop;
+	int p, error;
+	if((error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	start=timing_start();
+	if(mode==MODE_CORE) {
+		error=repack_to_core(&r, ctx, records, nRecords, recordSize, cpus[0], stream);
+	} else {
+		error=repack_partition(&r, ctx, records, nRecords, recordSize, cpus, nParts, Key, &nParts, stream);
+	}
+	stop=timing_stop();
+	if(error) {
+		printf("Failed to repack the records: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	/* Every record must be copied, and a sample of them must be on the slice of their part */
+	unsigned long long wrongSlices=0, checked=0;
+	for(i=0;i<nRecords;i++) {
+		if(memcmp(repack_get(&r, i), records+i*recordSize, recordSize)!=0) {
+			printf("Record %zu was not copied correctly!\n", i);
+			exit(1);
+		}
+	}
+	for(p=0;p<nParts;p++) {
+		for(i=0;i<r.parts[p].nRecords;i+=r.parts[p].nRecords/64+1) {
+			int slice=sa_slice_of(ctx, repack_part_get(&r, p, i));
+			if(slice>=0) {
+				wrongSlices+=(slice!=r.parts[p].slice);
+				checked++;
+			}
+		}
+	}
+	if(wrongSlices) {
+		printf("%llu of %llu records are not on the slice of their part!\n", wrongSlices, checked);
+		exit(1);
+	}
+
+	uint64_t sum=0;
+	double originalNs=Read(records, nRecords, recordSize, NULL, -1, &sum);
+	double remapNs=Read(records, nRecords, recordSize, &r, -1, &sum);
+	double partNs=0;
+	for(p=0;p<nParts;p++) {
+		CorePin(r.parts[p].cpu);
+		partNs+=Read(records, nRecords, recordSize, &r, p, &sum)/nParts;
+	}
+	double seconds=timing_seconds(timing_cycles(start, stop));
+	fprintf(stderr, "%llu records checked on their slices, sum %llu\n", checked, (unsigned long long)sum);
+
+	printf("mode,parts,records,record_size,streamed,repack_ms,repack_GB_per_s,original_ns,remap_ns,part_ns\n");
+	printf("%s,%d,%zu,%zu,%d,%.3f,%.2f,%.2f,%.2f,%.2f\n", modeNames[mode], nParts, nRecords, recordSize, r.streamed,
+		seconds*1e3, nRecords*recordSize/seconds/1e9, originalNs, remapNs, partNs);
+
+	repack_destroy(&r);
+	sa_context_destroy(ctx);
+	free(records);
+	return 0;
+}
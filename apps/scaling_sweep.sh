@@ -0,0 +1,54 @@
+#
+# Scaling sweep: run slice_bench with the slice and noslice layouts
+# and 1..N threads on a core set (see lib/topology-utils.h) and print
+# the aggregate throughput, the scaling efficiency and the speedup of slice-aware allocation
+#
+# Usage: sudo ./scaling_sweep.sh <access_pattern_file> [max_threads] [core_set]
+#
+# Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology
+#
+
+
+if [ $# -lt 1 ]
+then
+	echo "Enter: $0 <access_pattern_file> [max_threads] [core_set]"
+	exit 1
+fi
+
+pattern=$1
+core_set=${3:-default}
+bin_dir=$(dirname $0)/build
+
+#The number of threads defaults to the number of CPUs of the core set
+max_threads=$2
+if [[ -z $max_threads ]]
+then
+	max_threads=$($bin_dir/slice_bench -c $core_set -q 2>/dev/null | grep -xE "[0-9]+")
+	if [[ -z $max_threads ]]
+	then
+		echo "Unable to find the number of CPUs of core set $core_set"
+		exit 1
+	fi
+fi
+
+#Aggregate throughput: the average over the runs of the operations per second of all threads
+aggregate() {
+	$bin_dir/slice_bench -l $1 -c $core_set -n $2 $pattern 2>/dev/null | \
+		awk -F, 'NF == 5 {sum+=$5; count++} END {if (count) printf "%.0f", sum/count; else print 0}'
+}
+
+printf "%-8s %-16s %-12s %-16s %-12s %-8s\n" "threads" "slice_TPS" "slice_eff" "noslice_TPS" "noslice_eff" "speedup"
+for ((n=1; n<=max_threads; n++))
+do
+	slice=$(aggregate slice $n)
+	noslice=$(aggregate noslice $n)
+	if [ $n -eq 1 ]
+	then
+		slice_one=$slice
+		noslice_one=$noslice
+	fi
+	#Efficiency: aggregate(n) / (n * aggregate(1)), 1.00 is linear scaling
+	awk -v n=$n -v s=$slice -v s1=$slice_one -v ns=$noslice -v ns1=$noslice_one 'BEGIN {
+		printf "%-8d %-16.0f %-12.2f %-16.0f %-12.2f %-8.2f\n", n, s, (s1 ? s/(n*s1) : 0), ns, (ns1 ? ns/(n*ns1) : 0), (ns ? s/ns : 0)
+	}'
+done
@@ -0,0 +1,183 @@
+/*
+ * This program runs tasks whose data lives on different LLC slices with the slice-aware work-stealing scheduler.
+ * The tasks are assigned to slices with a skewed (Zipf-like) distribution, so the cores of the popular slices
+ * are overloaded. With stealing, idle cores take the tasks of their nearest busy slices;
+ * without stealing, every task runs on the core of its slice (static partitioning).
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/sched-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NUMBER_CORES 8
+#define READ_TIMES 100
+#define LINES_PER_SLICE_FACTOR 16	/* Every slice holds the data of this many tasks */
+
+/* Task argument */
+struct task_arg {
+	void **lines;				/* Lines of the slice */
+	unsigned long nLines;
+	unsigned long first;		/* First line touched by the task */
+	unsigned long linesPerTask;
+	uint64_t result;
+	uint64_t cycles;			/* Run time of the task */
+};
+
+/*
+ * Read the lines of the task
+ */
+
+void Run_Task(void *argument) {
+
+	struct task_arg *arg = argument;
+	unsigned long i;
+	int k;
+	uint64_t sum = 0, start = timing_start();
+
+	for(k=0;k<READ_TIMES;k++) {
+		for(i=0;i<arg->linesPerTask;i++) {
+			volatile unsigned char *line = arg->lines[(arg->first+i) % arg->nLines];
+			sum += line[0];
+		}
+	}
+	arg->result = sum;
+	arg->cycles = timing_cycles(start, timing_stop());
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: number of cores, number of tasks, lines per task, skew and stealing mode,
+	 * and optionally a latency table
+	 */
+
+	if(argc!=6 && argc!=7){
+		printf("Wrong Input!\n");
+		printf("Enter: %s <number_cores> <number_tasks> <lines_per_task> <skew> <steal|nosteal> [latency_table]\n", argv[0]);
+		exit(1);
+	}
+
+	int nCores=atoi(argv[1]);
+	unsigned long nTasks=strtoul(argv[2], NULL, 10);
+	unsigned long linesPerTask=strtoul(argv[3], NULL, 10);
+	double skew=atof(argv[4]);
+	if(nCores<1 || nCores>NUMBER_CORES || nTasks==0 || linesPerTask==0 || skew<0) {
+		printf("Wrong input! Cores should be between 1 and %d, tasks and lines should be more than 0!\n", NUMBER_CORES);
+		exit(1);
+	}
+	int steal;
+	if(strcmp(argv[5], "steal")==0) {
+		steal=SCHED_STEAL;
+	} else if(strcmp(argv[5], "nosteal")==0) {
+		steal=SCHED_NO_STEAL;
+	} else {
+		printf("Wrong mode! It should be steal or nosteal!\n");
+		exit(1);
+	}
+
+	int error;
+	struct latency_table table, *tablePtr=NULL;
+	if(argc==7) {
+		if((error=latency_table_load(&table, argv[6]))) {
+			printf("Failed to load the latency table: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		tablePtr=&table;
+	}
+
+	/* Cores: the first ones of the default core set, i.e., one per physical core of socket 0 */
+	int cpus[TOPOLOGY_MAX_CPUS];
+	const struct cpu_topology *topology=topology_get();
+	int nCpus=(topology!=NULL) ? topology_select(topology, NULL, cpus, TOPOLOGY_MAX_CPUS) : 0;
+	if(nCpus<nCores) {
+		printf("Wrong number of cores! Socket 0 has %d cores!\n", nCpus);
+		exit(1);
+	}
+
+	/* One worker per core */
+	int slices[NUMBER_CORES], c;
+	for(c=0;c<nCores;c++) {
+		slices[c]=sa_cpu_slice(cpus[c]);
+	}
+
+	/* Data of every slice */
+	sa_context_t *ctx;
+	if((error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	unsigned long nLines=linesPerTask*LINES_PER_SLICE_FACTOR, i;
+	void **lines[NUMBER_CORES];
+	for(c=0;c<nCores;c++) {
+		lines[c]=malloc(nLines*sizeof(void*));
+		if((error=sa_alloc_lines(ctx, slices[c], lines[c], nLines))) {
+			printf("Failed to allocate the lines of slice %d: %s\n", slices[c], sa_strerror(error));
+			exit(1);
+		}
+		for(i=0;i<nLines;i++) {
+			memset(lines[c][i], c, LINE);
+		}
+	}
+
+	/* Skewed popularity of the slices: P(c) ~ 1/(c+1)^skew */
+	double weights[NUMBER_CORES], total=0;
+	for(c=0;c<nCores;c++) {
+		weights[c]=1.0/pow(c+1, skew);
+		total+=weights[c];
+	}
+	struct task_arg *tasks=malloc(nTasks*sizeof(*tasks));
+	int *taskCore=malloc(nTasks*sizeof(*taskCore));
+	unsigned long perCore[NUMBER_CORES]={0};
+	srand(1);
+	for(i=0;i<nTasks;i++) {
+		double r=(double)rand()/RAND_MAX*total;
+		for(c=0;c<nCores-1 && r>weights[c];c++) {
+			r-=weights[c];
+		}
+		taskCore[i]=c;
+		perCore[c]++;
+		tasks[i].lines=lines[c];
+		tasks[i].nLines=nLines;
+		tasks[i].first=(i*linesPerTask) % nLines;
+		tasks[i].linesPerTask=linesPerTask;
+	}
+
+	struct scheduler s;
+	if((error=sched_init(&s, cpus, nCores, tablePtr, steal))) {
+		printf("Failed to start the scheduler: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	timing_print(stdout);
+	uint64_t start=timing_start();
+	for(i=0;i<nTasks;i++) {
+		sched_submit(&s, Run_Task, &tasks[i], slices[taskCore[i]]);
+	}
+	sched_wait(&s);
+	double seconds=timing_seconds(timing_cycles(start, timing_stop()));
+
+	/* Run time of the tasks, wherever they ran (a stolen task reads the lines of a remote slice) */
+	struct timing_hist taskHist;
+	timing_hist_init(&taskHist);
+	for(i=0;i<nTasks;i++) {
+		timing_hist_record(&taskHist, tasks[i].cycles);
+	}
+
+	for(c=0;c<nCores;c++) {
+		printf("Core %d (slice %d): %lu tasks submitted, %llu executed, %llu stolen\n", c, slices[c], perCore[c],
+			s.workers[c].nExecuted, s.workers[c].nStolen);
+	}
+	timing_hist_print(stdout, "Task", &taskHist);
+	printf("Total (%s, skew %.2f): %.3f s, %.0f tasks/s\n", argv[5], skew, seconds, nTasks/seconds);
+
+	sched_destroy(&s);
+	sa_context_destroy(ctx);
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * This program compares the update cost of per-core statistics (lib/shard-utils.h) kept on three kinds of lines:
+ * - slice: shards on lines of the slice of each core
+ * - padded: shards on ordinary cache-aligned lines (a padded array)
+ * - thread_local: __thread variables of every thread, registered so that a reader can aggregate them
+ * Every thread updates a counter, a gauge and a histogram per operation; in all modes, the addresses of its
+ * statistics are resolved before the timed loop, so only the placement of the lines differs. Optionally, every operation also
+ * touches a line of a private noise buffer (-x KB), so that the statistics are evicted from the private caches
+ * between updates, as in a service whose packets or requests do not fit in L1/L2 along with its counters.
+ * After the run, the aggregated counter is checked against the number of operations.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/shard-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUMBER_CORES 8				/* Default number of threads */
+#define DEFAULT_OPERATIONS 16		/* Millions of operations per thread */
+
+#define MODE_SLICE 0
+#define MODE_PADDED 1
+#define MODE_THREAD_LOCAL 2
+#define NUMBER_MODES 3
+
+static const char *modeNames[] = {"slice", "padded", "thread_local"};
+
+/* Statistics of the thread_local mode */
+struct tls_stats {
+	uint64_t count;
+	int64_t gauge;
+	uint64_t hist[SHARD_HIST_BUCKETS];
+};
+
+/* Thread argument */
+struct arg_struct {
+	int shard;
+	int cpu;
+	int mode;
+	unsigned long long nOps;
+	unsigned char *noise;			/* Private buffer touched per operation (NULL -> none) */
+	size_t noiseLines;
+	double opsPerSecond;
+	uint64_t sum;
+};
+
+static struct shard_counter counter;
+static struct shard_gauge gauge;
+static struct shard_hist hist;
+static __thread struct tls_stats tls;
+static struct tls_stats **tlsStats;		/* Registered statistics of every thread */
+static pthread_barrier_t barrier;
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Value recorded by an operation: pseudo-random in [0, 4096) */
+static inline uint64_t Value(unsigned long long i) {
+	return (i * 2654435761ULL) >> 20 & 4095;
+}
+
+/*
+ * Function to be called by each thread
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = arguments;
+	unsigned long long i;
+	uint64_t start, sum = 0, *count, *histLines[SHARD_HIST_LINES];
+	int64_t *gaugeValue;
+	size_t n = 0;
+	unsigned l;
+
+	CorePin(args->cpu);
+	/* The lines of the statistics are resolved once, as the address of a __thread variable is */
+	if(args->mode == MODE_THREAD_LOCAL) {
+		memset(&tls, 0, sizeof(tls));
+		tlsStats[args->shard] = &tls;
+		count = &tls.count;
+		gaugeValue = &tls.gauge;
+		for(l=0;l<SHARD_HIST_LINES;l++) {
+			histLines[l] = tls.hist + l*SHARD_VALUES_PER_LINE;
+		}
+	} else {
+		count = shard_values(&counter.s, args->shard, 0);
+		gaugeValue = (int64_t*)shard_values(&gauge.s, args->shard, 0);
+		shard_hist_lines(&hist, args->shard, histLines);
+	}
+	pthread_barrier_wait(&barrier);
+
+	/* The same updates in all modes: only the placement of the lines differs */
+	start = timing_start();
+	for(i=0;i<args->nOps;i++) {
+		shard_counter_add_value(count, 1);
+		shard_gauge_set_value(gaugeValue, (int64_t)i);
+		shard_hist_record_lines(histLines, Value(i));
+		if(args->noise != NULL) {
+			sum += *(volatile unsigned char*)(args->noise + n * LINE);
+			n = (n + 1 == args->noiseLines) ? 0 : n + 1;
+		}
+	}
+	args->opsPerSecond = args->nOps / timing_seconds(timing_cycles(start, timing_stop()));
+	args->sum = sum;
+
+	/* Keep the statistics of the thread alive until they are read */
+	pthread_barrier_wait(&barrier);
+	pthread_barrier_wait(&barrier);
+	return NULL;
+}
+
+/*
+ * Run all threads in one mode, check the aggregated statistics and print the throughput
+ */
+
+static void RunMode(int mode, sa_context_t *ctx, const int *cpus, int nThreads, unsigned long long nOps,
+	size_t noiseKB) {
+
+	struct arg_struct *args = calloc(nThreads, sizeof(*args));
+	pthread_t *threads = malloc(nThreads*sizeof(*threads));
+	uint64_t counts[SHARD_HIST_BUCKETS], nSamples, total;
+	int64_t gaugeMax;
+	double opsPerSecond = 0;
+	int t, b, error;
+
+	if(mode != MODE_THREAD_LOCAL) {
+		sa_context_t *shardCtx = (mode == MODE_SLICE) ? ctx : NULL;
+		if((error=shard_counter_init(&counter, shardCtx, cpus, nThreads)) ||
+			(error=shard_gauge_init(&gauge, shardCtx, cpus, nThreads)) ||
+			(error=shard_hist_init(&hist, shardCtx, cpus, nThreads))) {
+			printf("Failed to allocate the statistics: %s\n", sa_strerror(error));
+			exit(1);
+		}
+	}
+
+	pthread_barrier_init(&barrier, NULL, nThreads+1);
+	for(t=0;t<nThreads;t++) {
+		args[t].shard=t;
+		args[t].cpu=cpus[t];
+		args[t].mode=mode;
+		args[t].nOps=nOps;
+		if(noiseKB) {
+			args[t].noiseLines=noiseKB*1024/LINE;
+			args[t].noise=aligned_alloc(LINE, args[t].noiseLines*LINE);
+			if(args[t].noise==NULL) {
+				printf("Failed to allocate the noise buffer\n");
+				exit(1);
+			}
+			memset(args[t].noise, 1, args[t].noiseLines*LINE);
+		}
+		if(pthread_create(&threads[t], NULL, Run_Exp, &args[t])) {
+			printf("Failed to create thread %d\n", t);
+			exit(1);
+		}
+	}
+	pthread_barrier_wait(&barrier);
+
+	/* All threads are done and their statistics are still alive */
+	pthread_barrier_wait(&barrier);
+	if(mode == MODE_THREAD_LOCAL) {
+		memset(counts, 0, sizeof(counts));
+		total=0;
+		gaugeMax=INT64_MIN;
+		for(t=0;t<nThreads;t++) {
+			total+=__atomic_load_n(&tlsStats[t]->count, __ATOMIC_RELAXED);
+			if(tlsStats[t]->gauge > gaugeMax) {
+				gaugeMax=tlsStats[t]->gauge;
+			}
+			for(b=0;b<SHARD_HIST_BUCKETS;b++) {
+				counts[b]+=__atomic_load_n(&tlsStats[t]->hist[b], __ATOMIC_RELAXED);
+			}
+		}
+		for(nSamples=0,b=0;b<SHARD_HIST_BUCKETS;b++) {
+			nSamples+=counts[b];
+		}
+	} else {
+		total=shard_counter_read(&counter);
+		gaugeMax=shard_gauge_max(&gauge);
+		nSamples=shard_hist_read(&hist, counts);
+	}
+	pthread_barrier_wait(&barrier);
+
+	for(t=0;t<nThreads;t++) {
+		pthread_join(threads[t], NULL);
+		opsPerSecond+=args[t].opsPerSecond;
+		free(args[t].noise);
+	}
+	if(total!=nThreads*nOps || nSamples!=nThreads*nOps || gaugeMax!=(int64_t)nOps-1) {
+		printf("%s: wrong statistics! counter %llu, samples %llu, gauge max %lld (expected %llu, %llu, %llu)\n",
+			modeNames[mode], (unsigned long long)total, (unsigned long long)nSamples, (long long)gaugeMax,
+			nThreads*nOps, nThreads*nOps, nOps-1);
+		exit(1);
+	}
+	printf("%s: %d threads, %.2f Mops/s in total, %.2f ns per operation, p50 %llu p99 %llu\n", modeNames[mode],
+		nThreads, opsPerSecond/1e6, nThreads*1e9/opsPerSecond,
+		(unsigned long long)shard_hist_percentile(counts, nSamples, 50),
+		(unsigned long long)shard_hist_percentile(counts, nSamples, 99));
+
+	if(mode != MODE_THREAD_LOCAL) {
+		shards_destroy(&counter.s);
+		shards_destroy(&gauge.s);
+		shards_destroy(&hist.s);
+	}
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+	free(args);
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the mode (slice, padded, thread_local or all) and optionally millions of operations per thread
+	 * Options: the cores to run on (a core set of topology-utils.h), the number of threads and the size of
+	 * the noise buffer of every thread in KB
+	 */
+
+	const char *coreSet=NULL;
+	int nThreads=0, noiseKB=0, mode, option, wrong=0;
+	while((option=getopt(argc, argv, "c:n:x:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else if(option=='x') {
+			noiseKB=atoi(optarg);
+		} else {
+			wrong=1;
+		}
+	}
+	if(!wrong && argc-optind>=1 && argc-optind<=2) {
+		for(mode=NUMBER_MODES-1;mode>=0 && strcmp(argv[optind], modeNames[mode])!=0;mode--);
+		wrong=(mode<0 && strcmp(argv[optind], "all")!=0);
+	}
+	unsigned long long nOps=(argc-optind==2) ? strtoull(argv[optind+1], NULL, 10)*1000000 : DEFAULT_OPERATIONS*1000000ULL;
+	if(wrong || argc-optind<1 || argc-optind>2 || nThreads<0 || noiseKB<0 || nOps==0){
+		printf("Wrong Input! The mode should be passed as input!\n");
+		printf("Enter: %s [-c core_set] [-n number_threads] [-x noise_KB] <slice|padded|thread_local|all> [millions_of_operations]\n", argv[0]);
+		exit(1);
+	}
+
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
+	timing_print(stderr);
+
+	sa_context_t *ctx=NULL;
+	int error;
+	if((mode==MODE_SLICE || mode<0) && (error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if((tlsStats=calloc(nThreads, sizeof(*tlsStats)))==NULL) {
+		printf("Failed to allocate the statistics\n");
+		exit(1);
+	}
+
+	if(mode>=0) {
+		RunMode(mode, ctx, cpus, nThreads, nOps, noiseKB);
+	} else {
+		for(mode=0;mode<NUMBER_MODES;mode++) {
+			RunMode(mode, ctx, cpus, nThreads, nOps, noiseKB);
+		}
+	}
+
+	free(tlsStats);
+	sa_context_destroy(ctx);
+	return 0;
+}
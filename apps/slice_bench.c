@@ -0,0 +1,462 @@
+/*
+ * This program is the benchmark of poormans_multicore_slice and poormans_multicore_noslice in one binary:
+ * one thread per core reads (or writes) its own lines according to an access pattern (e.g., Uniform or Zipf),
+ * and the layout of the lines is a run-time option:
+ * - slice: lines of the slice of the core
+ * - noslice: consecutive lines of a (hugepage-backed) buffer
+ * - spill: lines of the core's slice up to its capacity, then of the nearby slices (weighted spill policy)
+ * - plan: a hot/cold layout planned by layout_planner from the access frequencies (-P remap_table): the hottest
+ *   lines on the core's slice, the next ones on the nearby slices and the rest in plain memory
+ * The size of the working set is the largest index of the pattern + 1.
+ * By default, every thread replays the same pattern over its own lines. Instead, the threads can use
+ * different pattern files (thread t gets file t % number of files), or a seed gives every thread its own
+ * permutation of the lines and starting point, so the threads have different hot lines and phases.
+ * In shared mode (-S owner), all threads access one set of lines homed like the lines of the owner thread
+ * (e.g., on its slice), and with writes (-W percent) the cores keep invalidating each other's copies.
+ * All threads run at the same time (a barrier per run), and each run prints one CSV line on stdout:
+ * layout,threads,lines,run,operations per second of all threads. apps/bench_driver.sh runs it on all sample workloads.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/spill-utils.h"
+#include "../lib/plan-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include "../lib/memory-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUMBER_CORES 8				/* Default number of threads */
+#define DEFAULT_RUNS 10
+#define OPERATIONS_PER_RUN (64ULL*1024*1024)	/* Per thread; whole passes over the pattern */
+
+#define LAYOUT_SLICE 0
+#define LAYOUT_NOSLICE 1
+#define LAYOUT_SPILL 2
+#define LAYOUT_PLAN 3
+
+static const char *layoutNames[] = {"slice", "noslice", "spill", "plan"};
+
+/* Thread argument */
+struct arg_struct {
+	int cpu;
+	void **lines;					/* Lines of the thread */
+	const unsigned long long *pattern;
+	unsigned long long size;		/* Accesses per pass */
+	unsigned long long passes;		/* Passes per run */
+	int runs;
+	const unsigned char *writes;	/* Per access: write instead of read (NULL -> reads only) */
+	double *opsPerSecond;			/* Result of each run */
+	struct timing_hist passHist;	/* Cycles per pass */
+	uint64_t sum;
+};
+
+static pthread_barrier_t barrier;
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * One pass over the pattern
+ */
+
+static inline uint64_t Pass(struct arg_struct *args) {
+	unsigned long long i;
+	uint64_t sum = 0;
+	if(args->writes == NULL) {
+		for(i=0;i<args->size;i++) {
+			sum += *(volatile unsigned char*)args->lines[args->pattern[i]];	/* Read Latency */
+		}
+	} else {
+		for(i=0;i<args->size;i++) {
+			if(args->writes[i]) {
+				*(volatile unsigned char*)args->lines[args->pattern[i]] = 30;	/* Write Latency */
+			} else {
+				sum += *(volatile unsigned char*)args->lines[args->pattern[i]];
+			}
+		}
+	}
+	return sum;
+}
+
+/*
+ * Function to be called by each thread
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = arguments;
+	unsigned long long p;
+	uint64_t start, passStart;
+	int r;
+
+	CorePin(args->cpu);
+
+	/* Warm up: the lines are in the LLC (or as far as they fit) before the first run */
+	args->sum = Pass(args);
+
+	for(r=0;r<args->runs;r++) {
+		pthread_barrier_wait(&barrier);
+		start = timing_start();
+		for(p=0;p<args->passes;p++) {
+			passStart = timing_start();
+			args->sum += Pass(args);
+			timing_hist_record(&args->passHist, timing_cycles(passStart, timing_stop()));
+		}
+		args->opsPerSecond[r] = args->size*args->passes/timing_seconds(timing_cycles(start, timing_stop()));
+	}
+	return NULL;
+}
+
+/*
+ * Read the access pattern: one line index per access
+ */
+
+static unsigned long long* ReadPattern(const char *file, unsigned long long *size, unsigned long long *nLines) {
+
+	FILE *fileptr = fopen(file, "r");
+	unsigned long long capacity = 4096, index, *pattern = malloc(capacity*sizeof(*pattern));
+
+	if(fileptr == NULL || pattern == NULL) {
+		printf("Cannot read %s\n", file);
+		exit(1);
+	}
+	*size = 0;
+	*nLines = 0;
+	while(fscanf(fileptr, "%llu", &index) == 1) {
+		if(*size == capacity) {
+			capacity *= 2;
+			if((pattern = realloc(pattern, capacity*sizeof(*pattern))) == NULL) {
+				printf("Failed to allocate the pattern\n");
+				exit(1);
+			}
+		}
+		pattern[(*size)++] = index;
+		if(index >= *nLines) {
+			*nLines = index+1;
+		}
+	}
+	fclose(fileptr);
+	return pattern;
+}
+
+/*
+ * Pattern of a thread with its own seed: the same distribution over a permutation of the lines,
+ * starting at a random point of the pattern
+ */
+
+static unsigned long long* SeedPattern(const unsigned long long *pattern, unsigned long long size,
+	unsigned long long nLines, unsigned int seed) {
+
+	unsigned long long *seeded = malloc(size*sizeof(*seeded)), *permutation = malloc(nLines*sizeof(*permutation));
+	unsigned long long i, j, tmp, start;
+
+	if(seeded == NULL || permutation == NULL) {
+		printf("Failed to allocate the pattern\n");
+		exit(1);
+	}
+	for(i=0;i<nLines;i++) {
+		permutation[i] = i;
+	}
+	for(i=nLines-1;i>0;i--) {
+		j = ((unsigned long long)rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (i+1);
+		tmp = permutation[i];
+		permutation[i] = permutation[j];
+		permutation[j] = tmp;
+	}
+	start = ((unsigned long long)rand_r(&seed) * RAND_MAX + rand_r(&seed)) % size;
+	for(i=0;i<size;i++) {
+		seeded[i] = permutation[pattern[(start+i) % size]];
+	}
+	free(permutation);
+	return seeded;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the access pattern files
+	 * Options: the cores to run on (a core set of topology-utils.h) and the number of threads,
+	 * the layout, the number of runs, the share of writes (-w: only writes), a seed for per-thread patterns,
+	 * the owner of the lines in shared mode (the index of a thread) and the remap table of the plan layout
+	 * With -q, only the number of CPUs of the core set is printed (e.g., for scaling_sweep.sh) and no file is needed
+	 */
+
+	const char *coreSet=NULL, *planPath=NULL;
+	int nThreads=0, layout=LAYOUT_SLICE, runs=DEFAULT_RUNS, writePercent=0, owner=-1, query=0, option, wrong=0;
+	unsigned int seed=0;
+	while((option=getopt(argc, argv, "c:n:l:r:wW:s:S:P:q"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else if(option=='l') {
+			for(layout=LAYOUT_PLAN;layout>=0 && strcmp(optarg, layoutNames[layout])!=0;layout--);
+			wrong|=(layout<0);
+		} else if(option=='r') {
+			runs=atoi(optarg);
+			wrong|=(runs<1);
+		} else if(option=='w') {
+			writePercent=100;
+		} else if(option=='W') {
+			writePercent=atoi(optarg);
+			wrong|=(writePercent<0 || writePercent>100);
+		} else if(option=='s') {
+			seed=strtoul(optarg, NULL, 10);
+		} else if(option=='S') {
+			owner=atoi(optarg);
+			wrong|=(owner<0);
+		} else if(option=='P') {
+			planPath=optarg;
+		} else if(option=='q') {
+			query=1;
+		} else {
+			wrong=1;
+		}
+	}
+	/* The plan ranks the lines of the pattern files, which a seed permutes */
+	wrong|=((layout==LAYOUT_PLAN)!=(planPath!=NULL) || (layout==LAYOUT_PLAN && seed));
+	if(wrong || (argc-optind<1 && !query) || nThreads<0){
+		printf("Wrong Input! Access pattern filename should be passed as input!\n");
+		printf("Enter: %s [-c core_set] [-n number_threads] [-l slice|noslice|spill|plan] [-P remap_table] [-r runs] [-w | -W write_percent] [-s seed] [-S owner_thread] <access_pattern_file> [access_pattern_file ...]\n", argv[0]);
+		printf("   or: %s [-c core_set] -q (print the number of CPUs of the core set)\n", argv[0]);
+		exit(1);
+	}
+
+	/* Cores: one per physical core of socket 0 by default */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(query) {
+		printf("%d\n", nCpus);
+		return 0;
+	}
+
+	/* Patterns: thread t replays file t % nPatterns; all threads have lines for the largest index of all files */
+	int nPatterns=argc-optind, f;
+	unsigned long long **patterns=malloc(nPatterns*sizeof(*patterns));
+	unsigned long long *sizes=malloc(nPatterns*sizeof(*sizes));
+	unsigned long long nLines=0, n, i;
+	for(f=0;f<nPatterns;f++) {
+		patterns[f]=ReadPattern(argv[optind+f], &sizes[f], &n);
+		if(sizes[f] == 0) {
+			printf("Empty access pattern: %s!\n", argv[optind+f]);
+			exit(1);
+		}
+		if(n > nLines) {
+			nLines=n;
+		}
+	}
+
+	/* At most NUMBER_CORES threads by default, unless -n says otherwise */
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+	if(owner>=nThreads) {
+		printf("Wrong owner! It should be a thread between 0 and %d!\n", nThreads-1);
+		exit(1);
+	}
+	int shared=(owner>=0);
+
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
+	timing_print(stderr);
+
+	struct arg_struct *args=calloc(nThreads, sizeof(*args));
+	pthread_t *threads=malloc(nThreads*sizeof(*threads));
+	sa_context_t *ctx=NULL;
+	int t, error;
+
+	/* In shared mode, only the owner gets lines; the others use them */
+	for(t=0;t<nThreads;t++) {
+		args[t].opsPerSecond=malloc(runs*sizeof(double));
+		if(!shared || t==owner) {
+			args[t].lines=malloc(nLines*sizeof(void*));
+		}
+		if(args[t].opsPerSecond==NULL || ((!shared || t==owner) && args[t].lines==NULL)) {
+			printf("Failed to allocate the lines\n");
+			exit(1);
+		}
+	}
+
+	if(layout==LAYOUT_NOSLICE) {
+		for(t=0;t<nThreads;t++) {
+			struct buffer buf;
+			if(shared && t!=owner) {
+				continue;
+			}
+			if((error=create_buffer_sized(&buf, nLines*LINE, PAGE_SIZE_AUTO))) {
+				printf("Failed to allocate memory for buffer: %s\n", sa_strerror(error));
+				exit(1);
+			}
+			for(i=0;i<nLines;i++) {
+				args[t].lines[i]=(char*)buf.addr+i*LINE;
+			}
+		}
+	} else {
+		if((error=sa_context_create(&ctx, NULL))) {
+			printf("Failed to create the context: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		if(layout==LAYOUT_SLICE) {
+			for(t=0;t<nThreads;t++) {
+				if(shared && t!=owner) {
+					continue;
+				}
+				if((error=sa_alloc_lines(ctx, sa_cpu_slice(cpus[t]), args[t].lines, nLines))) {
+					printf("Failed to allocate the lines of core %d: %s\n", cpus[t], sa_strerror(error));
+					exit(1);
+				}
+			}
+		} else if(layout==LAYOUT_PLAN) {
+			struct layout_plan plan;
+			struct spill_policy policy;
+			struct buffer plain;
+			if((error=plan_load(&plan, planPath))) {
+				printf("Failed to load the plan %s: %s\n", planPath, sa_strerror(error));
+				exit(1);
+			}
+			plan_print(stderr, &plan);
+			for(t=0;t<nThreads;t++) {
+				if(shared && t!=owner) {
+					continue;
+				}
+				if((error=spill_policy_init(&policy, SPILL_FILL, sa_cpu_slice(cpus[t]), NULL, plan.nTiers)) ||
+					(error=plan_alloc_lines(ctx, &plan, &policy, args[t].lines, nLines, &plain))) {
+					printf("Failed to allocate the lines of core %d: %s\n", cpus[t], sa_strerror(error));
+					exit(1);
+				}
+			}
+			plan_destroy(&plan);
+		} else {
+			/* The threads share the capacity of the slices: first every thread fills its own slice, then they spill */
+			static unsigned long long budget[NUMBER_VIRTUAL_SLICES];
+			struct spill_policy *policies=malloc(nThreads*sizeof(*policies));
+			unsigned long long *nPrimary=malloc(nThreads*sizeof(*nPrimary));
+			int round;
+			for(t=0;t<nThreads;t++) {
+				int slice=sa_cpu_slice(cpus[t]);
+				if(shared && t!=owner) {
+					continue;
+				}
+				if((error=spill_policy_init(&policies[t], SPILL_WEIGHTED, slice, NULL, 0))) {
+					printf("Failed to set up the policy of core %d: %s\n", cpus[t], sa_strerror(error));
+					exit(1);
+				}
+				spill_policy_share(&policies[t], budget);
+				nPrimary[t]=(nLines<spill_slice_capacity(slice)) ? nLines : spill_slice_capacity(slice);
+			}
+			for(round=0;round<2;round++) {
+				for(t=0;t<nThreads;t++) {
+					if(shared && t!=owner) {
+						continue;
+					}
+					unsigned long long first=round ? nPrimary[t] : 0;
+					n=round ? nLines-nPrimary[t] : nPrimary[t];
+					if(n && (error=spill_alloc_lines(ctx, &policies[t], args[t].lines+first, n))) {
+						printf("Failed to allocate the lines of core %d: %s\n", cpus[t], sa_strerror(error));
+						exit(1);
+					}
+				}
+			}
+		}
+	}
+
+	/* Fill the lines */
+	for(t=0;t<nThreads;t++) {
+		if(shared && t!=owner) {
+			args[t].lines=args[owner].lines;
+			continue;
+		}
+		for(i=0;i<nLines;i++) {
+			memset(args[t].lines[i], 10, LINE);
+		}
+	}
+
+	pthread_barrier_init(&barrier, NULL, nThreads);
+	for(t=0;t<nThreads;t++) {
+		args[t].cpu=cpus[t];
+		args[t].size=sizes[t % nPatterns];
+		args[t].pattern=patterns[t % nPatterns];
+		if(seed) {
+			args[t].pattern=SeedPattern(patterns[t % nPatterns], args[t].size, nLines, seed+t);
+		}
+		if(writePercent) {
+			unsigned int writeSeed=seed+t+1;
+			unsigned char *writes=malloc(args[t].size);
+			if(writes==NULL) {
+				printf("Failed to allocate the pattern\n");
+				exit(1);
+			}
+			for(i=0;i<args[t].size;i++) {
+				writes[i]=(rand_r(&writeSeed) % 100 < writePercent);
+			}
+			args[t].writes=writes;
+		}
+		args[t].passes=(OPERATIONS_PER_RUN+args[t].size-1)/args[t].size;
+		args[t].runs=runs;
+		timing_hist_init(&args[t].passHist);
+		if(pthread_create(&threads[t], NULL, Run_Exp, &args[t])) {
+			printf("Failed to create thread %d\n", t);
+			exit(1);
+		}
+	}
+
+	struct timing_hist allHist;
+	timing_hist_init(&allHist);
+	for(t=0;t<nThreads;t++) {
+		pthread_join(threads[t], NULL);
+		timing_hist_merge(&allHist, &args[t].passHist);
+	}
+
+	int r;
+	for(r=0;r<runs;r++) {
+		double total=0;
+		for(t=0;t<nThreads;t++) {
+			total+=args[t].opsPerSecond[r];
+		}
+		printf("%s,%d,%llu,%d,%.0f\n", layoutNames[layout], nThreads, nLines, r, total);
+	}
+
+	/* Per thread, on stderr: in shared mode, the owner is close to the lines and the others are not */
+	for(t=0;t<nThreads;t++) {
+		double mean=0;
+		for(r=0;r<runs;r++) {
+			mean+=args[t].opsPerSecond[r]/runs;
+		}
+		fprintf(stderr, "Thread %d (CPU %d, slice %d)%s: %.0f operations/s\n", t, cpus[t], sa_cpu_slice(cpus[t]),
+			(t==owner) ? " owner" : "", mean);
+	}
+	char label[64];
+	snprintf(label, sizeof(label), "Pass (%d%% writes)", writePercent);
+	timing_hist_print(stderr, label, &allHist);
+
+	sa_context_destroy(ctx);
+	return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * This program reports how the cache lines of existing memory are spread over the slices (lib/inspect-utils.h):
+ * virtual ranges ("start-end" or "start+size" in hex), mappings of a process by path (-M, e.g., "[heap]";
+ * "" for the anonymous mappings, "all" for all of them) or a heap dump of objects (-f, one "address [size]"
+ * per line, in hex). With a core (-c), it also compares the mean latency from the core with all lines on its slice.
+ * With -d, it inspects its own buffers instead: a malloc() buffer and lines of sa_alloc_lines() on the slice
+ * of the core, as a reference.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/inspect-utils.h"
+#include "../lib/sliceaware.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE_LENGTH 256
+
+/*
+ * Read a heap dump: "address [size]" per line (hex), '#' starts a comment
+ */
+
+static struct inspect_object* ReadObjects(const char *file, size_t *n) {
+
+	FILE *fileptr = fopen(file, "r");
+	size_t capacity = 4096;
+	struct inspect_object *objects = malloc(capacity*sizeof(*objects));
+	char line[LINE_LENGTH];
+
+	if(fileptr == NULL || objects == NULL) {
+		printf("Cannot read %s\n", file);
+		exit(1);
+	}
+	*n = 0;
+	while(fgets(line, sizeof(line), fileptr) != NULL) {
+		unsigned long long address, size = 0;
+		if(line[0] == '#' || sscanf(line, "%llx %llx", &address, &size) < 1) {
+			continue;
+		}
+		if(*n == capacity) {
+			capacity *= 2;
+			if((objects = realloc(objects, capacity*sizeof(*objects))) == NULL) {
+				printf("Failed to allocate the objects\n");
+				exit(1);
+			}
+		}
+		objects[*n].address = address;
+		objects[(*n)++].size = size;
+	}
+	fclose(fileptr);
+	return objects;
+}
+
+/*
+ * Inspect one input and print its distribution (and add it to the total)
+ */
+
+static void Report(struct inspector *in, const char *label, const struct inspect_stats *st, struct inspect_stats *total,
+	const struct latency_table *table, int core, uint64_t start) {
+
+	int slice;
+
+	inspect_print(stdout, label, st, table, core);
+	printf("%s: %.1f us, %llu pagemap reads so far\n", label, timing_ns(timing_cycles(start, timing_stop()))/1000,
+		in->nReads);
+	for(slice=0;slice<st->nSlices;slice++) {
+		total->lines[slice] += st->lines[slice];
+	}
+	total->nLines += st->nLines;
+	total->nUnmapped += st->nUnmapped;
+	total->nObjects += st->nObjects;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the virtual ranges to inspect
+	 * Options: the process (pid), a hash model, a latency table (see lib/latency-utils.h) and the core to compare with,
+	 * the mappings and the heap dump to inspect, and the size of the reference buffers in KB (-d)
+	 */
+
+	const char *modelPath=NULL, *tablePath=NULL, *mapping=NULL, *objectsPath=NULL;
+	int pid=0, core=-1, demoKB=0, option, wrong=0;
+	while((option=getopt(argc, argv, "p:m:t:c:M:f:d:"))!=-1) {
+		if(option=='p') {
+			pid=atoi(optarg);
+		} else if(option=='m') {
+			modelPath=optarg;
+		} else if(option=='t') {
+			tablePath=optarg;
+		} else if(option=='c') {
+			core=atoi(optarg);
+		} else if(option=='M') {
+			mapping=optarg;
+		} else if(option=='f') {
+			objectsPath=optarg;
+		} else if(option=='d') {
+			demoKB=atoi(optarg);
+		} else {
+			wrong=1;
+		}
+	}
+	if(wrong || pid<0 || demoKB<0 || (argc-optind==0 && mapping==NULL && objectsPath==NULL && demoKB==0) ||
+		(demoKB && pid)){
+		printf("Wrong Input! Ranges, mappings (-M), a heap dump (-f) or the size of the reference buffers (-d) should be passed as input!\n");
+		printf("Enter: %s [-p pid] [-m hash_model] [-t latency_table] [-c core] [-M mapping|all] [-f heap_dump] [-d reference_KB] [start-end | start+size ...]\n", argv[0]);
+		exit(1);
+	}
+
+	int error;
+	struct hash_model model;
+	struct latency_table table;
+	if(modelPath!=NULL && (error=hash_model_load(&model, modelPath))) {
+		printf("Failed to load the hash model: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(tablePath!=NULL && (error=latency_table_load(&table, tablePath))) {
+		printf("Failed to load the latency table: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(tablePath==NULL) {
+		latency_table_ring(&table, NUMBER_VIRTUAL_SLICES, NUMBER_VIRTUAL_SLICES);
+	}
+
+	struct inspector in;
+	if((error=inspect_init(&in, pid, modelPath ? &model : NULL))) {
+		printf("Failed to inspect %s: %s\n", pid ? "the process" : "this process", sa_strerror(error));
+		exit(1);
+	}
+	printf("Model: %s, %d slices\n", in.model.name, in.nSlices);
+
+	struct inspect_stats st, total;
+	char label[LINE_LENGTH];
+	uint64_t start;
+	int i;
+	inspect_stats_init(&in, &total);
+
+	for(i=optind;i<argc;i++) {
+		char *separator;
+		unsigned long long first=strtoull(argv[i], &separator, 16), last;
+		if(*separator=='-') {
+			last=strtoull(separator+1, NULL, 16);
+		} else if(*separator=='+') {
+			last=first+strtoull(separator+1, NULL, 16);
+		} else {
+			printf("Wrong range: %s\n", argv[i]);
+			exit(1);
+		}
+		inspect_stats_init(&in, &st);
+		start=timing_start();
+		if(last<=first || (error=inspect_range(&in, first, last-first, &st))) {
+			printf("Failed to inspect %s: %s\n", argv[i], sa_strerror(last<=first ? SA_ERR_INVALID : error));
+			exit(1);
+		}
+		Report(&in, argv[i], &st, &total, &table, core, start);
+	}
+
+	if(mapping!=NULL) {
+		inspect_stats_init(&in, &st);
+		start=timing_start();
+		int nMappings=inspect_mappings(&in, pid, strcmp(mapping, "all") ? mapping : NULL, &st);
+		if(nMappings<0) {
+			printf("Failed to inspect the mappings: %s\n", sa_strerror(nMappings));
+			exit(1);
+		}
+		snprintf(label, sizeof(label), "%d mappings '%s'", nMappings, mapping);
+		Report(&in, label, &st, &total, &table, core, start);
+	}
+
+	if(objectsPath!=NULL) {
+		size_t nObjects;
+		struct inspect_object *objects=ReadObjects(objectsPath, &nObjects);
+		inspect_stats_init(&in, &st);
+		start=timing_start();
+		if((error=inspect_objects(&in, objects, nObjects, &st))) {
+			printf("Failed to inspect the objects: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		Report(&in, objectsPath, &st, &total, &table, core, start);
+		free(objects);
+	}
+
+	/* Reference buffers of this process: what a plain allocation and a slice-local one look like */
+	if(demoKB) {
+		size_t n=(size_t)demoKB*1024/LINE, l;
+		int slice=sa_cpu_slice(core>=0 ? core : 0);
+		char *buffer=malloc(n*LINE);
+		void **lines=malloc(n*sizeof(*lines));
+		struct inspect_object *objects=malloc(n*sizeof(*objects));
+		sa_context_t *ctx;
+		if(buffer==NULL || lines==NULL || objects==NULL) {
+			printf("Failed to allocate the reference buffers\n");
+			exit(1);
+		}
+		memset(buffer, 1, n*LINE);
+		inspect_stats_init(&in, &st);
+		start=timing_start();
+		if((error=inspect_range(&in, (uint64_t)buffer, n*LINE, &st))) {
+			printf("Failed to inspect the malloc buffer: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		Report(&in, "malloc", &st, &total, &table, core, start);
+
+		if((error=sa_context_create(&ctx, NULL)) || (error=sa_alloc_lines(ctx, slice, lines, n))) {
+			printf("Failed to allocate lines on slice %d: %s\n", slice, sa_strerror(error));
+			exit(1);
+		}
+		for(l=0;l<n;l++) {
+			objects[l].address=(uint64_t)lines[l];
+			objects[l].size=LINE;
+		}
+		inspect_stats_init(&in, &st);
+		start=timing_start();
+		if((error=inspect_objects(&in, objects, n, &st))) {
+			printf("Failed to inspect the lines: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		snprintf(label, sizeof(label), "sa_alloc_lines(slice %d)", slice);
+		Report(&in, label, &st, &total, &table, core, start);
+		sa_free_lines(ctx, slice, lines, n);
+		sa_context_destroy(ctx);
+		free(objects);
+		free(lines);
+		free(buffer);
+	}
+
+	inspect_print(stdout, "total", &total, &table, core);
+	inspect_destroy(&in);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/* 
+ * This program samples the LLC lookups of every slice at a fixed interval and reports per-slice rates and imbalance
+ * CSV is printed to stdout; Prometheus metrics can be written to a file (e.g., for node_exporter's textfile collector)
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/telemetry-utils.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMULATED_RATE 1000000	/* Lookups per second of each slice for the simulated backend */
+#define SIMULATED_HOT_FACTOR 4	/* Slice 0 is this many times hotter than the others */
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: should contain interval, number of samples and backend
+	 */
+
+	if(argc!=4 && argc!=5 && argc!=6){
+		printf("Wrong Input! Interval, number of samples and backend should be passed as input!\n");
+		printf("Enter: %s <interval_ms> <number_samples (0 -> forever)> <msr|sim> [number_slices] [prometheus_file]\n", argv[0]);
+		exit(1);
+	}
+
+	unsigned long intervalMs;
+	sscanf (argv[1],"%lu",&intervalMs);
+	if(intervalMs == 0){
+		printf("Wrong interval! Interval should be more than 0!\n");
+		exit(1);
+	}
+
+	unsigned long long nSamples;
+	sscanf (argv[2],"%llu",&nSamples);
+
+	int backend;
+	if(strcmp(argv[3],"msr")==0) {
+		backend=TELEMETRY_BACKEND_MSR;
+	} else if(strcmp(argv[3],"sim")==0) {
+		backend=TELEMETRY_BACKEND_SIMULATED;
+	} else {
+		printf("Wrong backend! Backend should be msr or sim!\n");
+		exit(1);
+	}
+
+	int nSlices=NUMBER_SLICES;
+	if(argc>=5) {
+		sscanf (argv[4],"%d",&nSlices);
+		if(nSlices > NUMBER_SLICES || nSlices <= 0){
+			printf("Wrong number of slices! It should be between 1 and %d!\n", NUMBER_SLICES);
+			exit(1);
+		}
+	}
+
+	const char *promPath = (argc==6) ? argv[5] : NULL;
+
+	/* MSRs are accessed through CPU 0 */
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(0,&set);
+	sched_setaffinity(0, sizeof(cpu_set_t), &set);
+
+	struct msr_device msr;
+	msr_init(&msr, 0);
+
+	struct telemetry t;
+	int error=telemetry_init(&t, backend, nSlices, &msr);
+	if(error) {
+		printf("Failed to initialize the counters: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	if(backend==TELEMETRY_BACKEND_SIMULATED) {
+		int i;
+		for(i=0;i<nSlices;i++) {
+			telemetry_simulate_rate(&t, i, SIMULATED_RATE);
+		}
+		telemetry_simulate_rate(&t, 0, SIMULATED_RATE*SIMULATED_HOT_FACTOR);
+	}
+
+	if((error=telemetry_run(&t, intervalMs, nSamples, stdout, promPath))) {
+		printf("Sampling failed: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	return 0;
+}
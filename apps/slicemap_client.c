@@ -0,0 +1,108 @@
+/*
+ * This program gets slice-local lines from the slice-map daemon (slicemap_daemon) and measures how long it takes,
+ * compared to discovering them locally with a new context (what every process does without the daemon).
+ * It also checks that the lines received from the daemon are mapped to the requested slices.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/slicemap-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double Elapsed(uint64_t start) {
+	return timing_seconds(timing_cycles(start, timing_stop()));
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: number of lines per slice, and optionally the socket path and "local" to compare with local discovery
+	 */
+
+	if(argc<2 || argc>4){
+		printf("Wrong Input!\n");
+		printf("Enter: %s <lines_per_slice> [socket_path] [local]\n", argv[0]);
+		exit(1);
+	}
+
+	unsigned long nLines=strtoul(argv[1], NULL, 10);
+	if(nLines==0) {
+		printf("Wrong number of lines! It should be more than 0!\n");
+		exit(1);
+	}
+	const char *path=(argc>=3) ? argv[2] : SLICEMAP_DEFAULT_SOCKET;
+	int local=(argc==4 && strcmp(argv[3], "local")==0);
+
+	int error, slice;
+	unsigned long i;
+	void **lines[NUMBER_VIRTUAL_SLICES];
+	for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+		lines[slice]=malloc(nLines*sizeof(void*));
+	}
+
+	/* From the daemon */
+	struct slicemap_client client;
+	timing_get();	/* Calibrate the timer before measuring */
+	uint64_t start=timing_start();
+	if((error=slicemap_connect(&client, path))) {
+		printf("Failed to connect to %s: %s\n", path, sa_strerror(error));
+		exit(1);
+	}
+	for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+		if((error=slicemap_alloc_lines(&client, slice, lines[slice], nLines))) {
+			printf("Failed to get the lines of slice %d: %s\n", slice, sa_strerror(error));
+			exit(1);
+		}
+	}
+	printf("Daemon: %lu lines per slice in %.3f ms\n", nLines, Elapsed(start)*1e3);
+
+	/* Check the slices (in this process, the lines have other virtual addresses but the same physical ones) */
+	struct msr_device msr;
+	msr_init(&msr, 0);
+	unsigned long nChecked=0, nWrong=0;
+	for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+		for(i=0;i<nLines;i++) {
+			uint64_t pa;
+			if(translate_address(lines[slice][i], &pa)) {
+				break;
+			}
+			nChecked++;
+			if(calculatePlacementSlice(hash_model_active(), &msr, lines[slice][i], pa)!=slice) {
+				nWrong++;
+			}
+		}
+	}
+	msr_close(&msr);
+	printf("Checked %lu lines, %lu on a wrong slice\n", nChecked, nWrong);
+
+	uint64_t nFree[NUMBER_VIRTUAL_SLICES];
+	if(slicemap_stats(&client, nFree)==SA_OK) {
+		for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+			printf("Slice %d: %llu lines left\n", slice, (unsigned long long)nFree[slice]);
+		}
+	}
+	slicemap_disconnect(&client);
+
+	/* Local discovery, for comparison */
+	if(local) {
+		sa_context_t *ctx;
+		start=timing_start();
+		if((error=sa_context_create(&ctx, NULL))) {
+			printf("Failed to create the context: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+			if((error=sa_alloc_lines(ctx, slice, lines[slice], nLines))) {
+				printf("Failed to allocate the lines of slice %d: %s\n", slice, sa_strerror(error));
+				exit(1);
+			}
+		}
+		printf("Local: %lu lines per slice in %.3f ms\n", nLines, Elapsed(start)*1e3);
+		sa_context_destroy(ctx);
+	}
+	return 0;
+}
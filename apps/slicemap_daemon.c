@@ -0,0 +1,90 @@
+/*
+ * This program is the host-level slice-map daemon: it reserves hugepages, finds the slice of every line once,
+ * and hands slice-local lines to client processes over a unix socket (see lib/slicemap-utils.h),
+ * so the clients (e.g., slicemap_client) start without any discovery. It runs until SIGINT/SIGTERM.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/slicemap-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+static struct slicemap_server server;
+
+static void Stop(int signum) {
+	(void)signum;
+	server.stop = 1;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: size of the memory to share, and optionally the socket path and a hash model
+	 */
+
+	if(argc<2 || argc>4){
+		printf("Wrong Input!\n");
+		printf("Enter: %s <size_MB> [socket_path] [hash_model]\n", argv[0]);
+		exit(1);
+	}
+
+	unsigned long sizeMB=strtoul(argv[1], NULL, 10);
+	if(sizeMB==0) {
+		printf("Wrong size! Size should be more than 0!\n");
+		exit(1);
+	}
+	const char *path=(argc>=3) ? argv[2] : SLICEMAP_DEFAULT_SOCKET;
+
+	int error;
+	struct hash_model model;
+	if(argc==4) {
+		if((error=hash_model_load(&model, argv[3])) || (error=hash_model_use(&model))) {
+			printf("Failed to load the hash model: %s\n", sa_strerror(error));
+			exit(1);
+		}
+	}
+
+	/* The signal handler interrupts poll(), so the daemon leaves its loop and removes the socket */
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler=Stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	struct msr_device msr;
+	msr_init(&msr, 0);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if((error=slicemap_server_init(&server, sizeMB*1024*1024, &msr))) {
+		printf("Failed to reserve and classify the memory: %s\n", sa_strerror(error));
+		exit(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	msr_close(&msr);
+
+	printf("%lu lines on %zuKB-pages classified in %.3f s\n", server.nLines, server.pageSize/1024,
+		(end.tv_sec-start.tv_sec)+(end.tv_nsec-start.tv_nsec)/1e9);
+	int slice;
+	for(slice=0;slice<NUMBER_VIRTUAL_SLICES;slice++) {
+		printf("Slice %d: %lu lines\n", slice, server.nSliceLines[slice]);
+	}
+
+	if((error=slicemap_server_listen(&server, path))) {
+		printf("Failed to listen on %s: %s\n", path, sa_strerror(error));
+		slicemap_server_destroy(&server);
+		exit(1);
+	}
+	printf("Listening on %s\n", path);
+	fflush(stdout);
+
+	if((error=slicemap_server_run(&server))) {
+		printf("Failed to serve the clients: %s\n", sa_strerror(error));
+	}
+	slicemap_server_destroy(&server);
+	return error ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * This program runs one thread per core reading a hot set of cache lines at random, where the hot set can be
+ * larger than one slice. The lines are placed with a spill policy (single, fill or weighted, see lib/spill-utils.h)
+ * or without slice awareness (noslice: consecutive lines of an ordinary buffer).
+ * For each core, it prints the throughput and how the bytes of the hot set were distributed over the slices.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/spill-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define NUMBER_CORES 8
+#define NUMBER_READS (64UL*1024*1024)
+#define BATCH_READS 1024			/* Reads per latency sample */
+
+/* Thread argument */
+struct arg_struct {
+	int coreID;
+	int cpu;
+	void **lines;
+	unsigned long nLines;
+	double MReadsPerSecond;		/* Result */
+	struct timing_hist batchHist;	/* Cycles per batch of BATCH_READS reads */
+	uint64_t sum;
+};
+
+/*
+ * Read random lines of the hot set (xorshift, so the indices are not predictable by the prefetchers)
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = arguments;
+	cpu_set_t set;
+	uint64_t x = 88172645463325252ULL + args->coreID, sum = 0;
+	unsigned long i, b;
+
+	CPU_ZERO(&set);
+	CPU_SET(args->cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set) < 0) {
+		fprintf(stderr, "Core %d: unable to set affinity, running without locality\n", args->coreID);
+	}
+
+	/* Warm up: touch the whole hot set once */
+	for(i=0;i<args->nLines;i++) {
+		sum += *(volatile unsigned char*)args->lines[i];
+	}
+
+	uint64_t start = timing_start(), batchStart;
+	for(b=0;b<NUMBER_READS/BATCH_READS;b++) {
+		batchStart = timing_start();
+		for(i=0;i<BATCH_READS;i++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			sum += *(volatile unsigned char*)args->lines[x % args->nLines];
+		}
+		timing_hist_record(&args->batchHist, timing_cycles(batchStart, timing_stop()));
+	}
+	args->MReadsPerSecond = NUMBER_READS/timing_seconds(timing_cycles(start, timing_stop()))/1e6;
+	args->sum = sum;
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: number of cores, hot set size and policy, and optionally
+	 * the maximum number of slices per core and a latency table
+	 */
+
+	if(argc<4 || argc>6){
+		printf("Wrong Input!\n");
+		printf("Enter: %s <number_cores> <hot_set_KB> <single|fill|weighted|noslice> [max_slices] [latency_table]\n", argv[0]);
+		exit(1);
+	}
+
+	int nCores=atoi(argv[1]);
+	unsigned long hotSetKB=strtoul(argv[2], NULL, 10);
+	if(nCores<1 || nCores>NUMBER_CORES || hotSetKB==0) {
+		printf("Wrong input! Cores should be between 1 and %d and the hot set more than 0!\n", NUMBER_CORES);
+		exit(1);
+	}
+	int mode;
+	if(strcmp(argv[3], "noslice")==0) {
+		mode=-1;
+	} else if(strcmp(argv[3], spill_mode_name(SPILL_SINGLE))==0) {
+		mode=SPILL_SINGLE;
+	} else if(strcmp(argv[3], spill_mode_name(SPILL_FILL))==0) {
+		mode=SPILL_FILL;
+	} else if(strcmp(argv[3], spill_mode_name(SPILL_WEIGHTED))==0) {
+		mode=SPILL_WEIGHTED;
+	} else {
+		printf("Wrong policy! It should be single, fill, weighted or noslice!\n");
+		exit(1);
+	}
+	int maxSlices=(argc>=5) ? atoi(argv[4]) : 0;
+
+	int error;
+	struct latency_table table, *tablePtr=NULL;
+	if(argc==6) {
+		if((error=latency_table_load(&table, argv[5]))) {
+			printf("Failed to load the latency table: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		tablePtr=&table;
+	}
+
+	/* Cores: the first ones of the default core set, i.e., one per physical core of socket 0 */
+	int cpus[TOPOLOGY_MAX_CPUS];
+	const struct cpu_topology *topology=topology_get();
+	int nCpus=(topology!=NULL) ? topology_select(topology, NULL, cpus, TOPOLOGY_MAX_CPUS) : 0;
+	if(nCpus<nCores) {
+		printf("Wrong number of cores! Socket 0 has %d cores!\n", nCpus);
+		exit(1);
+	}
+
+	unsigned long nLines=hotSetKB*1024/LINE, i;
+	struct arg_struct args[NUMBER_CORES];
+	struct spill_policy policies[NUMBER_CORES];
+	sa_context_t *ctx=NULL;
+	int c, slice, slices[NUMBER_CORES];
+	for(c=0;c<nCores;c++) {
+		slices[c]=sa_cpu_slice(cpus[c]);
+	}
+
+	if(mode<0) {
+		for(c=0;c<nCores;c++) {
+			char *buffer=aligned_alloc(LINE, nLines*LINE);
+			args[c].lines=malloc(nLines*sizeof(void*));
+			if(buffer==NULL || args[c].lines==NULL) {
+				printf("Failed to allocate the hot set\n");
+				exit(1);
+			}
+			memset(buffer, c, nLines*LINE);
+			for(i=0;i<nLines;i++) {
+				args[c].lines[i]=buffer+i*LINE;
+			}
+		}
+	} else {
+		if((error=sa_context_create(&ctx, NULL))) {
+			printf("Failed to create the context: %s\n", sa_strerror(error));
+			exit(1);
+		}
+		/* The cores share the capacity of the slices: first every core fills its own slice, then they spill */
+		static unsigned long long budget[NUMBER_VIRTUAL_SLICES];
+		unsigned long nPrimary[NUMBER_CORES];
+		for(c=0;c<nCores;c++) {
+			args[c].lines=malloc(nLines*sizeof(void*));
+			if((error=spill_policy_init(&policies[c], mode, slices[c], tablePtr, maxSlices))) {
+				printf("Failed to set up the policy of core %d: %s\n", c, sa_strerror(error));
+				exit(1);
+			}
+			spill_policy_share(&policies[c], budget);
+			nPrimary[c]=(mode==SPILL_SINGLE || nLines<spill_slice_capacity(slices[c])) ? nLines : spill_slice_capacity(slices[c]);
+		}
+		int round;
+		for(round=0;round<2;round++) {
+			for(c=0;c<nCores;c++) {
+				unsigned long first=round ? nPrimary[c] : 0, n=round ? nLines-nPrimary[c] : nPrimary[c];
+				if(n && (error=spill_alloc_lines(ctx, &policies[c], args[c].lines+first, n))) {
+					printf("Failed to allocate the hot set of core %d: %s\n", c, sa_strerror(error));
+					exit(1);
+				}
+			}
+		}
+		for(c=0;c<nCores;c++) {
+			for(i=0;i<nLines;i++) {
+				memset(args[c].lines[i], c, LINE);
+			}
+		}
+	}
+
+	timing_print(stdout);
+	pthread_t threads[NUMBER_CORES];
+	for(c=0;c<nCores;c++) {
+		timing_hist_init(&args[c].batchHist);
+		args[c].coreID=c;
+		args[c].cpu=cpus[c];
+		args[c].nLines=nLines;
+		if(pthread_create(&threads[c], NULL, Run_Exp, &args[c])) {
+			printf("Failed to create thread %d\n", c);
+			exit(1);
+		}
+	}
+
+	double total=0;
+	struct timing_hist allHist;
+	timing_hist_init(&allHist);
+	for(c=0;c<nCores;c++) {
+		pthread_join(threads[c], NULL);
+		total+=args[c].MReadsPerSecond;
+		timing_hist_merge(&allHist, &args[c].batchHist);
+		printf("Core %d: %.2f M reads/s", c, args[c].MReadsPerSecond);
+		if(mode>=0) {
+			printf(", %llu KB over capacity,", policies[c].nOverCapacity*LINE/1024);
+			for(i=0;i<(unsigned long)policies[c].nSlices;i++) {
+				slice=policies[c].slices[i];
+				if(policies[c].nLines[slice]) {
+					printf(" S%d: %llu KB", slice, policies[c].nLines[slice]*LINE/1024);
+				}
+			}
+		}
+		printf("\n");
+	}
+	char label[64];
+	snprintf(label, sizeof(label), "Batch of %d reads", BATCH_READS);
+	timing_hist_print(stdout, label, &allHist);
+	printf("Total (%s, %lu KB per core): %.2f M reads/s\n", argv[3], hotSetKB, total);
+
+	sa_context_destroy(ctx);
+	return 0;
+}
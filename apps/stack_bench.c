@@ -0,0 +1,287 @@
+/*
+ * This program measures call-heavy code (a deep recursive descent, as in our parsers) on threads with
+ * - default: pthread stacks (malloc/mmap memory) and __thread counters, pinned with CorePin()
+ * - pinned: stacks and TLS arenas of lib/thread-utils.h (locked hugepage stacks with a guard, per-call counters
+ *   on a line of the slice of the core)
+ * Every call touches every line of its frame (-f Bytes) and updates a per-thread counter, so that a descent
+ * of depth -d touches depth*frame Bytes of stack, e.g., more than the L2 with the defaults.
+ * Optionally, a private noise buffer (-x KB) is swept between descents to evict the stack from the private caches.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/thread-utils.h"
+#include "../lib/topology-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define NUMBER_CORES 8				/* Default number of threads */
+#define DEFAULT_RUNS 10
+#define DEFAULT_DEPTH 4096
+#define DEFAULT_FRAME 256			/* Bytes of locals per call */
+#define CALLS_PER_RUN (16*1024*1024ULL)	/* Per thread; whole descents */
+
+#define MODE_DEFAULT 0
+#define MODE_PINNED 1
+#define NUMBER_MODES 2
+
+static const char *modeNames[] = {"default", "pinned"};
+
+/* Thread argument */
+struct arg_struct {
+	int cpu;
+	int mode;
+	int depth;
+	int frameWords;
+	int runs;
+	unsigned long long descents;	/* Per run */
+	unsigned char *noise;			/* Private buffer swept between descents (NULL -> none) */
+	size_t noiseLines;
+	uint64_t *calls;				/* Per-thread counter */
+	double *callsPerSecond;			/* Result of each run */
+	uint64_t sum;
+};
+
+static __thread uint64_t tlsCalls;
+static pthread_barrier_t barrier;
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * One call of the descent: write every line of the frame, recurse, then read the frame back
+ */
+
+static __attribute__((noinline)) uint64_t Descend(struct arg_struct *args, int depth, uint64_t value) {
+
+	volatile uint64_t frame[args->frameWords];
+	int i;
+
+	for(i=0;i<args->frameWords;i+=LINE/sizeof(uint64_t)) {
+		frame[i] = value + i;
+	}
+	__atomic_store_n(args->calls, *args->calls + 1, __ATOMIC_RELAXED);
+	if(depth > 1) {
+		value = Descend(args, depth - 1, value * 31 + depth);
+	}
+	for(i=0;i<args->frameWords;i+=LINE/sizeof(uint64_t)) {
+		value += frame[i];
+	}
+	return value;
+}
+
+/*
+ * Function to be called by each thread
+ */
+
+void* Run_Exp(void *arguments) {
+
+	struct arg_struct *args = arguments;
+	unsigned long long d;
+	uint64_t start;
+	size_t n;
+	int r;
+
+	if(args->mode == MODE_DEFAULT) {
+		CorePin(args->cpu);
+		args->calls = &tlsCalls;
+	} else if((args->calls = thread_tls_alloc(sizeof(*args->calls))) == NULL) {
+		printf("Failed to allocate the counter of CPU %d\n", args->cpu);
+		exit(1);
+	}
+
+	/* Warm up: the stack is faulted in before the first run */
+	args->sum = Descend(args, args->depth, 1);
+
+	for(r=0;r<args->runs;r++) {
+		pthread_barrier_wait(&barrier);
+		start = timing_start();
+		for(d=0;d<args->descents;d++) {
+			args->sum += Descend(args, args->depth, d);
+			for(n=0;n<args->noiseLines;n++) {
+				args->sum += *(volatile unsigned char*)(args->noise + n * LINE);
+			}
+		}
+		args->callsPerSecond[r] = args->descents * args->depth / timing_seconds(timing_cycles(start, timing_stop()));
+	}
+	if(*args->calls != (args->runs * args->descents + 1) * args->depth) {
+		printf("Wrong number of calls on CPU %d: %llu\n", args->cpu, (unsigned long long)*args->calls);
+		exit(1);
+	}
+	return NULL;
+}
+
+/*
+ * Run all threads in one mode and print the throughput of every run and their mean
+ */
+
+static void RunMode(int mode, sa_context_t *ctx, const int *cpus, int nThreads, int depth, int frame, int runs,
+	size_t noiseKB) {
+
+	struct arg_struct *args = calloc(nThreads, sizeof(*args));
+	pthread_t *threads = malloc(nThreads*sizeof(*threads));
+	struct pinned_thread *pinned = calloc(nThreads, sizeof(*pinned));
+	size_t stackSize = 2 * (size_t)depth * (frame + 256);	/* Frames, plus room for their bookkeeping */
+	double mean = 0, total;
+	int t, r, error;
+
+	if(args==NULL || threads==NULL || pinned==NULL) {
+		printf("Failed to allocate the threads\n");
+		exit(1);
+	}
+	pthread_barrier_init(&barrier, NULL, nThreads);
+	for(t=0;t<nThreads;t++) {
+		args[t].cpu=cpus[t];
+		args[t].mode=mode;
+		args[t].depth=depth;
+		args[t].frameWords=frame/sizeof(uint64_t);
+		args[t].runs=runs;
+		args[t].descents=(CALLS_PER_RUN+depth-1)/depth;
+		args[t].callsPerSecond=malloc(runs*sizeof(double));
+		if(noiseKB) {
+			args[t].noiseLines=noiseKB*1024/LINE;
+			args[t].noise=aligned_alloc(LINE, args[t].noiseLines*LINE);
+		}
+		if(args[t].callsPerSecond==NULL || (noiseKB && args[t].noise==NULL)) {
+			printf("Failed to allocate the results\n");
+			exit(1);
+		}
+		if(noiseKB) {
+			memset(args[t].noise, 1, args[t].noiseLines*LINE);
+		}
+		if(mode==MODE_DEFAULT) {
+			error=pthread_create(&threads[t], NULL, Run_Exp, &args[t]) ? SA_ERR_NOMEM : SA_OK;
+		} else {
+			error=thread_create_pinned(&pinned[t], ctx, cpus[t], stackSize, 1, Run_Exp, &args[t]);
+		}
+		if(error) {
+			printf("Failed to create thread %d: %s\n", t, sa_strerror(error));
+			exit(1);
+		}
+	}
+	if(mode==MODE_PINNED) {
+		fprintf(stderr, "%s: stacks of %zu KB on %zu KB pages\n", modeNames[mode], pinned[0].stack.size/1024,
+			pinned[0].stack.page_size/1024);
+	}
+
+	for(t=0;t<nThreads;t++) {
+		if(mode==MODE_DEFAULT) {
+			pthread_join(threads[t], NULL);
+		} else {
+			thread_join_pinned(&pinned[t], NULL);
+		}
+	}
+	for(r=0;r<runs;r++) {
+		for(total=0,t=0;t<nThreads;t++) {
+			total+=args[t].callsPerSecond[r];
+		}
+		printf("%s,%d,%d,%d,%d,%.0f\n", modeNames[mode], nThreads, depth, frame, r, total);
+		mean+=total/runs;
+	}
+	fprintf(stderr, "%s: %d threads, depth %d, frames of %d Bytes: %.2f Mcalls/s in total, %.2f ns per call\n",
+		modeNames[mode], nThreads, depth, frame, mean/1e6, nThreads*1e9/mean);
+
+	for(t=0;t<nThreads;t++) {
+		free(args[t].callsPerSecond);
+		free(args[t].noise);
+	}
+	pthread_barrier_destroy(&barrier);
+	free(pinned);
+	free(threads);
+	free(args);
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the mode (default, pinned or all)
+	 * Options: the cores to run on (a core set of topology-utils.h), the number of threads, the depth of the descent,
+	 * the Bytes of locals per call, the number of runs and the size of the noise buffer of every thread in KB
+	 */
+
+	const char *coreSet=NULL;
+	int nThreads=0, depth=DEFAULT_DEPTH, frame=DEFAULT_FRAME, runs=DEFAULT_RUNS, noiseKB=0, mode=-1, option, wrong=0;
+	while((option=getopt(argc, argv, "c:n:d:f:r:x:"))!=-1) {
+		if(option=='c') {
+			coreSet=optarg;
+		} else if(option=='n') {
+			nThreads=atoi(optarg);
+		} else if(option=='d') {
+			depth=atoi(optarg);
+		} else if(option=='f') {
+			frame=atoi(optarg);
+		} else if(option=='r') {
+			runs=atoi(optarg);
+		} else if(option=='x') {
+			noiseKB=atoi(optarg);
+		} else {
+			wrong=1;
+		}
+	}
+	if(!wrong && argc-optind==1) {
+		for(mode=NUMBER_MODES-1;mode>=0 && strcmp(argv[optind], modeNames[mode])!=0;mode--);
+		wrong=(mode<0 && strcmp(argv[optind], "all")!=0);
+	}
+	if(wrong || argc-optind!=1 || nThreads<0 || depth<1 || frame<LINE || runs<1 || noiseKB<0){
+		printf("Wrong Input! The mode should be passed as input!\n");
+		printf("Enter: %s [-c core_set] [-n number_threads] [-d depth] [-f frame_bytes (>= 64)] [-r runs] [-x noise_KB] <default|pinned|all>\n", argv[0]);
+		exit(1);
+	}
+
+	/* Cores: one per physical core of socket 0 by default, at most NUMBER_CORES of them unless -n says otherwise */
+	const struct cpu_topology *topology=topology_get();
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int nCpus=(topology!=NULL) ? topology_select(topology, coreSet, cpus, TOPOLOGY_MAX_CPUS) : SA_ERR_IO;
+	if(nCpus<0) {
+		printf("Wrong core set! %s\n", sa_strerror(nCpus));
+		exit(1);
+	}
+	if(nThreads==0) {
+		nThreads=(coreSet==NULL && nCpus>NUMBER_CORES) ? NUMBER_CORES : nCpus;
+	}
+	if(nThreads>nCpus) {
+		printf("Wrong number of threads! It should be between 1 and %d (CPUs of the core set)!\n", nCpus);
+		exit(1);
+	}
+
+	/* Pin the program to the first core for initialization (polling) */
+	CorePin(cpus[0]);
+	timing_print(stderr);
+
+	sa_context_t *ctx=NULL;
+	int error;
+	if(mode!=MODE_DEFAULT && (error=sa_context_create(&ctx, NULL))) {
+		printf("Failed to create the context: %s\n", sa_strerror(error));
+		exit(1);
+	}
+
+	printf("mode,threads,depth,frame,run,calls_per_s\n");
+	if(mode>=0) {
+		RunMode(mode, ctx, cpus, nThreads, depth, frame, runs, noiseKB);
+	} else {
+		for(mode=0;mode<NUMBER_MODES;mode++) {
+			RunMode(mode, ctx, cpus, nThreads, depth, frame, runs, noiseKB);
+		}
+	}
+
+	sa_context_destroy(ctx);
+	return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * This program measures the bandwidth of sequential scans over slice-local lines and over consecutive lines,
+ * to decide which structures are scan-dominated and should stay contiguous:
+ * - slice: lines of the slice of the core (sa_alloc_lines()), which are scattered over the pages, so the
+ *   adjacent-line and stream prefetchers of the core cannot follow them
+ * - noslice: consecutive lines of a (hugepage-backed) buffer
+ * Every scan reads (or writes) all lines of a working set in order with loads (stores) of 64, 128, 256 or 512 bits
+ * (the widths that the CPU does not support are skipped), without software prefetch and with a prefetch of the line
+ * distance lines ahead (-p). Both layouts are scanned through the same array of line addresses, so they only differ
+ * in where the lines are. The working set grows 4x from the smallest to the largest size (-m and -M, in KB).
+ * For every layout, operation, size, width and prefetch distance, it prints one CSV line:
+ * layout,operation,size_KB,width_bits,prefetch,mean and max GB/s of the runs.
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include "../lib/sliceaware.h"
+#include "../lib/cache-utils.h"
+#include "../lib/memory-utils.h"
+#include "../lib/timing-utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+#define DEFAULT_MIN_KB 16
+#define DEFAULT_MAX_KB (16*1024)
+#define DEFAULT_RUNS 5
+#define DEFAULT_DISTANCE 8			/* Lines */
+#define BYTES_PER_RUN (512*1024*1024ULL)	/* Scans of a run: at least this many bytes */
+
+#define LAYOUT_SLICE 0
+#define LAYOUT_NOSLICE 1
+#define NUMBER_LAYOUTS 2
+
+#define OPERATION_READ 0
+#define OPERATION_WRITE 1
+#define NUMBER_OPERATIONS 2
+
+#define NUMBER_WIDTHS 4
+
+static const char *layoutNames[] = {"slice", "noslice", "all"};
+static const char *operationNames[] = {"read", "write", "all"};
+static const int widthBits[] = {64, 128, 256, 512};
+
+/*
+ * Pin program to the input core
+ */
+
+void CorePin(int coreID)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(coreID,&set);
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) < 0) {
+		printf("\nUnable to Set Affinity\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Scans of n lines with one width: reads (sum of all words) or writes, with a prefetch distance lines ahead
+ * (0 -> none). lines has distance more entries, so the prefetches need no bound check.
+ * The words of a line are unrolled, so that every width only differs in its loads and stores.
+ */
+
+/* Not vectorized by the compiler, so that it stays 64-bit wide */
+__attribute__((optimize("no-tree-vectorize")))
+uint64_t Scan64(void **lines, unsigned long long n, int distance, int write) {
+
+	uint64_t acc = 0;
+	unsigned long long i;
+	int k;
+
+	for(i=0;i<n && write;i++) {
+		uint64_t *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 1, 3);
+		}
+#pragma GCC unroll 8
+		for(k=0;k<LINE/8;k++) {
+			line[k] = i;
+		}
+	}
+	for(i=0;i<n && !write;i++) {
+		uint64_t *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 0, 3);
+		}
+#pragma GCC unroll 8
+		for(k=0;k<LINE/8;k++) {
+			acc += line[k];
+		}
+	}
+	return acc;
+}
+
+uint64_t Scan128(void **lines, unsigned long long n, int distance, int write) {
+
+	__m128i acc = _mm_setzero_si128(), value = _mm_set1_epi64x(n);
+	unsigned long long i;
+	int k;
+
+	for(i=0;i<n && write;i++) {
+		__m128i *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 1, 3);
+		}
+#pragma GCC unroll 4
+		for(k=0;k<LINE/16;k++) {
+			_mm_store_si128(line + k, value);
+		}
+	}
+	for(i=0;i<n && !write;i++) {
+		__m128i *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 0, 3);
+		}
+#pragma GCC unroll 4
+		for(k=0;k<LINE/16;k++) {
+			acc = _mm_add_epi64(acc, _mm_load_si128(line + k));
+		}
+	}
+	return _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+}
+
+__attribute__((target("avx2")))
+uint64_t Scan256(void **lines, unsigned long long n, int distance, int write) {
+
+	__m256i acc = _mm256_setzero_si256(), value = _mm256_set1_epi64x(n);
+	uint64_t words[4];
+	unsigned long long i;
+
+	for(i=0;i<n && write;i++) {
+		__m256i *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 1, 3);
+		}
+		_mm256_store_si256(line, value);
+		_mm256_store_si256(line + 1, value);
+	}
+	for(i=0;i<n && !write;i++) {
+		__m256i *line = lines[i];
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 0, 3);
+		}
+		acc = _mm256_add_epi64(acc, _mm256_load_si256(line));
+		acc = _mm256_add_epi64(acc, _mm256_load_si256(line + 1));
+	}
+	_mm256_storeu_si256((__m256i*)words, acc);
+	return words[0] + words[1] + words[2] + words[3];
+}
+
+__attribute__((target("avx512f")))
+uint64_t Scan512(void **lines, unsigned long long n, int distance, int write) {
+
+	__m512i acc = _mm512_setzero_si512(), value = _mm512_set1_epi64(n);
+	unsigned long long i;
+
+	for(i=0;i<n && write;i++) {
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 1, 3);
+		}
+		_mm512_store_si512(lines[i], value);
+	}
+	for(i=0;i<n && !write;i++) {
+		if(distance) {
+			__builtin_prefetch(lines[i+distance], 0, 3);
+		}
+		acc = _mm512_add_epi64(acc, _mm512_load_si512(lines[i]));
+	}
+	return _mm512_reduce_add_epi64(acc);
+}
+
+typedef uint64_t (*scan_fn)(void **lines, unsigned long long n, int distance, int write);
+
+static const scan_fn scans[] = {Scan64, Scan128, Scan256, Scan512};
+
+/*
+ * Widths supported by the CPU
+ */
+
+int Supported(int width) {
+	__builtin_cpu_init();
+	if(widthBits[width]==256) {
+		return __builtin_cpu_supports("avx2");
+	} else if(widthBits[width]==512) {
+		return __builtin_cpu_supports("avx512f");
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+
+	/*
+	 * Check arguments: the layout (slice, noslice or all)
+	 * Options: the core to run on, the smallest and largest working sets in KB, the number of runs,
+	 * the prefetch distance in lines (0 -> no software prefetch) and the operation (read, write or all)
+	 */
+
+	int core=0, runs=DEFAULT_RUNS, distance=DEFAULT_DISTANCE, layout=-1, operation=NUMBER_OPERATIONS, option, wrong=0;
+	unsigned long long minKB=DEFAULT_MIN_KB, maxKB=DEFAULT_MAX_KB;
+	while((option=getopt(argc, argv, "c:m:M:r:p:o:"))!=-1) {
+		if(option=='c') {
+			core=atoi(optarg);
+		} else if(option=='m') {
+			minKB=strtoull(optarg, NULL, 10);
+		} else if(option=='M') {
+			maxKB=strtoull(optarg, NULL, 10);
+		} else if(option=='r') {
+			runs=atoi(optarg);
+		} else if(option=='p') {
+			distance=atoi(optarg);
+		} else if(option=='o') {
+			for(operation=NUMBER_OPERATIONS;operation>=0 && strcmp(optarg, operationNames[operation])!=0;operation--);
+			wrong=(operation<0);
+		} else {
+			wrong=1;
+		}
+	}
+	if(!wrong && argc-optind==1) {
+		for(layout=NUMBER_LAYOUTS;layout>=0 && strcmp(argv[optind], layoutNames[layout])!=0;layout--);
+		wrong=(layout<0);
+	}
+	if(wrong || argc-optind!=1 || core<0 || minKB==0 || maxKB<minKB || runs<1 || distance<0){
+		printf("Wrong Input! The layout should be passed as input!\n");
+		printf("Enter: %s [-c core] [-m min_KB] [-M max_KB] [-r runs] [-p prefetch_distance_lines] [-o read|write|all] <slice|noslice|all>\n", argv[0]);
+		exit(1);
+	}
+
+	CorePin(core);
+	timing_print(stderr);
+
+	/* The largest working set of every layout; the smaller ones are its first lines */
+	unsigned long long nLines=maxKB*1024/LINE, i;
+	void **lines[NUMBER_LAYOUTS];
+	sa_context_t *ctx=NULL;
+	struct buffer buf;
+	int l, error;
+	for(l=0;l<NUMBER_LAYOUTS;l++) {
+		if(layout!=NUMBER_LAYOUTS && layout!=l) {
+			lines[l]=NULL;
+			continue;
+		}
+		if((lines[l]=malloc((nLines+distance)*sizeof(void*)))==NULL) {
+			printf("Failed to allocate the lines\n");
+			exit(1);
+		}
+		if(l==LAYOUT_NOSLICE) {
+			if((error=create_buffer_sized(&buf, nLines*LINE, PAGE_SIZE_AUTO))) {
+				printf("Failed to allocate memory for buffer: %s\n", sa_strerror(error));
+				exit(1);
+			}
+			for(i=0;i<nLines;i++) {
+				lines[l][i]=(char*)buf.addr+i*LINE;
+			}
+		} else {
+			if((error=sa_context_create(&ctx, NULL)) || (error=sa_alloc_lines(ctx, sa_cpu_slice(core), lines[l], nLines))) {
+				printf("Failed to allocate the lines of core %d: %s\n", core, sa_strerror(error));
+				exit(1);
+			}
+		}
+		for(i=0;i<(unsigned long long)distance;i++) {
+			lines[l][nLines+i]=lines[l][i % nLines];
+		}
+		/* Map and touch every line before the measurements */
+		Scan64(lines[l], nLines, 0, 1);
+	}
+
+	int o, w, p, r;
+	unsigned long long kb, n, scan, nScans;
+	uint64_t sum=0, start;
+	printf("layout,operation,size_KB,width_bits,prefetch,mean_GB_per_s,max_GB_per_s\n");
+	for(l=0;l<NUMBER_LAYOUTS;l++) {
+		if(lines[l]==NULL) {
+			continue;
+		}
+		for(o=0;o<NUMBER_OPERATIONS;o++) {
+			if(operation!=NUMBER_OPERATIONS && operation!=o) {
+				continue;
+			}
+			for(kb=minKB;kb<=maxKB;kb*=4) {
+				n=kb*1024/LINE;
+				nScans=(BYTES_PER_RUN+n*LINE-1)/(n*LINE);
+				for(w=0;w<NUMBER_WIDTHS;w++) {
+					if(!Supported(w)) {
+						if(l==0 && o==0 && kb==minKB) {
+							fprintf(stderr, "%d-bit loads and stores are not supported, skipped\n", widthBits[w]);
+						}
+						continue;
+					}
+					for(p=0;p<2;p++) {
+						double mean=0, max=0, gbps;
+						if(p && distance==0) {
+							continue;
+						}
+						/* Warm up the caches with one scan */
+						sum+=scans[w](lines[l], n, p ? distance : 0, o==OPERATION_WRITE);
+						for(r=0;r<runs;r++) {
+							start=timing_start();
+							for(scan=0;scan<nScans;scan++) {
+								sum+=scans[w](lines[l], n, p ? distance : 0, o==OPERATION_WRITE);
+							}
+							gbps=nScans*n*LINE/timing_seconds(timing_cycles(start, timing_stop()))/1e9;
+							mean+=gbps/runs;
+							max=(gbps>max) ? gbps : max;
+						}
+						printf("%s,%s,%llu,%d,%d,%.2f,%.2f\n", layoutNames[l], operationNames[o], kb, widthBits[w],
+							p ? distance : 0, mean, max);
+						fflush(stdout);
+					}
+				}
+			}
+		}
+	}
+	fprintf(stderr, "sum %llu\n", (unsigned long long)sum);
+
+	if(lines[LAYOUT_SLICE]!=NULL) {
+		sa_free_lines(ctx, sa_cpu_slice(core), lines[LAYOUT_SLICE], nLines);
+		sa_context_destroy(ctx);
+	}
+	if(lines[LAYOUT_NOSLICE]!=NULL) {
+		free_buffer_sized(&buf);
+	}
+	free(lines[LAYOUT_SLICE]);
+	free(lines[LAYOUT_NOSLICE]);
+	return 0;
+}
@@ -0,0 +1,15 @@
+/*
+ * Architecture of the target CPU
+ * check_cpu.sh will automatically define the proper architecture (i.e., the HASWELL or SKYLAKE macro below)
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef ARCH_CONFIG_H
+#define ARCH_CONFIG_H
+
+#define HASWELL /* Can be changed to HASWELL or SKYLAKE -> Will be changed automatically by check_cpu.sh */
+#define SKYLAKE_SERVER_MODEL 85
+#define HASWELL_SERVER_MODEL 63
+
+#endif /* ARCH_CONFIG_H */
@@ -0,0 +1,435 @@
+/*
+ * Slice-local arena for objects of arbitrary size (e.g., for C++ allocators)
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena-utils.h"
+
+/*
+ * Initialize an arena that takes its pages from pool and finds the slices with model
+ * msr is only used without a model (SkyLake by default), where slices are found by polling the uncore counters
+ */
+
+void arena_init(struct line_arena *arena, struct hugepage_pool *pool, struct msr_device *msr, const struct hash_model *model) {
+	memset(arena, 0, sizeof(*arena));
+	pthread_mutex_init(&arena->lock, NULL);
+	arena->pool = pool;
+	arena->msr = msr;
+	arena->model = model;
+}
+
+
+/*
+ * Slice of a line
+ * Model of the arena on the physical address, or virtual slice via uncore counters without a model (SkyLake)
+ */
+
+static int arena_line_slice(struct line_arena *arena, void *va, uint64_t pa) {
+	return calculatePlacementSlice(arena->model, arena->msr, va, pa);
+}
+
+
+/*
+ * Size class of a chunk: 0 -> 8 Bytes, 1 -> 16 Bytes, 2 -> 32 Bytes
+ */
+
+static int arena_class(size_t size, size_t alignment) {
+
+	int class = 0;
+	size_t chunk = ARENA_MIN_CHUNK;
+
+	if (alignment > size) {
+		size = alignment;
+	}
+	while (chunk < size) {
+		chunk <<= 1;
+		class++;
+	}
+	return class;
+}
+
+
+/*
+ * Take one page from the pool, find the slice of all its lines and add it to the arena
+ * Must be called with arena->lock held
+ */
+
+static int arena_grow(struct line_arena *arena) {
+
+	unsigned long i, nWords, pos;
+	uint64_t pagePhyAddr = 0;
+	char *page = hugepage_pool_get(arena->pool);
+
+	if (page == NULL) {
+		return SA_ERR_EXHAUSTED;
+	}
+	/* Each page is physically contiguous; the physical address is only needed by the hash model */
+	int error;
+	if (arena->model != NULL && (error = translate_address(page, &pagePhyAddr))) {
+		hugepage_pool_put(arena->pool, page);
+		return error;
+	}
+
+	if (arena->nPages == arena->capacity) {
+		unsigned long capacity = arena->capacity ? 2*arena->capacity : 16;
+		struct arena_page *pages = realloc(arena->pages, capacity*sizeof(*pages));
+		if (pages != NULL) {
+			arena->pages = pages;
+		}
+		unsigned long *order = realloc(arena->order, capacity*sizeof(*order));
+		if (order != NULL) {
+			arena->order = order;
+		}
+		if (pages == NULL || order == NULL) {
+			hugepage_pool_put(arena->pool, page);
+			return SA_ERR_NOMEM;
+		}
+		arena->capacity = capacity;
+	}
+
+	arena->nLinesPerPage = arena->pool->page_size/LINE;
+	nWords = (arena->nLinesPerPage + ARENA_WORD_BITS - 1)/ARENA_WORD_BITS;
+	struct arena_page *p = &arena->pages[arena->nPages];
+	p->addr = page;
+	p->slices = malloc(arena->nLinesPerPage);
+	p->classes = calloc(arena->nLinesPerPage, 1);
+	p->used = calloc(nWords, sizeof(*p->used));
+	if (p->slices == NULL || p->classes == NULL || p->used == NULL) {
+		free(p->slices);
+		free(p->classes);
+		free(p->used);
+		hugepage_pool_put(arena->pool, page);
+		return SA_ERR_NOMEM;
+	}
+	for (i=0; i<arena->nLinesPerPage; i++) {
+		int slice = arena_line_slice(arena, page + i*LINE, pagePhyAddr + i*LINE);
+		if (slice < 0) {
+			free(p->slices);
+			free(p->classes);
+			free(p->used);
+			hugepage_pool_put(arena->pool, page);
+			return slice;
+		}
+		p->slices[i] = slice;
+	}
+
+	/* Keep the order sorted by address for arena_find() */
+	for (pos=arena->nPages; pos>0 && arena->pages[arena->order[pos-1]].addr > page; pos--) {
+		arena->order[pos] = arena->order[pos-1];
+	}
+	arena->order[pos] = arena->nPages++;
+	return SA_OK;
+}
+
+
+/*
+ * Page of the arena containing ptr, or NULL
+ */
+
+static struct arena_page* arena_find(struct line_arena *arena, const void *ptr) {
+
+	unsigned long low = 0, high = arena->nPages;
+	const char *addr = ptr;
+
+	while (low < high) {
+		unsigned long mid = (low + high)/2;
+		struct arena_page *p = &arena->pages[arena->order[mid]];
+		if (addr < p->addr) {
+			high = mid;
+		} else if (addr >= p->addr + arena->pool->page_size) {
+			low = mid + 1;
+		} else {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+
+static inline int arena_line_used(struct arena_page *p, unsigned long line) {
+	return (p->used[line/ARENA_WORD_BITS] >> (line%ARENA_WORD_BITS)) & 1;
+}
+
+static void arena_mark(struct arena_page *p, unsigned long line, unsigned long nLines, int used) {
+
+	unsigned long i;
+
+	for (i=line; i<line+nLines; i++) {
+		if (used) {
+			p->used[i/ARENA_WORD_BITS] |= 1ULL << (i%ARENA_WORD_BITS);
+		} else {
+			p->used[i/ARENA_WORD_BITS] &= ~(1ULL << (i%ARENA_WORD_BITS));
+		}
+	}
+}
+
+
+/*
+ * Find nLines free consecutive lines in a page, the first of which is on the slice and aligned
+ * Returns the first line, or nLinesPerPage if there is none
+ */
+
+static unsigned long arena_scan(struct line_arena *arena, struct arena_page *p, unsigned long first, int slice, unsigned long nLines, size_t alignment) {
+
+	unsigned long i, j;
+
+	for (i=first; i+nLines<=arena->nLinesPerPage; i++) {
+		if (p->slices[i] != slice || arena_line_used(p, i) || ((uintptr_t)(p->addr + i*LINE) & (alignment-1))) {
+			continue;
+		}
+		for (j=1; j<nLines && !arena_line_used(p, i+j); j++);
+		if (j == nLines) {
+			return i;
+		}
+	}
+	return arena->nLinesPerPage;
+}
+
+
+/*
+ * Allocate nLines consecutive lines starting on the slice
+ * Pages after the cursor of the slice are searched first; pages before it are only searched again
+ * once blocks of the slice have been released, otherwise a new page is added.
+ * Must be called with arena->lock held
+ */
+
+static int arena_alloc_lines(struct line_arena *arena, int slice, unsigned long nLines, size_t alignment, void **ptr) {
+
+	struct arena_cursor *c = &arena->cursor[slice];
+	unsigned long page, line, first = c->line;
+	int error;
+
+	for (page=c->page; ; page++) {
+		if (page == arena->nPages) {
+			if (c->nReleased > 0) {
+				/* Wrap around once to reuse released blocks */
+				c->nReleased = 0;
+				page = 0;
+				first = 0;
+			} else if ((error = arena_grow(arena))) {
+				return error;
+			}
+		}
+		struct arena_page *p = &arena->pages[page];
+		line = arena_scan(arena, p, first, slice, nLines, alignment);
+		first = 0;
+		if (line < arena->nLinesPerPage) {
+			arena_mark(p, line, nLines, 1);
+			c->page = page;
+			c->line = line + nLines;
+			*ptr = p->addr + line*LINE;
+			return SA_OK;
+		}
+	}
+}
+
+
+/*
+ * Allocate a block with its own mapping, starting at the first line on the slice
+ * Must be called with arena->lock held
+ */
+
+static int arena_alloc_large(struct line_arena *arena, int slice, unsigned long nLines, size_t alignment, void **ptr) {
+
+	uint64_t offset, pagePhyAddr = 0;
+	int error;
+	struct arena_large large;
+	size_t pageSize = arena->pool->page_size;
+
+	/* The first page has a line on every slice, the rest holds the block */
+	if ((error = create_buffer_sized(&large.buf, nLines*LINE + pageSize, pageSize))) {
+		return error;
+	}
+	if (arena->model != NULL && (error = translate_address(large.buf.addr, &pagePhyAddr))) {
+		free_buffer_sized(&large.buf);
+		return error;
+	}
+	for (offset=0; offset<large.buf.page_size; offset+=LINE) {
+		char *line = (char*)large.buf.addr + offset;
+		if (((uintptr_t)line & (alignment-1)) == 0 && arena_line_slice(arena, line, pagePhyAddr + offset) == slice) {
+			break;
+		}
+	}
+	if (offset == large.buf.page_size) {
+		free_buffer_sized(&large.buf);
+		return SA_ERR_INVALID;
+	}
+	large.block = (char*)large.buf.addr + offset;
+	large.slice = slice;
+
+	if (arena->nLarge == arena->capacityLarge) {
+		unsigned long capacity = arena->capacityLarge ? 2*arena->capacityLarge : 16;
+		struct arena_large *l = realloc(arena->large, capacity*sizeof(*l));
+		if (l == NULL) {
+			free_buffer_sized(&large.buf);
+			return SA_ERR_NOMEM;
+		}
+		arena->large = l;
+		arena->capacityLarge = capacity;
+	}
+	arena->large[arena->nLarge++] = large;
+	*ptr = large.block;
+	return SA_OK;
+}
+
+
+/*
+ * Allocate size bytes on the slice (see arena-utils.h for the layout)
+ * alignment must be a power of two and at most the page size (0 -> natural alignment)
+ */
+
+int arena_alloc(struct line_arena *arena, int slice, size_t size, size_t alignment, void **ptr) {
+
+	int error = SA_OK;
+
+	if (slice < 0 || slice >= NUMBER_VIRTUAL_SLICES || ptr == NULL || (alignment & (alignment-1))) {
+		return SA_ERR_INVALID;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+
+	pthread_mutex_lock(&arena->lock);
+
+	/* The page size is fixed by the first page */
+	if (arena->nPages == 0 && (error = arena_grow(arena))) {
+		pthread_mutex_unlock(&arena->lock);
+		return error;
+	}
+	if (alignment > arena->pool->page_size) {
+		pthread_mutex_unlock(&arena->lock);
+		return SA_ERR_INVALID;
+	}
+
+	if (size <= LINE/2 && alignment <= LINE/2) {
+		/* Small objects share lines of the slice */
+		int class = arena_class(size, alignment);
+		size_t chunk = ARENA_MIN_CHUNK << class;
+		if (arena->chunks[slice][class] == NULL) {
+			char *line;
+			unsigned long i;
+			if ((error = arena_alloc_lines(arena, slice, 1, LINE, (void**)&line))) {
+				pthread_mutex_unlock(&arena->lock);
+				return error;
+			}
+			struct arena_page *p = arena_find(arena, line);
+			p->classes[(line - p->addr)/LINE] = class + 1;
+			for (i=LINE; i>=chunk; i-=chunk) {
+				*(void**)(line + i - chunk) = arena->chunks[slice][class];
+				arena->chunks[slice][class] = line + i - chunk;
+			}
+		}
+		*ptr = arena->chunks[slice][class];
+		arena->chunks[slice][class] = *(void**)*ptr;
+	} else {
+		unsigned long nLines = (size + LINE - 1)/LINE;
+		alignment = (alignment < LINE) ? LINE : alignment;
+		if (nLines > arena->nLinesPerPage/4) {
+			error = arena_alloc_large(arena, slice, nLines, alignment, ptr);
+		} else {
+			error = arena_alloc_lines(arena, slice, nLines, alignment, ptr);
+		}
+	}
+
+	pthread_mutex_unlock(&arena->lock);
+	return error;
+}
+
+
+/*
+ * Give an allocation back to the arena; size must be the one passed to arena_alloc()
+ * Can be called from any thread, the slice is looked up from the address.
+ */
+
+void arena_free(struct line_arena *arena, void *ptr, size_t size) {
+
+	unsigned long i;
+
+	if (ptr == NULL) {
+		return;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+
+	pthread_mutex_lock(&arena->lock);
+
+	struct arena_page *p = arena_find(arena, ptr);
+	if (p == NULL) {
+		for (i=0; i<arena->nLarge; i++) {
+			if (arena->large[i].block == ptr) {
+				free_buffer_sized(&arena->large[i].buf);
+				arena->large[i] = arena->large[--arena->nLarge];
+				break;
+			}
+		}
+		pthread_mutex_unlock(&arena->lock);
+		return;
+	}
+
+	unsigned long line = ((char*)ptr - p->addr)/LINE;
+	int slice = p->slices[line];
+	if (p->classes[line] != 0) {
+		int class = p->classes[line] - 1;
+		*(void**)ptr = arena->chunks[slice][class];
+		arena->chunks[slice][class] = ptr;
+	} else {
+		arena_mark(p, line, (size + LINE - 1)/LINE, 0);
+		arena->cursor[slice].nReleased++;
+	}
+
+	pthread_mutex_unlock(&arena->lock);
+}
+
+
+/*
+ * Slice of an address handed out by the arena, or SA_ERR_INVALID
+ */
+
+int arena_slice_of(struct line_arena *arena, const void *ptr) {
+
+	int slice = SA_ERR_INVALID;
+	unsigned long i;
+
+	pthread_mutex_lock(&arena->lock);
+	struct arena_page *p = arena_find(arena, ptr);
+	if (p != NULL) {
+		slice = p->slices[((const char*)ptr - p->addr)/LINE];
+	} else {
+		for (i=0; i<arena->nLarge; i++) {
+			if (arena->large[i].block == ptr) {
+				slice = arena->large[i].slice;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&arena->lock);
+	return slice;
+}
+
+
+/*
+ * Release the bookkeeping and the large blocks
+ * The pages stay in the pool and are released by hugepage_pool_destroy()
+ */
+
+void arena_destroy(struct line_arena *arena) {
+
+	unsigned long i;
+
+	for (i=0; i<arena->nPages; i++) {
+		free(arena->pages[i].slices);
+		free(arena->pages[i].classes);
+		free(arena->pages[i].used);
+	}
+	for (i=0; i<arena->nLarge; i++) {
+		free_buffer_sized(&arena->large[i].buf);
+	}
+	free(arena->pages);
+	free(arena->order);
+	free(arena->large);
+	pthread_mutex_destroy(&arena->lock);
+}
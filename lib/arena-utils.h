@@ -0,0 +1,76 @@
+/*
+ * Slice-local arena for objects of arbitrary size (e.g., for C++ allocators)
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef ARENA_UTILS_H
+#define ARENA_UTILS_H
+
+#include "memory-utils.h"
+#include "cache-utils.h"
+
+/*
+ * Layout of an allocation of size bytes on slice s:
+ *
+ * - size <= 32: a chunk of the next power of two (at least 8 Bytes) inside a cache line of slice s.
+ *   Lines are split into chunks of one size class and are not given back to the arena.
+ * - 32 < size <= 64: a whole cache line of slice s.
+ * - size > 64: ceil(size/64) consecutive cache lines inside one page, the first of which is on slice s.
+ *   The following lines are mapped by the hash function, i.e., only about 1/NUMBER_SLICES of them are on s,
+ *   so the hot part of an object should be placed in its first 64 Bytes (as CacheDirector does for packet headers).
+ * - Blocks larger than a quarter of a page get their own mapping, whose first line on slice s is handed out.
+ *
+ * Every allocation is aligned to min(size class, 64) Bytes, or to the requested alignment if it is larger (up to a page).
+ */
+
+#define ARENA_MIN_CHUNK 8
+#define ARENA_CLASSES 3					/* Chunks of 8, 16 and 32 Bytes */
+#define ARENA_WORD_BITS 64
+
+/* A page of the arena */
+struct arena_page {
+	char *addr;
+	uint8_t *slices;		/* Slice of each line of the page */
+	uint8_t *classes;		/* Chunk class + 1 of the lines split into chunks, 0 for the other lines */
+	uint64_t *used;			/* Bitmap of the lines that are handed out */
+};
+
+/* A block with its own mapping */
+struct arena_large {
+	void *block;
+	int slice;
+	struct buffer buf;
+};
+
+/* Position of the next search for a slice */
+struct arena_cursor {
+	unsigned long page;
+	unsigned long line;
+	unsigned long nReleased;	/* Blocks of this slice released since the last wrap-around */
+};
+
+struct line_arena {
+	pthread_mutex_t lock;
+	struct hugepage_pool *pool;		/* Pages are taken from this pool */
+	struct msr_device *msr;			/* Used for finding the (virtual) slice on SkyLake */
+	const struct hash_model *model;	/* Model of the slices (NULL -> uncore counters) */
+	unsigned long nLinesPerPage;
+	unsigned long nPages;
+	unsigned long capacity;
+	struct arena_page *pages;		/* In the order they were added */
+	unsigned long *order;			/* Indexes of the pages sorted by address */
+	struct arena_cursor cursor[NUMBER_VIRTUAL_SLICES];
+	void *chunks[NUMBER_VIRTUAL_SLICES][ARENA_CLASSES];	/* Free chunks; the first word of a free chunk points to the next one */
+	struct arena_large *large;
+	unsigned long nLarge;
+	unsigned long capacityLarge;
+};
+
+void arena_init(struct line_arena *arena, struct hugepage_pool *pool, struct msr_device *msr, const struct hash_model *model);
+int arena_alloc(struct line_arena *arena, int slice, size_t size, size_t alignment, void **ptr);
+void arena_free(struct line_arena *arena, void *ptr, size_t size);
+int arena_slice_of(struct line_arena *arena, const void *ptr);
+void arena_destroy(struct line_arena *arena);
+
+#endif /* ARENA_UTILS_H */
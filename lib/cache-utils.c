@@ -5,107 +5,10 @@
  */
 
 #include <inttypes.h>
-#include "msr-utils.c"
-
-/* 
- * Architecture dependent values for LLC hash function
- *
- * Xeon-E5-2667 v3 (Haswell)
- * 8 cores in each socket -> 8 slices (2.5MB)
- * Each physical address will be mapped to a slice by XOR-ing the selected bits
- * The bits in physical_addr will be selected by using a hash_x
- * x=0,1,2
- * Then we will XOR all of those bits
- * Bitx = XOR( and(physical_addr,hash_x))
- * Output slice is the decimal value of: (Bit2.Bit1.Bit0)
- * 
- * Xeon-Gold-6134 (SkyLake Server)
- * 8 cores in each socket and 18 slices per socket (1.375MB)
- * Mapping is not known yet
-*/
-
-/*
- * Haswell hash
- */
-
-/* Number of hash functions/Bits for slices */
-#define bitNum 3
-/* Bit0 hash */
-#define hash_0 0x1B5F575440
-/* Bit1 hash */
-#define hash_1 0x2EB5FAA880
-/* Bit2 hash */
-#define hash_2 0x3CCCC93100
-
-
-/*
- * Cache hierarchy characteristics
- */
-
-/* TODO: Detect and define the values automatically by using data in: "/sys/devices/system/cpu/cpu[n]/cache/..." */
-
-#define LINE  64
-#define L1_SIZE (32UL*1024)
-#define L1_WAYS 8
-#define L1_SETS (L1_SIZE/LINE)/(L1_WAYS)
-
-#define SKYLAKE_LLC_SIZE (24.75*1024*1024UL)
-#define SKYLAKE_LLC_WAYS 11
-#define SKYLAKE_LLC_SETS (LLC_SIZE/LINE)/(LLC_WAYS*NUMBER_SLICES)
-#define SKYLAKE_SLICE_SIZE (LLC_SIZE/(NUMBER_SLICES))
-#define SKYLAKE_L2_SIZE (1UL*1024*1024)
-#define SKYLAKE_L2_WAYS 16
-#define SKYLAKE_L2_SETS (L2_SIZE/LINE)/(L2_WAYS)
-
-#define HASWELL_LLC_SIZE (20UL*1024*1024)
-#define HASWELL_LLC_WAYS 20
-#define HASWELL_LLC_SETS (LLC_SIZE/LINE)/(LLC_WAYS*NUMBER_SLICES)
-#define HASWELL_SLICE_SIZE (LLC_SIZE/(NUMBER_SLICES))
-#define HASWELL_L2_SIZE (256UL*1024)
-#define HASWELL_L2_WAYS 8
-#define HASWELL_L2_SETS (L2_SIZE/LINE)/(L2_WAYS)
-
-/* Set indexes */
-
-#define SKYLAKE_L3_INDEX_PER_SLICE 0x1FFC0 /* 11 bits - [16-6] - 2048 sets per slice + 11 way for each slice (1.375MB) */
-#define SKYLAKE_L2_INDEX 0xFFC0 /* 10 bits - [15-6] - 1024 sets + 16 way for each core  */
-#define SKYLAKE_L1_INDEX 0xFC0 /* 6 bits - [11-6] - 64 sets + 8 way for each core  */
-#define SKYLAKE_L3_INDEX_STRIDE 0x20000 /* Offset required to get the same indexes bit 17 = bit 16 (MSB bit of L3_INDEX_PER_SLICE) + 1 */
-#define SKYLAKE_L2_INDEX_STRIDE 0x10000 /* Offset required to get the same indexes bit 16 = bit 15 (MSB bit of L2_INDEX) + 1 */
-
-#define HASWELL_L3_INDEX_PER_SLICE 0x1FFC0 /* 11 bits - [16-6] - 2048 sets per slice + 20 way for each slice (2.5MB) */
-#define HASWELL_L2_INDEX 0x7FC0 /* 9 bits - [14-6] - 512 sets + 8 way for each core  */
-#define HASWELL_L1_INDEX 0xFC0 /* 6 bits - [11-6] - 64 sets + 8 way for each core  */
-#define HASWELL_L3_INDEX_STRIDE 0x20000 /* Offset required to get the same indexes bit 17 = bit 16 (MSB bit of L3_INDEX_PER_SLICE) + 1 */
-#define HASWELL_L2_INDEX_STRIDE 0x8000 /* Offset required to get the same indexes bit 15 = bit 14 (MSB bit of L2_INDEX) + 1 */
-
-#ifdef SKYLAKE 
-#define L3_INDEX_PER_SLICE SKYLAKE_L3_INDEX_PER_SLICE
-#define L2_INDEX SKYLAKE_L2_INDEX
-#define L1_INDEX SKYLAKE_L1_INDEX
-#define LLC_SIZE SKYLAKE_LLC_SIZE
-#define LLC_WAYS SKYLAKE_LLC_WAYS
-#define LLC_SETS SKYLAKE_LLC_SETS
-#define SLICE_SIZE SKYLAKE_SLICE_SIZE
-#define L2_SIZE SKYLAKE_L2_SIZE
-#define L2_WAYS SKYLAKE_L2_WAYS
-#define L2_SETS SKYLAKE_L2_SETS
-#define L3_INDEX_STRIDE SKYLAKE_L3_INDEX_STRIDE
-#define L2_INDEX_STRIDE SKYLAKE_L2_INDEX_STRIDE
-#else
-#define L3_INDEX_PER_SLICE HASWELL_L3_INDEX_PER_SLICE
-#define L2_INDEX HASWELL_L2_INDEX
-#define L1_INDEX HASWELL_L1_INDEX
-#define LLC_SIZE HASWELL_LLC_SIZE
-#define LLC_WAYS HASWELL_LLC_WAYS
-#define LLC_SETS HASWELL_LLC_SETS
-#define SLICE_SIZE HASWELL_SLICE_SIZE
-#define L2_SIZE HASWELL_L2_SIZE
-#define L2_WAYS HASWELL_L2_WAYS
-#define L2_SETS HASWELL_L2_SETS
-#define L3_INDEX_STRIDE HASWELL_L3_INDEX_STRIDE
-#define L2_INDEX_STRIDE HASWELL_L2_INDEX_STRIDE
-#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache-utils.h"
 
 /* 
  * Function for XOR-ing all bits
@@ -130,20 +33,28 @@ calculateSlice_HF_haswell(uint64_t pa) {
 
 /* Calculate the slice based on a given virtual address - Haswell and SkyLake */
 
-uint8_t
-calculateSlice_uncore(void* va) {
+int
+calculateSlice_uncore(struct msr_device *dev, void* va) {
 	/*
-	 * The registers' address and their values would be selected in msr-utils.c
-	 * check_cpu.sh will automatically define the proper architecture (i.e., #define HASWELL or #define SKYLAKE).
+	 * The registers' address and their values would be selected in msr-utils.h
+	 * check_cpu.sh will automatically define the proper architecture (i.e., #define HASWELL or #define SKYLAKE) in arch-config.h.
+	 * The counters are shared by all threads, so the whole session holds the lock of the device.
 	 */
-	uncore_init();
-	polling(va);
-	return find_CHA_CBO();
+	int slice;
+
+	pthread_mutex_lock(&dev->lock);
+	slice = uncore_init(dev);
+	if (slice == SA_OK) {
+		polling(va);
+		slice = find_CHA_CBO(dev);
+	}
+	pthread_mutex_unlock(&dev->lock);
+	return slice;
 }
 
 
 /* 
- * Calculate virtual slice based on the virtual address - SkyLake 
+ * Virtual slice of a slice, and virtual slice based on the virtual address - SkyLake 
  * Since SkyLake has 18 slices and 8 cores, we tag every slice with a number between 0 to 7, which represent the virtual slice
  * The mapping with virtual slice number and number of cores is similar to Haswell architecture, i.e., slice ith is the closest to core ith.
  * The mapping for virtual slices is as follows:
@@ -157,10 +68,9 @@ calculateSlice_uncore(void* va) {
  * VS7 -> S15/S17
  */
 
-uint8_t
-calculateVirtualSlice_uncore(void* va) {
-	uint8_t slice = calculateSlice_uncore(va);
-	uint8_t virtualSlice=0;
+int
+virtualSlice(int slice) {
+	int virtualSlice=0;
 
 	if (slice==0 || slice ==2 || slice==6){
 		virtualSlice=0;
@@ -183,6 +93,15 @@ calculateVirtualSlice_uncore(void* va) {
 	return virtualSlice;
 }
 
+int
+calculateVirtualSlice_uncore(struct msr_device *dev, void* va) {
+	int slice = calculateSlice_uncore(dev, va);
+	if (slice < 0) {
+		return slice;
+	}
+	return virtualSlice(slice);
+}
+
 /* Find the next chunk that is mapped to the input slice number - with Haswell hash function */
 
 uint64_t
@@ -197,14 +116,18 @@ sliceFinder_HF_haswell(uint64_t pa, uint8_t desiredSlice) {
 
 /* Find the next chunk that is mapped to the input slice number - with Haswell/Skylake uncore performance counters */
 
-uint64_t
-sliceFinder_uncore(void* va, uint8_t desiredSlice) {
-	uint64_t offset=0;
-	while(desiredSlice!=calculateSlice_uncore(va+offset)) {
+int
+sliceFinder_uncore(struct msr_device *dev, void* va, uint8_t desiredSlice, uint64_t *offset) {
+	int slice;
+	*offset=0;
+	while(desiredSlice!=(slice=calculateSlice_uncore(dev, va+*offset))) {
+		if (slice < 0) {
+			return slice;
+		}
 		/* Slice mapping will change for each cacheline which is 64 Bytes */
-		offset+=LINE;
+		*offset+=LINE;
 	}
-	return offset;
+	return SA_OK;
 }
 
 
@@ -221,15 +144,19 @@ sliceFinder_uncore(void* va, uint8_t desiredSlice) {
  * C7 -> VS7 -> S15/S17
  */
 
-uint64_t
-virtualSliceFinder_uncore(void* va, uint8_t desiredVirtualSlice) {
-	uint64_t offset=0;
+int
+virtualSliceFinder_uncore(struct msr_device *dev, void* va, uint8_t desiredVirtualSlice, uint64_t *offset) {
+	int slice;
+	*offset=0;
 
-	while(desiredVirtualSlice!=calculateVirtualSlice_uncore(va+offset)) {
+	while(desiredVirtualSlice!=(slice=calculateVirtualSlice_uncore(dev, va+*offset))) {
+		if (slice < 0) {
+			return slice;
+		}
 		/* Slice mapping will change for each cacheline which is 64 Bytes */
-		offset+=LINE;
+		*offset+=LINE;
 	}
-	return offset;
+	return SA_OK;
 }
 
 
@@ -257,7 +184,243 @@ indexCalculator(uint64_t addr_in, int cacheLevel) {
 	}
 	else
 	{
-		exit(EXIT_FAILURE);
+		index=INDEX_INVALID;
 	}
 	return index;
 }
+
+
+/* Built-in model of Xeon-E5-2667 v3 (Haswell): the hash_0/1/2 masks, 8 slices */
+
+static const struct hash_model haswellModel = {
+	.name = "Xeon E5-2667 v3 (Haswell)",
+	.nBits = bitNum,
+	.masks = {hash_0, hash_1, hash_2},
+	.nSlices = 8,
+};
+
+/* Model used by calculateSlice_HF() and for placement; the hash function of SkyLake is not known by default */
+
+#ifdef SKYLAKE
+#define DEFAULT_HASH_MODEL NULL
+#else
+#define DEFAULT_HASH_MODEL (&haswellModel)
+#endif
+
+static const struct hash_model *activeModel = DEFAULT_HASH_MODEL;
+
+/* Nothing but blanks after a value of a model file */
+
+static int
+hash_model_blank(const char *p) {
+	return p[strspn(p, " \t\r\n")] == '\0';
+}
+
+void
+hash_model_haswell(struct hash_model *m) {
+	*m = haswellModel;
+}
+
+/* 
+ * Load a model file: one keyword per line, '#' starts a comment
+ * name <text> | slices <n> | mask <hex> (one per output bit, bit 0 first) | lut <n0> <n1> ... | virtual <v0> <v1> ...
+ */
+
+int
+hash_model_load(struct hash_model *m, const char *path) {
+
+	char line[HASH_LINE_LENGTH];
+	int i, nVirtual=0, error=SA_OK;
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	memset(m, 0, sizeof(*m));
+
+	while (error == SA_OK && fgets(line, sizeof(line), file) != NULL) {
+		char keyword[16], *p = line, *end;
+		int consumed;
+		if (strchr(line, '#') != NULL) {
+			*strchr(line, '#') = '\0';
+		}
+		if (sscanf(p, "%15s%n", keyword, &consumed) != 1) {
+			continue;
+		}
+		p += consumed;
+		if (strcmp(keyword, "name") == 0) {
+			p += strspn(p, " \t");
+			p[strcspn(p, "\r\n")] = '\0';
+			snprintf(m->name, sizeof(m->name), "%s", p);
+		} else if (strcmp(keyword, "slices") == 0) {
+			m->nSlices = strtol(p, &end, 0);
+			if (end == p || !hash_model_blank(end)) {
+				error = SA_ERR_INVALID;
+			}
+		} else if (strcmp(keyword, "mask") == 0) {
+			if (m->nBits == HASH_MAX_BITS) {
+				error = SA_ERR_INVALID;
+				break;
+			}
+			m->masks[m->nBits++] = strtoull(p, &end, 0);
+			if (end == p || !hash_model_blank(end)) {
+				error = SA_ERR_INVALID;
+			}
+		} else if (strcmp(keyword, "lut") == 0 || strcmp(keyword, "virtual") == 0) {
+			int isLut = (keyword[0] == 'l'), n = 0;
+			long value;
+			while ((value = strtol(p, &end, 0)), end != p) {
+				if (n == (isLut ? (1 << HASH_MAX_BITS) : HASH_MAX_SLICES) || value < 0 || value > 255) {
+					error = SA_ERR_INVALID;
+					break;
+				}
+				if (isLut) {
+					m->lut[n++] = value;
+				} else {
+					m->virtualSlices[n++] = value;
+				}
+				p = end;
+			}
+			if (n == 0 || !hash_model_blank(p)) {
+				error = SA_ERR_INVALID;
+			}
+			if (isLut) {
+				m->lutSize = n;
+			} else {
+				nVirtual = n;
+				m->hasVirtual = 1;
+			}
+		} else {
+			error = SA_ERR_INVALID;
+		}
+	}
+	fclose(file);
+	if (error) {
+		return error;
+	}
+
+	/* The output has to cover the slices, through the lookup table if there is one */
+	if (m->nBits == 0 || m->nSlices <= 0 || m->nSlices > HASH_MAX_SLICES) {
+		return SA_ERR_INVALID;
+	}
+	if (m->lutSize == 0 && (1 << m->nBits) != m->nSlices) {
+		return SA_ERR_INVALID;
+	}
+	if (m->lutSize != 0 && m->lutSize != (1 << m->nBits)) {
+		return SA_ERR_INVALID;
+	}
+	for (i=0; i<m->lutSize; i++) {
+		if (m->lut[i] >= m->nSlices) {
+			return SA_ERR_INVALID;
+		}
+	}
+	if (m->hasVirtual && nVirtual != m->nSlices) {
+		return SA_ERR_INVALID;
+	}
+	return SA_OK;
+}
+
+/* Slice of a physical address with a model */
+
+int
+hash_model_slice(const struct hash_model *m, uint64_t pa) {
+	int i, output=0;
+	for (i=0; i<m->nBits; i++) {
+		output |= rte_xorall64(pa&m->masks[i]) << i;
+	}
+	return m->lutSize ? m->lut[output] : output;
+}
+
+int
+hash_model_virtual_slice(const struct hash_model *m, uint64_t pa) {
+	int slice = hash_model_slice(m, pa);
+	return m->hasVirtual ? m->virtualSlices[slice] : slice;
+}
+
+/* 
+ * Find the next chunk that is mapped to the input slice number - with a model
+ * Fails if the slice does not appear within HASH_FINDER_LIMIT Bytes (e.g., a slice that the model cannot produce)
+ */
+
+int
+hash_model_finder(const struct hash_model *m, uint64_t pa, int desiredSlice, uint64_t *offset) {
+	if (desiredSlice < 0 || desiredSlice >= m->nSlices) {
+		return SA_ERR_INVALID;
+	}
+	for (*offset=0; *offset<HASH_FINDER_LIMIT; *offset+=LINE) {
+		if (desiredSlice == hash_model_slice(m, pa+*offset)) {
+			return SA_OK;
+		}
+	}
+	return SA_ERR_INVALID;
+}
+
+/* 
+ * Use a model for calculateSlice_HF() and placement (NULL -> back to the default of the architecture)
+ * The model must stay valid while it is used and should be set before other threads allocate memory.
+ */
+
+int
+hash_model_use(const struct hash_model *m) {
+	int error;
+	if (m == NULL) {
+		m = DEFAULT_HASH_MODEL;
+	} else if ((error = hash_model_check(m))) {
+		return error;
+	}
+	__atomic_store_n(&activeModel, m, __ATOMIC_RELEASE);
+	return SA_OK;
+}
+
+/* Check that a model can be used for placement: every slice maps to one of the virtual slices */
+
+int
+hash_model_check(const struct hash_model *m) {
+	int i;
+	for (i=0; i<m->nSlices; i++) {
+		if ((m->hasVirtual ? m->virtualSlices[i] : i) >= NUMBER_VIRTUAL_SLICES) {
+			return SA_ERR_INVALID;
+		}
+	}
+	return SA_OK;
+}
+
+const struct hash_model*
+hash_model_active(void) {
+	return __atomic_load_n(&activeModel, __ATOMIC_ACQUIRE);
+}
+
+/* Calculate slice based on the physical address - active model (same as calculateSlice_HF_haswell() by default on Haswell) */
+
+int
+calculateSlice_HF(uint64_t pa) {
+	const struct hash_model *m = hash_model_active();
+	if (m == NULL) {
+		return SA_ERR_INVALID;
+	}
+	return hash_model_slice(m, pa);
+}
+
+/* Find the next chunk that is mapped to the input slice number - active model */
+
+int
+sliceFinder_HF(uint64_t pa, uint8_t desiredSlice, uint64_t *offset) {
+	const struct hash_model *m = hash_model_active();
+	if (m == NULL) {
+		return SA_ERR_INVALID;
+	}
+	return hash_model_finder(m, pa, desiredSlice, offset);
+}
+
+/* 
+ * Slice used for placing a line: virtual slice from a model (e.g., the model of a context or hash_model_active()),
+ * or from the uncore counters without a model (SkyLake by default)
+ */
+
+int
+calculatePlacementSlice(const struct hash_model *m, struct msr_device *dev, void *va, uint64_t pa) {
+	if (m != NULL) {
+		return hash_model_virtual_slice(m, pa);
+	}
+	return calculateVirtualSlice_uncore(dev, va);
+}
@@ -0,0 +1,181 @@
+/* 
+ * LLC-slice-related functions for calculating the slice number and finding the appropriate offset
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef CACHE_UTILS_H
+#define CACHE_UTILS_H
+
+#include <inttypes.h>
+#include "msr-utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 
+ * Architecture dependent values for LLC hash function
+ *
+ * Xeon-E5-2667 v3 (Haswell)
+ * 8 cores in each socket -> 8 slices (2.5MB)
+ * Each physical address will be mapped to a slice by XOR-ing the selected bits
+ * The bits in physical_addr will be selected by using a hash_x
+ * x=0,1,2
+ * Then we will XOR all of those bits
+ * Bitx = XOR( and(physical_addr,hash_x))
+ * Output slice is the decimal value of: (Bit2.Bit1.Bit0)
+ * 
+ * Xeon-Gold-6134 (SkyLake Server)
+ * 8 cores in each socket and 18 slices per socket (1.375MB)
+ * Mapping is not known yet
+*/
+
+/*
+ * Haswell hash
+ */
+
+/* Number of hash functions/Bits for slices */
+#define bitNum 3
+/* Bit0 hash */
+#define hash_0 0x1B5F575440
+/* Bit1 hash */
+#define hash_1 0x2EB5FAA880
+/* Bit2 hash */
+#define hash_2 0x3CCCC93100
+
+
+/*
+ * Cache hierarchy characteristics
+ */
+
+/* TODO: Detect and define the values automatically by using data in: "/sys/devices/system/cpu/cpu[n]/cache/..." */
+
+#define LINE  64
+#define L1_SIZE (32UL*1024)
+#define L1_WAYS 8
+#define L1_SETS (L1_SIZE/LINE)/(L1_WAYS)
+
+#define SKYLAKE_LLC_SIZE (24.75*1024*1024UL)
+#define SKYLAKE_LLC_WAYS 11
+#define SKYLAKE_LLC_SETS (LLC_SIZE/LINE)/(LLC_WAYS*NUMBER_SLICES)
+#define SKYLAKE_SLICE_SIZE (LLC_SIZE/(NUMBER_SLICES))
+#define SKYLAKE_L2_SIZE (1UL*1024*1024)
+#define SKYLAKE_L2_WAYS 16
+#define SKYLAKE_L2_SETS (L2_SIZE/LINE)/(L2_WAYS)
+
+#define HASWELL_LLC_SIZE (20UL*1024*1024)
+#define HASWELL_LLC_WAYS 20
+#define HASWELL_LLC_SETS (LLC_SIZE/LINE)/(LLC_WAYS*NUMBER_SLICES)
+#define HASWELL_SLICE_SIZE (LLC_SIZE/(NUMBER_SLICES))
+#define HASWELL_L2_SIZE (256UL*1024)
+#define HASWELL_L2_WAYS 8
+#define HASWELL_L2_SETS (L2_SIZE/LINE)/(L2_WAYS)
+
+/* Set indexes */
+
+#define SKYLAKE_L3_INDEX_PER_SLICE 0x1FFC0 /* 11 bits - [16-6] - 2048 sets per slice + 11 way for each slice (1.375MB) */
+#define SKYLAKE_L2_INDEX 0xFFC0 /* 10 bits - [15-6] - 1024 sets + 16 way for each core  */
+#define SKYLAKE_L1_INDEX 0xFC0 /* 6 bits - [11-6] - 64 sets + 8 way for each core  */
+#define SKYLAKE_L3_INDEX_STRIDE 0x20000 /* Offset required to get the same indexes bit 17 = bit 16 (MSB bit of L3_INDEX_PER_SLICE) + 1 */
+#define SKYLAKE_L2_INDEX_STRIDE 0x10000 /* Offset required to get the same indexes bit 16 = bit 15 (MSB bit of L2_INDEX) + 1 */
+
+#define HASWELL_L3_INDEX_PER_SLICE 0x1FFC0 /* 11 bits - [16-6] - 2048 sets per slice + 20 way for each slice (2.5MB) */
+#define HASWELL_L2_INDEX 0x7FC0 /* 9 bits - [14-6] - 512 sets + 8 way for each core  */
+#define HASWELL_L1_INDEX 0xFC0 /* 6 bits - [11-6] - 64 sets + 8 way for each core  */
+#define HASWELL_L3_INDEX_STRIDE 0x20000 /* Offset required to get the same indexes bit 17 = bit 16 (MSB bit of L3_INDEX_PER_SLICE) + 1 */
+#define HASWELL_L2_INDEX_STRIDE 0x8000 /* Offset required to get the same indexes bit 15 = bit 14 (MSB bit of L2_INDEX) + 1 */
+
+#ifdef SKYLAKE 
+#define L3_INDEX_PER_SLICE SKYLAKE_L3_INDEX_PER_SLICE
+#define L2_INDEX SKYLAKE_L2_INDEX
+#define L1_INDEX SKYLAKE_L1_INDEX
+#define LLC_SIZE SKYLAKE_LLC_SIZE
+#define LLC_WAYS SKYLAKE_LLC_WAYS
+#define LLC_SETS SKYLAKE_LLC_SETS
+#define SLICE_SIZE SKYLAKE_SLICE_SIZE
+#define L2_SIZE SKYLAKE_L2_SIZE
+#define L2_WAYS SKYLAKE_L2_WAYS
+#define L2_SETS SKYLAKE_L2_SETS
+#define L3_INDEX_STRIDE SKYLAKE_L3_INDEX_STRIDE
+#define L2_INDEX_STRIDE SKYLAKE_L2_INDEX_STRIDE
+#else
+#define L3_INDEX_PER_SLICE HASWELL_L3_INDEX_PER_SLICE
+#define L2_INDEX HASWELL_L2_INDEX
+#define L1_INDEX HASWELL_L1_INDEX
+#define LLC_SIZE HASWELL_LLC_SIZE
+#define LLC_WAYS HASWELL_LLC_WAYS
+#define LLC_SETS HASWELL_LLC_SETS
+#define SLICE_SIZE HASWELL_SLICE_SIZE
+#define L2_SIZE HASWELL_L2_SIZE
+#define L2_WAYS HASWELL_L2_WAYS
+#define L2_SETS HASWELL_L2_SETS
+#define L3_INDEX_STRIDE HASWELL_L3_INDEX_STRIDE
+#define L2_INDEX_STRIDE HASWELL_L2_INDEX_STRIDE
+#endif
+
+/*
+ * Number of slices used for placement
+ * SkyLake: 8 virtual slices (one per core), each being a group of physical slices; Haswell: one slice per core
+ */
+#ifdef SKYLAKE
+#define NUMBER_VIRTUAL_SLICES 8
+#else
+#define NUMBER_VIRTUAL_SLICES NUMBER_SLICES
+#endif
+
+/*
+ * Generic hash model
+ * Output bit i is parity(pa & masks[i]). The nBits-bit output is the slice itself or, when the number of slices
+ * is not a power of two (e.g., 18-slice SkyLake-SP), an index in a lookup table giving the physical slice.
+ * virtualSlices (optional) maps every slice to the virtual slice used for placement (i.e., the core it is closest to).
+ * Models are loaded from a file (see other/haswell-e5-2667v3.model for the format).
+ */
+
+#define HASH_MAX_BITS 8
+#define HASH_MAX_SLICES 64
+#define HASH_NAME_LENGTH 64
+#define HASH_LINE_LENGTH 4096
+#define HASH_FINDER_LIMIT (2UL*1024*1024)	/* Lines searched by hash_model_finder(): one 2MB page */
+
+struct hash_model {
+	char name[HASH_NAME_LENGTH];
+	int nBits;
+	uint64_t masks[HASH_MAX_BITS];
+	int nSlices;
+	int lutSize;							/* 0 -> no lookup table */
+	uint8_t lut[1 << HASH_MAX_BITS];
+	int hasVirtual;
+	uint8_t virtualSlices[HASH_MAX_SLICES];
+};
+
+/* Returned by indexCalculator() for an unknown cache level */
+#define INDEX_INVALID UINT64_MAX
+
+uint64_t rte_xorall64(uint64_t ma);
+uint8_t calculateSlice_HF_haswell(uint64_t pa);
+int calculateSlice_uncore(struct msr_device *dev, void* va);
+int virtualSlice(int slice);
+int calculateVirtualSlice_uncore(struct msr_device *dev, void* va);
+uint64_t sliceFinder_HF_haswell(uint64_t pa, uint8_t desiredSlice);
+int sliceFinder_uncore(struct msr_device *dev, void* va, uint8_t desiredSlice, uint64_t *offset);
+int virtualSliceFinder_uncore(struct msr_device *dev, void* va, uint8_t desiredVirtualSlice, uint64_t *offset);
+uint64_t indexCalculator(uint64_t addr_in, int cacheLevel);
+
+void hash_model_haswell(struct hash_model *m);
+int hash_model_load(struct hash_model *m, const char *path);
+int hash_model_slice(const struct hash_model *m, uint64_t pa);
+int hash_model_virtual_slice(const struct hash_model *m, uint64_t pa);
+int hash_model_finder(const struct hash_model *m, uint64_t pa, int desiredSlice, uint64_t *offset);
+int hash_model_use(const struct hash_model *m);
+int hash_model_check(const struct hash_model *m);
+const struct hash_model* hash_model_active(void);
+int calculateSlice_HF(uint64_t pa);
+int sliceFinder_HF(uint64_t pa, uint8_t desiredSlice, uint64_t *offset);
+int calculatePlacementSlice(const struct hash_model *m, struct msr_device *dev, void *va, uint64_t pa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHE_UTILS_H */
@@ -0,0 +1,268 @@
+/*
+ * Cache Allocation Technology (CAT) configuration through resctrl, combined with slice-aware allocation
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "cat-utils.h"
+
+/* Root of the resctrl filesystem, set once at startup */
+static char cat_root[CAT_ROOT_LENGTH] = CAT_DEFAULT_ROOT;
+
+
+/*
+ * Set the root of the resctrl filesystem (default: /sys/fs/resctrl)
+ */
+
+void cat_set_root(const char *root) {
+	snprintf(cat_root, sizeof(cat_root), "%s", root);
+}
+
+
+/*
+ * Write a string to <root>/<group>/<file>
+ */
+
+static int cat_write(const char *group, const char *file, const char *value) {
+
+	char path[CAT_PATH_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s/%s", cat_root, group, file);
+
+	FILE *fileptr = fopen(path, "w");
+	if (fileptr == NULL) {
+		return SA_ERR_RESCTRL;
+	}
+	/* resctrl reports invalid values when the file is written (i.e., flushed) */
+	if (fputs(value, fileptr) == EOF || fclose(fileptr) == EOF) {
+		return SA_ERR_RESCTRL;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Read a hexadecimal or decimal value from <root>/info/L3/<file>
+ */
+
+static int cat_read_info(const char *file, const char *format, unsigned long long *value) {
+
+	char path[CAT_PATH_LENGTH];
+	snprintf(path, sizeof(path), "%s/info/L3/%s", cat_root, file);
+
+	FILE *fileptr = fopen(path, "r");
+	if (fileptr == NULL) {
+		return SA_ERR_RESCTRL;
+	}
+	int ok = (fscanf(fileptr, format, value) == 1);
+	fclose(fileptr);
+	return ok ? SA_OK : SA_ERR_RESCTRL;
+}
+
+
+/*
+ * Check whether a ways mask can be used: contiguous, within cbm_mask and at least min_cbm_bits wide
+ * Returns SA_OK if valid, SA_ERR_INVALID otherwise
+ */
+
+int cat_check_mask(uint64_t mask) {
+
+	unsigned long long cbmMask, minBits = 1;
+
+	if (cat_read_info("cbm_mask", "%llx", &cbmMask)) {
+		return SA_ERR_RESCTRL;
+	}
+	cat_read_info("min_cbm_bits", "%llu", &minBits);
+
+	if (mask == 0 || (mask & ~cbmMask) != 0) {
+		return SA_ERR_INVALID;
+	}
+	/* Intel CAT requires the set bits to be contiguous */
+	uint64_t shifted = mask >> __builtin_ctzll(mask);
+	if ((shifted & (shifted + 1)) != 0) {
+		return SA_ERR_INVALID;
+	}
+	if ((unsigned long long)__builtin_popcountll(mask) < minBits) {
+		return SA_ERR_INVALID;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Split the ways among nWorkers workers, waysPerWorker ways each, starting from the lowest way
+ * As in CAT-manual.txt, a worker can also get more ways by passing its own mask to cat_worker_init()
+ * Returns SA_OK, or SA_ERR_INVALID if there are no workers or not enough ways
+ */
+
+int cat_split_ways(int nWorkers, int waysPerWorker, uint64_t *masks) {
+
+	unsigned long long cbmMask;
+	int i;
+
+	if (cat_read_info("cbm_mask", "%llx", &cbmMask)) {
+		return SA_ERR_RESCTRL;
+	}
+	if (nWorkers <= 0 || waysPerWorker <= 0 || masks == NULL || nWorkers*waysPerWorker > __builtin_popcountll(cbmMask)) {
+		return SA_ERR_INVALID;
+	}
+
+	uint64_t workerMask = (1ULL << waysPerWorker) - 1;
+	for (i=0; i<nWorkers; i++) {
+		masks[i] = workerMask << (i*waysPerWorker + __builtin_ctzll(cbmMask));
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Create a resctrl group (i.e., a class of service); it is fine if it already exists
+ */
+
+int cat_create_group(const char *group) {
+
+	char path[CAT_PATH_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s", cat_root, group);
+
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		return SA_ERR_RESCTRL;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Remove a resctrl group; its tasks and CPUs go back to the default group
+ */
+
+int cat_remove_group(const char *group) {
+
+	char path[CAT_PATH_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s", cat_root, group);
+
+	if (rmdir(path)) {
+		return SA_ERR_RESCTRL;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Give the ways in mask of the L3 cache cacheID to the group
+ */
+
+int cat_set_ways(const char *group, int cacheID, uint64_t mask) {
+
+	char value[64];
+	int error;
+
+	if ((error = cat_check_mask(mask))) {
+		return error;
+	}
+	snprintf(value, sizeof(value), "L3:%d=%"PRIx64"\n", cacheID, mask);
+	return cat_write(group, "schemata", value);
+}
+
+
+/*
+ * Make a CPU use the group by default
+ */
+
+int cat_assign_cpu(const char *group, int coreID) {
+
+	char value[16];
+	snprintf(value, sizeof(value), "%d\n", coreID);
+	return cat_write(group, "cpus_list", value);
+}
+
+
+/*
+ * Move a thread (TID) to the group; 0 moves the calling thread
+ */
+
+int cat_assign_task(const char *group, pid_t tid) {
+
+	char value[16];
+
+	if (tid == 0) {
+		tid = syscall(SYS_gettid);
+	}
+	snprintf(value, sizeof(value), "%d\n", (int)tid);
+	return cat_write(group, "tasks", value);
+}
+
+
+/*
+ * Describe a worker pinned to coreID whose data should be placed in the given slice
+ * The worker's group is named "sliceaware-core<coreID>"
+ */
+
+void cat_worker_init(struct cat_worker *w, int coreID, uint8_t slice, int cacheID, uint64_t waysMask) {
+
+	w->coreID = coreID;
+	w->slice = slice;
+	w->cacheID = cacheID;
+	w->waysMask = waysMask;
+	snprintf(w->group, sizeof(w->group), CAT_GROUP_PREFIX"%d", coreID);
+	w->ca = NULL;
+	w->tenant = COLOR_NO_TENANT;
+}
+
+
+/*
+ * Set up the class of service of the worker
+ * Should be called by the worker thread after pinning, so that the thread itself is moved to the group
+ */
+
+int cat_worker_apply(struct cat_worker *w) {
+
+	int error;
+
+	if ((error = cat_create_group(w->group)) ||
+		(error = cat_set_ways(w->group, w->cacheID, w->waysMask)) ||
+		(error = cat_assign_cpu(w->group, w->coreID)) ||
+		(error = cat_assign_task(w->group, 0))) {
+		return error;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Let the worker allocate lines from nSets L3 sets of its slice
+ * (L3_SETS_PER_SLICE -> the whole slice)
+ * Returns SA_OK, or SA_ERR_INVALID if the slice does not have nSets sets left
+ */
+
+int cat_worker_attach(struct cat_worker *w, struct color_allocator *ca, uint64_t nSets) {
+
+	w->tenant = color_add_tenant(ca, w->slice, nSets);
+	if (w->tenant == COLOR_NO_TENANT) {
+		return SA_ERR_INVALID;
+	}
+	w->ca = ca;
+	return SA_OK;
+}
+
+
+/*
+ * Allocate nLines lines of the worker's slice/sets
+ * Returns the number of allocated lines
+ */
+
+unsigned long long cat_worker_alloc_lines(struct cat_worker *w, void **lines, unsigned long long nLines) {
+	return color_alloc_lines(w->ca, w->tenant, lines, nLines, NULL);
+}
+
+
+/*
+ * Remove the worker's group
+ */
+
+int cat_worker_release(struct cat_worker *w) {
+	return cat_remove_group(w->group);
+}
@@ -0,0 +1,62 @@
+/*
+ * Cache Allocation Technology (CAT) configuration through resctrl, combined with slice-aware allocation
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef CAT_UTILS_H
+#define CAT_UTILS_H
+
+#include <sys/types.h>
+#include "coloring-utils.h"
+
+/*
+ * This is the programmatic version of the pqos commands in "other/CAT-manual.txt".
+ * Each pinned worker gets its own resctrl group (i.e., class of service) with a set of LLC ways,
+ * and its data is placed in its own slice (optionally in its own L3 sets) by the coloring allocator.
+ * CAT limits the ways that a worker can fill in every slice, while slice-aware allocation
+ * keeps the worker's data in the slice closest to its core.
+ *
+ * resctrl layout (see Documentation/x86/resctrl in the kernel):
+ * <root>/info/L3/cbm_mask		-> Ways that can be used, e.g., fffff
+ * <root>/info/L3/min_cbm_bits	-> Minimum number of ways in a mask
+ * <root>/<group>/schemata		-> e.g., "L3:0=3" gives ways 0-1 of cache 0 (socket 0) to the group
+ * <root>/<group>/cpus_list		-> CPUs that use the group by default
+ * <root>/<group>/tasks			-> Threads (TIDs) that use the group
+ * The root can be changed with cat_set_root(), e.g., to use a mock directory tree for testing (apps/cat_check.c).
+ *
+ * Functions return SA_OK, SA_ERR_INVALID for an unusable mask, or SA_ERR_RESCTRL (errno tells why).
+ */
+
+#define CAT_DEFAULT_ROOT "/sys/fs/resctrl"
+#define CAT_ROOT_LENGTH 256
+#define CAT_PATH_LENGTH 512
+#define CAT_GROUP_LENGTH 64
+#define CAT_GROUP_PREFIX "sliceaware-core"
+
+/* A pinned worker and its isolation */
+struct cat_worker {
+	int coreID;						/* Core that the worker is pinned to */
+	uint8_t slice;					/* Slice for the worker's data (virtual slice on SkyLake) */
+	int cacheID;					/* L3 cache (socket) of the core */
+	uint64_t waysMask;				/* LLC ways of the worker's class of service */
+	char group[CAT_GROUP_LENGTH];	/* Name of the resctrl group */
+	struct color_allocator *ca;		/* Allocator of the worker's lines (NULL if not attached) */
+	int tenant;						/* Tenant of the worker in ca */
+};
+
+void cat_set_root(const char *root);
+int cat_check_mask(uint64_t mask);
+int cat_split_ways(int nWorkers, int waysPerWorker, uint64_t *masks);
+int cat_create_group(const char *group);
+int cat_remove_group(const char *group);
+int cat_set_ways(const char *group, int cacheID, uint64_t mask);
+int cat_assign_cpu(const char *group, int coreID);
+int cat_assign_task(const char *group, pid_t tid);
+void cat_worker_init(struct cat_worker *w, int coreID, uint8_t slice, int cacheID, uint64_t waysMask);
+int cat_worker_apply(struct cat_worker *w);
+int cat_worker_attach(struct cat_worker *w, struct color_allocator *ca, uint64_t nSets);
+unsigned long long cat_worker_alloc_lines(struct cat_worker *w, void **lines, unsigned long long nLines);
+int cat_worker_release(struct cat_worker *w);
+
+#endif /* CAT_UTILS_H */
@@ -1,6 +1,6 @@
 # 
 # Check CPU Model
-# define a proper pragma in 'msr-utils.c' accordingly
+# define a proper pragma in 'arch-config.h' accordingly
 #
 # Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology
 #
@@ -11,7 +11,7 @@ cpu_vendor=`lscpu | grep "Vendor ID:" | awk '{print $3}'`
 cpu_model=`lscpu | grep "Model:" | awk '{print $2}'`
 skylake_config_line="#define SKYLAKE"
 haswell_config_line="#define HASWELL"
-config_file="../lib/msr-utils.c"
+config_file="../lib/arch-config.h"
 
 #Load msr module
 `sudo modprobe msr`
@@ -29,16 +29,16 @@ if [ $cpu_model -ge 85 ]
 then
 	#SkyLake
 	echo "SkyLake is found! Model is $cpu_model"
-	skylake_found=$(grep -E "$skylake_config_line\b" $config_file)
+	skylake_found=$(grep -E "^$skylake_config_line\b" $config_file)
 	if [[ -z $skylake_found ]]; then
 		#If not found
-		sed -i "s/$haswell_config_line /$skylake_config_line /g" $config_file
+		sed -i "s/^$haswell_config_line /$skylake_config_line /" $config_file
 	fi
 else
 	#Haswell
 	echo "Haswell or older Intel CPU is found! Model is $cpu_model"
-	haswell_found=$(grep -E "$haswell_config_line\b" $config_file)
+	haswell_found=$(grep -E "^$haswell_config_line\b" $config_file)
 	if [[ -z $haswell_found ]]; then
-		sed -i "s/$skylake_config_line /$haswell_config_line /g" $config_file
+		sed -i "s/^$skylake_config_line /$haswell_config_line /" $config_file
 	fi
 fi
@@ -0,0 +1,306 @@
+/*
+ * Slice + set-index coloring allocator for partitioning the LLC among cores/tenants in software
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include "coloring-utils.h"
+
+/*
+ * Initialize a coloring allocator that takes its pages from pool and finds the slices with model
+ * msr is only used without a model (SkyLake by default), where slices are found by polling the uncore counters
+ */
+
+int color_allocator_init(struct color_allocator *ca, struct hugepage_pool *pool, struct msr_device *msr,
+	const struct hash_model *model, int maxTenants) {
+
+	unsigned long i;
+
+	ca->tenants = calloc(maxTenants, sizeof(*ca->tenants));
+	ca->owner = malloc(NUMBER_SLICES*L3_SETS_PER_SLICE*sizeof(*ca->owner));
+	if (ca->tenants == NULL || ca->owner == NULL) {
+		free(ca->tenants);
+		free(ca->owner);
+		return SA_ERR_NOMEM;
+	}
+	pthread_mutex_init(&ca->lock, NULL);
+	ca->pool = pool;
+	ca->msr = msr;
+	ca->model = model;
+	ca->nTenants = 0;
+	ca->maxTenants = maxTenants;
+	for (i=0; i<NUMBER_SLICES*L3_SETS_PER_SLICE; i++) {
+		ca->owner[i] = COLOR_NO_TENANT;
+	}
+	ca->nPages = 0;
+	return SA_OK;
+}
+
+
+/*
+ * Add a tenant owning nSets L3 sets of the given slice
+ * The sets are the first ones in the slice that are not owned by another tenant
+ * Returns the tenant ID, or COLOR_NO_TENANT if the slice does not have nSets free sets
+ */
+
+int color_add_tenant(struct color_allocator *ca, uint8_t slice, uint64_t nSets) {
+
+	uint64_t firstSet = 0, i;
+	int tenant;
+
+	if (slice >= NUMBER_SLICES || nSets == 0 || nSets > L3_SETS_PER_SLICE) {
+		return COLOR_NO_TENANT;
+	}
+
+	pthread_mutex_lock(&ca->lock);
+
+	/* Partitions in a slice are allocated back to back */
+	for (tenant=0; tenant<ca->nTenants; tenant++) {
+		struct color_tenant *t = &ca->tenants[tenant];
+		if (t->slice == slice && t->firstSet + t->nSets > firstSet) {
+			firstSet = t->firstSet + t->nSets;
+		}
+	}
+	if (ca->nTenants == ca->maxTenants || firstSet + nSets > L3_SETS_PER_SLICE) {
+		pthread_mutex_unlock(&ca->lock);
+		return COLOR_NO_TENANT;
+	}
+
+	tenant = ca->nTenants++;
+	struct color_tenant *t = &ca->tenants[tenant];
+	t->slice = slice;
+	t->firstSet = firstSet;
+	t->nSets = nSets;
+	t->nextSet = 0;
+	t->nAllocated = 0;
+	t->sets = calloc(nSets, sizeof(*t->sets));
+	if (t->sets == NULL) {
+		ca->nTenants--;
+		pthread_mutex_unlock(&ca->lock);
+		return COLOR_NO_TENANT;
+	}
+	for (i=0; i<nSets; i++) {
+		ca->owner[slice*L3_SETS_PER_SLICE + firstSet + i] = tenant;
+	}
+
+	pthread_mutex_unlock(&ca->lock);
+	return tenant;
+}
+
+
+/*
+ * Slice of a line, as used for the partitions
+ * Model of the allocator on the physical address, or virtual slice via uncore counters without a model (SkyLake)
+ * Returns the slice or an error code
+ */
+
+int color_slice(struct color_allocator *ca, void *va, uint64_t pa) {
+	return calculatePlacementSlice(ca->model, ca->msr, va, pa);
+}
+
+
+/*
+ * L3 set index (within the slice) of a line
+ */
+
+uint64_t color_set_index(struct color_allocator *ca, void *va) {
+	if (ca->pool->page_size >= L3_INDEX_STRIDE) {
+		/* The page covers all set-index bits, so the virtual address can be used */
+		return indexCalculator((uint64_t)va, 3);
+	}
+	return indexCalculator(get_physical_address(va), 3);
+}
+
+
+/*
+ * Push a free line to the list of its set
+ */
+
+static int color_set_push(struct color_set *set, void *line) {
+	if (set->nLines == set->capacity) {
+		unsigned long capacity = set->capacity ? 2*set->capacity : 64;
+		void **lines = realloc(set->lines, capacity*sizeof(*set->lines));
+		if (lines == NULL) {
+			return SA_ERR_NOMEM;
+		}
+		set->lines = lines;
+		set->capacity = capacity;
+	}
+	set->lines[set->nLines++] = line;
+	return SA_OK;
+}
+
+
+/*
+ * Take one page from the pool and distribute its lines among the tenants
+ * Returns SA_OK, SA_ERR_EXHAUSTED if the pool cannot provide more pages, or another error code
+ * Must be called with ca->lock held. With a hash model, the lock is released while the page is classified,
+ * so that other threads can allocate and classify their own pages meanwhile; the uncore counters
+ * (no model) are one resource per socket, so polling them stays under the lock.
+ */
+
+static int color_classify_page(struct color_allocator *ca) {
+
+	uint64_t offset, pagePhyAddr;
+	unsigned long i, nLines;
+	int slice, error = SA_OK, unlocked = (ca->model != NULL);
+	uint8_t *slices;
+	void *page = hugepage_pool_get(ca->pool);
+
+	if (page == NULL) {
+		return SA_ERR_EXHAUSTED;
+	}
+	/* The size is known once the pool has its first page (it may fall back to smaller pages) */
+	nLines = ca->pool->page_size/LINE;
+	slices = malloc(nLines);
+	if (slices == NULL) {
+		hugepage_pool_put(ca->pool, page);
+		return SA_ERR_NOMEM;
+	}
+
+	if (unlocked) {
+		pthread_mutex_unlock(&ca->lock);
+	}
+	/* Each page is physically contiguous */
+	if ((error = translate_address(page, &pagePhyAddr)) == SA_OK) {
+		for (i=0; i<nLines; i++) {
+			if ((slice = color_slice(ca, page+i*LINE, pagePhyAddr+i*LINE)) < 0) {
+				error = slice;
+				break;
+			}
+			slices[i] = slice;
+		}
+	}
+	if (unlocked) {
+		pthread_mutex_lock(&ca->lock);
+	}
+	if (error) {
+		free(slices);
+		hugepage_pool_put(ca->pool, page);
+		return error;
+	}
+
+	/* Publish the lines; the partitions are read under the lock, as tenants may have been added meanwhile */
+	for (i=0; i<nLines; i++) {
+		offset = i*LINE;
+		uint64_t set = indexCalculator(pagePhyAddr + offset, 3);
+		int tenant = ca->owner[slices[i]*L3_SETS_PER_SLICE + set];
+		if (tenant == COLOR_NO_TENANT) {
+			continue;
+		}
+		struct color_tenant *t = &ca->tenants[tenant];
+		if ((error = color_set_push(&t->sets[set - t->firstSet], page+offset))) {
+			/* The lines that are already distributed stay valid, the rest of the page is lost */
+			free(slices);
+			return error;
+		}
+	}
+	free(slices);
+	ca->nPages++;
+	return SA_OK;
+}
+
+
+/*
+ * Allocate one line (64 Bytes) from the partition of the tenant
+ * Consecutive allocations use consecutive sets of the partition
+ * Returns NULL if the pool cannot provide more pages (or lines cannot be classified); the reason is stored in
+ * *error if error is not NULL
+ */
+
+void* color_alloc_line(struct color_allocator *ca, int tenant, int *error) {
+
+	void *line = NULL;
+	struct color_tenant *t = &ca->tenants[tenant];
+
+	pthread_mutex_lock(&ca->lock);
+
+	struct color_set *set;
+	int classifyError;
+	/* The lock may be released while a page is classified, so the set is looked up again */
+	while ((set = &t->sets[t->nextSet])->nLines == 0) {
+		if ((classifyError = color_classify_page(ca))) {
+			pthread_mutex_unlock(&ca->lock);
+			if (error != NULL) {
+				*error = classifyError;
+			}
+			return NULL;
+		}
+	}
+	line = set->lines[--set->nLines];
+	t->nextSet = (t->nextSet + 1) % t->nSets;
+	t->nAllocated++;
+
+	pthread_mutex_unlock(&ca->lock);
+	return line;
+}
+
+
+/*
+ * Allocate nLines lines for the tenant, spread evenly over its sets
+ * Returns the number of lines allocated, which is less than nLines only if the pool is exhausted
+ * (or lines cannot be classified); the reason is then stored in *error if error is not NULL
+ */
+
+unsigned long long color_alloc_lines(struct color_allocator *ca, int tenant, void **lines, unsigned long long nLines,
+	int *error) {
+
+	unsigned long long i;
+
+	for (i=0; i<nLines; i++) {
+		lines[i] = color_alloc_line(ca, tenant, error);
+		if (lines[i] == NULL) {
+			break;
+		}
+	}
+	return i;
+}
+
+
+/*
+ * Give a line back to the partition of the tenant
+ */
+
+void color_free_line(struct color_allocator *ca, int tenant, void *line) {
+
+	struct color_tenant *t = &ca->tenants[tenant];
+	uint64_t set = color_set_index(ca, line);
+
+	pthread_mutex_lock(&ca->lock);
+	/* The set list had room for this line when it was allocated */
+	color_set_push(&t->sets[set - t->firstSet], line);
+	t->nAllocated--;
+	pthread_mutex_unlock(&ca->lock);
+}
+
+
+/*
+ * Maximum number of lines of a tenant that fit in the LLC without conflict misses
+ */
+
+unsigned long long color_tenant_capacity(struct color_allocator *ca, int tenant) {
+	return ca->tenants[tenant].nSets*LLC_WAYS;
+}
+
+
+/*
+ * Free the bookkeeping of the allocator
+ * The pages stay in the pool and are released by hugepage_pool_destroy()
+ */
+
+void color_allocator_destroy(struct color_allocator *ca) {
+
+	int tenant;
+	uint64_t i;
+
+	for (tenant=0; tenant<ca->nTenants; tenant++) {
+		for (i=0; i<ca->tenants[tenant].nSets; i++) {
+			free(ca->tenants[tenant].sets[i].lines);
+		}
+		free(ca->tenants[tenant].sets);
+	}
+	free(ca->tenants);
+	free(ca->owner);
+	pthread_mutex_destroy(&ca->lock);
+}
@@ -0,0 +1,73 @@
+/*
+ * Slice + set-index coloring allocator for partitioning the LLC among cores/tenants in software
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef COLORING_UTILS_H
+#define COLORING_UTILS_H
+
+#include "memory-utils.h"
+#include "cache-utils.h"
+
+/*
+ * Every cache line has a color: (slice, L3 set index within the slice).
+ * Each tenant (e.g., a core) owns one slice and a range of L3 sets in that slice,
+ * and ranges of tenants sharing a slice never overlap, so tenants cannot evict each other's lines.
+ *
+ * Lines are carved from the pages of a hugepage pool. With 2MB/1GB-pages, bits [16-6] of the virtual
+ * and physical addresses are the same, so the set index of a line is known without reading pagemap.
+ * With 4KB-pages, the set index depends on the page frame and pagemap is used instead.
+ *
+ * Allocations rotate over the sets of the partition, so N lines are spread evenly over the sets
+ * and up to nSets*LLC_WAYS lines can be cached without conflict misses.
+ *
+ * Note: a tenant owning nSets sets of one slice receives about nSets/(L3_SETS_PER_SLICE*NUMBER_SLICES)
+ * of every page; the rest of the page goes to the other tenants or is left unused.
+ */
+
+#define L3_SETS_PER_SLICE ((L3_INDEX_PER_SLICE >> 6) + 1)	/* 2048 sets per slice */
+#define COLOR_NO_TENANT -1
+
+/* Free lines of one L3 set */
+struct color_set {
+	void **lines;
+	unsigned long nLines;
+	unsigned long capacity;
+};
+
+/* Partition of a tenant */
+struct color_tenant {
+	uint8_t slice;				/* Slice of the tenant (virtual slice on SkyLake) */
+	uint64_t firstSet;			/* First L3 set of the partition */
+	uint64_t nSets;				/* Number of L3 sets in the partition */
+	uint64_t nextSet;			/* Set used for the next allocation (round-robin) */
+	struct color_set *sets;		/* Free lines for each set of the partition */
+	unsigned long long nAllocated;	/* Number of lines handed out */
+};
+
+struct color_allocator {
+	pthread_mutex_t lock;
+	struct hugepage_pool *pool;		/* Pages are taken from this pool */
+	struct msr_device *msr;			/* Used for finding the (virtual) slice on SkyLake */
+	const struct hash_model *model;	/* Model of the slices (NULL -> uncore counters) */
+	int nTenants;
+	int maxTenants;
+	struct color_tenant *tenants;
+	int *owner;						/* Tenant of each (slice, set), or COLOR_NO_TENANT */
+	unsigned long nPages;			/* Number of pages classified so far */
+};
+
+int color_allocator_init(struct color_allocator *ca, struct hugepage_pool *pool, struct msr_device *msr,
+	const struct hash_model *model, int maxTenants);
+int color_add_tenant(struct color_allocator *ca, uint8_t slice, uint64_t nSets);
+int color_slice(struct color_allocator *ca, void *va, uint64_t pa);
+uint64_t color_set_index(struct color_allocator *ca, void *va);
+void* color_alloc_line(struct color_allocator *ca, int tenant, int *error);
+unsigned long long color_alloc_lines(struct color_allocator *ca, int tenant, void **lines, unsigned long long nLines,
+	int *error);
+void color_free_line(struct color_allocator *ca, int tenant, void *line);
+unsigned long long color_tenant_capacity(struct color_allocator *ca, int tenant);
+void color_allocator_destroy(struct color_allocator *ca);
+
+#endif /* COLORING_UTILS_H */
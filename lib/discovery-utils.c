@@ -0,0 +1,165 @@
+/*
+ * Incremental discovery of slice-local lines in background threads
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "discovery-utils.h"
+
+/*
+ * Fill the lists of a range, one batch per list at a time
+ */
+
+static void* discovery_loop(void *arg) {
+
+	struct discovery_thread *t = arg;
+	struct discovery *d = t->d;
+	int i, remaining = 1, error = SA_OK;
+
+	while (remaining && error == SA_OK && !__atomic_load_n(&d->stop, __ATOMIC_ACQUIRE)) {
+		remaining = 0;
+		for (i=t->first; i<=t->last && error == SA_OK; i++) {
+			struct line_list *list = &d->lists[i];
+			unsigned long nReady = list->nReady, n = list->nLines - nReady;
+			if (n == 0) {
+				continue;
+			}
+			if (n > d->batch) {
+				n = d->batch;
+			}
+			if ((error = sa_alloc_lines(d->ctx, list->slice, list->lines + nReady, n))) {
+				break;
+			}
+			__atomic_store_n(&list->nReady, nReady + n, __ATOMIC_RELEASE);
+			remaining |= (nReady + n < list->nLines);
+
+			pthread_mutex_lock(&d->lock);
+			pthread_cond_broadcast(&d->progress);
+			pthread_mutex_unlock(&d->lock);
+		}
+	}
+
+	pthread_mutex_lock(&d->lock);
+	if (error && d->error == SA_OK) {
+		d->error = error;
+	}
+	d->nRunning--;
+	pthread_cond_broadcast(&d->progress);
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+
+/*
+ * Start discovering the lines of the lists with nThreads threads, batch lines per list at a time
+ * nReady of the lists must be 0 (or the number of lines already there)
+ */
+
+int discovery_start(struct discovery *d, sa_context_t *ctx, struct line_list *lists, int nLists, int nThreads, unsigned long batch) {
+
+	int i;
+
+	memset(d, 0, sizeof(*d));
+	if (nLists <= 0 || nThreads <= 0 || batch == 0) {
+		return SA_ERR_INVALID;
+	}
+	if (nThreads > nLists) {
+		nThreads = nLists;
+	}
+	d->ctx = ctx;
+	d->lists = lists;
+	d->nLists = nLists;
+	d->batch = batch;
+	d->threads = calloc(nThreads, sizeof(*d->threads));
+	if (d->threads == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->progress, NULL);
+
+	for (i=0; i<nThreads; i++) {
+		struct discovery_thread *t = &d->threads[i];
+		t->d = d;
+		t->first = i*nLists/nThreads;
+		t->last = (i+1)*nLists/nThreads - 1;
+		pthread_mutex_lock(&d->lock);
+		d->nRunning++;
+		pthread_mutex_unlock(&d->lock);
+		if (pthread_create(&t->thread, NULL, discovery_loop, t)) {
+			pthread_mutex_lock(&d->lock);
+			d->nRunning--;
+			pthread_mutex_unlock(&d->lock);
+			discovery_destroy(d);
+			return SA_ERR_NOMEM;
+		}
+		d->nThreads++;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Number of lines of a list that can be used (they stay valid and in place while more are added)
+ */
+
+unsigned long discovery_ready(const struct line_list *list) {
+	return __atomic_load_n(&list->nReady, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+ * Wait until at least nLines lines of a list are ready
+ * Returns SA_OK, or the error of the discovery if the lines will never be ready
+ */
+
+int discovery_wait(struct discovery *d, const struct line_list *list, unsigned long nLines) {
+
+	int error = SA_OK;
+
+	if (nLines > list->nLines) {
+		return SA_ERR_INVALID;
+	}
+	pthread_mutex_lock(&d->lock);
+	while (discovery_ready(list) < nLines && d->nRunning > 0 && d->error == SA_OK) {
+		pthread_cond_wait(&d->progress, &d->lock);
+	}
+	if (discovery_ready(list) < nLines) {
+		error = (d->error != SA_OK) ? d->error : SA_ERR_EXHAUSTED;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return error;
+}
+
+
+/*
+ * Wait until all the lists are complete
+ * Returns SA_OK or the first error of the threads
+ */
+
+int discovery_join(struct discovery *d) {
+
+	int i;
+
+	for (i=0; i<d->nThreads; i++) {
+		pthread_join(d->threads[i].thread, NULL);
+	}
+	d->nThreads = 0;
+	return d->error;
+}
+
+
+/*
+ * Stop discovering (the batches being allocated are finished) and free the threads
+ * The lines published so far stay allocated in the context.
+ */
+
+void discovery_destroy(struct discovery *d) {
+	__atomic_store_n(&d->stop, 1, __ATOMIC_RELEASE);
+	discovery_join(d);
+	free(d->threads);
+	d->threads = NULL;
+	pthread_mutex_destroy(&d->lock);
+	pthread_cond_destroy(&d->progress);
+}
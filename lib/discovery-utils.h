@@ -0,0 +1,66 @@
+/*
+ * Incremental discovery of slice-local lines in background threads
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DISCOVERY_UTILS_H
+#define DISCOVERY_UTILS_H
+
+#include <pthread.h>
+#include "sliceaware.h"
+
+/*
+ * Every list (e.g., the working set of a core) is filled with lines of its slice by background threads,
+ * one batch at a time, and the lines are published as soon as a batch is ready. Consumers start once
+ * their first batch is ready and grow their working set by reading discovery_ready() again, so the time
+ * to the first operation depends on the batch size and not on the total size.
+ *
+ * The lists are split into contiguous ranges, one per thread (e.g., per socket), and a thread serves
+ * the lists of its range round-robin, so they all grow at the same pace. All threads use the same context,
+ * i.e., every page is still classified once and its lines feed all the slices. With a hash model, every thread
+ * classifies its own page outside the lock of the context and only holds the lock to publish the lines
+ * (see color_classify_page()), so the threads classify pages in parallel. Without a model (uncore polling),
+ * pages are classified one at a time and more threads do not speed up the discovery.
+ *
+ * On SkyLake without a hash model, pages are classified by polling the uncore counters, which also count
+ * the accesses of the workload running at the same time, so some lines may end up on a wrong slice.
+ */
+
+struct line_list {
+	int slice;
+	void **lines;				/* Room for nLines lines */
+	unsigned long nLines;		/* Lines to discover */
+	unsigned long nReady;		/* Lines published so far (read with discovery_ready()) */
+};
+
+struct discovery;
+
+struct discovery_thread {
+	struct discovery *d;
+	pthread_t thread;
+	int first;					/* Range of the lists of the thread */
+	int last;
+};
+
+struct discovery {
+	sa_context_t *ctx;
+	struct line_list *lists;
+	int nLists;
+	unsigned long batch;
+	int nThreads;
+	struct discovery_thread *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t progress;	/* Signaled when a batch is published or a thread is finished */
+	int nRunning;
+	int error;					/* First error of the threads */
+	int stop;
+};
+
+int discovery_start(struct discovery *d, sa_context_t *ctx, struct line_list *lists, int nLists, int nThreads, unsigned long batch);
+unsigned long discovery_ready(const struct line_list *list);
+int discovery_wait(struct discovery *d, const struct line_list *list, unsigned long nLines);
+int discovery_join(struct discovery *d);
+void discovery_destroy(struct discovery *d);
+
+#endif /* DISCOVERY_UTILS_H */
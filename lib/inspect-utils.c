@@ -0,0 +1,268 @@
+/*
+ * Slice introspection: the distribution of existing memory (ranges or objects) over the slices
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "inspect-utils.h"
+#include "memory-utils.h"
+
+#define INSPECT_PRESENT (1ULL << 63)
+#define INSPECT_PFN_MASK 0x7FFFFFFFFFFFFFULL
+#define INSPECT_PATH_LENGTH 64
+#define INSPECT_LINE_LENGTH 4096
+
+/* Hash output bits of a physical address (before the lookup table) */
+static inline int inspect_bits(const struct hash_model *m, uint64_t pa) {
+	int i, output = 0;
+	for (i=0; i<m->nBits; i++) {
+		output |= rte_xorall64(pa & m->masks[i]) << i;
+	}
+	return output;
+}
+
+/* Placement slice of hash output bits */
+static inline int inspect_slice(const struct hash_model *m, int bits) {
+	int slice = m->lutSize ? m->lut[bits] : bits;
+	return m->hasVirtual ? m->virtualSlices[slice] : slice;
+}
+
+
+/*
+ * Inspector of a process (pid 0 -> the calling process) with a hash model (NULL -> the active model)
+ * Returns SA_OK, SA_ERR_INVALID if there is no model (e.g., SkyLake without a model file), or SA_ERR_PAGEMAP
+ */
+
+int inspect_init(struct inspector *in, pid_t pid, const struct hash_model *model) {
+
+	char path[INSPECT_PATH_LENGTH];
+	int l, slice;
+
+	memset(in, 0, sizeof(*in));
+	in->fd = -1;
+	if (model == NULL && (model = hash_model_active()) == NULL) {
+		return SA_ERR_INVALID;
+	}
+	in->model = *model;
+	in->nSlices = 0;
+	for (slice=0; slice<model->nSlices; slice++) {
+		int placement = model->hasVirtual ? model->virtualSlices[slice] : slice;
+		if (placement >= HASH_MAX_SLICES) {
+			return SA_ERR_INVALID;
+		}
+		if (placement + 1 > in->nSlices) {
+			in->nSlices = placement + 1;
+		}
+	}
+	for (l=0; l<INSPECT_LINES_PER_PAGE; l++) {
+		in->offsetBits[l] = inspect_bits(model, (uint64_t)l * LINE);
+	}
+
+	if (pid == 0) {
+		snprintf(path, sizeof(path), "/proc/self/pagemap");
+	} else {
+		snprintf(path, sizeof(path), "/proc/%d/pagemap", (int)pid);
+	}
+	if ((in->fd = open(path, O_RDONLY)) < 0) {
+		return SA_ERR_PAGEMAP;
+	}
+	return SA_OK;
+}
+
+
+void inspect_destroy(struct inspector *in) {
+	if (in->fd >= 0) {
+		close(in->fd);
+	}
+	in->fd = -1;
+}
+
+
+void inspect_stats_init(const struct inspector *in, struct inspect_stats *st) {
+	memset(st, 0, sizeof(*st));
+	st->nSlices = in->nSlices;
+}
+
+
+/*
+ * Pagemap entry of a virtual page, from the cache or with a batched read
+ * Returns SA_OK, or SA_ERR_PAGEMAP if the entry cannot be read
+ */
+
+static int inspect_entry(struct inspector *in, uint64_t page, uint64_t *entry) {
+
+	ssize_t n;
+
+	if (page < in->first || page >= in->first + in->nEntries) {
+		n = pread(in->fd, in->entries, sizeof(in->entries), page * PAGEMAP_LENGTH);
+		in->nReads++;
+		if (n < PAGEMAP_LENGTH) {
+			in->nEntries = 0;
+			return SA_ERR_PAGEMAP;
+		}
+		in->first = page;
+		in->nEntries = n / PAGEMAP_LENGTH;
+	}
+	*entry = in->entries[page - in->first];
+	return SA_OK;
+}
+
+
+/*
+ * Count the lines of [va, va+size) with the cached pagemap entries
+ */
+
+static int inspect_lines(struct inspector *in, uint64_t va, size_t size, struct inspect_stats *st) {
+
+	uint64_t line = va / LINE, end = (va + size + LINE - 1) / LINE, page, entry;
+	int error, bits, l, first, last;
+
+	while (line < end) {
+		page = line / INSPECT_LINES_PER_PAGE;
+		first = line % INSPECT_LINES_PER_PAGE;
+		last = (end - page * INSPECT_LINES_PER_PAGE < INSPECT_LINES_PER_PAGE) ?
+			(int)(end - page * INSPECT_LINES_PER_PAGE) : INSPECT_LINES_PER_PAGE;
+		line += last - first;
+
+		if ((error = inspect_entry(in, page, &entry))) {
+			return error;
+		}
+		if (!(entry & INSPECT_PRESENT)) {
+			st->nUnmapped += last - first;
+			continue;
+		}
+		if ((entry & INSPECT_PFN_MASK) == 0) {
+			return SA_ERR_PAGEMAP;
+		}
+
+		/* One hash per page; the lines only differ in the bits of their offset */
+		bits = inspect_bits(&in->model, (entry & INSPECT_PFN_MASK) << PAGE_SHIFT);
+		for (l=first; l<last; l++) {
+			st->lines[inspect_slice(&in->model, bits ^ in->offsetBits[l])]++;
+		}
+		st->nLines += last - first;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Count the lines of [va, va+size) on every slice
+ * Returns SA_OK, or SA_ERR_PAGEMAP if the pagemap cannot be read or hides the frames (not root)
+ */
+
+int inspect_range(struct inspector *in, uint64_t va, size_t size, struct inspect_stats *st) {
+	/* Pages may have been faulted in or moved since the last call */
+	in->nEntries = 0;
+	return inspect_lines(in, va, size, st);
+}
+
+
+/* By address, so that the pagemap entries are read in order */
+static int inspect_compare(const void *a, const void *b) {
+	const struct inspect_object *x = a, *y = b;
+	return (x->address > y->address) - (x->address < y->address);
+}
+
+
+/*
+ * Count the lines of objects (sorted by address in place)
+ */
+
+int inspect_objects(struct inspector *in, struct inspect_object *objects, size_t n, struct inspect_stats *st) {
+
+	size_t i;
+	int error;
+
+	in->nEntries = 0;
+	qsort(objects, n, sizeof(*objects), inspect_compare);
+	for (i=0; i<n; i++) {
+		if ((error = inspect_lines(in, objects[i].address, objects[i].size ? objects[i].size : 1, st))) {
+			return error;
+		}
+		st->nObjects++;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Count the lines of the mappings of a process (pid 0 -> the calling process) whose path is name
+ * (e.g., "[heap]"; "" -> anonymous mappings; NULL -> all mappings)
+ * Returns the number of mappings, SA_ERR_IO if the maps cannot be read or an error of inspect_range()
+ */
+
+int inspect_mappings(struct inspector *in, pid_t pid, const char *name, struct inspect_stats *st) {
+
+	char path[INSPECT_PATH_LENGTH], line[INSPECT_LINE_LENGTH];
+	unsigned long long start, end;
+	FILE *file;
+	int nMappings = 0, error, offset;
+
+	if (pid == 0) {
+		snprintf(path, sizeof(path), "/proc/self/maps");
+	} else {
+		snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+	}
+	if ((file = fopen(path, "r")) == NULL) {
+		return SA_ERR_IO;
+	}
+	in->nEntries = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *mapping;
+		/* start-end perms offset dev inode [path] */
+		if (sscanf(line, "%llx-%llx %*s %*s %*s %*s %n", &start, &end, &offset) != 2) {
+			continue;
+		}
+		mapping = line + offset;
+		mapping[strcspn(mapping, "\n")] = '\0';
+		/* The vsyscall page lies beyond the range of the pagemap */
+		if ((name != NULL && strcmp(mapping, name) != 0) || strcmp(mapping, "[vsyscall]") == 0) {
+			continue;
+		}
+		if ((error = inspect_lines(in, start, end - start, st))) {
+			fclose(file);
+			return error;
+		}
+		nMappings++;
+	}
+	fclose(file);
+	return nMappings;
+}
+
+
+/*
+ * Lines per slice and, with a latency table, the mean latency from a core compared with all lines on its slice
+ */
+
+void inspect_print(FILE *file, const char *label, const struct inspect_stats *st, const struct latency_table *table,
+	int core) {
+
+	double latency = 0;
+	int slice;
+
+	fprintf(file, "%s: %llu lines (%llu KB)", label, st->nLines, st->nLines * LINE / 1024);
+	if (st->nObjects) {
+		fprintf(file, " of %llu objects", st->nObjects);
+	}
+	fprintf(file, ", %llu lines not present\n", st->nUnmapped);
+	for (slice=0; slice<st->nSlices; slice++) {
+		fprintf(file, "%s: slice %d: %llu lines (%.2f%%)\n", label, slice, st->lines[slice],
+			st->nLines ? 100.0 * st->lines[slice] / st->nLines : 0);
+	}
+	if (table == NULL || st->nLines == 0 || core < 0 || core >= table->nCores || core >= st->nSlices) {
+		return;
+	}
+
+	for (slice=0; slice<st->nSlices && slice<table->nSlices; slice++) {
+		latency += table->latency[core][slice] * st->lines[slice];
+	}
+	latency /= st->nLines;
+	fprintf(file, "%s: core %d: %.2f%% of the lines on its slice, mean latency %.2f (%.2f if all were on its slice)\n",
+		label, core, 100.0 * st->lines[core] / st->nLines, latency, table->latency[core][core]);
+}
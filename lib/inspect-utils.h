@@ -0,0 +1,70 @@
+/*
+ * Slice introspection: the distribution of existing memory (ranges or objects) over the slices
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef INSPECT_UTILS_H
+#define INSPECT_UTILS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "cache-utils.h"
+#include "latency-utils.h"
+
+/*
+ * An inspector counts the cache lines of virtual ranges of a process (itself by default) per slice, e.g.,
+ * to see how far the layout of existing data structures is from slice-local before changing it.
+ *
+ * - Pagemap reads are batched and cached: the entries of INSPECT_BATCH consecutive pages are read with one
+ *   pread() and kept, so ranges and sorted object addresses cost one system call per INSPECT_BATCH pages.
+ * - Hashing is batched per page: output bit i of the hash is parity(pa & masks[i]), which is the XOR of the
+ *   parities of the frame and of the offset in the page, so the 64 lines of a page cost one hash of the frame
+ *   and a lookup in a table of the 64 offsets.
+ *
+ * Lines are counted on their placement slice (the virtual slice of the model, if it has virtual slices), i.e., the
+ * slice numbering of sa_cpu_slice(). Lines of pages that are not present (never touched or swapped out)
+ * are counted as unmapped. Reading the frames of a process requires root (CAP_SYS_ADMIN).
+ */
+
+#define INSPECT_BATCH 512				/* Pagemap entries per read (one 4KB block) */
+#define INSPECT_PAGE_SIZE 4096
+#define INSPECT_LINES_PER_PAGE (INSPECT_PAGE_SIZE/LINE)
+
+struct inspect_stats {
+	int nSlices;
+	unsigned long long lines[HASH_MAX_SLICES];	/* Lines on every slice */
+	unsigned long long nLines;				/* Lines on a slice */
+	unsigned long long nUnmapped;			/* Lines of pages that are not present */
+	unsigned long long nObjects;
+};
+
+/* An object of a heap dump: size 0 -> only its first line */
+struct inspect_object {
+	uint64_t address;
+	uint64_t size;
+};
+
+struct inspector {
+	struct hash_model model;
+	int nSlices;
+	int fd;									/* pagemap of the process */
+	uint8_t offsetBits[INSPECT_LINES_PER_PAGE];	/* Hash output of every line offset in a page */
+	uint64_t entries[INSPECT_BATCH];		/* Cached pagemap entries of pages first..first+nEntries-1 */
+	uint64_t first;
+	size_t nEntries;
+	unsigned long long nReads;				/* pread() calls so far */
+};
+
+int inspect_init(struct inspector *in, pid_t pid, const struct hash_model *model);
+void inspect_destroy(struct inspector *in);
+void inspect_stats_init(const struct inspector *in, struct inspect_stats *st);
+
+int inspect_range(struct inspector *in, uint64_t va, size_t size, struct inspect_stats *st);
+int inspect_objects(struct inspector *in, struct inspect_object *objects, size_t n, struct inspect_stats *st);
+int inspect_mappings(struct inspector *in, pid_t pid, const char *name, struct inspect_stats *st);
+
+void inspect_print(FILE *file, const char *label, const struct inspect_stats *st, const struct latency_table *table,
+	int core);
+
+#endif /* INSPECT_UTILS_H */
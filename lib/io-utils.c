@@ -0,0 +1,311 @@
+/*
+ * io_uring ring and slice-local I/O buffer pool for file reads
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "io-utils.h"
+
+
+/*
+ * Create a ring with (at least) the given number of entries
+ */
+
+int io_ring_init(struct io_ring *ring, unsigned entries) {
+
+	struct io_uring_params p;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0) {
+		return SA_ERR_IO;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sqRingSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	ring->cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		/* Both rings share one mapping */
+		if (ring->cqRingSize > ring->sqRingSize) {
+			ring->sqRingSize = ring->cqRingSize;
+		}
+		ring->cqRingSize = ring->sqRingSize;
+	}
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sqRing == MAP_FAILED) {
+		close(ring->fd);
+		return SA_ERR_MAP;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cqRing = ring->sqRing;
+	} else {
+		ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cqRing == MAP_FAILED) {
+			munmap(ring->sqRing, ring->sqRingSize);
+			close(ring->fd);
+			return SA_ERR_MAP;
+		}
+	}
+	ring->sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		if (ring->cqRing != ring->sqRing) {
+			munmap(ring->cqRing, ring->cqRingSize);
+		}
+		munmap(ring->sqRing, ring->sqRingSize);
+		close(ring->fd);
+		return SA_ERR_MAP;
+	}
+
+	char *sq = ring->sqRing, *cq = ring->cqRing;
+	ring->sqHead = (unsigned*)(sq + p.sq_off.head);
+	ring->sqTail = (unsigned*)(sq + p.sq_off.tail);
+	ring->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+	ring->sqArray = (unsigned*)(sq + p.sq_off.array);
+	ring->cqHead = (unsigned*)(cq + p.cq_off.head);
+	ring->cqTail = (unsigned*)(cq + p.cq_off.tail);
+	ring->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return SA_OK;
+}
+
+
+/*
+ * Next free submission entry (cleared), or NULL if the submission queue is full
+ */
+
+struct io_uring_sqe* io_ring_get_sqe(struct io_ring *ring) {
+
+	unsigned tail = *ring->sqTail + ring->nPending;
+	unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= ring->entries) {
+		return NULL;
+	}
+	unsigned index = tail & *ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sqArray[index] = index;
+	ring->nPending++;
+	return sqe;
+}
+
+
+/*
+ * Submit the prepared entries and wait for at least waitNr completions
+ */
+
+int io_ring_submit(struct io_ring *ring, unsigned waitNr) {
+
+	unsigned nSubmit = ring->nPending;
+	int ret;
+
+	__atomic_store_n(ring->sqTail, *ring->sqTail + nSubmit, __ATOMIC_RELEASE);
+	ring->nPending = 0;
+	do {
+		ret = syscall(__NR_io_uring_enter, ring->fd, nSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	return (ret < 0) ? SA_ERR_IO : ret;
+}
+
+
+/*
+ * Take one completion (waiting for it if none is available)
+ */
+
+int io_ring_wait(struct io_ring *ring, struct io_uring_cqe *cqe) {
+
+	unsigned head = *ring->cqHead;
+
+	while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+		int ret = io_ring_submit(ring, 1);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	*cqe = ring->cqes[head & *ring->cqMask];
+	__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+	return SA_OK;
+}
+
+
+void io_ring_exit(struct io_ring *ring) {
+	munmap(ring->sqes, ring->entries*sizeof(struct io_uring_sqe));
+	if (ring->cqRing != ring->sqRing) {
+		munmap(ring->cqRing, ring->cqRingSize);
+	}
+	munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+}
+
+
+/*
+ * Create a pool of nBuffers buffers made of lines of the slice
+ * bufferSize is rounded up to a multiple of 64 Bytes and must not exceed IO_MAX_SEGMENTS lines
+ */
+
+int io_pool_init_slice(struct io_buffer_pool *pool, sa_context_t *ctx, int slice, unsigned nBuffers, size_t bufferSize) {
+
+	unsigned b;
+	size_t nLines = (bufferSize + LINE - 1)/LINE, i;
+	int error;
+
+	memset(pool, 0, sizeof(*pool));
+	if (nBuffers == 0 || nLines == 0 || nLines > IO_MAX_SEGMENTS) {
+		return SA_ERR_INVALID;
+	}
+	pool->ctx = ctx;
+	pool->slice = slice;
+	pool->nBuffers = nBuffers;
+	pool->bufferSize = nLines*LINE;
+	pool->buffers = calloc(nBuffers, sizeof(*pool->buffers));
+	pool->lines = malloc(nBuffers*nLines*sizeof(*pool->lines));
+	if (pool->buffers == NULL || pool->lines == NULL) {
+		/* No line is allocated yet, so io_pool_destroy() must not give them back */
+		free(pool->lines);
+		pool->lines = NULL;
+		io_pool_destroy(pool);
+		return SA_ERR_NOMEM;
+	}
+	if ((error = sa_alloc_lines(ctx, slice, pool->lines, nBuffers*nLines))) {
+		free(pool->lines);
+		pool->lines = NULL;
+		io_pool_destroy(pool);
+		return error;
+	}
+
+	for (b=0; b<nBuffers; b++) {
+		struct io_buffer *buf = &pool->buffers[b];
+		void **lines = &pool->lines[b*nLines];
+		buf->iov = malloc(nLines*sizeof(*buf->iov));
+		if (buf->iov == NULL) {
+			io_pool_destroy(pool);
+			return SA_ERR_NOMEM;
+		}
+		/* Lines that happen to be adjacent are merged into one segment */
+		for (i=0; i<nLines; i++) {
+			struct iovec *last = buf->nSegments ? &buf->iov[buf->nSegments-1] : NULL;
+			if (last != NULL && (char*)last->iov_base + last->iov_len == lines[i]) {
+				last->iov_len += LINE;
+			} else {
+				buf->iov[buf->nSegments].iov_base = lines[i];
+				buf->iov[buf->nSegments].iov_len = LINE;
+				buf->nSegments++;
+			}
+		}
+		buf->size = pool->bufferSize;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Create a pool of nBuffers ordinary contiguous buffers (page-aligned, from one mapping)
+ */
+
+int io_pool_init_contiguous(struct io_buffer_pool *pool, unsigned nBuffers, size_t bufferSize) {
+
+	unsigned b;
+	int error;
+
+	memset(pool, 0, sizeof(*pool));
+	if (nBuffers == 0 || bufferSize == 0) {
+		return SA_ERR_INVALID;
+	}
+	pool->slice = IO_NO_SLICE;
+	pool->nBuffers = nBuffers;
+	pool->bufferSize = (bufferSize + PAGE_SIZE_4KB - 1) & ~(PAGE_SIZE_4KB - 1);
+	pool->buffers = calloc(nBuffers, sizeof(*pool->buffers));
+	pool->contiguousIov = calloc(nBuffers, sizeof(*pool->contiguousIov));
+	if (pool->buffers == NULL || pool->contiguousIov == NULL) {
+		io_pool_destroy(pool);
+		return SA_ERR_NOMEM;
+	}
+	if ((error = create_buffer_sized(&pool->contiguous, nBuffers*pool->bufferSize, PAGE_SIZE_AUTO))) {
+		io_pool_destroy(pool);
+		return error;
+	}
+	for (b=0; b<nBuffers; b++) {
+		pool->contiguousIov[b].iov_base = (char*)pool->contiguous.addr + b*pool->bufferSize;
+		pool->contiguousIov[b].iov_len = pool->bufferSize;
+		pool->buffers[b].iov = &pool->contiguousIov[b];
+		pool->buffers[b].nSegments = 1;
+		pool->buffers[b].size = pool->bufferSize;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Register the buffers of a contiguous pool with the ring, so reads use IORING_OP_READ_FIXED
+ * Slice-local buffers are read with IORING_OP_READV and are not registered.
+ */
+
+int io_pool_register(struct io_buffer_pool *pool, struct io_ring *ring) {
+	if (pool->slice != IO_NO_SLICE) {
+		return SA_OK;
+	}
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, pool->contiguousIov, pool->nBuffers) < 0) {
+		return SA_ERR_IO;
+	}
+	pool->registered = 1;
+	return SA_OK;
+}
+
+
+/*
+ * Prepare a read of the whole buffer from fd at offset; userData is returned with the completion
+ */
+
+int io_prep_read(struct io_ring *ring, struct io_buffer_pool *pool, unsigned buffer, int fd, uint64_t offset, uint64_t userData) {
+
+	struct io_buffer *buf = &pool->buffers[buffer];
+	struct io_uring_sqe *sqe = io_ring_get_sqe(ring);
+
+	if (sqe == NULL) {
+		return SA_ERR_EXHAUSTED;
+	}
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->user_data = userData;
+	if (pool->registered) {
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->addr = (uint64_t)buf->iov[0].iov_base;
+		sqe->len = buf->size;
+		sqe->buf_index = buffer;
+	} else {
+		sqe->opcode = IORING_OP_READV;
+		sqe->addr = (uint64_t)buf->iov;
+		sqe->len = buf->nSegments;
+	}
+	return SA_OK;
+}
+
+
+void io_pool_destroy(struct io_buffer_pool *pool) {
+
+	unsigned b;
+
+	if (pool->slice != IO_NO_SLICE) {
+		if (pool->buffers != NULL) {
+			for (b=0; b<pool->nBuffers; b++) {
+				free(pool->buffers[b].iov);
+			}
+		}
+		if (pool->lines != NULL) {
+			sa_free_lines(pool->ctx, pool->slice, pool->lines, pool->nBuffers*(pool->bufferSize/LINE));
+		}
+	} else if (pool->contiguous.addr != NULL) {
+		free_buffer_sized(&pool->contiguous);
+	}
+	free(pool->lines);
+	free(pool->contiguousIov);
+	free(pool->buffers);
+	memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,80 @@
+/*
+ * io_uring ring and slice-local I/O buffer pool for file reads
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef IO_UTILS_H
+#define IO_UTILS_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "sliceaware.h"
+#include "memory-utils.h"
+#include "cache-utils.h"
+
+/*
+ * Minimal io_uring ring on top of the raw system calls (liburing is not required)
+ */
+
+struct io_ring {
+	int fd;
+	unsigned entries;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	struct io_uring_sqe *sqes;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+	void *sqRing, *cqRing;
+	size_t sqRingSize, cqRingSize;
+	unsigned nPending;				/* Prepared entries not submitted yet */
+};
+
+int io_ring_init(struct io_ring *ring, unsigned entries);
+struct io_uring_sqe* io_ring_get_sqe(struct io_ring *ring);
+int io_ring_submit(struct io_ring *ring, unsigned waitNr);
+int io_ring_wait(struct io_ring *ring, struct io_uring_cqe *cqe);
+void io_ring_exit(struct io_ring *ring);
+
+/*
+ * I/O buffer pool
+ *
+ * Slice-local pool: every buffer is a list of 64-Byte lines of one slice, read with IORING_OP_READV,
+ * so the data copied by the kernel on the consuming core lands in the slice closest to it.
+ * A contiguous buffer of more than one line cannot be slice-local (consecutive lines are spread over
+ * all slices by the hash function), so these buffers cannot be used with IORING_OP_READ_FIXED, and a
+ * buffer has at most IO_MAX_SEGMENTS lines (64KB).
+ *
+ * Contiguous pool: ordinary page-aligned buffers from one mapping, read with IORING_OP_READV (one segment),
+ * which is the baseline of the slice-local pool, or, once registered with io_pool_register(), with
+ * IORING_OP_READ_FIXED.
+ */
+
+#define IO_MAX_SEGMENTS 1024	/* UIO_MAXIOV */
+#define IO_NO_SLICE -1
+
+struct io_buffer {
+	struct iovec *iov;		/* Segments of the buffer, in file order */
+	int nSegments;
+	size_t size;
+};
+
+struct io_buffer_pool {
+	sa_context_t *ctx;
+	int slice;						/* IO_NO_SLICE for a contiguous pool */
+	unsigned nBuffers;
+	size_t bufferSize;
+	struct io_buffer *buffers;
+	void **lines;					/* Slice-local pool: all lines of the buffers */
+	struct buffer contiguous;		/* Contiguous pool: the mapping holding the buffers */
+	struct iovec *contiguousIov;	/* Contiguous pool: one segment per buffer */
+	int registered;
+};
+
+int io_pool_init_slice(struct io_buffer_pool *pool, sa_context_t *ctx, int slice, unsigned nBuffers, size_t bufferSize);
+int io_pool_init_contiguous(struct io_buffer_pool *pool, unsigned nBuffers, size_t bufferSize);
+int io_pool_register(struct io_buffer_pool *pool, struct io_ring *ring);
+int io_prep_read(struct io_ring *ring, struct io_buffer_pool *pool, unsigned buffer, int fd, uint64_t offset, uint64_t userData);
+void io_pool_destroy(struct io_buffer_pool *pool);
+
+#endif /* IO_UTILS_H */
@@ -0,0 +1,91 @@
+/*
+ * Core <-> slice access latency table
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency-utils.h"
+
+/*
+ * Default table: slices on a ring, one hop costs one unit
+ */
+
+void latency_table_ring(struct latency_table *table, int nCores, int nSlices) {
+
+	int c, s;
+
+	table->nCores = nCores;
+	table->nSlices = nSlices;
+	for (c=0; c<nCores; c++) {
+		for (s=0; s<nSlices; s++) {
+			int distance = abs(c - s);
+			if (nSlices - distance < distance) {
+				distance = nSlices - distance;
+			}
+			table->latency[c][s] = distance;
+		}
+	}
+}
+
+
+/*
+ * Load a measured table (see latency-utils.h for the format)
+ * All cores must have the same number of slices
+ */
+
+int latency_table_load(struct latency_table *table, const char *path) {
+
+	char line[LATENCY_LINE_LENGTH];
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	table->nCores = 0;
+	table->nSlices = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		int core, nSlices = 0, consumed;
+		char *p = line;
+		if (line[0] == '#' || sscanf(p, " C%d:%n", &core, &consumed) != 1) {
+			continue;
+		}
+		if (core != table->nCores || core >= LATENCY_MAX_CORES) {
+			fclose(file);
+			return SA_ERR_INVALID;
+		}
+		p += consumed;
+		while (nSlices < NUMBER_VIRTUAL_SLICES && sscanf(p, "%lf%n", &table->latency[core][nSlices], &consumed) == 1) {
+			p += consumed;
+			nSlices++;
+		}
+		if (nSlices == 0 || (table->nSlices != 0 && nSlices != table->nSlices)) {
+			fclose(file);
+			return SA_ERR_INVALID;
+		}
+		table->nSlices = nSlices;
+		table->nCores++;
+	}
+	fclose(file);
+	return (table->nCores > 0) ? SA_OK : SA_ERR_INVALID;
+}
+
+
+/*
+ * Slices sorted by their latency from a core (nearest first; ties keep the slice order)
+ */
+
+void latency_order(const struct latency_table *table, int core, int *slices) {
+
+	int i, j;
+
+	for (i=0; i<table->nSlices; i++) {
+		int slice = i;
+		for (j=i; j>0 && table->latency[core][slices[j-1]] > table->latency[core][slice]; j--) {
+			slices[j] = slices[j-1];
+		}
+		slices[j] = slice;
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * Core <-> slice access latency table
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef LATENCY_UTILS_H
+#define LATENCY_UTILS_H
+
+#include "cache-utils.h"
+
+/*
+ * latency[c][s]: access time (cycles) from core c to (virtual) slice s, as measured with L3_access.
+ * Core N is the core closest to slice N.
+ *
+ * File format (lines starting with '#' are ignored), one line per core:
+ *	C0: 34 52 48 60 ...
+ *	C1: 52 34 ...
+ *
+ * Without a file, the slices are assumed to be on a ring in the order of the cores,
+ * i.e., the latency grows with the distance on the ring (own slice first, then the adjacent ones).
+ */
+
+#define LATENCY_MAX_CORES NUMBER_VIRTUAL_SLICES
+#define LATENCY_LINE_LENGTH 1024
+
+struct latency_table {
+	int nCores;
+	int nSlices;
+	double latency[LATENCY_MAX_CORES][NUMBER_VIRTUAL_SLICES];
+};
+
+void latency_table_ring(struct latency_table *table, int nCores, int nSlices);
+int latency_table_load(struct latency_table *table, const char *path);
+void latency_order(const struct latency_table *table, int core, int *slices);
+
+#endif /* LATENCY_UTILS_H */
@@ -0,0 +1,240 @@
+/*
+ * Trace-driven NUCA LLC simulator: replaying access streams against slice layouts without the hardware
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "llcsim-utils.h"
+
+/* Placement slice of a physical slice */
+static inline int llcsim_placement(const struct llc_sim *s, int slice) {
+	return s->model.hasVirtual ? s->model.virtualSlices[slice] : slice;
+}
+
+
+/*
+ * Set up an empty LLC
+ * model NULL -> Haswell; table NULL -> ring; nSets/nWays <= 0 -> L3_SETS_PER_SLICE/LLC_WAYS; memoryLatency < 0 -> LLCSIM_MEMORY_LATENCY
+ */
+
+int llcsim_init(struct llc_sim *s, const struct hash_model *model, const struct latency_table *table,
+	int nSets, int nWays, double memoryLatency) {
+
+	int c, slice;
+	size_t nEntries;
+
+	memset(s, 0, sizeof(*s));
+	if (model != NULL) {
+		s->model = *model;
+	} else {
+		hash_model_haswell(&s->model);
+	}
+	if (table != NULL) {
+		s->table = *table;
+	} else {
+		latency_table_ring(&s->table, NUMBER_VIRTUAL_SLICES, NUMBER_VIRTUAL_SLICES);
+		for (c=0; c<s->table.nCores; c++) {
+			for (slice=0; slice<s->table.nSlices; slice++) {
+				s->table.latency[c][slice] = LLCSIM_HIT_LATENCY + LLCSIM_HOP_LATENCY * s->table.latency[c][slice];
+			}
+		}
+	}
+	s->nSlices = s->model.nSlices;
+	s->nSets = (nSets > 0) ? nSets : L3_SETS_PER_SLICE;
+	s->nWays = (nWays > 0) ? nWays : LLC_WAYS;
+	s->memoryLatency = (memoryLatency >= 0) ? memoryLatency : LLCSIM_MEMORY_LATENCY;
+
+	/* Every slice needs a column in the table */
+	for (slice=0; slice<s->nSlices; slice++) {
+		if (llcsim_placement(s, slice) >= s->table.nSlices) {
+			return SA_ERR_INVALID;
+		}
+	}
+
+	nEntries = (size_t)s->nSlices * s->nSets * s->nWays;
+	s->lines = calloc(nEntries, sizeof(*s->lines));
+	s->stamps = calloc(nEntries, sizeof(*s->stamps));
+	if (s->lines == NULL || s->stamps == NULL) {
+		llcsim_destroy(s);
+		return SA_ERR_NOMEM;
+	}
+	return SA_OK;
+}
+
+
+void llcsim_destroy(struct llc_sim *s) {
+	free(s->lines);
+	free(s->stamps);
+	s->lines = NULL;
+	s->stamps = NULL;
+}
+
+
+/*
+ * Empty the LLC and reset the statistics
+ */
+
+void llcsim_flush(struct llc_sim *s) {
+	size_t nEntries = (size_t)s->nSlices * s->nSets * s->nWays;
+	memset(s->lines, 0, nEntries * sizeof(*s->lines));
+	memset(s->stamps, 0, nEntries * sizeof(*s->stamps));
+	s->clock = 0;
+	llcsim_reset_stats(s);
+}
+
+
+/*
+ * Reset the statistics, but keep the content of the LLC (e.g., after warming it up)
+ */
+
+void llcsim_reset_stats(struct llc_sim *s) {
+	memset(s->cores, 0, sizeof(s->cores));
+	memset(s->slices, 0, sizeof(s->slices));
+}
+
+
+/*
+ * One access of a core to a physical address
+ * Returns its latency in cycles, or SA_ERR_INVALID for a core that is not in the table
+ */
+
+double llcsim_access(struct llc_sim *s, int core, uint64_t pa) {
+
+	int slice, way, victim = 0;
+	uint64_t line = (pa / LINE) + 1, *lines, *stamps;
+	double latency;
+	size_t first;
+
+	if (core < 0 || core >= s->table.nCores) {
+		return SA_ERR_INVALID;
+	}
+	slice = hash_model_slice(&s->model, pa);
+	first = ((size_t)slice * s->nSets + (pa / LINE) % s->nSets) * s->nWays;
+	lines = s->lines + first;
+	stamps = s->stamps + first;
+	latency = s->table.latency[core][llcsim_placement(s, slice)];
+	s->clock++;
+
+	for (way=0; way<s->nWays; way++) {
+		if (lines[way] == line) {
+			stamps[way] = s->clock;
+			s->cores[core].hits++;
+			s->slices[slice].hits++;
+			s->cores[core].latency += latency;
+			s->slices[slice].latency += latency;
+			return latency;
+		}
+		if (stamps[way] < stamps[victim]) {
+			victim = way;
+		}
+	}
+
+	/* Miss: the least recently used way (empty ways have the oldest stamp) */
+	lines[victim] = line;
+	stamps[victim] = s->clock;
+	latency += s->memoryLatency;
+	s->cores[core].misses++;
+	s->slices[slice].misses++;
+	s->cores[core].latency += latency;
+	s->slices[slice].latency += latency;
+	return latency;
+}
+
+
+/*
+ * Replay a trace file (see llcsim-utils.h for the format)
+ * Returns the number of accesses, SA_ERR_IO if the file cannot be read, or SA_ERR_INVALID for a malformed line
+ */
+
+int llcsim_replay_trace(struct llc_sim *s, const char *path) {
+
+	char line[LLCSIM_LINE_LENGTH];
+	FILE *file = fopen(path, "r");
+	int nAccesses = 0, core;
+	unsigned long long pa;
+
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+		if (sscanf(p, "%d %llx", &core, &pa) != 2 || llcsim_access(s, core, pa) < 0) {
+			fclose(file);
+			return SA_ERR_INVALID;
+		}
+		nAccesses++;
+	}
+	fclose(file);
+	return nAccesses;
+}
+
+
+/*
+ * Hit rate and average latency of every core and slice, and of all accesses
+ */
+
+void llcsim_print(FILE *file, const char *label, const struct llc_sim *s, int nCores) {
+
+	struct llc_sim_stats total = {0, 0, 0};
+	int c, slice;
+
+	for (c=0; c<nCores && c<s->table.nCores; c++) {
+		const struct llc_sim_stats *st = &s->cores[c];
+		unsigned long long n = st->hits + st->misses;
+		total.hits += st->hits;
+		total.misses += st->misses;
+		total.latency += st->latency;
+		if (n) {
+			fprintf(file, "%s: core %d: %llu accesses, hit rate %.2f%%, average latency %.1f cycles\n", label, c,
+				n, 100.0 * st->hits / n, st->latency / n);
+		}
+	}
+	fprintf(file, "%s: slices (accesses, hit rate):", label);
+	for (slice=0; slice<s->nSlices; slice++) {
+		const struct llc_sim_stats *st = &s->slices[slice];
+		unsigned long long n = st->hits + st->misses;
+		fprintf(file, " S%d %llu %.1f%%", slice, n, n ? 100.0 * st->hits / n : 0);
+	}
+	fprintf(file, "\n");
+	if (total.hits + total.misses) {
+		fprintf(file, "%s: total: %llu accesses, hit rate %.2f%%, average latency %.1f cycles\n", label,
+			total.hits + total.misses, 100.0 * total.hits / (total.hits + total.misses),
+			total.latency / (total.hits + total.misses));
+	}
+}
+
+
+/*
+ * noslice layout: consecutive lines of the region of the core
+ */
+
+void llcsim_layout_contiguous(int core, uint64_t *pas, size_t nLines) {
+	size_t i;
+	for (i=0; i<nLines; i++) {
+		pas[i] = core * LLCSIM_REGION_SIZE + i * LINE;
+	}
+}
+
+
+/*
+ * slice layout: the lines of the region of the core that are mapped to a (placement) slice, in address order
+ * Returns SA_ERR_EXHAUSTED if the region does not have enough of them
+ */
+
+int llcsim_layout_slice(const struct llc_sim *s, int core, int slice, uint64_t *pas, size_t nLines) {
+
+	uint64_t pa = core * LLCSIM_REGION_SIZE, end = pa + LLCSIM_REGION_SIZE;
+	size_t n = 0;
+
+	for (; pa < end && n < nLines; pa += LINE) {
+		if (llcsim_placement(s, hash_model_slice(&s->model, pa)) == slice) {
+			pas[n++] = pa;
+		}
+	}
+	return (n == nLines) ? SA_OK : SA_ERR_EXHAUSTED;
+}
@@ -0,0 +1,70 @@
+/*
+ * Trace-driven NUCA LLC simulator: replaying access streams against slice layouts without the hardware
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef LLCSIM_UTILS_H
+#define LLCSIM_UTILS_H
+
+#include <stdio.h>
+#include "sliceaware.h"
+#include "latency-utils.h"
+#include "coloring-utils.h"
+
+/*
+ * The simulated LLC has one set-associative cache per slice (nSets sets of nWays ways, LRU, by default the
+ * geometry of cache-utils.h) and a slice hash (struct hash_model, Haswell's by default), so any Linux box
+ * can estimate how a layout behaves on a CPU whose hash is known.
+ * Accesses are the ones reaching the LLC (private caches are not modeled), identified by core and physical address:
+ * - hit: latency[core][slice] of the latency table, where slice is the placement (virtual) slice of the line
+ * - miss: the same plus memoryLatency, and the line is inserted into its slice (evicting the LRU line of its set)
+ * Without a table, the slices are on a ring (latency_table_ring()) and a hit costs
+ * LLCSIM_HIT_LATENCY + LLCSIM_HOP_LATENCY * distance cycles, roughly what L3_access measures on Haswell.
+ *
+ * Layouts give the physical addresses of the lines of a simulated core (each core has its own 1GB region,
+ * as if it had a 1GB hugepage): contiguous lines (noslice), or only the lines of one slice (slice).
+ * Traces are text files with one access per line: "<core> <physical address in hex>" ('#' starts a comment).
+ */
+
+#define LLCSIM_HIT_LATENCY 34
+#define LLCSIM_HOP_LATENCY 6
+#define LLCSIM_MEMORY_LATENCY 200
+#define LLCSIM_REGION_SIZE (1ULL << 30)		/* Physical memory of each simulated core */
+#define LLCSIM_LINE_LENGTH 256
+
+struct llc_sim_stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	double latency;				/* Sum of the latencies (cycles) */
+};
+
+struct llc_sim {
+	struct hash_model model;
+	struct latency_table table;	/* Cycles from a core to a placement slice */
+	double memoryLatency;
+	int nSlices;				/* Physical slices of the model */
+	int nSets;					/* Per slice */
+	int nWays;
+	uint64_t *lines;			/* [slice][set][way]: line address + 1 (0 -> empty) */
+	uint64_t *stamps;			/* Last use of each way, for LRU */
+	uint64_t clock;
+
+	/* Statistics */
+	struct llc_sim_stats cores[LATENCY_MAX_CORES];
+	struct llc_sim_stats slices[HASH_MAX_SLICES];
+};
+
+int llcsim_init(struct llc_sim *s, const struct hash_model *model, const struct latency_table *table,
+	int nSets, int nWays, double memoryLatency);
+void llcsim_destroy(struct llc_sim *s);
+void llcsim_flush(struct llc_sim *s);
+void llcsim_reset_stats(struct llc_sim *s);
+double llcsim_access(struct llc_sim *s, int core, uint64_t pa);
+int llcsim_replay_trace(struct llc_sim *s, const char *path);
+void llcsim_print(FILE *file, const char *label, const struct llc_sim *s, int nCores);
+
+void llcsim_layout_contiguous(int core, uint64_t *pas, size_t nLines);
+int llcsim_layout_slice(const struct llc_sim *s, int core, int slice, uint64_t *pas, size_t nLines);
+
+#endif /* LLCSIM_UTILS_H */
@@ -10,65 +10,140 @@
 #include <stdio.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <string.h>
+#include <pthread.h>
+#include "memory-utils.h"
+
 
 /*
- * Definitions + mmap Flags
+ * Map size bytes backed by pages of page_size
+ * Returns MAP_FAILED if the system cannot provide such pages (e.g., no free hugepages of that size)
  */
 
-#define USE_HUGEPAGE	/* Should be defined for allocating hugepages; comment it for 4KB-pages */
-
-#define SIZE (8*1024UL*1024*1024)	/* Buffer Size -> 8*1GB */
+void* map_pages(size_t size, size_t page_size) {
 
-#define PROTECTION (PROT_READ | PROT_WRITE)	/* Protection of the mapping: page may be read and written */
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
 
-#ifndef MAP_HUGETLB	/* Use hugepages */
-#define MAP_HUGETLB 0x40000 /* arch. specific */
-#endif
-
-/* Only ia64 requires this */
-#ifdef __ia64__
-#define ADDR (void *)(0x8000000000000000UL)	/* the kernel takes it as a hint about where to place the mapping */
-/* Flags: Can use [MAP_HUGE_2MB|MAP_HUGE_1GB] instead of MAP_HUGE_1GB */
-#define FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED | MAP_HUGE_1GB)
-#else
-#define ADDR (void *)(0x0UL)
-#define FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB)
-#endif
+	if (page_size == PAGE_SIZE_1GB) {
+		flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+	} else if (page_size == PAGE_SIZE_2MB) {
+		flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+	}
+	return mmap(ADDR, size, PROTECTION, flags, -1, 0);
+}
 
 
 /*
- * Create buffer backed by a hugepage
+ * Pick the first page size to try for a buffer of the given size
+ * 1GB-pages are only worth it if the buffer fills at least one of them
  */
 
-void* create_buffer(void) {
+size_t preferred_page_size(size_t size, size_t page_size) {
 
 	#ifdef USE_HUGEPAGE
-	/* Allocate some memory using mmap (hugepage 1GB/2MB) based on the input FLAGS */
-	void *buffer = mmap(ADDR, SIZE, PROTECTION, FLAGS, 0, 0);
-	if (buffer == MAP_FAILED) {
-		fprintf(stderr, "Failed to allocate memory for buffer\n");
-		exit(1);
+	if (page_size != PAGE_SIZE_AUTO) {
+		return page_size;
 	}
+	return (size >= PAGE_SIZE_1GB) ? PAGE_SIZE_1GB : PAGE_SIZE_2MB;
 	#else
-	/* Allocate some memory using malloc (4KB-page) */
-	void *buffer = malloc(buf_size);
-	if(buffer == NULL) {
-		fprintf(stderr, "Failed to allocate memory for buffer\n");
-		exit(1);
-	}
+	/* Without hugepages, every buffer is backed by 4KB-pages */
+	(void)size;
+	(void)page_size;
+	return PAGE_SIZE_4KB;
 	#endif
+}
+
+
+/*
+ * Next (smaller) page size to fall back to, or 0 if there is none left
+ */
+
+size_t fallback_page_size(size_t page_size) {
+
+	if (page_size == PAGE_SIZE_1GB) {
+		return PAGE_SIZE_2MB;
+	} else if (page_size == PAGE_SIZE_2MB) {
+		return PAGE_SIZE_4KB;
+	}
+	return 0;
+}
+
+
+/*
+ * Create buffer of (at least) size bytes
+ * page_size selects 1GB/2MB/4KB-pages, or PAGE_SIZE_AUTO to let the size decide.
+ * If the requested pages are not available, smaller pages will be used instead
+ * The chosen page size is stored in buf->page_size and buf->size is rounded up to it.
+ * Returns SA_OK, or SA_ERR_MAP if no pages can be mapped (or hugepages cannot be locked)
+ */
+
+int create_buffer_sized(struct buffer *buf, size_t size, size_t page_size) {
+
+	size_t requested = preferred_page_size(size, page_size);
+	size_t current = requested;
+	void *addr = MAP_FAILED;
+	size_t rounded = 0;
+
+	while (current != 0) {
+		rounded = (size + current - 1) & ~(current - 1);
+		addr = map_pages(rounded, current);
+		if (addr != MAP_FAILED) {
+			break;
+		}
+		current = fallback_page_size(current);
+	}
+
+	if (addr == MAP_FAILED) {
+		return SA_ERR_MAP;
+	}
+
 	/* 
-	 * Lock the page in the memory
-	 * Do this before writing data to the buffer so that any copy-on-write
-	 * mechanisms will give us our own page locked in memory
+	 * Lock the pages in the memory
+	 * Hugepages cannot be swapped anyway, so only 4KB-pages may move if this fails
 	 */
-	if(mlock(buffer, SIZE) == -1) {
-		fprintf(stderr, "Failed to lock page in memory: %s\n", strerror(errno));
-		exit(1);
+	if (mlock(addr, rounded) == -1 && current != PAGE_SIZE_4KB) {
+		int error = errno;
+		munmap(addr, rounded);
+		errno = error;
+		return SA_ERR_MAP;
 	}
-	return buffer;
+
+	buf->addr = addr;
+	buf->size = rounded;
+	buf->page_size = current;
+	return SA_OK;
+}
+
+
+/*
+ * Free buffer created by create_buffer_sized()
+ */
+
+int free_buffer_sized(struct buffer *buf) {
+	/* munmap() length of MAP_HUGETLB memory must be hugepage aligned */
+	if (munmap(buf->addr, buf->size)) {
+		return SA_ERR_INVALID;
+	}
+	buf->addr = NULL;
+	buf->size = 0;
+	return SA_OK;
+}
+
+
+/*
+ * Create buffer backed by a hugepage
+ * Legacy interface: SIZE bytes, preferably backed by 1GB-pages; NULL on failure
+ */
+
+void* create_buffer(void) {
+
+	struct buffer buf;
+	if (create_buffer_sized(&buf, SIZE, PAGE_SIZE_1GB)) {
+		return NULL;
+	}
+	return buf.addr;
 }
 
 
@@ -76,14 +151,139 @@ void* create_buffer(void) {
  * Free buffer 
  */ 
 
-void free_buffer(void* buffer) {
+int free_buffer(void* buffer) {
 	/* munmap() length of MAP_HUGETLB memory must be hugepage aligned */
 	if (munmap(buffer, SIZE)) {
-		perror("munmap");
-		exit(EXIT_FAILURE);
+		return SA_ERR_INVALID;
 	}
+	return SA_OK;
 }
 
+
+/*
+ * Initialize a pool of pages with page_size (PAGE_SIZE_AUTO -> 2MB)
+ * Falls back to smaller pages if the requested hugepages are not available
+ */
+
+void hugepage_pool_init(struct hugepage_pool *pool, size_t page_size, unsigned long maxPages) {
+
+	pthread_mutex_init(&pool->lock, NULL);
+	#ifdef USE_HUGEPAGE
+	pool->page_size = (page_size == PAGE_SIZE_AUTO) ? PAGE_SIZE_2MB : page_size;
+	#else
+	(void)page_size;
+	pool->page_size = PAGE_SIZE_4KB;
+	#endif
+	pool->maxPages = maxPages;
+	pool->nPages = 0;
+	pool->nFree = 0;
+	pool->pages = NULL;
+	pool->freePages = NULL;
+}
+
+
+/*
+ * Get one page from the pool: reuse a released page or map a new one
+ * Returns NULL if the pool reached maxPages or no page can be mapped
+ */
+
+void* hugepage_pool_get(struct hugepage_pool *pool) {
+
+	void *page = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->nFree > 0) {
+		page = pool->freePages[--pool->nFree];
+		pthread_mutex_unlock(&pool->lock);
+		return page;
+	}
+
+	if (pool->maxPages != 0 && pool->nPages >= pool->maxPages) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	/* Fall back to smaller pages once, and keep using them for the rest of the pool */
+	while (pool->page_size != 0) {
+		page = map_pages(pool->page_size, pool->page_size);
+		if (page != MAP_FAILED) {
+			break;
+		}
+		if (pool->nPages != 0) {
+			/* All the pages in the pool must have the same size */
+			page = MAP_FAILED;
+			break;
+		}
+		pool->page_size = fallback_page_size(pool->page_size);
+	}
+	if (page == MAP_FAILED) {
+		if (pool->page_size == 0) {
+			pool->page_size = PAGE_SIZE_4KB;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	/* Hugepages cannot be swapped anyway, so a failure only matters for 4KB-pages */
+	mlock(page, pool->page_size);
+
+	void **pages = realloc(pool->pages, (pool->nPages+1)*sizeof(*pages));
+	if (pages != NULL) {
+		pool->pages = pages;
+	}
+	void **freePages = realloc(pool->freePages, (pool->nPages+1)*sizeof(*freePages));
+	if (freePages != NULL) {
+		pool->freePages = freePages;
+	}
+	if (pages == NULL || freePages == NULL) {
+		munmap(page, pool->page_size);
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	pool->pages[pool->nPages++] = page;
+
+	pthread_mutex_unlock(&pool->lock);
+	return page;
+}
+
+
+/*
+ * Return a page to the pool for reuse
+ * The content of the page is preserved
+ */
+
+void hugepage_pool_put(struct hugepage_pool *pool, void *page) {
+
+	pthread_mutex_lock(&pool->lock);
+	pool->freePages[pool->nFree++] = page;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+ * Unmap all the pages of the pool, including the ones that are not returned
+ */
+
+void hugepage_pool_destroy(struct hugepage_pool *pool) {
+
+	unsigned long i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i=0; i<pool->nPages; i++) {
+		munmap(pool->pages[i], pool->page_size);
+	}
+	free(pool->pages);
+	free(pool->freePages);
+	pool->pages = NULL;
+	pool->freePages = NULL;
+	pool->nPages = 0;
+	pool->nFree = 0;
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+
 /*
  * Virtual Address to Physical Address Translation by using /proc/self/pagemap
  * Inspired by http://fivelinesofcode.blogspot.com/2014/03/how-to-translate-virtual-to-physical.html
@@ -95,50 +295,79 @@ void free_buffer(void* buffer) {
  * Note that this number is architecture dependent. For x86_64 with 4096 page sizes,
  * it is defined as 12. If you're running something different, check the kernel source
  * for what it is defined as.
+ *
+ * The pagemap file is opened once per process and read with pread(), which is safe from multiple threads.
  */
 
-#define PAGE_SHIFT 12
-#define PAGEMAP_LENGTH 8
+static int pagemap_fd = -1;
+static pthread_once_t pagemap_once = PTHREAD_ONCE_INIT;
+
+static void pagemap_open(void) {
+	/* Open the pagemap file for the current process */
+	pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+}
+
 
 /* 
- * Get the page frame number
+ * Get the physical address of an address
+ * Returns SA_OK, or SA_ERR_PAGEMAP if the page is not present or the page frame is hidden (not root)
  */
 
-uint64_t get_page_frame_number_of_address(void *address) {
+int translate_address(const void *address, uint64_t *physical_address) {
 
-	/* Open the pagemap file for the current process */
-	FILE *pagemap = fopen("/proc/self/pagemap", "rb");
+	uint64_t entry = 0;
+
+	pthread_once(&pagemap_once, pagemap_open);
+	if (pagemap_fd < 0) {
+		return SA_ERR_PAGEMAP;
+	}
 
 	/* Seek to the page that the buffer is on it */ 
 	uint64_t offset = (uint64_t)((uint64_t)address >> PAGE_SHIFT) * (uint64_t)PAGEMAP_LENGTH;
-	if(fseek(pagemap, (uint64_t)offset, SEEK_SET) != 0) {
-		fprintf(stderr, "Failed to seek pagemap to proper location\n");
-		exit(1);
+	if (pread(pagemap_fd, &entry, PAGEMAP_LENGTH, offset) != PAGEMAP_LENGTH) {
+		return SA_ERR_PAGEMAP;
+	}
+
+	/* The page frame number is in bits 0-54 */
+	uint64_t page_frame_number = entry & 0x7FFFFFFFFFFFFF;
+	if (page_frame_number == 0) {
+		return SA_ERR_PAGEMAP;
 	}
 
-	/* The page frame number is in bits 0-54 so read the first 7 bytes and clear the 55th bit */
-	uint64_t page_frame_number = 0;
-	fread(&page_frame_number, 1, PAGEMAP_LENGTH-1, pagemap);
-	page_frame_number &= 0x7FFFFFFFFFFFFF;
-	fclose(pagemap);
-	return page_frame_number;
+	/* Find the difference from the buffer to the page boundary */
+	uint64_t distance_from_page_boundary = (uint64_t)address & ((1UL << PAGE_SHIFT) - 1);
+
+	/* Determine how far to seek into memory to find the buffer */
+	*physical_address = (page_frame_number << PAGE_SHIFT) + distance_from_page_boundary;
+	return SA_OK;
 }
 
 
-/*
- * Get the physical address of a page: 
+/* 
+ * Get the page frame number (0 on failure)
  */
 
-uint64_t get_physical_address(void* address) {
+uint64_t get_page_frame_number_of_address(void *address) {
 
-	/* Get page frame number */
-	unsigned int page_frame_number = get_page_frame_number_of_address(address);
+	uint64_t physical_address;
 
-	/* Find the difference from the buffer to the page boundary */
-	uint64_t distance_from_page_boundary = (uint64_t)address % getpagesize();
+	if (translate_address(address, &physical_address)) {
+		return 0;
+	}
+	return physical_address >> PAGE_SHIFT;
+}
 
-	/* Determine how far to seek into memory to find the buffer */
-	uint64_t physical_address = (uint64_t)((uint64_t)page_frame_number << PAGE_SHIFT) + (uint64_t)distance_from_page_boundary;
 
+/*
+ * Get the physical address of a page (0 on failure): 
+ */
+
+uint64_t get_physical_address(void* address) {
+
+	uint64_t physical_address;
+
+	if (translate_address(address, &physical_address)) {
+		return 0;
+	}
 	return physical_address;
-}
\ No newline at end of file
+}
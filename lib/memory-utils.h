@@ -0,0 +1,107 @@
+/*
+ * Memory-related functions for creating a buffer and getting its physical address
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef MEMORY_UTILS_H
+#define MEMORY_UTILS_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "sliceaware.h"
+
+/*
+ * Definitions + mmap Flags
+ */
+
+#define USE_HUGEPAGE	/* Should be defined for allocating hugepages; comment it for 4KB-pages */
+
+#define SIZE (8*1024UL*1024*1024)	/* Buffer Size -> 8*1GB */
+
+#define PROTECTION (PROT_READ | PROT_WRITE)	/* Protection of the mapping: page may be read and written */
+
+#ifndef MAP_HUGETLB	/* Use hugepages */
+#define MAP_HUGETLB 0x40000 /* arch. specific */
+#endif
+
+/* Encoding of the hugepage size in the mmap flags (log2 of the size shifted by MAP_HUGE_SHIFT) */
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+/* Only ia64 requires this */
+#ifdef __ia64__
+#define ADDR (void *)(0x8000000000000000UL)	/* the kernel takes it as a hint about where to place the mapping */
+/* Flags: Can use [MAP_HUGE_2MB|MAP_HUGE_1GB] instead of MAP_HUGE_1GB */
+#define FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED | MAP_HUGE_1GB)
+#else
+#define ADDR (void *)(0x0UL)
+#define FLAGS (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB)
+#endif
+
+/* Page sizes that can back a buffer */
+#define PAGE_SIZE_AUTO 0	/* Pick the page size based on the requested size */
+#define PAGE_SIZE_4KB (4*1024UL)
+#define PAGE_SIZE_2MB (2*1024UL*1024)
+#define PAGE_SIZE_1GB (1024UL*1024*1024)
+
+/* A buffer and the pages backing it */
+struct buffer {
+	void *addr;			/* Virtual address of the buffer */
+	size_t size;		/* Size of the buffer, rounded up to page_size */
+	size_t page_size;	/* Size of the pages backing the buffer */
+};
+
+/*
+ * Hugepage pool
+ * Pages are mapped one at a time and handed out individually, so every page is physically contiguous.
+ * Released pages are kept in the pool and reused by later requests (from any thread),
+ * instead of mapping (and locking) a new buffer for each allocation.
+ */
+
+struct hugepage_pool {
+	pthread_mutex_t lock;
+	size_t page_size;			/* Size of the pages in the pool, decided by the first mapping */
+	unsigned long maxPages;		/* Maximum number of pages to map (0 -> no limit) */
+	unsigned long nPages;		/* Number of pages mapped so far */
+	unsigned long nFree;		/* Number of pages available for reuse */
+	void **pages;				/* All the mapped pages */
+	void **freePages;			/* Stack of pages available for reuse */
+};
+
+void* map_pages(size_t size, size_t page_size);
+size_t preferred_page_size(size_t size, size_t page_size);
+size_t fallback_page_size(size_t page_size);
+
+int create_buffer_sized(struct buffer *buf, size_t size, size_t page_size);
+int free_buffer_sized(struct buffer *buf);
+void* create_buffer(void);
+int free_buffer(void* buffer);
+
+void hugepage_pool_init(struct hugepage_pool *pool, size_t page_size, unsigned long maxPages);
+void* hugepage_pool_get(struct hugepage_pool *pool);
+void hugepage_pool_put(struct hugepage_pool *pool, void *page);
+void hugepage_pool_destroy(struct hugepage_pool *pool);
+
+/*
+ * Virtual Address to Physical Address Translation by using /proc/self/pagemap
+ * The page frame shifted left by PAGE_SHIFT will give us the physcial address of the frame
+ */
+
+#define PAGE_SHIFT 12
+#define PAGEMAP_LENGTH 8
+
+int translate_address(const void *address, uint64_t *physical_address);
+uint64_t get_page_frame_number_of_address(void *address);
+uint64_t get_physical_address(void* address);
+
+#endif /* MEMORY_UTILS_H */
@@ -0,0 +1,281 @@
+/*
+ * Online migration of hot objects to the slice of the cores that access them
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include "migrate-utils.h"
+
+/*
+ * Set up a space for nReaders reader threads
+ * sampleRate/minSamples 0 -> defaults; share <= 0 -> MIGR_DEFAULT_SHARE
+ */
+
+int migr_init(struct migr_space *m, sa_context_t *ctx, int nReaders, uint32_t sampleRate, uint32_t minSamples,
+	double share) {
+
+	memset(m, 0, sizeof(*m));
+	if (ctx == NULL || nReaders <= 0 || share > 1) {
+		return SA_ERR_INVALID;
+	}
+	m->ctx = ctx;
+	m->nReaders = nReaders;
+	m->sampleRate = sampleRate ? sampleRate : MIGR_DEFAULT_SAMPLE_RATE;
+	m->minSamples = minSamples ? minSamples : MIGR_DEFAULT_MIN_SAMPLES;
+	m->share = (share > 0) ? share : MIGR_DEFAULT_SHARE;
+	m->readers = aligned_alloc(LINE, nReaders * sizeof(*m->readers));
+	if (m->readers == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	memset(m->readers, 0, nReaders * sizeof(*m->readers));
+	pthread_mutex_init(&m->lock, NULL);
+	return SA_OK;
+}
+
+
+/*
+ * Stop the migration and free the space with all its objects (no reader may be left)
+ */
+
+void migr_destroy(struct migr_space *m) {
+
+	size_t i;
+
+	migr_stop(m);
+	for (i=0; i<m->nObjects; i++) {
+		sa_free(m->ctx, m->objects[i]->ptr, m->objects[i]->size);
+		free(m->objects[i]);
+	}
+	free(m->objects);
+	free(m->readers);
+	pthread_mutex_destroy(&m->lock);
+	memset(m, 0, sizeof(*m));
+}
+
+
+/*
+ * Reader state of a thread running on a CPU, or NULL for a wrong reader index
+ */
+
+struct migr_reader* migr_reader_init(struct migr_space *m, int reader, int cpu) {
+
+	struct migr_reader *r;
+	int slice = sa_cpu_slice(cpu);
+
+	if (reader < 0 || reader >= m->nReaders || slice < 0 || slice >= NUMBER_VIRTUAL_SLICES) {
+		return NULL;
+	}
+	r = &m->readers[reader];
+	r->slice = slice;
+	r->sampleRate = m->sampleRate;
+	r->countdown = m->sampleRate;
+	return r;
+}
+
+
+/*
+ * New zeroed object of size bytes on a slice
+ */
+
+int migr_alloc(struct migr_space *m, size_t size, int slice, struct migr_object **object) {
+
+	struct migr_object *o = calloc(1, sizeof(*o));
+	int error;
+
+	if (o == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	if (slice < 0 || slice >= NUMBER_VIRTUAL_SLICES) {
+		free(o);
+		return SA_ERR_INVALID;
+	}
+	if ((error = sa_alloc(m->ctx, slice, size, 0, &o->ptr))) {
+		free(o);
+		return error;
+	}
+	memset(o->ptr, 0, size);
+	o->size = size;
+	o->slice = slice;
+
+	pthread_mutex_lock(&m->lock);
+	if (m->nObjects == m->capacity) {
+		size_t capacity = m->capacity ? 2 * m->capacity : 1024;
+		struct migr_object **objects = realloc(m->objects, capacity * sizeof(*objects));
+		if (objects == NULL) {
+			pthread_mutex_unlock(&m->lock);
+			sa_free(m->ctx, o->ptr, size);
+			free(o);
+			return SA_ERR_NOMEM;
+		}
+		m->objects = objects;
+		m->capacity = capacity;
+	}
+	o->index = m->nObjects;
+	m->objects[m->nObjects++] = o;
+	pthread_mutex_unlock(&m->lock);
+
+	*object = o;
+	return SA_OK;
+}
+
+
+/*
+ * Free an object once no reader can see it (the caller must not be in a read-side section)
+ */
+
+void migr_free(struct migr_space *m, struct migr_object *object) {
+
+	pthread_mutex_lock(&m->lock);
+	m->objects[object->index] = m->objects[--m->nObjects];
+	m->objects[object->index]->index = object->index;
+	pthread_mutex_unlock(&m->lock);
+
+	migr_synchronize(m);
+	sa_free(m->ctx, object->ptr, object->size);
+	free(object);
+}
+
+
+/*
+ * Wait for a grace period: every reader that is in a read-side section leaves it
+ */
+
+void migr_synchronize(struct migr_space *m) {
+
+	uint64_t epoch;
+	unsigned long spins;
+	int i;
+
+	/* The swapped pointers must be visible before the epochs are read */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (i=0; i<m->nReaders; i++) {
+		epoch = __atomic_load_n(&m->readers[i].epoch, __ATOMIC_ACQUIRE);
+		if (!(epoch & 1)) {
+			continue;
+		}
+		for (spins=0; __atomic_load_n(&m->readers[i].epoch, __ATOMIC_ACQUIRE) == epoch; spins++) {
+			if (spins & 1023) {
+				__builtin_ia32_pause();
+			} else {
+				sched_yield();
+			}
+		}
+	}
+}
+
+
+/*
+ * One pass over the objects: migrate the ones that are mostly read from another slice, then decay the samples
+ * Returns the number of migrated objects, or SA_ERR_NOMEM
+ */
+
+int migr_scan(struct migr_space *m) {
+
+	void **old;
+	size_t *oldSizes, nOld = 0, i;
+	int s, best, migrated;
+
+	pthread_mutex_lock(&m->lock);
+	old = malloc((m->nObjects + 1) * sizeof(*old));
+	oldSizes = malloc((m->nObjects + 1) * sizeof(*oldSizes));
+	if (old == NULL || oldSizes == NULL) {
+		pthread_mutex_unlock(&m->lock);
+		free(old);
+		free(oldSizes);
+		return SA_ERR_NOMEM;
+	}
+
+	for (i=0; i<m->nObjects; i++) {
+		struct migr_object *o = m->objects[i];
+		uint32_t samples[NUMBER_VIRTUAL_SLICES];
+		unsigned long long total = 0;
+		void *copy;
+
+		for (s=0, best=0; s<NUMBER_VIRTUAL_SLICES; s++) {
+			samples[s] = __atomic_load_n(&o->samples[s], __ATOMIC_RELAXED);
+			total += samples[s];
+			if (samples[s] > samples[best]) {
+				best = s;
+			}
+		}
+
+		migrated = 0;
+		if (best != o->slice && total >= m->minSamples && samples[best] >= m->share * total) {
+			if (sa_alloc(m->ctx, best, o->size, 0, &copy)) {
+				m->nFailed++;
+			} else {
+				migr_write_lock(o);
+				memcpy(copy, o->ptr, o->size);
+				old[nOld] = o->ptr;
+				oldSizes[nOld++] = o->size;
+				__atomic_store_n(&o->ptr, copy, __ATOMIC_RELEASE);
+				o->slice = best;
+				migr_write_unlock(o);
+				m->nMigrations++;
+				migrated = 1;
+			}
+		}
+
+		/* Samples racing with the decay may be lost, which only delays a migration */
+		for (s=0; s<NUMBER_VIRTUAL_SLICES; s++) {
+			__atomic_store_n(&o->samples[s], migrated ? 0 : samples[s] / 2, __ATOMIC_RELAXED);
+		}
+	}
+	m->nScans++;
+	pthread_mutex_unlock(&m->lock);
+
+	/* Readers may still use the old copies until they leave their sections */
+	if (nOld) {
+		migr_synchronize(m);
+		for (i=0; i<nOld; i++) {
+			sa_free(m->ctx, old[i], oldSizes[i]);
+		}
+	}
+	free(old);
+	free(oldSizes);
+	return (int)nOld;
+}
+
+
+/* Background migration: a scan every intervalUs */
+static void* migr_loop(void *arg) {
+	struct migr_space *m = arg;
+	while (!__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+		usleep(m->intervalUs);
+		migr_scan(m);
+	}
+	return NULL;
+}
+
+
+/*
+ * Scan the objects every intervalUs on a background thread
+ */
+
+int migr_start(struct migr_space *m, unsigned long intervalUs) {
+
+	if (m->running || intervalUs == 0) {
+		return SA_ERR_INVALID;
+	}
+	m->intervalUs = intervalUs;
+	m->stop = 0;
+	if (pthread_create(&m->thread, NULL, migr_loop, m)) {
+		return SA_ERR_NOMEM;
+	}
+	m->running = 1;
+	return SA_OK;
+}
+
+
+void migr_stop(struct migr_space *m) {
+	if (m->running) {
+		__atomic_store_n(&m->stop, 1, __ATOMIC_RELEASE);
+		pthread_join(m->thread, NULL);
+		m->running = 0;
+	}
+}
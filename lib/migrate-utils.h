@@ -0,0 +1,123 @@
+/*
+ * Online migration of hot objects to the slice of the cores that access them
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef MIGRATE_UTILS_H
+#define MIGRATE_UTILS_H
+
+#include <pthread.h>
+#include "sliceaware.h"
+#include "cache-utils.h"
+
+/*
+ * Objects of a migration space are allocated with sa_alloc() and reached through a handle (struct migr_object),
+ * whose pointer to the current copy is the only one the application keeps across read-side sections.
+ *
+ * - Readers: every thread has a struct migr_reader (its slice and an epoch). Between migr_read_lock() and
+ *   migr_read_unlock(), migr_deref() gives the current copy of an object, which stays valid until the unlock.
+ *   One in sampleRate dereferences of a reader is counted for the slice of the reader (software sampling).
+ * - Writers: updates in place must hold the lock of the object (migr_write_lock()), so they are not lost by a copy.
+ * - Migration (migr_scan(), or periodically on a background thread with migr_start()): an object whose samples
+ *   are at least minSamples, and mostly (at least share of them) from one slice other than its own, is copied
+ *   to that slice and its pointer is swapped (RCU-style). The old copy is freed after a grace period, i.e., once
+ *   every reader has left the read-side section it was in. The samples then decay by half per scan, so objects
+ *   follow their readers when the load is rebalanced among the cores.
+ *
+ * Read-side sections must be short and must not block on the migration (e.g., on migr_free()).
+ */
+
+#define MIGR_DEFAULT_SAMPLE_RATE 64		/* One sample per 64 dereferences */
+#define MIGR_DEFAULT_MIN_SAMPLES 16
+#define MIGR_DEFAULT_SHARE 0.6
+
+/* One per reader thread, on its own line */
+struct migr_reader {
+	uint64_t epoch;						/* Odd inside a read-side section */
+	uint32_t countdown;					/* Dereferences until the next sample */
+	uint32_t sampleRate;
+	int slice;
+} __attribute__((aligned(LINE)));
+
+struct migr_object {
+	void *ptr;							/* Current copy */
+	size_t size;
+	int slice;							/* Slice of the current copy */
+	int lock;
+	size_t index;						/* Position in the list of the space */
+	uint32_t samples[NUMBER_VIRTUAL_SLICES];	/* Sampled dereferences from every slice */
+};
+
+struct migr_space {
+	sa_context_t *ctx;
+	int nReaders;
+	struct migr_reader *readers;
+
+	pthread_mutex_t lock;				/* Protects the list of objects */
+	struct migr_object **objects;
+	size_t nObjects;
+	size_t capacity;
+
+	uint32_t sampleRate;
+	uint32_t minSamples;
+	double share;
+
+	/* Background migration */
+	pthread_t thread;
+	int running;
+	int stop;
+	unsigned long intervalUs;
+
+	/* Statistics */
+	unsigned long long nScans;
+	unsigned long long nMigrations;
+	unsigned long long nFailed;			/* Migrations without memory on the target slice */
+};
+
+int migr_init(struct migr_space *m, sa_context_t *ctx, int nReaders, uint32_t sampleRate, uint32_t minSamples,
+	double share);
+void migr_destroy(struct migr_space *m);
+struct migr_reader* migr_reader_init(struct migr_space *m, int reader, int cpu);
+
+int migr_alloc(struct migr_space *m, size_t size, int slice, struct migr_object **object);
+void migr_free(struct migr_space *m, struct migr_object *object);
+
+int migr_scan(struct migr_space *m);
+int migr_start(struct migr_space *m, unsigned long intervalUs);
+void migr_stop(struct migr_space *m);
+void migr_synchronize(struct migr_space *m);
+
+static inline void migr_read_lock(struct migr_reader *r) {
+	__atomic_store_n(&r->epoch, r->epoch + 1, __ATOMIC_RELAXED);
+	/* The epoch must be visible before the pointers are read */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void migr_read_unlock(struct migr_reader *r) {
+	__atomic_store_n(&r->epoch, r->epoch + 1, __ATOMIC_RELEASE);
+}
+
+static inline void* migr_deref(struct migr_reader *r, struct migr_object *o) {
+	if (--r->countdown == 0) {
+		r->countdown = r->sampleRate;
+		__atomic_fetch_add(&o->samples[r->slice], 1, __ATOMIC_RELAXED);
+	}
+	return __atomic_load_n(&o->ptr, __ATOMIC_ACQUIRE);
+}
+
+/* Current copy of the object, which does not move until migr_write_unlock() */
+static inline void* migr_write_lock(struct migr_object *o) {
+	while (__atomic_exchange_n(&o->lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&o->lock, __ATOMIC_RELAXED)) {
+			__builtin_ia32_pause();
+		}
+	}
+	return o->ptr;
+}
+
+static inline void migr_write_unlock(struct migr_object *o) {
+	__atomic_store_n(&o->lock, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* MIGRATE_UTILS_H */
@@ -0,0 +1,74 @@
+/* 
+ * Functions for reading and writing MSR registers, configuring CHA/CBO registers,
+ * polling an address, and finding the slice counter (i.e., CBO/CHA) with highest number
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef MSR_UTILS_H
+#define MSR_UTILS_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include "arch-config.h"
+#include "sliceaware.h"
+#ifdef _MSC_VER
+#include <intrin.h> /* for rdtscp and clflush */
+#pragma optimize("gt",on)
+#else
+#include <x86intrin.h> /* for rdtscp and clflush */
+#endif
+
+/* Number of polling for acquiring the slice */
+#define NUMBER_POLLING 750
+
+/* MSR Addresses */
+#define PMON_GLOBAL_CTL_ADDRESS 0x700
+
+/* MSR Values */
+#define ENABLE_COUNT_SKYLAKE 0x2000000000000000 
+#define DISABLE_COUNT_SKYLAKE 0x8000000000000000
+#define ENABLE_COUNT_HASWELL 0x20000000
+#define DISABLE_COUNT_HASWELL 0x80000000
+#define SELECTED_EVENT 0x441134 /* Event: LLC_LOOKUP Mask: Any request (All snooping signals) */
+#define RESET_COUNTERS 0x30002
+#define FILTER_BOX_VALUE_SKYLAKE 0x01FE0000
+#define FILTER_BOX_VALUE_HASWELL 0x007E0000
+
+
+#ifdef SKYLAKE 
+#define NUMBER_SLICES 28 /* Maximum number of slices in SkyLake architecture */
+#define ENABLE_COUNT ENABLE_COUNT_SKYLAKE
+#define DISABLE_COUNT DISABLE_COUNT_SKYLAKE	
+#define FILTER_BOX_VALUE FILTER_BOX_VALUE_SKYLAKE															
+#else
+#define NUMBER_SLICES 8 /* Can be different for different CPUs */
+#define ENABLE_COUNT ENABLE_COUNT_HASWELL
+#define DISABLE_COUNT DISABLE_COUNT_HASWELL
+#define FILTER_BOX_VALUE FILTER_BOX_VALUE_HASWELL	
+#endif
+
+/*
+ * MSR device of one CPU (/dev/cpu/<cpu>/msr)
+ * The file is opened on first use. The uncore counters are shared by all threads,
+ * so a complete probing session (init -> poll -> read) must hold the lock.
+ */
+
+struct msr_device {
+	int cpu;
+	int fd;
+	pthread_mutex_t lock;
+};
+
+void msr_init(struct msr_device *dev, int cpu);
+void msr_close(struct msr_device *dev);
+
+int rdmsr_on_cpu(struct msr_device *dev, uint32_t reg, uint64_t *value);
+int wrmsr_on_cpu(struct msr_device *dev, uint32_t reg, uint64_t value);
+
+void polling(void* address);
+int uncore_init(struct msr_device *dev);
+int read_CHA_CBO(struct msr_device *dev, uint64_t *values, int nCounters);
+int find_CHA_CBO(struct msr_device *dev);
+
+#endif /* MSR_UTILS_H */
@@ -0,0 +1,382 @@
+/*
+ * Profile-guided hot/cold layouts: placing items on slices by their access frequency
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "plan-utils.h"
+
+/* An item and its number of accesses, for ranking */
+struct plan_item {
+	unsigned long long count;
+	unsigned long long index;
+};
+
+/* Hottest first; ties by index, so plans are reproducible */
+static int plan_compare(const void *a, const void *b) {
+	const struct plan_item *x = a, *y = b;
+	if (x->count != y->count) {
+		return (x->count > y->count) ? -1 : 1;
+	}
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+
+/*
+ * Grow an array of counts to hold index (new entries are 0)
+ * Returns SA_ERR_INVALID if the array cannot have index+1 entries (its size would overflow)
+ */
+
+static int plan_grow(unsigned long long **counts, unsigned long long *capacity, unsigned long long index) {
+
+	unsigned long long newCapacity = *capacity ? *capacity : 4096;
+	unsigned long long *grown;
+
+	while (newCapacity <= index) {
+		if (newCapacity > SIZE_MAX / sizeof(*grown) / 2) {
+			return SA_ERR_INVALID;
+		}
+		newCapacity *= 2;
+	}
+	if (newCapacity == *capacity) {
+		return SA_OK;
+	}
+	if ((grown = realloc(*counts, newCapacity * sizeof(*grown))) == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	memset(grown + *capacity, 0, (newCapacity - *capacity) * sizeof(*grown));
+	*counts = grown;
+	*capacity = newCapacity;
+	return SA_OK;
+}
+
+
+/*
+ * Number of accesses of every item of a profile (see plan-utils.h for the format)
+ * *counts is allocated here (nItems entries, freed by the caller)
+ * Returns SA_OK, SA_ERR_IO if the file cannot be read, SA_ERR_INVALID for a malformed line (or an index too large to hold) or SA_ERR_NOMEM
+ */
+
+int plan_profile_load(const char *path, unsigned long long **counts, unsigned long long *nItems) {
+
+	char line[PLAN_LINE_LENGTH];
+	unsigned long long capacity = 0, index, count;
+	FILE *file = fopen(path, "r");
+	int error = SA_OK;
+
+	*counts = NULL;
+	*nItems = 0;
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *p = line + strspn(line, " \t");
+		int n;
+		if (*p == '#' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+		if ((n = sscanf(p, "%llu %llu", &index, &count)) < 1) {
+			error = SA_ERR_INVALID;
+			break;
+		}
+		if ((error = plan_grow(counts, &capacity, index))) {
+			break;
+		}
+		(*counts)[index] += (n == 2) ? count : 1;
+		if (index >= *nItems) {
+			*nItems = index + 1;
+		}
+	}
+	fclose(file);
+	if (error) {
+		free(*counts);
+		*counts = NULL;
+		*nItems = 0;
+	}
+	return error;
+}
+
+
+/*
+ * Plan for nItems items with the given numbers of accesses
+ * The tiers are the slices of the policy (its mode does not matter, only their order and capacity);
+ * items with fewer than minCount accesses stay in plain memory
+ * Returns SA_OK, SA_ERR_INVALID or SA_ERR_NOMEM
+ */
+
+int plan_build(struct layout_plan *plan, const unsigned long long *counts, unsigned long long nItems,
+	const struct spill_policy *p, double fill, unsigned long long minCount) {
+
+	struct plan_item *items;
+	unsigned long long i, room;
+	int tier = 0;
+
+	memset(plan, 0, sizeof(*plan));
+	if (nItems == 0 || p->nSlices < 1 || fill < 0 || fill > 1) {
+		return SA_ERR_INVALID;
+	}
+	items = malloc(nItems * sizeof(*items));
+	plan->tiers = malloc(nItems * sizeof(*plan->tiers));
+	if (items == NULL || plan->tiers == NULL) {
+		free(items);
+		plan_destroy(plan);
+		return SA_ERR_NOMEM;
+	}
+	for (i=0; i<nItems; i++) {
+		items[i].count = counts[i];
+		items[i].index = i;
+	}
+	qsort(items, nItems, sizeof(*items), plan_compare);
+
+	plan->nItems = nItems;
+	room = (unsigned long long)(fill * p->capacity[0]);
+	for (i=0; i<nItems; i++) {
+		/* Next tier with room */
+		while (tier < p->nSlices && room == 0) {
+			if (++tier < p->nSlices) {
+				room = (unsigned long long)(fill * p->capacity[tier]);
+			}
+		}
+		if (tier >= p->nSlices || items[i].count < minCount || items[i].count == 0) {
+			plan->tiers[items[i].index] = PLAN_PLAIN;
+			plan->nPlain++;
+			plan->accessesPlain += items[i].count;
+			continue;
+		}
+		plan->tiers[items[i].index] = tier;
+		plan->nPlaced[tier]++;
+		plan->accesses[tier] += items[i].count;
+		if (tier + 1 > plan->nTiers) {
+			plan->nTiers = tier + 1;
+		}
+		room--;
+	}
+	free(items);
+	return SA_OK;
+}
+
+
+/*
+ * Write the remap table of a plan (plain items are left out)
+ */
+
+int plan_save(const struct layout_plan *plan, const char *path) {
+
+	FILE *file = fopen(path, "w");
+	unsigned long long i;
+
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	fprintf(file, "# item tier (%d tiers; tier 0 is the slice of the core, missing items are in plain memory)\n",
+		plan->nTiers);
+	for (i=0; i<plan->nItems; i++) {
+		if (plan->tiers[i] != PLAN_PLAIN) {
+			fprintf(file, "%llu %d\n", i, plan->tiers[i]);
+		}
+	}
+	if (fclose(file) != 0) {
+		return SA_ERR_IO;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Read a remap table written by plan_save()
+ * Returns SA_OK, SA_ERR_IO if the file cannot be read, SA_ERR_INVALID for a malformed line (or an index too large to hold) or SA_ERR_NOMEM
+ */
+
+int plan_load(struct layout_plan *plan, const char *path) {
+
+	char line[PLAN_LINE_LENGTH];
+	unsigned long long capacity = 0, index, *tiers = NULL, i;
+	FILE *file = fopen(path, "r");
+	int tier, error = SA_OK;
+
+	memset(plan, 0, sizeof(*plan));
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+
+	/* Tiers are kept as tier + 1 while reading, so that missing items are 0 */
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == '\0') {
+			continue;
+		}
+		if (sscanf(p, "%llu %d", &index, &tier) != 2 || tier < PLAN_PLAIN || tier >= NUMBER_VIRTUAL_SLICES) {
+			error = SA_ERR_INVALID;
+			break;
+		}
+		if ((error = plan_grow(&tiers, &capacity, index))) {
+			break;
+		}
+		tiers[index] = tier + 1;
+		if (index >= plan->nItems) {
+			plan->nItems = index + 1;
+		}
+	}
+	fclose(file);
+	if (error == SA_OK && plan->nItems == 0) {
+		error = SA_ERR_INVALID;
+	}
+	if (error == SA_OK && (plan->tiers = malloc(plan->nItems * sizeof(*plan->tiers))) == NULL) {
+		error = SA_ERR_NOMEM;
+	}
+	if (error) {
+		free(tiers);
+		memset(plan, 0, sizeof(*plan));
+		return error;
+	}
+
+	for (i=0; i<plan->nItems; i++) {
+		plan->tiers[i] = (int)tiers[i] - 1;
+		if (plan->tiers[i] == PLAN_PLAIN) {
+			plan->nPlain++;
+			continue;
+		}
+		plan->nPlaced[plan->tiers[i]]++;
+		if (plan->tiers[i] + 1 > plan->nTiers) {
+			plan->nTiers = plan->tiers[i] + 1;
+		}
+	}
+	free(tiers);
+	return SA_OK;
+}
+
+
+/*
+ * Items of every tier, with the share of the accesses they serve (for plans built from a profile)
+ */
+
+void plan_print(FILE *file, const struct layout_plan *plan) {
+
+	unsigned long long total = plan->accessesPlain;
+	int tier;
+
+	for (tier=0; tier<plan->nTiers; tier++) {
+		total += plan->accesses[tier];
+	}
+	for (tier=0; tier<plan->nTiers; tier++) {
+		fprintf(file, "Tier %d: %llu items (%llu KB)", tier, plan->nPlaced[tier], plan->nPlaced[tier] * LINE / 1024);
+		if (total) {
+			fprintf(file, ", %.2f%% of the accesses", 100.0 * plan->accesses[tier] / total);
+		}
+		fprintf(file, "\n");
+	}
+	fprintf(file, "Plain: %llu items (%llu KB)", plan->nPlain, plan->nPlain * LINE / 1024);
+	if (total) {
+		fprintf(file, ", %.2f%% of the accesses", 100.0 * plan->accessesPlain / total);
+	}
+	fprintf(file, "\n");
+}
+
+
+void plan_destroy(struct layout_plan *plan) {
+	free(plan->tiers);
+	memset(plan, 0, sizeof(*plan));
+}
+
+
+/* Tier of an item; items beyond the plan are in plain memory */
+static inline int plan_tier(const struct layout_plan *plan, size_t item) {
+	return (item < plan->nItems) ? plan->tiers[item] : PLAN_PLAIN;
+}
+
+
+/*
+ * Lines for the items 0..nLines-1 of a core, whose tiers are the slices of its policy
+ * The plain items are consecutive lines of a buffer created here (plain->addr NULL if there are none)
+ * Returns SA_OK, SA_ERR_INVALID if the plan has more tiers than the policy has slices, or an allocation error
+ */
+
+int plan_alloc_lines(sa_context_t *ctx, const struct layout_plan *plan, const struct spill_policy *p,
+	void **lines, size_t nLines, struct buffer *plain) {
+
+	size_t counts[NUMBER_VIRTUAL_SLICES] = {0}, nPlain = 0, i, n;
+	void **tierLines;
+	int tier, error = SA_OK;
+
+	memset(plain, 0, sizeof(*plain));
+	if (plan->nTiers > p->nSlices) {
+		return SA_ERR_INVALID;
+	}
+	for (i=0; i<nLines; i++) {
+		tier = plan_tier(plan, i);
+		if (tier == PLAN_PLAIN) {
+			nPlain++;
+		} else {
+			counts[tier]++;
+		}
+	}
+
+	if (nPlain && (error = create_buffer_sized(plain, nPlain * LINE, PAGE_SIZE_AUTO))) {
+		return error;
+	}
+	for (tier=0; tier<plan->nTiers; tier++) {
+		if (counts[tier] == 0) {
+			continue;
+		}
+		if ((tierLines = malloc(counts[tier] * sizeof(*tierLines))) == NULL) {
+			error = SA_ERR_NOMEM;
+			break;
+		}
+		if ((error = sa_alloc_lines(ctx, p->slices[tier], tierLines, counts[tier])) == SA_OK) {
+			for (i=0, n=0; i<nLines; i++) {
+				if (plan_tier(plan, i) == tier) {
+					lines[i] = tierLines[n++];
+				}
+			}
+		}
+		free(tierLines);
+		if (error) {
+			break;
+		}
+	}
+	if (error) {
+		/* Give back the tiers allocated so far */
+		int failed = tier;
+		for (tier=0; tier<failed; tier++) {
+			for (i=0; i<nLines; i++) {
+				if (plan_tier(plan, i) == tier) {
+					sa_free_lines(ctx, p->slices[tier], &lines[i], 1);
+				}
+			}
+		}
+		if (plain->addr != NULL) {
+			free_buffer_sized(plain);
+		}
+		memset(plain, 0, sizeof(*plain));
+		return error;
+	}
+
+	for (i=0, n=0; i<nLines; i++) {
+		if (plan_tier(plan, i) == PLAN_PLAIN) {
+			lines[i] = (char*)plain->addr + (n++) * LINE;
+		}
+	}
+	return SA_OK;
+}
+
+
+void plan_free_lines(sa_context_t *ctx, const struct layout_plan *plan, const struct spill_policy *p,
+	void **lines, size_t nLines, struct buffer *plain) {
+
+	size_t i;
+	int tier;
+
+	for (i=0; i<nLines; i++) {
+		tier = plan_tier(plan, i);
+		if (tier != PLAN_PLAIN) {
+			sa_free_lines(ctx, p->slices[tier], &lines[i], 1);
+		}
+	}
+	if (plain->addr != NULL) {
+		free_buffer_sized(plain);
+	}
+	memset(plain, 0, sizeof(*plain));
+}
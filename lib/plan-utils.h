@@ -0,0 +1,56 @@
+/*
+ * Profile-guided hot/cold layouts: placing items on slices by their access frequency
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef PLAN_UTILS_H
+#define PLAN_UTILS_H
+
+#include <stdio.h>
+#include "spill-utils.h"
+#include "memory-utils.h"
+
+/*
+ * A plan gives every item (a cache line of the working set, i.e., an index of an access pattern) a tier:
+ * tier k is the k-th slice of a spill policy (0 -> the primary slice of the core, 1 -> the closest other slice, ...),
+ * and PLAN_PLAIN is ordinary memory. Items are ranked by their number of accesses and the hottest ones fill
+ * the tiers in order, each up to fill * its capacity, so that e.g. the head of a Zipf distribution is on the
+ * primary slice, its body on the nearby slices and its tail (and the items that are never accessed) in plain memory
+ * instead of evicting the hot items. A fill below 1 leaves room on the slices for other data and other cores.
+ *
+ * Tiers are relative to a core, so one plan (a remap table) applies to every core: each core resolves
+ * the tiers with its own policy (plan_alloc_lines()).
+ *
+ * Profile: one item per line, "<index>" for every access (an access pattern) or "<index> <count>"
+ * (a sampled profile), '#' starts a comment.
+ * Remap table: "<index> <tier>" per line (tier -1 -> plain memory); missing items are in plain memory.
+ */
+
+#define PLAN_PLAIN -1
+#define PLAN_LINE_LENGTH 256
+
+struct layout_plan {
+	unsigned long long nItems;
+	int *tiers;										/* Tier of every item */
+	int nTiers;										/* Tiers with items (highest tier + 1) */
+	unsigned long long nPlaced[NUMBER_VIRTUAL_SLICES];	/* Items of every tier */
+	unsigned long long nPlain;						/* Items in plain memory */
+	unsigned long long accesses[NUMBER_VIRTUAL_SLICES];	/* Accesses of the profile served by every tier (0 if loaded) */
+	unsigned long long accessesPlain;
+};
+
+int plan_profile_load(const char *path, unsigned long long **counts, unsigned long long *nItems);
+int plan_build(struct layout_plan *plan, const unsigned long long *counts, unsigned long long nItems,
+	const struct spill_policy *p, double fill, unsigned long long minCount);
+int plan_save(const struct layout_plan *plan, const char *path);
+int plan_load(struct layout_plan *plan, const char *path);
+void plan_print(FILE *file, const struct layout_plan *plan);
+void plan_destroy(struct layout_plan *plan);
+
+int plan_alloc_lines(sa_context_t *ctx, const struct layout_plan *plan, const struct spill_policy *p,
+	void **lines, size_t nLines, struct buffer *plain);
+void plan_free_lines(sa_context_t *ctx, const struct layout_plan *plan, const struct spill_policy *p,
+	void **lines, size_t nLines, struct buffer *plain);
+
+#endif /* PLAN_UTILS_H */
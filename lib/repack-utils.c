@@ -0,0 +1,187 @@
+/*
+ * Repacking existing arrays of records into slice-local lines
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include "repack-utils.h"
+
+/* Write a staged line with non-temporal stores */
+static inline void repack_stream_line(void *dst, const void *line) {
+	const __m128i *s = line;
+	__m128i *d = dst;
+	_mm_stream_si128(d, _mm_load_si128(s));
+	_mm_stream_si128(d + 1, _mm_load_si128(s + 1));
+	_mm_stream_si128(d + 2, _mm_load_si128(s + 2));
+	_mm_stream_si128(d + 3, _mm_load_si128(s + 3));
+}
+
+
+/*
+ * Copy the records into the lines of their parts (the slots hold the parts and receive the slots)
+ */
+
+static int repack_copy(struct repack *r, const char *src, int streamed) {
+
+	size_t *next, *end, i, slot, mask = (1UL << r->recordsShift) - 1;
+	uint8_t *staging = NULL, *stage;
+	int p, part;
+
+	next = malloc(r->nParts * sizeof(*next));
+	end = malloc(r->nParts * sizeof(*end));
+	if (streamed && (staging = aligned_alloc(LINE, r->nParts * LINE)) != NULL) {
+		memset(staging, 0, r->nParts * LINE);
+	}
+	if (next == NULL || end == NULL || (streamed && staging == NULL)) {
+		free(next);
+		free(end);
+		free(staging);
+		return SA_ERR_NOMEM;
+	}
+	for (p=0; p<r->nParts; p++) {
+		next[p] = r->parts[p].firstLine << r->recordsShift;
+		end[p] = next[p] + r->parts[p].nRecords;
+	}
+
+	for (i=0; i<r->nRecords; i++, src += r->recordSize) {
+		/* Prefetching beyond the input is harmless */
+		__builtin_prefetch(src + REPACK_PREFETCH_DISTANCE);
+		part = r->slots ? (int)r->slots[i] : 0;
+		slot = next[part]++;
+		if (r->slots) {
+			r->slots[i] = slot;
+		}
+		if (!streamed) {
+			memcpy(repack_slot(r, slot), src, r->recordSize);
+			continue;
+		}
+		stage = staging + part * LINE;
+		memcpy(stage + ((slot & mask) << r->strideShift), src, r->recordSize);
+		if ((slot & mask) == mask || next[part] == end[part]) {
+			repack_stream_line(r->lines[slot >> r->recordsShift], stage);
+			memset(stage, 0, LINE);
+		}
+	}
+	if (streamed) {
+		/* Non-temporal stores are weakly ordered */
+		_mm_sfence();
+	}
+
+	free(next);
+	free(end);
+	free(staging);
+	return SA_OK;
+}
+
+
+/*
+ * Copy nRecords records of recordSize bytes (at most a line) into lines on the slices of nParts cores;
+ * key gives the part of every record (NULL only with one part). stream is a copy mode (REPACK_STREAM_*).
+ * Returns SA_OK, SA_ERR_INVALID (e.g., records larger than a line or a part out of range), SA_ERR_NOMEM,
+ * or an error of sa_alloc_lines()
+ */
+
+int repack_partition(struct repack *r, sa_context_t *ctx, const void *records, size_t nRecords, size_t recordSize,
+	const int *cpus, int nParts, repack_key_fn key, void *arg, int stream) {
+
+	const char *src = records;
+	unsigned lineShift;
+	size_t i;
+	int p, part, error;
+
+	memset(r, 0, sizeof(*r));
+	if (ctx == NULL || records == NULL || nRecords == 0 || nRecords > UINT32_MAX || recordSize == 0 ||
+		recordSize > LINE || cpus == NULL || nParts <= 0 || (nParts > 1 && key == NULL)) {
+		return SA_ERR_INVALID;
+	}
+	for (lineShift=0; (1UL << lineShift) < LINE; lineShift++);
+	for (r->strideShift=0; (1UL << r->strideShift) < recordSize; r->strideShift++);
+	r->recordsShift = lineShift - r->strideShift;
+	r->ctx = ctx;
+	r->nRecords = nRecords;
+	r->recordSize = recordSize;
+
+	r->parts = calloc(nParts, sizeof(*r->parts));
+	if (r->parts == NULL || (nParts > 1 && (r->slots = malloc(nRecords * sizeof(*r->slots))) == NULL)) {
+		repack_destroy(r);
+		return SA_ERR_NOMEM;
+	}
+	for (p=0; p<nParts; p++) {
+		r->parts[p].cpu = cpus[p];
+		r->parts[p].slice = sa_cpu_slice(cpus[p]);
+		if (r->parts[p].slice < 0 || r->parts[p].slice >= NUMBER_VIRTUAL_SLICES) {
+			repack_destroy(r);
+			return SA_ERR_INVALID;
+		}
+	}
+
+	/* The part of every record, kept in its slot until the copy */
+	for (i=0; i<nRecords; i++) {
+		part = (nParts > 1) ? key(src + i * recordSize, i, arg) : 0;
+		if (part < 0 || part >= nParts) {
+			repack_destroy(r);
+			return SA_ERR_INVALID;
+		}
+		if (r->slots) {
+			r->slots[i] = part;
+		}
+		r->parts[part].nRecords++;
+	}
+
+	for (p=0; p<nParts; p++) {
+		r->parts[p].firstLine = r->nLines;
+		r->parts[p].nLines = (r->parts[p].nRecords + (1UL << r->recordsShift) - 1) >> r->recordsShift;
+		r->nLines += r->parts[p].nLines;
+	}
+	if ((r->lines = malloc(r->nLines * sizeof(*r->lines))) == NULL) {
+		repack_destroy(r);
+		return SA_ERR_NOMEM;
+	}
+	/* Only the parts with lines are freed on an error */
+	for (p=0; p<nParts; p++) {
+		if (r->parts[p].nLines &&
+			(error = sa_alloc_lines(ctx, r->parts[p].slice, r->lines + r->parts[p].firstLine, r->parts[p].nLines))) {
+			repack_destroy(r);
+			return error;
+		}
+		r->nParts = p + 1;
+	}
+
+	r->streamed = (stream == REPACK_STREAM_AUTO) ? (nRecords * recordSize >= REPACK_STREAM_BYTES) :
+		(stream != REPACK_STREAM_NEVER);
+	if ((error = repack_copy(r, records, r->streamed))) {
+		repack_destroy(r);
+		return error;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Copy the records into lines on the slice of a core
+ */
+
+int repack_to_core(struct repack *r, sa_context_t *ctx, const void *records, size_t nRecords, size_t recordSize,
+	int cpu, int stream) {
+	return repack_partition(r, ctx, records, nRecords, recordSize, &cpu, 1, NULL, NULL, stream);
+}
+
+
+void repack_destroy(struct repack *r) {
+
+	int p;
+
+	for (p=0; p<r->nParts; p++) {
+		if (r->parts[p].nLines) {
+			sa_free_lines(r->ctx, r->parts[p].slice, r->lines + r->parts[p].firstLine, r->parts[p].nLines);
+		}
+	}
+	free(r->lines);
+	free(r->slots);
+	free(r->parts);
+	memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,85 @@
+/*
+ * Repacking existing arrays of records into slice-local lines
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef REPACK_UTILS_H
+#define REPACK_UTILS_H
+
+#include <stdint.h>
+#include "sliceaware.h"
+#include "cache-utils.h"
+
+/*
+ * A repacked table is a copy of an array of fixed-size records in lines of sa_alloc_lines(), e.g., to bring
+ * a warm table into a slice-aware layout at startup instead of writing a copy loop for every table.
+ * The records either go to the slice of one core (repack_to_core()) or are partitioned over the slices
+ * of several cores by a key function (repack_partition()), e.g., the core that handles a flow.
+ *
+ * - Records are at most one line (64 Bytes) and are placed at a stride of their size rounded up to a power of two,
+ *   so that no record straddles two lines (which would be on different slices). Larger records should be
+ *   split into their hot fields, which are repacked, and the rest.
+ * - repack_get() maps the index of a record in the original array to its copy: with one part, the index is
+ *   the slot of the record; with several parts, a remap table (4 Bytes per record) gives its slot.
+ *   The records of a part keep their original order, and repack_part_get() iterates over them without the table.
+ * - Large inputs (REPACK_STREAM_BYTES or more) are copied with non-temporal stores: every destination line is
+ *   gathered in a staging line and written as a whole, so the copy neither reads the destination lines
+ *   (read-for-ownership) nor evicts the working set of the core with them.
+ */
+
+#define REPACK_STREAM_BYTES (8*1024*1024)	/* Inputs of at least this size are streamed by default */
+#define REPACK_PREFETCH_DISTANCE 512			/* Bytes of the input prefetched ahead of the copy */
+
+/* Copy modes */
+#define REPACK_STREAM_AUTO -1
+#define REPACK_STREAM_NEVER 0
+#define REPACK_STREAM_ALWAYS 1
+
+/* Part of a record, in [0, nParts) */
+typedef int (*repack_key_fn)(const void *record, size_t index, void *arg);
+
+struct repack_part {
+	int cpu;
+	int slice;
+	size_t firstLine;				/* The part has lines firstLine..firstLine+nLines-1 of the table */
+	size_t nLines;
+	size_t nRecords;
+};
+
+struct repack {
+	sa_context_t *ctx;
+	size_t nRecords;
+	size_t recordSize;
+	unsigned strideShift;			/* log2 of the stride of the records */
+	unsigned recordsShift;			/* log2 of the records per line */
+	void **lines;					/* Lines of all parts, part by part */
+	size_t nLines;
+	uint32_t *slots;				/* Slot of every record (NULL -> one part, the slot is the index) */
+	int nParts;
+	struct repack_part *parts;
+	int streamed;					/* Copied with non-temporal stores */
+};
+
+int repack_to_core(struct repack *r, sa_context_t *ctx, const void *records, size_t nRecords, size_t recordSize,
+	int cpu, int stream);
+int repack_partition(struct repack *r, sa_context_t *ctx, const void *records, size_t nRecords, size_t recordSize,
+	const int *cpus, int nParts, repack_key_fn key, void *arg, int stream);
+void repack_destroy(struct repack *r);
+
+/* Record of a slot */
+static inline void* repack_slot(const struct repack *r, size_t slot) {
+	return (char*)r->lines[slot >> r->recordsShift] + ((slot & ((1UL << r->recordsShift) - 1)) << r->strideShift);
+}
+
+/* Copy of record i of the original array */
+static inline void* repack_get(const struct repack *r, size_t i) {
+	return repack_slot(r, r->slots ? r->slots[i] : i);
+}
+
+/* Record n of a part (in the order of the original array) */
+static inline void* repack_part_get(const struct repack *r, int part, size_t n) {
+	return repack_slot(r, (r->parts[part].firstLine << r->recordsShift) + n);
+}
+
+#endif /* REPACK_UTILS_H */
@@ -0,0 +1,339 @@
+/*
+ * Slice-affinity-aware task scheduler with work stealing
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "sched-utils.h"
+
+/*
+ * Deque of a worker
+ */
+
+static int deque_init(struct task_deque *d) {
+	pthread_mutex_init(&d->lock, NULL);
+	d->head = 0;
+	d->nTasks = 0;
+	d->capacity = 64;
+	d->tasks = malloc(d->capacity*sizeof(*d->tasks));
+	return (d->tasks == NULL) ? SA_ERR_NOMEM : SA_OK;
+}
+
+static int deque_push(struct task_deque *d, const struct task *t) {
+
+	unsigned long i;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->nTasks == d->capacity) {
+		struct task *tasks = malloc(2*d->capacity*sizeof(*tasks));
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&d->lock);
+			return SA_ERR_NOMEM;
+		}
+		for (i=0; i<d->nTasks; i++) {
+			tasks[i] = d->tasks[(d->head + i) % d->capacity];
+		}
+		free(d->tasks);
+		d->tasks = tasks;
+		d->head = 0;
+		d->capacity *= 2;
+	}
+	d->tasks[(d->head + d->nTasks) % d->capacity] = *t;
+	__atomic_store_n(&d->nTasks, d->nTasks + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&d->lock);
+	return SA_OK;
+}
+
+/* Newest task, for the owner */
+static int deque_pop_tail(struct task_deque *d, struct task *t) {
+
+	int found = 0;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->nTasks > 0) {
+		*t = d->tasks[(d->head + d->nTasks - 1) % d->capacity];
+		__atomic_store_n(&d->nTasks, d->nTasks - 1, __ATOMIC_RELEASE);
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+/* Oldest task, for thieves */
+static int deque_pop_head(struct task_deque *d, struct task *t) {
+
+	int found = 0;
+
+	/* Skip empty victims without taking their lock */
+	if (__atomic_load_n(&d->nTasks, __ATOMIC_ACQUIRE) == 0) {
+		return 0;
+	}
+	pthread_mutex_lock(&d->lock);
+	if (d->nTasks > 0) {
+		*t = d->tasks[d->head];
+		d->head = (d->head + 1) % d->capacity;
+		__atomic_store_n(&d->nTasks, d->nTasks - 1, __ATOMIC_RELEASE);
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+
+/*
+ * Latency from the core of a worker to a slice (unknown entries are the most expensive)
+ */
+
+static double sched_latency(const struct latency_table *table, int core, int slice) {
+	if (core >= table->nCores || slice >= table->nSlices) {
+		return 1e30;
+	}
+	return table->latency[core][slice];
+}
+
+
+/*
+ * Steal a task, trying the victims in order
+ */
+
+static int sched_steal(struct sched_worker *w, struct task *t) {
+
+	int i;
+
+	for (i=0; i<w->s->nWorkers-1; i++) {
+		if (deque_pop_head(&w->s->workers[w->victims[i]].deque, t)) {
+			w->nStolen++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static void* sched_worker_loop(void *arg) {
+
+	struct sched_worker *w = arg;
+	struct scheduler *s = w->s;
+	struct task t;
+	cpu_set_t set;
+
+	/* The worker still runs if the core is not available, only without locality */
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	for (;;) {
+		if (deque_pop_tail(&w->deque, &t) || (s->steal && sched_steal(w, &t))) {
+			__atomic_sub_fetch(&s->nQueued, 1, __ATOMIC_ACQ_REL);
+			t.fn(t.arg);
+			w->nExecuted++;
+			pthread_mutex_lock(&s->lock);
+			if (--s->nOutstanding == 0) {
+				pthread_cond_broadcast(&s->done);
+			}
+			pthread_mutex_unlock(&s->lock);
+			continue;
+		}
+
+		/* Sleep until there is something to run (tasks are pushed with s->lock held) */
+		pthread_mutex_lock(&s->lock);
+		while (!s->stop && (s->steal ? __atomic_load_n(&s->nQueued, __ATOMIC_ACQUIRE)
+				: __atomic_load_n(&w->deque.nTasks, __ATOMIC_ACQUIRE)) == 0) {
+			pthread_cond_wait(&s->work, &s->lock);
+		}
+		if (s->stop) {
+			pthread_mutex_unlock(&s->lock);
+			break;
+		}
+		pthread_mutex_unlock(&s->lock);
+	}
+	return NULL;
+}
+
+
+/*
+ * Free the memory of the scheduler (the workers must not be running)
+ */
+
+static void sched_free(struct scheduler *s) {
+
+	int i, slice;
+
+	for (i=0; s->workers != NULL && i<s->nWorkers; i++) {
+		free(s->workers[i].deque.tasks);
+		free(s->workers[i].victims);
+		pthread_mutex_destroy(&s->workers[i].deque.lock);
+	}
+	for (slice=0; slice<NUMBER_VIRTUAL_SLICES; slice++) {
+		free(s->sliceWorkers[slice]);
+	}
+	free(s->workers);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->work);
+	pthread_cond_destroy(&s->done);
+}
+
+
+/*
+ * Start one worker per CPU in cpus
+ * table gives the latency from each core to each slice (NULL -> ring model)
+ */
+
+int sched_init(struct scheduler *s, const int *cpus, int nWorkers, const struct latency_table *table, int steal) {
+
+	int i, j, slice;
+	struct latency_table ring;
+
+	memset(s, 0, sizeof(*s));
+	if (nWorkers <= 0) {
+		return SA_ERR_INVALID;
+	}
+	if (table == NULL) {
+		latency_table_ring(&ring, NUMBER_VIRTUAL_SLICES, NUMBER_VIRTUAL_SLICES);
+		table = &ring;
+	}
+	s->nWorkers = nWorkers;
+	s->steal = steal;
+	s->workers = calloc(nWorkers, sizeof(*s->workers));
+	if (s->workers == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->work, NULL);
+	pthread_cond_init(&s->done, NULL);
+
+	for (i=0; i<nWorkers; i++) {
+		struct sched_worker *w = &s->workers[i];
+		w->id = i;
+		w->cpu = cpus[i];
+		w->slice = sa_cpu_slice(cpus[i]);
+		w->s = s;
+		w->victims = malloc(nWorkers*sizeof(*w->victims));
+		if (w->slice < 0 || w->victims == NULL || deque_init(&w->deque)) {
+			sched_free(s);
+			return (w->slice < 0) ? SA_ERR_INVALID : SA_ERR_NOMEM;
+		}
+	}
+
+	/* Victims: other workers by the latency from this core to their slice */
+	for (i=0; i<nWorkers; i++) {
+		struct sched_worker *w = &s->workers[i];
+		int n = 0;
+		for (j=0; j<nWorkers; j++) {
+			int k;
+			if (j == i) {
+				continue;
+			}
+			double l = sched_latency(table, w->slice, s->workers[j].slice);
+			for (k=n; k>0 && sched_latency(table, w->slice, s->workers[w->victims[k-1]].slice) > l; k--) {
+				w->victims[k] = w->victims[k-1];
+			}
+			w->victims[k] = j;
+			n++;
+		}
+	}
+
+	/* Tasks of a slice go to the workers of that slice, or to the workers closest to it */
+	for (slice=0; slice<NUMBER_VIRTUAL_SLICES; slice++) {
+		double best = 0;
+		s->sliceWorkers[slice] = malloc(nWorkers*sizeof(int));
+		if (s->sliceWorkers[slice] == NULL) {
+			sched_free(s);
+			return SA_ERR_NOMEM;
+		}
+		for (i=0; i<nWorkers; i++) {
+			double l = (s->workers[i].slice == slice) ? -1 : sched_latency(table, s->workers[i].slice, slice);
+			if (s->nSliceWorkers[slice] == 0 || l < best) {
+				best = l;
+				s->nSliceWorkers[slice] = 0;
+			}
+			if (l == best) {
+				s->sliceWorkers[slice][s->nSliceWorkers[slice]++] = i;
+			}
+		}
+	}
+
+	for (i=0; i<nWorkers; i++) {
+		if (pthread_create(&s->workers[i].thread, NULL, sched_worker_loop, &s->workers[i])) {
+			pthread_mutex_lock(&s->lock);
+			s->stop = 1;
+			pthread_cond_broadcast(&s->work);
+			pthread_mutex_unlock(&s->lock);
+			for (j=0; j<i; j++) {
+				pthread_join(s->workers[j].thread, NULL);
+			}
+			sched_free(s);
+			return SA_ERR_NOMEM;
+		}
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Queue a task whose data lives on the slice (SCHED_ANY_SLICE -> slice of the calling thread)
+ * Can be called from tasks.
+ */
+
+int sched_submit(struct scheduler *s, task_fn fn, void *arg, int slice) {
+
+	struct task t = {fn, arg, slice};
+	int error;
+
+	if (slice == SCHED_ANY_SLICE) {
+		slice = sa_current_slice();
+		t.slice = (slice < 0) ? 0 : slice;
+	}
+	if (t.slice < 0 || t.slice >= NUMBER_VIRTUAL_SLICES) {
+		return SA_ERR_INVALID;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	int worker = s->sliceWorkers[t.slice][s->nextWorker[t.slice]++ % s->nSliceWorkers[t.slice]];
+	if ((error = deque_push(&s->workers[worker].deque, &t))) {
+		pthread_mutex_unlock(&s->lock);
+		return error;
+	}
+	s->nOutstanding++;
+	__atomic_add_fetch(&s->nQueued, 1, __ATOMIC_ACQ_REL);
+	pthread_cond_broadcast(&s->work);
+	pthread_mutex_unlock(&s->lock);
+	return SA_OK;
+}
+
+
+/*
+ * Wait until all the submitted tasks (including the ones they submit) are finished
+ */
+
+void sched_wait(struct scheduler *s) {
+	pthread_mutex_lock(&s->lock);
+	while (s->nOutstanding > 0) {
+		pthread_cond_wait(&s->done, &s->lock);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+
+/*
+ * Stop the workers (queued tasks are dropped) and free the scheduler
+ */
+
+void sched_destroy(struct scheduler *s) {
+
+	int i;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->work);
+	pthread_mutex_unlock(&s->lock);
+
+	for (i=0; i<s->nWorkers; i++) {
+		pthread_join(s->workers[i].thread, NULL);
+	}
+	sched_free(s);
+}
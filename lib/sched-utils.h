@@ -0,0 +1,76 @@
+/*
+ * Slice-affinity-aware task scheduler with work stealing
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SCHED_UTILS_H
+#define SCHED_UTILS_H
+
+#include <pthread.h>
+#include "latency-utils.h"
+
+/*
+ * Every task is tagged with the slice its data lives on and is queued at a worker whose core
+ * is closest to that slice (round-robin among the workers sharing the slice).
+ * A worker runs its own tasks first (newest first, since their data is most likely cached),
+ * then steals the oldest task of other workers, trying the victims whose slice is the cheapest
+ * to access from its core first (according to the latency table), i.e., adjacent/secondary slices before far ones.
+ */
+
+#define SCHED_ANY_SLICE -1
+#define SCHED_STEAL 1
+#define SCHED_NO_STEAL 0
+
+typedef void (*task_fn)(void *arg);
+
+struct task {
+	task_fn fn;
+	void *arg;
+	int slice;
+};
+
+/* Tasks of a worker: the owner takes from the tail, thieves from the head */
+struct task_deque {
+	pthread_mutex_t lock;
+	struct task *tasks;			/* Circular buffer */
+	unsigned long head;
+	unsigned long nTasks;
+	unsigned long capacity;
+};
+
+struct scheduler;
+
+struct sched_worker {
+	int id;
+	int cpu;
+	int slice;					/* Slice closest to the core of the worker */
+	pthread_t thread;
+	struct task_deque deque;
+	int *victims;				/* Other workers, cheapest slice first */
+	struct scheduler *s;
+	unsigned long long nExecuted;
+	unsigned long long nStolen;	/* Tasks taken from other workers */
+};
+
+struct scheduler {
+	int nWorkers;
+	struct sched_worker *workers;
+	int steal;							/* SCHED_STEAL or SCHED_NO_STEAL (static partitioning) */
+	int *sliceWorkers[NUMBER_VIRTUAL_SLICES];	/* Workers a task of each slice can be queued at */
+	int nSliceWorkers[NUMBER_VIRTUAL_SLICES];
+	unsigned nextWorker[NUMBER_VIRTUAL_SLICES];
+	pthread_mutex_t lock;
+	pthread_cond_t work;				/* Signaled when a task is submitted */
+	pthread_cond_t done;				/* Signaled when the last outstanding task is finished */
+	unsigned long nQueued;				/* Tasks waiting in the deques */
+	unsigned long nOutstanding;			/* Tasks submitted and not finished */
+	int stop;
+};
+
+int sched_init(struct scheduler *s, const int *cpus, int nWorkers, const struct latency_table *table, int steal);
+int sched_submit(struct scheduler *s, task_fn fn, void *arg, int slice);
+void sched_wait(struct scheduler *s);
+void sched_destroy(struct scheduler *s);
+
+#endif /* SCHED_UTILS_H */
@@ -0,0 +1,212 @@
+/*
+ * Sharded statistics on slice-local memory: counters, gauges, histograms and token buckets
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "shard-utils.h"
+#include "timing-utils.h"
+
+/*
+ * Allocate linesPerShard zeroed lines per shard, on the slice of cpus[shard] (cpus NULL -> CPU i for shard i)
+ */
+
+int shards_init(struct shards *s, sa_context_t *ctx, const int *cpus, int nShards, int linesPerShard) {
+
+	int i, error;
+	size_t l;
+
+	memset(s, 0, sizeof(*s));
+	if (nShards <= 0 || linesPerShard <= 0) {
+		return SA_ERR_INVALID;
+	}
+	s->ctx = ctx;
+	s->nShards = nShards;
+	s->linesPerShard = linesPerShard;
+	s->slices = malloc(nShards * sizeof(*s->slices));
+	s->lines = malloc((size_t)nShards * linesPerShard * sizeof(*s->lines));
+	if (s->slices == NULL || s->lines == NULL) {
+		shards_destroy(s);
+		return SA_ERR_NOMEM;
+	}
+
+	for (i=0; i<nShards; i++) {
+		s->slices[i] = sa_cpu_slice(cpus ? cpus[i] : i);
+		if (s->slices[i] < 0) {
+			error = s->slices[i];
+			shards_destroy(s);
+			return error;
+		}
+	}
+
+	if (ctx == NULL) {
+		s->padded = aligned_alloc(LINE, (size_t)nShards * linesPerShard * LINE);
+		if (s->padded == NULL) {
+			shards_destroy(s);
+			return SA_ERR_NOMEM;
+		}
+		for (l=0; l<(size_t)nShards * linesPerShard; l++) {
+			s->lines[l] = (char*)s->padded + l * LINE;
+		}
+	} else {
+		for (i=0; i<nShards; i++) {
+			if ((error = sa_alloc_lines(ctx, s->slices[i], s->lines + (size_t)i * linesPerShard, linesPerShard))) {
+				/* Shards allocated so far are released by shards_destroy() */
+				s->nShards = i;
+				shards_destroy(s);
+				return error;
+			}
+		}
+	}
+	for (l=0; l<(size_t)nShards * linesPerShard; l++) {
+		memset(s->lines[l], 0, LINE);
+	}
+	return SA_OK;
+}
+
+
+void shards_destroy(struct shards *s) {
+	int i;
+	if (s->ctx != NULL && s->lines != NULL) {
+		for (i=0; i<s->nShards; i++) {
+			sa_free_lines(s->ctx, s->slices[i], s->lines + (size_t)i * s->linesPerShard, s->linesPerShard);
+		}
+	}
+	free(s->padded);
+	free(s->lines);
+	free(s->slices);
+	memset(s, 0, sizeof(*s));
+}
+
+
+uint64_t shard_counter_read(const struct shard_counter *c) {
+	uint64_t sum = 0;
+	int i;
+	for (i=0; i<c->s.nShards; i++) {
+		sum += __atomic_load_n(shard_values(&c->s, i, 0), __ATOMIC_RELAXED);
+	}
+	return sum;
+}
+
+
+int64_t shard_gauge_sum(const struct shard_gauge *g) {
+	int64_t sum = 0;
+	int i;
+	for (i=0; i<g->s.nShards; i++) {
+		sum += __atomic_load_n((int64_t*)shard_values(&g->s, i, 0), __ATOMIC_RELAXED);
+	}
+	return sum;
+}
+
+
+int64_t shard_gauge_max(const struct shard_gauge *g) {
+	int64_t max = INT64_MIN, value;
+	int i;
+	for (i=0; i<g->s.nShards; i++) {
+		value = __atomic_load_n((int64_t*)shard_values(&g->s, i, 0), __ATOMIC_RELAXED);
+		if (value > max) {
+			max = value;
+		}
+	}
+	return max;
+}
+
+
+/*
+ * Sum of the buckets of all shards (counts has SHARD_HIST_BUCKETS entries)
+ * Returns the number of samples
+ */
+
+uint64_t shard_hist_read(const struct shard_hist *h, uint64_t *counts) {
+
+	uint64_t nSamples = 0;
+	int i, b;
+
+	memset(counts, 0, SHARD_HIST_BUCKETS * sizeof(*counts));
+	for (i=0; i<h->s.nShards; i++) {
+		for (b=0; b<SHARD_HIST_BUCKETS; b++) {
+			uint64_t count = __atomic_load_n(shard_values(&h->s, i, b / SHARD_VALUES_PER_LINE) + b % SHARD_VALUES_PER_LINE,
+				__ATOMIC_RELAXED);
+			counts[b] += count;
+			nSamples += count;
+		}
+	}
+	return nSamples;
+}
+
+
+/*
+ * Upper bound of the bucket holding the given percentile (0-100) of the samples
+ */
+
+uint64_t shard_hist_percentile(const uint64_t *counts, uint64_t nSamples, double percentile) {
+
+	uint64_t target = (uint64_t)(percentile / 100 * nSamples + 0.5), seen = 0;
+	int b;
+
+	if (nSamples == 0) {
+		return 0;
+	}
+	if (target < 1) {
+		target = 1;
+	}
+	for (b=0; b<SHARD_HIST_BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= target) {
+			break;
+		}
+	}
+	if (b >= SHARD_HIST_BUCKETS - 1) {
+		return UINT64_MAX;
+	}
+	return (b == 0) ? 0 : (1ULL << b) - 1;
+}
+
+
+/*
+ * Token bucket of tokensPerSecond and burst tokens in total, split evenly among the shards; the shards start full
+ */
+
+int shard_bucket_init(struct shard_bucket *b, sa_context_t *ctx, const int *cpus, int nShards,
+	double tokensPerSecond, double burst) {
+
+	int i, error;
+	uint64_t now;
+
+	if (tokensPerSecond <= 0 || burst <= 0) {
+		return SA_ERR_INVALID;
+	}
+	if ((error = shards_init(&b->s, ctx, cpus, nShards, 1))) {
+		return error;
+	}
+	b->tokensPerTick = tokensPerSecond / nShards / (timing_get()->tscGHz * 1e9);
+	b->burst = burst / nShards;
+	now = __rdtsc();
+	for (i=0; i<nShards; i++) {
+		struct shard_bucket_line *line = (struct shard_bucket_line*)b->s.lines[i];
+		line->tokens = b->burst;
+		line->last = now;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Tokens of all shards, including the ones refilled since their last use
+ */
+
+double shard_bucket_available(const struct shard_bucket *b) {
+
+	uint64_t now = __rdtsc();
+	double sum = 0;
+	int i;
+
+	for (i=0; i<b->s.nShards; i++) {
+		const struct shard_bucket_line *line = (const struct shard_bucket_line*)b->s.lines[i];
+		double tokens = line->tokens + ((now > line->last) ? now - line->last : 0) * b->tokensPerTick;
+		sum += (tokens > b->burst) ? b->burst : tokens;
+	}
+	return sum;
+}
@@ -0,0 +1,186 @@
+/*
+ * Sharded statistics on slice-local memory: counters, gauges, histograms and token buckets
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SHARD_UTILS_H
+#define SHARD_UTILS_H
+
+#include <x86intrin.h>
+#include "sliceaware.h"
+#include "cache-utils.h"
+
+/*
+ * Every primitive has one shard per core (cpus[i] -> shard i). A shard is made of whole cache lines from the slice
+ * of its core (sa_alloc_lines()), so the most frequently written lines of a service stay close to their writer
+ * when they are evicted from the private caches, and shards never share a line (no false sharing).
+ * With ctx NULL, shards are ordinary cache-aligned lines (a padded array), e.g., as a baseline.
+ *
+ * Updates take the shard of the caller (e.g., the index of its core) and are plain loads and relaxed
+ * atomic stores, so each shard must have a single writer at a time. A writer updating its shard in a hot loop can
+ * resolve its lines once (shard_values(), shard_hist_lines()) and update them with the _value and _lines variants
+ * instead of looking them up on every update. Reads aggregate all shards and can run
+ * concurrently with the updates (they see every shard at some recent point, not one snapshot).
+ *
+ * - counter: monotonic sum (e.g., packets)
+ * - gauge: value set or moved by every core (e.g., queue lengths), read as the sum or the maximum
+ * - histogram: power-of-two buckets (bucket b counts values in [2^(b-1), 2^b), bucket 0 counts 0)
+ * - token bucket: rate limiter whose rate and burst are split evenly among the shards; a shard refills from the TSC
+ *   and does not borrow from the others, so the aggregate rate is only reached if the load is spread over the cores
+ */
+
+#define SHARD_HIST_BUCKETS 64
+#define SHARD_VALUES_PER_LINE (LINE/sizeof(uint64_t))
+#define SHARD_HIST_LINES (SHARD_HIST_BUCKETS/SHARD_VALUES_PER_LINE)
+
+struct shards {
+	sa_context_t *ctx;			/* NULL -> padded array */
+	int nShards;
+	int linesPerShard;
+	int *slices;				/* Slice of each shard */
+	void **lines;				/* Line i of shard s: lines[s*linesPerShard + i] */
+	void *padded;				/* Padded array backing the lines without a context */
+};
+
+struct shard_counter {
+	struct shards s;
+};
+
+struct shard_gauge {
+	struct shards s;
+};
+
+struct shard_hist {
+	struct shards s;
+};
+
+/* One line per shard */
+struct shard_bucket_line {
+	double tokens;
+	uint64_t last;				/* TSC of the last refill */
+};
+
+struct shard_bucket {
+	struct shards s;
+	double tokensPerTick;		/* Refill rate of a shard */
+	double burst;				/* Capacity of a shard */
+};
+
+int shards_init(struct shards *s, sa_context_t *ctx, const int *cpus, int nShards, int linesPerShard);
+void shards_destroy(struct shards *s);
+
+static inline uint64_t* shard_values(const struct shards *s, int shard, int line) {
+	return (uint64_t*)s->lines[shard * s->linesPerShard + line];
+}
+
+/*
+ * Counters
+ */
+
+static inline int shard_counter_init(struct shard_counter *c, sa_context_t *ctx, const int *cpus, int nShards) {
+	return shards_init(&c->s, ctx, cpus, nShards, 1);
+}
+
+/* Add to a resolved counter (shard_values(&c->s, shard, 0)) */
+static inline void shard_counter_add_value(uint64_t *value, uint64_t delta) {
+	__atomic_store_n(value, *value + delta, __ATOMIC_RELAXED);
+}
+
+static inline void shard_counter_add(struct shard_counter *c, int shard, uint64_t delta) {
+	shard_counter_add_value(shard_values(&c->s, shard, 0), delta);
+}
+
+uint64_t shard_counter_read(const struct shard_counter *c);
+
+/*
+ * Gauges
+ */
+
+static inline int shard_gauge_init(struct shard_gauge *g, sa_context_t *ctx, const int *cpus, int nShards) {
+	return shards_init(&g->s, ctx, cpus, nShards, 1);
+}
+
+/* Set or move a resolved gauge ((int64_t*)shard_values(&g->s, shard, 0)) */
+static inline void shard_gauge_set_value(int64_t *gauge, int64_t value) {
+	__atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline void shard_gauge_add_value(int64_t *gauge, int64_t delta) {
+	__atomic_store_n(gauge, *gauge + delta, __ATOMIC_RELAXED);
+}
+
+static inline void shard_gauge_set(struct shard_gauge *g, int shard, int64_t value) {
+	shard_gauge_set_value((int64_t*)shard_values(&g->s, shard, 0), value);
+}
+
+static inline void shard_gauge_add(struct shard_gauge *g, int shard, int64_t delta) {
+	shard_gauge_add_value((int64_t*)shard_values(&g->s, shard, 0), delta);
+}
+
+int64_t shard_gauge_sum(const struct shard_gauge *g);
+int64_t shard_gauge_max(const struct shard_gauge *g);
+
+/*
+ * Histograms
+ */
+
+static inline int shard_hist_init(struct shard_hist *h, sa_context_t *ctx, const int *cpus, int nShards) {
+	return shards_init(&h->s, ctx, cpus, nShards, SHARD_HIST_LINES);
+}
+
+/* Resolve the SHARD_HIST_LINES lines of a shard */
+static inline void shard_hist_lines(const struct shard_hist *h, int shard, uint64_t **lines) {
+	unsigned l;
+	for (l=0; l<SHARD_HIST_LINES; l++) {
+		lines[l] = shard_values(&h->s, shard, l);
+	}
+}
+
+/* Bucket of a value */
+static inline unsigned shard_hist_bucket(uint64_t value) {
+	unsigned bucket = value ? 64 - __builtin_clzll(value) : 0;
+	return (bucket < SHARD_HIST_BUCKETS) ? bucket : SHARD_HIST_BUCKETS - 1;
+}
+
+/* Record a value in resolved lines (line l holds buckets [l*SHARD_VALUES_PER_LINE, (l+1)*SHARD_VALUES_PER_LINE)) */
+static inline void shard_hist_record_lines(uint64_t *const *lines, uint64_t value) {
+	unsigned bucket = shard_hist_bucket(value);
+	shard_counter_add_value(lines[bucket / SHARD_VALUES_PER_LINE] + bucket % SHARD_VALUES_PER_LINE, 1);
+}
+
+static inline void shard_hist_record(struct shard_hist *h, int shard, uint64_t value) {
+	unsigned bucket = shard_hist_bucket(value);
+	shard_counter_add_value(shard_values(&h->s, shard, bucket / SHARD_VALUES_PER_LINE) + bucket % SHARD_VALUES_PER_LINE, 1);
+}
+
+uint64_t shard_hist_read(const struct shard_hist *h, uint64_t *counts);
+uint64_t shard_hist_percentile(const uint64_t *counts, uint64_t nSamples, double percentile);
+
+/*
+ * Token buckets
+ */
+
+int shard_bucket_init(struct shard_bucket *b, sa_context_t *ctx, const int *cpus, int nShards,
+	double tokensPerSecond, double burst);
+
+/* Take n tokens from the shard; returns 1 if they were available */
+static inline int shard_bucket_take(struct shard_bucket *b, int shard, double n) {
+	struct shard_bucket_line *line = (struct shard_bucket_line*)b->s.lines[shard];
+	uint64_t now = __rdtsc();
+	double tokens = line->tokens + ((now > line->last) ? now - line->last : 0) * b->tokensPerTick;
+	if (tokens > b->burst) {
+		tokens = b->burst;
+	}
+	line->last = now;
+	if (tokens < n) {
+		line->tokens = tokens;
+		return 0;
+	}
+	line->tokens = tokens - n;
+	return 1;
+}
+
+double shard_bucket_available(const struct shard_bucket *b);
+
+#endif /* SHARD_UTILS_H */
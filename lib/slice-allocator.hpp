@@ -0,0 +1,165 @@
+/*
+ * STL-compatible allocator and polymorphic memory resource for placing C++ objects on LLC slices
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SLICE_ALLOCATOR_HPP
+#define SLICE_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "sliceaware.h"
+
+/*
+ * Usage (requires C++17 and linking against libsliceaware):
+ *
+ *	std::vector<int, sliceaware::SliceAllocator<int>> v(sliceaware::SliceAllocator<int>(3));	// slice 3
+ *	std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+ *		sliceaware::SliceAllocator<std::pair<const int, int>>> m;				// slice of the calling thread
+ *
+ *	sliceaware::SliceMemoryResource local;							// slice of the calling thread
+ *	std::pmr::vector<int> w(&local);
+ *
+ * Layout (see arena-utils.h):
+ * - Objects of up to 64 Bytes (e.g., nodes of lists, maps and sets) lie entirely in one cache line of the slice.
+ * - Larger blocks (e.g., the array of a vector) are consecutive lines whose first line is on the slice;
+ *   the other lines are spread over all slices by the hash function, since a contiguous range cannot be
+ *   slice-local. Keep the hot fields of large objects in their first 64 Bytes.
+ *
+ * With CURRENT_SLICE, the slice of the core the calling thread runs on is looked up at every allocation,
+ * so threads should be pinned. Memory can be released from any thread.
+ */
+
+namespace sliceaware {
+
+/* Use the slice closest to the core of the calling thread */
+constexpr int CURRENT_SLICE = -1;
+
+/* Error code of the library as an exception */
+class Error : public std::runtime_error {
+public:
+	explicit Error(int code) : std::runtime_error(sa_strerror(code)), code_(code) {}
+	int code() const noexcept { return code_; }
+private:
+	int code_;
+};
+
+/*
+ * Context used by allocators that are created without one
+ * It is created on first use with the default configuration and never destroyed,
+ * so containers with static storage can still release their memory at exit.
+ */
+inline sa_context_t* default_context() {
+	static int error = SA_OK;
+	static sa_context_t *ctx = [] {
+		sa_context_t *c = nullptr;
+		error = sa_context_create(&c, nullptr);
+		return c;
+	}();
+	if (ctx == nullptr) {
+		throw Error(error);
+	}
+	return ctx;
+}
+
+inline int resolve_slice(int slice) {
+	if (slice != CURRENT_SLICE) {
+		return slice;
+	}
+	int current = sa_current_slice();
+	return (current < 0) ? 0 : current;
+}
+
+inline void* allocate(sa_context_t *ctx, int slice, std::size_t bytes, std::size_t alignment) {
+	void *ptr;
+	if (sa_alloc(ctx, resolve_slice(slice), bytes, alignment, &ptr) != SA_OK) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+/*
+ * Memory resource for std::pmr containers
+ */
+class SliceMemoryResource : public std::pmr::memory_resource {
+public:
+	explicit SliceMemoryResource(int slice = CURRENT_SLICE, sa_context_t *ctx = nullptr)
+		: slice_(slice), ctx_(ctx ? ctx : default_context()) {}
+
+	int slice() const noexcept { return slice_; }
+	sa_context_t* context() const noexcept { return ctx_; }
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		return sliceaware::allocate(ctx_, slice_, bytes, alignment);
+	}
+
+	void do_deallocate(void *ptr, std::size_t bytes, std::size_t) override {
+		sa_free(ctx_, ptr, bytes);
+	}
+
+	/* Memory of a context can be released through any resource of that context */
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		const SliceMemoryResource *o = dynamic_cast<const SliceMemoryResource*>(&other);
+		return o != nullptr && o->ctx_ == ctx_;
+	}
+
+private:
+	int slice_;
+	sa_context_t *ctx_;
+};
+
+/*
+ * Allocator for standard (and our own) containers
+ */
+template <typename T>
+class SliceAllocator {
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	explicit SliceAllocator(int slice = CURRENT_SLICE, sa_context_t *ctx = nullptr)
+		: slice_(slice), ctx_(ctx ? ctx : default_context()) {}
+
+	template <typename U>
+	SliceAllocator(const SliceAllocator<U> &other) noexcept
+		: slice_(other.slice()), ctx_(other.context()) {}
+
+	T* allocate(std::size_t n) {
+		if (n > static_cast<std::size_t>(-1)/sizeof(T)) {
+			throw std::bad_array_new_length();
+		}
+		return static_cast<T*>(sliceaware::allocate(ctx_, slice_, n*sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *ptr, std::size_t n) noexcept {
+		sa_free(ctx_, ptr, n*sizeof(T));
+	}
+
+	int slice() const noexcept { return slice_; }
+	sa_context_t* context() const noexcept { return ctx_; }
+
+private:
+	int slice_;
+	sa_context_t *ctx_;
+};
+
+template <typename T, typename U>
+bool operator==(const SliceAllocator<T> &a, const SliceAllocator<U> &b) noexcept {
+	return a.context() == b.context();
+}
+
+template <typename T, typename U>
+bool operator!=(const SliceAllocator<T> &a, const SliceAllocator<U> &b) noexcept {
+	return !(a == b);
+}
+
+} /* namespace sliceaware */
+
+#endif /* SLICE_ALLOCATOR_HPP */
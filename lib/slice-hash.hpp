@@ -0,0 +1,206 @@
+/*
+ * Compile-time slice hash models for C++: every CPU model is a constexpr policy type
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SLICE_HASH_HPP
+#define SLICE_HASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <cpuid.h>
+#include "arch-config.h"
+
+/*
+ * A model describes the LLC of one CPU: the hash masks (slice bit i = parity(pa & masks[i])),
+ * the number of slices, the mapping of slices to virtual slices (i.e., cores) and the set-index bits.
+ * SliceHash<Model> turns it into constexpr functions that the compiler inlines into a few
+ * AND + POPCNT instructions, instead of the calls through cache-utils.c.
+ *
+ * Models whose hash function is unknown (SkyLake) have no masks (hasHash == false);
+ * their slices can only be found by polling the uncore counters (calculateSlice_uncore()).
+ *
+ * Usage: pick the model once and run the whole loop in the instantiation for that model, e.g.,
+ *
+ *	sliceaware::with_model([&](auto model) {
+ *		using Hash = sliceaware::SliceHash<decltype(model)>;
+ *		if constexpr (Hash::hasHash) {
+ *			uint64_t term = Hash::page_term(pagePhyAddr);
+ *			for (uint64_t offset=0; offset<pageSize; offset+=64)
+ *				lines[Hash::line_slice(term, offset)].push_back(page + offset);
+ *		}
+ *	});
+ *
+ * or use the function table returned by hash_ops() when the call site cannot be a template.
+ */
+
+namespace sliceaware {
+
+/* Xeon E5-2667 v3: 8 cores -> 8 slices (2.5MB, 20 ways) */
+struct HaswellE5_2667v3 {
+	static constexpr const char *name = "Xeon E5-2667 v3 (Haswell)";
+	static constexpr int cpuModel = HASWELL_SERVER_MODEL;
+	static constexpr bool hasHash = true;
+	static constexpr int numberSlices = 8;
+	static constexpr int numberVirtualSlices = 8;
+	static constexpr std::array<uint64_t, 3> masks = {0x1B5F575440, 0x2EB5FAA880, 0x3CCCC93100};	/* hash_0, hash_1, hash_2 */
+	static constexpr std::array<uint8_t, 8> virtualSlices = {0, 1, 2, 3, 4, 5, 6, 7};
+	static constexpr uint64_t l3IndexPerSlice = 0x1FFC0;
+	static constexpr int llcWays = 20;
+};
+
+/* Xeon Gold 6134: 8 cores and 18 slices (1.375MB, 11 ways), grouped into 8 virtual slices (see other/skylake-slice-core-mapping.txt) */
+struct SkylakeGold6134 {
+	static constexpr const char *name = "Xeon Gold 6134 (SkyLake)";
+	static constexpr int cpuModel = SKYLAKE_SERVER_MODEL;
+	static constexpr bool hasHash = false;
+	static constexpr int numberSlices = 18;
+	static constexpr int numberVirtualSlices = 8;
+	static constexpr std::array<uint64_t, 0> masks = {};
+	static constexpr std::array<uint8_t, 18> virtualSlices = {0, 1, 0, 6, 1, 6, 0, 4, 2, 4, 4, 2, 3, 3, 5, 7, 5, 7};
+	static constexpr uint64_t l3IndexPerSlice = 0x1FFC0;
+	static constexpr int llcWays = 11;
+};
+
+/* Model selected by check_cpu.sh, used when the running CPU is not one of the models above */
+#ifdef SKYLAKE
+using ConfiguredModel = SkylakeGold6134;
+#else
+using ConfiguredModel = HaswellE5_2667v3;
+#endif
+
+template <typename Model>
+struct SliceHash {
+	static constexpr bool hasHash = Model::hasHash;
+	static constexpr int numberSlices = Model::numberSlices;
+	static constexpr int numberVirtualSlices = Model::numberVirtualSlices;
+	static constexpr uint64_t line = 64;
+
+	/* Slice of a physical address */
+	static constexpr int slice(uint64_t pa) noexcept {
+		static_assert(Model::hasHash, "the hash function of this model is unknown, use calculateSlice_uncore()");
+		return bits(pa, std::make_index_sequence<Model::masks.size()>());
+	}
+
+	static constexpr int virtual_slice(uint64_t pa) noexcept {
+		return Model::virtualSlices[slice(pa)];
+	}
+
+	/*
+	 * Within a physically contiguous page, pa = base | offset, so the slice is the XOR of a term
+	 * computed once per page and the slice of the offset.
+	 */
+	static constexpr int page_term(uint64_t pagePhyAddr) noexcept {
+		return slice(pagePhyAddr);
+	}
+
+	static constexpr int line_slice(int pageTerm, uint64_t offset) noexcept {
+		return pageTerm ^ slice(offset);
+	}
+
+	/* Offset from pa to the next line (pa itself included) on the slice */
+	static constexpr uint64_t next_line(uint64_t pa, int desiredSlice) noexcept {
+		uint64_t offset = 0;
+		while (slice(pa + offset) != desiredSlice) {
+			offset += line;
+		}
+		return offset;
+	}
+
+	/* L3 set index of an address within its slice */
+	static constexpr uint64_t set_index(uint64_t addr) noexcept {
+		return (addr & Model::l3IndexPerSlice) >> 6;
+	}
+
+private:
+	template <std::size_t... I>
+	static constexpr int bits(uint64_t pa, std::index_sequence<I...>) noexcept {
+		return (0 | ... | (__builtin_parityll(pa & Model::masks[I]) << I));
+	}
+};
+
+/* The models are checked at compile time against the measured mappings */
+static_assert(SliceHash<HaswellE5_2667v3>::slice(0x0) == 0, "Haswell hash");
+static_assert(SliceHash<HaswellE5_2667v3>::slice(0x40) == 1, "Haswell hash");
+static_assert(SliceHash<HaswellE5_2667v3>::set_index(0x1FFC0) == 2047, "L3 set index");
+
+/*
+ * Runtime dispatch
+ */
+
+/* Model number of the running CPU (family 6), or -1 */
+inline int cpu_model() noexcept {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return -1;
+	}
+	return ((eax >> 4) & 0xF) | ((eax >> 12) & 0xF0);
+}
+
+enum class ModelId { Haswell, Skylake };
+
+/* Model of the running CPU, detected once */
+inline ModelId detected_model() noexcept {
+	static const ModelId id = [] {
+		switch (cpu_model()) {
+		case HaswellE5_2667v3::cpuModel:
+			return ModelId::Haswell;
+		case SkylakeGold6134::cpuModel:
+			return ModelId::Skylake;
+		default:
+			return (ConfiguredModel::cpuModel == SkylakeGold6134::cpuModel) ? ModelId::Skylake : ModelId::Haswell;
+		}
+	}();
+	return id;
+}
+
+/* Call f with an instance of the model of the running CPU */
+template <typename F>
+decltype(auto) with_model(F &&f) {
+	switch (detected_model()) {
+	case ModelId::Skylake:
+		return std::forward<F>(f)(SkylakeGold6134{});
+	case ModelId::Haswell:
+	default:
+		return std::forward<F>(f)(HaswellE5_2667v3{});
+	}
+}
+
+/*
+ * Functions of the running model for call sites that cannot be templates
+ * slice/next_line are NULL when the hash function of the model is unknown.
+ */
+struct HashOps {
+	const char *name;
+	bool hasHash;
+	int numberSlices;
+	int numberVirtualSlices;
+	int (*slice)(uint64_t pa);
+	int (*virtual_slice)(uint64_t pa);
+	uint64_t (*next_line)(uint64_t pa, int desiredSlice);
+	uint64_t (*set_index)(uint64_t addr);
+};
+
+template <typename Model>
+constexpr HashOps make_hash_ops() noexcept {
+	using Hash = SliceHash<Model>;
+	if constexpr (Model::hasHash) {
+		return {Model::name, true, Model::numberSlices, Model::numberVirtualSlices,
+			&Hash::slice, &Hash::virtual_slice, &Hash::next_line, &Hash::set_index};
+	} else {
+		return {Model::name, false, Model::numberSlices, Model::numberVirtualSlices,
+			nullptr, nullptr, nullptr, &Hash::set_index};
+	}
+}
+
+inline const HashOps& hash_ops() noexcept {
+	static const HashOps ops = with_model([](auto model) { return make_hash_ops<decltype(model)>(); });
+	return ops;
+}
+
+} /* namespace sliceaware */
+
+#endif /* SLICE_HASH_HPP */
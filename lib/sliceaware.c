@@ -0,0 +1,259 @@
+/*
+ * libsliceaware: context for thread-safe slice-aware allocation
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <sched.h>
+#include "sliceaware.h"
+#include "coloring-utils.h"
+#include "arena-utils.h"
+#include "topology-utils.h"
+
+/*
+ * A context is a coloring allocator with one tenant per slice owning all of its L3 sets,
+ * so tenant i is slice i and consecutive lines of a slice are spread over its sets.
+ * Pages come from a private hugepage pool and slices are found with the hash model (Haswell by default, or loaded
+ * from config->hashModel) or, without a model, by polling the uncore counters through the context's MSR device (SkyLake).
+ * The model belongs to the context: contexts with different models can be used at the same time, and none of them
+ * changes the process-wide model of hash_model_use().
+ * Objects of other sizes come from an arena sharing the same pool.
+ */
+
+struct sa_context {
+	struct sa_config config;
+	struct msr_device msr;
+	struct hugepage_pool pool;
+	struct color_allocator slices;
+	struct line_arena arena;
+	struct hash_model loaded;			/* Model of config->hashModel */
+	const struct hash_model *model;		/* Model used for placement (NULL -> uncore counters) */
+};
+
+
+/*
+ * Description of an error code
+ */
+
+const char* sa_strerror(int error) {
+	switch (error) {
+	case SA_OK:
+		return "Success";
+	case SA_ERR_INVALID:
+		return "Invalid argument";
+	case SA_ERR_NOMEM:
+		return "Out of memory";
+	case SA_ERR_MAP:
+		return "Pages cannot be mapped or locked (check the number of free hugepages)";
+	case SA_ERR_PAGEMAP:
+		return "Physical address is not available (/proc/self/pagemap requires root)";
+	case SA_ERR_MSR:
+		return "MSR cannot be accessed (requires root and the msr module)";
+	case SA_ERR_EXHAUSTED:
+		return "Page limit is reached";
+	case SA_ERR_RESCTRL:
+		return "resctrl cannot be configured (is it mounted?)";
+	case SA_ERR_IO:
+		return "File cannot be read or written";
+	case SA_ERR_PERM:
+		return "Permission denied";
+	default:
+		return "Unknown error";
+	}
+}
+
+
+/*
+ * Default configuration: 2MB-pages (falling back to smaller pages), no page limit, MSRs of CPU 0, built-in hash model
+ */
+
+void sa_config_default(struct sa_config *config) {
+	config->pageSize = PAGE_SIZE_AUTO;
+	config->maxPages = 0;
+	config->msrCPU = 0;
+	config->hashModel = NULL;
+}
+
+
+/*
+ * Create a context
+ */
+
+int sa_context_create(sa_context_t **ctx, const struct sa_config *config) {
+
+	int slice, error;
+
+	if (ctx == NULL) {
+		return SA_ERR_INVALID;
+	}
+
+	sa_context_t *c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		return SA_ERR_NOMEM;
+	}
+	if (config != NULL) {
+		c->config = *config;
+	} else {
+		sa_config_default(&c->config);
+	}
+
+	if (c->config.hashModel != NULL) {
+		if ((error = hash_model_load(&c->loaded, c->config.hashModel)) || (error = hash_model_check(&c->loaded))) {
+			free(c);
+			return error;
+		}
+		c->model = &c->loaded;
+	} else {
+		c->model = hash_model_active();
+	}
+	msr_init(&c->msr, c->config.msrCPU);
+	hugepage_pool_init(&c->pool, c->config.pageSize, c->config.maxPages);
+	arena_init(&c->arena, &c->pool, &c->msr, c->model);
+	if ((error = color_allocator_init(&c->slices, &c->pool, &c->msr, c->model, NUMBER_VIRTUAL_SLICES))) {
+		arena_destroy(&c->arena);
+		hugepage_pool_destroy(&c->pool);
+		msr_close(&c->msr);
+		free(c);
+		return error;
+	}
+	for (slice=0; slice<NUMBER_VIRTUAL_SLICES; slice++) {
+		if (color_add_tenant(&c->slices, slice, L3_SETS_PER_SLICE) != slice) {
+			sa_context_destroy(c);
+			return SA_ERR_NOMEM;
+		}
+	}
+
+	*ctx = c;
+	return SA_OK;
+}
+
+
+/*
+ * Destroy a context and unmap all of its pages
+ */
+
+void sa_context_destroy(sa_context_t *ctx) {
+	if (ctx == NULL) {
+		return;
+	}
+	color_allocator_destroy(&ctx->slices);
+	arena_destroy(&ctx->arena);
+	hugepage_pool_destroy(&ctx->pool);
+	msr_close(&ctx->msr);
+	free(ctx);
+}
+
+
+int sa_number_slices(sa_context_t *ctx) {
+	(void)ctx;
+	return NUMBER_VIRTUAL_SLICES;
+}
+
+
+size_t sa_page_size(sa_context_t *ctx) {
+	return ctx->pool.page_size;
+}
+
+
+/*
+ * Slice of the cache line containing va
+ */
+
+int sa_slice_of(sa_context_t *ctx, const void *va) {
+	uint64_t pa = 0;
+	if (ctx->model != NULL) {
+		int error = translate_address(va, &pa);
+		if (error) {
+			return error;
+		}
+	}
+	return calculatePlacementSlice(ctx->model, &ctx->msr, (void*)va, pa);
+}
+
+
+int sa_physical_address(sa_context_t *ctx, const void *va, uint64_t *pa) {
+	(void)ctx;
+	return translate_address(va, pa);
+}
+
+
+/*
+ * Allocate nLines lines of a slice
+ */
+
+int sa_alloc_lines(sa_context_t *ctx, int slice, void **lines, size_t nLines) {
+
+	if (slice < 0 || slice >= NUMBER_VIRTUAL_SLICES || (lines == NULL && nLines != 0)) {
+		return SA_ERR_INVALID;
+	}
+
+	int error = SA_ERR_EXHAUSTED;
+	size_t nAllocated = color_alloc_lines(&ctx->slices, slice, lines, nLines, &error);
+	if (nAllocated == nLines) {
+		return SA_OK;
+	}
+
+	sa_free_lines(ctx, slice, lines, nAllocated);
+	return error;
+}
+
+
+/*
+ * Give lines back to their slice
+ */
+
+void sa_free_lines(sa_context_t *ctx, int slice, void **lines, size_t nLines) {
+
+	size_t i;
+
+	for (i=0; i<nLines; i++) {
+		color_free_line(&ctx->slices, slice, lines[i]);
+	}
+}
+
+
+/*
+ * Allocate size bytes on a slice
+ */
+
+int sa_alloc(sa_context_t *ctx, int slice, size_t size, size_t alignment, void **ptr) {
+	return arena_alloc(&ctx->arena, slice, size, alignment, ptr);
+}
+
+
+void sa_free(sa_context_t *ctx, void *ptr, size_t size) {
+	arena_free(&ctx->arena, ptr, size);
+}
+
+
+/*
+ * Slice closest to a CPU
+ * Core N of a package uses slice N (virtual slice N on SkyLake), where cores are ranked by their core_id in sysfs,
+ * so SMT siblings share a slice. Without sysfs, the numbering of our systems is used: on our Haswell system
+ * the cores of socket 0 are the even CPUs, i.e., CPU 2N runs on core N.
+ */
+
+int sa_cpu_slice(int cpu) {
+	int slice;
+	if (cpu < 0) {
+		return SA_ERR_INVALID;
+	}
+	if ((slice = topology_cpu_slice(cpu)) != SA_ERR_IO) {
+		return slice;
+	}
+	#ifdef HASWELL
+	cpu /= 2;
+	#endif
+	return cpu % NUMBER_VIRTUAL_SLICES;
+}
+
+
+int sa_current_slice(void) {
+	int cpu = sched_getcpu();
+	if (cpu < 0) {
+		return SA_ERR_INVALID;
+	}
+	return sa_cpu_slice(cpu);
+}
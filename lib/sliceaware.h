@@ -0,0 +1,100 @@
+/*
+ * libsliceaware: public interface for slice-aware memory management
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SLICEAWARE_H
+#define SLICEAWARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Error codes
+ * Functions return SA_OK (or a non-negative value) on success and one of these negative values on failure.
+ * The library never exits the process; errno is preserved from the failing system call when relevant.
+ */
+
+#define SA_OK 0
+#define SA_ERR_INVALID -1		/* Invalid argument */
+#define SA_ERR_NOMEM -2			/* Out of (ordinary) memory */
+#define SA_ERR_MAP -3			/* Pages cannot be mapped or locked */
+#define SA_ERR_PAGEMAP -4		/* Physical address is not available (/proc/self/pagemap requires root) */
+#define SA_ERR_MSR -5			/* MSR cannot be accessed (/dev/cpu/N/msr requires root + msr module) */
+#define SA_ERR_EXHAUSTED -6		/* Page limit of the context is reached */
+#define SA_ERR_RESCTRL -7		/* resctrl cannot be configured */
+#define SA_ERR_IO -8			/* File cannot be read or written */
+#define SA_ERR_PERM -9			/* Peer is not allowed (e.g., a slice-map client of another user) */
+
+const char* sa_strerror(int error);
+
+/*
+ * Context
+ * A context owns the hugepages, the per-slice free lines and the MSR device used for probing.
+ * All functions taking a context are thread-safe.
+ */
+
+typedef struct sa_context sa_context_t;
+
+struct sa_config {
+	size_t pageSize;			/* Size of the pages backing the lines; 0 -> 2MB (falls back to smaller pages) */
+	unsigned long maxPages;		/* Maximum number of pages the context may map; 0 -> no limit */
+	int msrCPU;					/* CPU whose MSR device is used for uncore probing */
+	const char *hashModel;		/* Hash model file used for the slice lookups of this context; NULL -> hash_model_active() at creation */
+};
+
+void sa_config_default(struct sa_config *config);
+
+/* Create a context; config can be NULL for the defaults */
+int sa_context_create(sa_context_t **ctx, const struct sa_config *config);
+void sa_context_destroy(sa_context_t *ctx);
+
+/* Number of slices used for placement (virtual slices on SkyLake, i.e., one per core) */
+int sa_number_slices(sa_context_t *ctx);
+
+/* Size of the pages backing the lines of the context */
+size_t sa_page_size(sa_context_t *ctx);
+
+/* Slice of the cache line containing va; returns the slice or an error code */
+int sa_slice_of(sa_context_t *ctx, const void *va);
+
+/* Physical address of va */
+int sa_physical_address(sa_context_t *ctx, const void *va, uint64_t *pa);
+
+/*
+ * Allocate nLines cache lines (64 Bytes each) mapped to the given slice
+ * Consecutive lines are spread over the L3 sets of the slice
+ * Returns SA_OK, or an error code if fewer lines could be allocated (those are released)
+ */
+int sa_alloc_lines(sa_context_t *ctx, int slice, void **lines, size_t nLines);
+
+/* Give lines allocated by sa_alloc_lines() back to the context */
+void sa_free_lines(sa_context_t *ctx, int slice, void **lines, size_t nLines);
+
+/*
+ * Allocate size bytes on a slice, for objects that are not exactly one cache line (e.g., C++ containers)
+ * Objects of up to 64 Bytes lie entirely on the slice. Larger objects are consecutive lines whose
+ * first line is on the slice (the other lines follow the hash function), see arena-utils.h for the layout.
+ * alignment must be a power of two of at most the page size; 0 -> natural alignment
+ */
+int sa_alloc(sa_context_t *ctx, int slice, size_t size, size_t alignment, void **ptr);
+
+/* Give memory allocated by sa_alloc() back to the context; size must be the allocated size. Any thread can call it. */
+void sa_free(sa_context_t *ctx, void *ptr, size_t size);
+
+/* Slice closest to a CPU, i.e., the slice used for the threads running on it */
+int sa_cpu_slice(int cpu);
+
+/* Slice closest to the CPU the calling thread is running on */
+int sa_current_slice(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLICEAWARE_H */
@@ -0,0 +1,725 @@
+/*
+ * Host-level slice-map service: a daemon classifies hugepages once and hands slice-local lines to other processes
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "slicemap-utils.h"
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB MAP_HUGE_2MB	/* Same encoding as mmap */
+#endif
+
+/*
+ * Send/receive exactly len bytes
+ */
+
+static int slicemap_send_all(int fd, const void *buf, size_t len) {
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return SA_ERR_IO;
+		}
+		p += n;
+		len -= n;
+	}
+	return SA_OK;
+}
+
+static int slicemap_recv_all(int fd, void *buf, size_t len) {
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, MSG_WAITALL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return SA_ERR_IO;
+		}
+		p += n;
+		len -= n;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Size the memfd, map it (shared) and lock it
+ */
+
+static int slicemap_map(struct slicemap_server *s, size_t size) {
+
+	s->size = (size + s->pageSize - 1) & ~(s->pageSize - 1);
+	if (ftruncate(s->memfd, s->size) == -1) {
+		return SA_ERR_MAP;
+	}
+	s->addr = mmap(NULL, s->size, PROTECTION, MAP_SHARED | MAP_POPULATE, s->memfd, 0);
+	if (s->addr == MAP_FAILED) {
+		s->addr = NULL;
+		return SA_ERR_MAP;
+	}
+	/* Same as create_buffer_sized(): 4KB-pages still work (best effort) if they cannot be locked */
+	if (mlock(s->addr, s->size) == -1 && s->pageSize != PAGE_SIZE_4KB) {
+		munmap(s->addr, s->size);
+		s->addr = NULL;
+		return SA_ERR_MAP;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Reserve size bytes of hugepages (2MB, falling back to 4KB-pages) and find the slice of every line
+ * msr is used for uncore polling when there is no hash model (SkyLake)
+ */
+
+int slicemap_server_init(struct slicemap_server *s, size_t size, struct msr_device *msr) {
+
+	unsigned long i, page;
+	int slice, error;
+
+	memset(s, 0, sizeof(*s));
+	s->memfd = -1;
+	s->listenFd = -1;
+	s->uid = geteuid();
+	for (i=0; i<SLICEMAP_MAX_CLIENTS; i++) {
+		s->clients[i].fd = -1;
+	}
+	if (size == 0) {
+		return SA_ERR_INVALID;
+	}
+
+	s->pageSize = PAGE_SIZE_2MB;
+	s->memfd = memfd_create("sliceaware-slicemap", MFD_CLOEXEC | MFD_HUGETLB | MFD_HUGE_2MB);
+	if (s->memfd >= 0 && slicemap_map(s, size)) {
+		close(s->memfd);
+		s->memfd = -1;
+	}
+	if (s->memfd < 0) {
+		s->pageSize = PAGE_SIZE_4KB;
+		s->memfd = memfd_create("sliceaware-slicemap", MFD_CLOEXEC);
+		if (s->memfd < 0) {
+			return SA_ERR_MAP;
+		}
+		if ((error = slicemap_map(s, size))) {
+			slicemap_server_destroy(s);
+			return error;
+		}
+	}
+
+	s->nLines = s->size / LINE;
+	s->lineSlice = malloc(s->nLines);
+	s->owner = malloc(s->nLines);
+	if (s->lineSlice == NULL || s->owner == NULL) {
+		slicemap_server_destroy(s);
+		return SA_ERR_NOMEM;
+	}
+	memset(s->owner, SLICEMAP_NO_OWNER, s->nLines);
+
+	/* Classify each page once; lines of one page are physically contiguous */
+	for (page=0; page<s->size; page+=s->pageSize) {
+		uint64_t pagePhyAddr = 0;
+		if ((error = translate_address((char*)s->addr + page, &pagePhyAddr))) {
+			slicemap_server_destroy(s);
+			return error;
+		}
+		for (i=page/LINE; i<(page+s->pageSize)/LINE; i++) {
+			slice = calculatePlacementSlice(hash_model_active(), msr, (char*)s->addr + i*LINE, pagePhyAddr + i*LINE - page);
+			if (slice < 0) {
+				slicemap_server_destroy(s);
+				return slice;
+			}
+			s->lineSlice[i] = slice;
+			s->nSliceLines[slice]++;
+		}
+	}
+
+	/* Free lines are pushed backwards, so they are handed out in address order */
+	for (slice=0; slice<NUMBER_VIRTUAL_SLICES; slice++) {
+		s->freeLines[slice] = malloc((s->nSliceLines[slice] + 1)*sizeof(uint64_t));
+		if (s->freeLines[slice] == NULL) {
+			slicemap_server_destroy(s);
+			return SA_ERR_NOMEM;
+		}
+	}
+	for (i=s->nLines; i-->0; ) {
+		slice = s->lineSlice[i];
+		s->freeLines[slice][s->nFree[slice]++] = i;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Listen on a unix socket (a stale socket file at path is replaced)
+ */
+
+int slicemap_server_listen(struct slicemap_server *s, const char *path) {
+
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return SA_ERR_INVALID;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	s->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s->listenFd < 0) {
+		return SA_ERR_IO;
+	}
+	unlink(path);
+	if (bind(s->listenFd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(s->listenFd, SLICEMAP_MAX_CLIENTS) == -1) {
+		close(s->listenFd);
+		s->listenFd = -1;
+		return SA_ERR_IO;
+	}
+	snprintf(s->path, sizeof(s->path), "%s", path);
+	return SA_OK;
+}
+
+
+/*
+ * Accept a client and send it the memfd if it runs as the user of the daemon or as root
+ * The reply fits in the empty socket buffer of a new connection, so it is sent at once
+ */
+
+static void slicemap_accept(struct slicemap_server *s) {
+
+	struct slicemap_reply reply = {SA_OK, NUMBER_VIRTUAL_SLICES, s->nLines, s->size, s->pageSize};
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = {&reply, sizeof(reply)};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct ucred cred;
+	socklen_t credLen = sizeof(cred);
+	int fd, slot;
+
+	fd = accept4(s->listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0) {
+		return;
+	}
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1 || (cred.uid != s->uid && cred.uid != 0)) {
+		reply.status = SA_ERR_PERM;
+		slicemap_send_all(fd, &reply, sizeof(reply));
+		close(fd);
+		return;
+	}
+	for (slot=0; slot<SLICEMAP_MAX_CLIENTS && s->clients[slot].fd >= 0; slot++);
+	if (slot == SLICEMAP_MAX_CLIENTS) {
+		reply.status = SA_ERR_EXHAUSTED;
+		slicemap_send_all(fd, &reply, sizeof(reply));
+		close(fd);
+		return;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &s->memfd, sizeof(int));
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(reply)) {
+		close(fd);
+		return;
+	}
+	memset(&s->clients[slot], 0, sizeof(s->clients[slot]));
+	s->clients[slot].fd = fd;
+}
+
+
+/*
+ * Disconnect a client; its lines (and the lines reserved for it) become free again
+ */
+
+static void slicemap_drop(struct slicemap_server *s, int slot) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	unsigned long i;
+
+	close(c->fd);
+	c->fd = -1;
+	if (c->nSend > 0) {
+		s->nReserved[c->request.slice] -= c->nSend;
+		c->nSend = 0;
+	}
+	for (i=0; i<s->nLines; i++) {
+		if (s->owner[i] == slot) {
+			int slice = s->lineSlice[i];
+			s->owner[i] = SLICEMAP_NO_OWNER;
+			s->freeLines[slice][s->nFree[slice]++] = i;
+		}
+	}
+}
+
+
+/*
+ * Append to the reply of a client (out holds a reply and a chunk of offsets)
+ */
+
+static void slicemap_queue(struct slicemap_conn *c, const void *buf, size_t len) {
+	memcpy(c->out + c->outLen, buf, len);
+	c->outLen += len;
+}
+
+
+/*
+ * Take the next chunk of the lines of an ALLOC request from its reserved lines and queue their offsets
+ */
+
+static void slicemap_queue_lines(struct slicemap_server *s, int slot) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	int slice = c->request.slice;
+	uint64_t j, n = (c->nSend < SLICEMAP_CHUNK) ? c->nSend : SLICEMAP_CHUNK;
+
+	/* The lines belong to the client as soon as they are taken, so they are released if it goes away */
+	for (j=0; j<n; j++) {
+		uint64_t line = s->freeLines[slice][--s->nFree[slice]];
+		uint64_t offset = line*LINE;
+		s->owner[line] = slot;
+		slicemap_queue(c, &offset, sizeof(offset));
+	}
+	s->nReserved[slice] -= n;
+	c->nSend -= n;
+}
+
+
+/*
+ * Free n received offsets of a FREE request; the reply is queued after the last one
+ */
+
+static void slicemap_free_chunk(struct slicemap_server *s, int slot, uint64_t n) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	struct slicemap_reply reply = {SA_OK, NUMBER_VIRTUAL_SLICES, 0, s->size, s->pageSize};
+	uint64_t j;
+
+	/* Lines of other clients are not touched */
+	for (j=0; j<n; j++) {
+		uint64_t line = c->in[j]/LINE;
+		if (c->in[j] % LINE != 0 || line >= s->nLines || s->owner[line] != slot) {
+			c->status = SA_ERR_INVALID;
+			continue;
+		}
+		s->owner[line] = SLICEMAP_NO_OWNER;
+		s->freeLines[s->lineSlice[line]][s->nFree[s->lineSlice[line]]++] = line;
+	}
+	c->nReceive -= n;
+	if (c->nReceive == 0) {
+		reply.status = c->status;
+		slicemap_queue(c, &reply, sizeof(reply));
+	}
+}
+
+
+/*
+ * Start serving a request whose header is received
+ * Returns SA_OK, or an error code if the client has to be dropped
+ */
+
+static int slicemap_request(struct slicemap_server *s, int slot) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	struct slicemap_reply reply = {SA_OK, NUMBER_VIRTUAL_SLICES, 0, s->size, s->pageSize};
+	uint64_t nFree[NUMBER_VIRTUAL_SLICES];
+	int i;
+
+	switch (c->request.op) {
+	case SLICEMAP_OP_ALLOC:
+		if (c->request.slice < 0 || c->request.slice >= NUMBER_VIRTUAL_SLICES || c->request.nLines == 0) {
+			reply.status = SA_ERR_INVALID;
+		} else if (c->request.nLines > s->nFree[c->request.slice] - s->nReserved[c->request.slice]) {
+			reply.status = SA_ERR_EXHAUSTED;
+		} else {
+			/* Reserved now and taken as they are sent, so no other client can make the request fail halfway */
+			reply.nLines = c->request.nLines;
+			c->nSend = c->request.nLines;
+			s->nReserved[c->request.slice] += c->nSend;
+		}
+		slicemap_queue(c, &reply, sizeof(reply));
+		return SA_OK;
+
+	case SLICEMAP_OP_FREE:
+		if (c->request.nLines > s->nLines) {
+			return SA_ERR_INVALID;
+		}
+		c->status = SA_OK;
+		c->nReceive = c->request.nLines;
+		if (c->nReceive == 0) {
+			slicemap_free_chunk(s, slot, 0);
+		}
+		return SA_OK;
+
+	case SLICEMAP_OP_STATS:
+		reply.nLines = s->nLines;
+		for (i=0; i<NUMBER_VIRTUAL_SLICES; i++) {
+			nFree[i] = s->nFree[i] - s->nReserved[i];
+		}
+		slicemap_queue(c, &reply, sizeof(reply));
+		slicemap_queue(c, nFree, sizeof(nFree));
+		return SA_OK;
+
+	default:
+		reply.status = SA_ERR_INVALID;
+		slicemap_queue(c, &reply, sizeof(reply));
+		return SA_OK;
+	}
+}
+
+
+/*
+ * Receive what a client has sent (without blocking), up to the end of its request header or chunk of offsets
+ * Returns SA_OK, or an error code if the client has to be dropped
+ */
+
+static int slicemap_receive(struct slicemap_server *s, int slot) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	char *buf = (c->nReceive > 0) ? (char*)c->in : (char*)&c->request;
+	size_t len = (c->nReceive > 0) ? ((c->nReceive < SLICEMAP_CHUNK) ? c->nReceive : SLICEMAP_CHUNK)*sizeof(uint64_t) : sizeof(c->request);
+	ssize_t n;
+
+	n = recv(c->fd, buf + c->inLen, len - c->inLen, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return SA_OK;
+	}
+	if (n <= 0) {
+		return SA_ERR_IO;
+	}
+	c->inLen += n;
+	if (c->inLen < len) {
+		return SA_OK;
+	}
+	c->inLen = 0;
+	if (c->nReceive > 0) {
+		slicemap_free_chunk(s, slot, len/sizeof(uint64_t));
+		return SA_OK;
+	}
+	return slicemap_request(s, slot);
+}
+
+
+/*
+ * Send the reply of a client as far as its socket allows, refilling it with the next offsets of an ALLOC
+ * Returns SA_OK, or an error code if the client has to be dropped
+ */
+
+static int slicemap_send(struct slicemap_server *s, int slot) {
+
+	struct slicemap_conn *c = &s->clients[slot];
+	ssize_t n;
+
+	while (c->outSent < c->outLen) {
+		n = send(c->fd, c->out + c->outSent, c->outLen - c->outSent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return SA_OK;
+		}
+		if (n <= 0) {
+			return SA_ERR_IO;
+		}
+		c->outSent += n;
+		if (c->outSent == c->outLen) {
+			c->outSent = c->outLen = 0;
+			if (c->nSend > 0) {
+				slicemap_queue_lines(s, slot);
+			}
+		}
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Serve the clients until s->stop is set
+ * A client is read only when its previous reply is sent, so it has at most one request in progress.
+ * Everything runs in this thread, so the slice maps need no locking.
+ */
+
+int slicemap_server_run(struct slicemap_server *s) {
+
+	struct pollfd fds[SLICEMAP_MAX_CLIENTS + 1];
+	int slots[SLICEMAP_MAX_CLIENTS + 1];
+	int i, n, error;
+
+	while (!s->stop) {
+		n = 0;
+		fds[n].fd = s->listenFd;
+		fds[n].events = POLLIN;
+		n++;
+		for (i=0; i<SLICEMAP_MAX_CLIENTS; i++) {
+			if (s->clients[i].fd >= 0) {
+				fds[n].fd = s->clients[i].fd;
+				fds[n].events = (s->clients[i].outLen > 0) ? POLLOUT : POLLIN;
+				slots[n] = i;
+				n++;
+			}
+		}
+		if (poll(fds, n, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return SA_ERR_IO;
+		}
+		for (i=1; i<n; i++) {
+			if (fds[i].revents == 0) {
+				continue;
+			}
+			error = SA_OK;
+			if (s->clients[slots[i]].outLen == 0) {
+				error = slicemap_receive(s, slots[i]);
+			}
+			if (error == SA_OK) {
+				error = slicemap_send(s, slots[i]);
+			}
+			if (error) {
+				slicemap_drop(s, slots[i]);
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			slicemap_accept(s);
+		}
+	}
+	return SA_OK;
+}
+
+
+void slicemap_server_destroy(struct slicemap_server *s) {
+
+	int i;
+
+	for (i=0; i<SLICEMAP_MAX_CLIENTS; i++) {
+		if (s->clients[i].fd >= 0) {
+			close(s->clients[i].fd);
+			s->clients[i].fd = -1;
+		}
+	}
+	if (s->listenFd >= 0) {
+		close(s->listenFd);
+		unlink(s->path);
+		s->listenFd = -1;
+	}
+	if (s->addr != NULL) {
+		munmap(s->addr, s->size);
+		s->addr = NULL;
+	}
+	if (s->memfd >= 0) {
+		close(s->memfd);
+		s->memfd = -1;
+	}
+	for (i=0; i<NUMBER_VIRTUAL_SLICES; i++) {
+		free(s->freeLines[i]);
+		s->freeLines[i] = NULL;
+	}
+	free(s->lineSlice);
+	free(s->owner);
+	s->lineSlice = NULL;
+	s->owner = NULL;
+}
+
+
+/*
+ * Connect to the daemon and map its memory
+ * Returns SA_ERR_PERM if the daemon runs as another user than the client (or root)
+ */
+
+int slicemap_connect(struct slicemap_client *c, const char *path) {
+
+	struct sockaddr_un addr;
+	struct slicemap_reply reply;
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = {&reply, sizeof(reply)};
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct ucred cred;
+	socklen_t credLen = sizeof(cred);
+	int error = SA_ERR_IO;
+
+	memset(c, 0, sizeof(*c));
+	c->memfd = -1;
+	memset(&addr, 0, sizeof(addr));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return SA_ERR_INVALID;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	c->sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (c->sock < 0) {
+		return SA_ERR_IO;
+	}
+	if (connect(c->sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		goto fail;
+	}
+	/* The memfd of another user could be read by that user, so nothing is written to it */
+	if (getsockopt(c->sock, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1) {
+		goto fail;
+	}
+	if (cred.uid != geteuid() && cred.uid != 0) {
+		error = SA_ERR_PERM;
+		goto fail;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(c->sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(reply)) {
+		goto fail;
+	}
+	for (cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(&c->memfd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	if (reply.status != SA_OK) {
+		error = reply.status;
+		goto fail;
+	}
+	if (c->memfd < 0) {
+		goto fail;
+	}
+
+	c->size = reply.size;
+	c->pageSize = reply.pageSize;
+	c->nSlices = reply.nSlices;
+	c->addr = mmap(NULL, c->size, PROTECTION, MAP_SHARED | MAP_POPULATE, c->memfd, 0);
+	if (c->addr == MAP_FAILED) {
+		c->addr = NULL;
+		error = SA_ERR_MAP;
+		goto fail;
+	}
+	return SA_OK;
+
+fail:
+	slicemap_disconnect(c);
+	return error;
+}
+
+
+/*
+ * Get nLines lines of a slice from the daemon (all or nothing)
+ */
+
+int slicemap_alloc_lines(struct slicemap_client *c, int slice, void **lines, size_t nLines) {
+
+	struct slicemap_request request = {SLICEMAP_OP_ALLOC, slice, nLines};
+	struct slicemap_reply reply;
+	uint64_t chunk[SLICEMAP_CHUNK];
+	size_t i, j, n;
+	int error;
+
+	if ((error = slicemap_send_all(c->sock, &request, sizeof(request))) || (error = slicemap_recv_all(c->sock, &reply, sizeof(reply)))) {
+		return error;
+	}
+	if (reply.status != SA_OK) {
+		return reply.status;
+	}
+	for (i=0; i<nLines; i+=n) {
+		n = (nLines - i < SLICEMAP_CHUNK) ? nLines - i : SLICEMAP_CHUNK;
+		if ((error = slicemap_recv_all(c->sock, chunk, n*sizeof(uint64_t)))) {
+			return error;
+		}
+		for (j=0; j<n; j++) {
+			lines[i+j] = (char*)c->addr + chunk[j];
+		}
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Give lines back to the daemon (lines that are not owned by the client are ignored and reported as SA_ERR_INVALID)
+ */
+
+int slicemap_free_lines(struct slicemap_client *c, void **lines, size_t nLines) {
+
+	struct slicemap_request request = {SLICEMAP_OP_FREE, 0, nLines};
+	struct slicemap_reply reply;
+	uint64_t chunk[SLICEMAP_CHUNK];
+	size_t i, j, n;
+	int error;
+
+	if ((error = slicemap_send_all(c->sock, &request, sizeof(request)))) {
+		return error;
+	}
+	for (i=0; i<nLines; i+=n) {
+		n = (nLines - i < SLICEMAP_CHUNK) ? nLines - i : SLICEMAP_CHUNK;
+		for (j=0; j<n; j++) {
+			chunk[j] = (char*)lines[i+j] - (char*)c->addr;
+		}
+		if ((error = slicemap_send_all(c->sock, chunk, n*sizeof(uint64_t)))) {
+			return error;
+		}
+	}
+	if ((error = slicemap_recv_all(c->sock, &reply, sizeof(reply)))) {
+		return error;
+	}
+	return reply.status;
+}
+
+
+/*
+ * Number of free lines of each slice (nFree has NUMBER_VIRTUAL_SLICES entries)
+ */
+
+int slicemap_stats(struct slicemap_client *c, uint64_t *nFree) {
+
+	struct slicemap_request request = {SLICEMAP_OP_STATS, 0, 0};
+	struct slicemap_reply reply;
+	int error;
+
+	if ((error = slicemap_send_all(c->sock, &request, sizeof(request))) || (error = slicemap_recv_all(c->sock, &reply, sizeof(reply)))) {
+		return error;
+	}
+	if (reply.status != SA_OK) {
+		return reply.status;
+	}
+	return slicemap_recv_all(c->sock, nFree, NUMBER_VIRTUAL_SLICES*sizeof(uint64_t));
+}
+
+
+/*
+ * Unmap the memory and disconnect; the daemon frees the remaining lines of the client
+ */
+
+void slicemap_disconnect(struct slicemap_client *c) {
+	if (c->addr != NULL) {
+		munmap(c->addr, c->size);
+		c->addr = NULL;
+	}
+	if (c->memfd >= 0) {
+		close(c->memfd);
+		c->memfd = -1;
+	}
+	if (c->sock >= 0) {
+		close(c->sock);
+		c->sock = -1;
+	}
+}
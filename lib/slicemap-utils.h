@@ -0,0 +1,129 @@
+/*
+ * Host-level slice-map service: a daemon classifies hugepages once and hands slice-local lines to other processes
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SLICEMAP_UTILS_H
+#define SLICEMAP_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "sliceaware.h"
+#include "memory-utils.h"
+#include "msr-utils.h"
+#include "cache-utils.h"
+
+/*
+ * The daemon (server) reserves a memfd backed by hugepages (MFD_HUGETLB, i.e., hugetlbfs; 4KB shmem pages as
+ * a fallback), locks it, and finds the slice of every line once (hash model or uncore polling).
+ * Clients connect to a unix socket and receive the memfd (SCM_RIGHTS) when they connect. They map it and
+ * ask for lines of a slice: the daemon replies with the offsets of free lines of that slice in the memfd, which
+ * belong to the client until it frees them or disconnects. Since the mapping is shared, the physical addresses
+ * (and thus the slices) are the same in all processes, so a client gets slice-local memory without any
+ * discovery and all the processes of a host share one budget of lines per slice.
+ *
+ * Trust model: the memory is shared, not partitioned. Every client maps the whole memfd read/write, so it can
+ * read and overwrite the lines of all other clients; ownership only decides which lines the daemon hands out.
+ * The daemon therefore serves only processes of its own user and root (checked with SO_PEERCRED when they
+ * connect; others get SA_ERR_PERM without the memfd). Processes that must not see each other's data should
+ * use separate daemons.
+ * Clients trust the daemon the same way: slicemap_connect() only accepts a server running as the client's user
+ * or root, so a server that another user bound to the path (e.g., while the daemon is down) never receives the
+ * data of the client. The default socket is in /run, which only root can write; a daemon of another user
+ * should listen in a directory that this user owns and not in a world-writable one such as /tmp.
+ *
+ * Hugetlb pages never move; the 4KB fallback pages are locked by the daemon but may still be migrated
+ * by the kernel (e.g., compaction), in which case their slices are no longer accurate.
+ *
+ * Protocol (SOCK_STREAM, host byte order):
+ *	connect							-> reply {status, nSlices, size, pageSize} + memfd
+ *	{ALLOC, slice, n}				-> reply {status, n} + n line offsets (uint64_t), all or nothing
+ *	{FREE, 0, n} + n line offsets	-> reply {status}
+ *	{STATS, 0, 0}					-> reply {status, nSlices, nLines} + nSlices free line counts (uint64_t)
+ *
+ * The daemon serves all clients from one thread without blocking on any of them: every client has its own
+ * buffers and state, requests are read and replies written as far as the socket allows, and a client that
+ * sends or reads slowly only delays itself. The offsets of an ALLOC are reserved when it is accepted and
+ * taken from the free lines as they are sent.
+ */
+
+#define SLICEMAP_DEFAULT_SOCKET "/run/sliceaware-slicemap.sock"
+#define SLICEMAP_MAX_CLIENTS 64
+#define SLICEMAP_NO_OWNER 0xFF
+#define SLICEMAP_CHUNK 512			/* Line offsets sent or received at once */
+
+#define SLICEMAP_OP_ALLOC 1
+#define SLICEMAP_OP_FREE 2
+#define SLICEMAP_OP_STATS 3
+
+struct slicemap_request {
+	int32_t op;
+	int32_t slice;
+	uint64_t nLines;
+};
+
+struct slicemap_reply {
+	int32_t status;				/* SA_OK or an SA_ERR_* code */
+	int32_t nSlices;
+	uint64_t nLines;
+	uint64_t size;				/* Size of the memfd */
+	uint64_t pageSize;
+};
+
+/* State of a connected client in the daemon */
+struct slicemap_conn {
+	int fd;							/* -1 -> empty slot */
+	struct slicemap_request request;
+	size_t inLen;					/* Bytes received of the request, or of the offsets in in */
+	uint64_t nReceive;				/* Offsets of a FREE request still to be received */
+	uint64_t nSend;					/* Offsets of an ALLOC request still to be sent */
+	int32_t status;					/* Status of the FREE request */
+	uint64_t in[SLICEMAP_CHUNK];
+	char out[sizeof(struct slicemap_reply) + SLICEMAP_CHUNK*sizeof(uint64_t)];
+	size_t outLen;					/* Bytes of the reply in out, of which outSent are sent */
+	size_t outSent;
+};
+
+struct slicemap_server {
+	int memfd;
+	void *addr;						/* Mapping of the memfd in the daemon */
+	size_t size;
+	size_t pageSize;
+	unsigned long nLines;
+	uint8_t *lineSlice;				/* Slice of each line */
+	uint8_t *owner;					/* Client slot owning each line, or SLICEMAP_NO_OWNER */
+	uint64_t *freeLines[NUMBER_VIRTUAL_SLICES];	/* Stack of the free lines (indices) of each slice */
+	unsigned long nFree[NUMBER_VIRTUAL_SLICES];
+	unsigned long nSliceLines[NUMBER_VIRTUAL_SLICES];
+	unsigned long nReserved[NUMBER_VIRTUAL_SLICES];	/* Free lines promised to ALLOC requests being sent */
+	int listenFd;
+	uid_t uid;						/* User of the daemon; only this user and root are served */
+	char path[108];
+	struct slicemap_conn clients[SLICEMAP_MAX_CLIENTS];
+	volatile int stop;						/* Set (e.g., from a signal handler) to leave slicemap_server_run() */
+};
+
+int slicemap_server_init(struct slicemap_server *s, size_t size, struct msr_device *msr);
+int slicemap_server_listen(struct slicemap_server *s, const char *path);
+int slicemap_server_run(struct slicemap_server *s);
+void slicemap_server_destroy(struct slicemap_server *s);
+
+/* A client is used by one thread at a time */
+struct slicemap_client {
+	int sock;
+	int memfd;
+	void *addr;						/* Mapping of the memfd in the client */
+	size_t size;
+	size_t pageSize;
+	int nSlices;
+};
+
+int slicemap_connect(struct slicemap_client *c, const char *path);
+int slicemap_alloc_lines(struct slicemap_client *c, int slice, void **lines, size_t nLines);
+int slicemap_free_lines(struct slicemap_client *c, void **lines, size_t nLines);
+int slicemap_stats(struct slicemap_client *c, uint64_t *nFree);
+void slicemap_disconnect(struct slicemap_client *c);
+
+#endif /* SLICEMAP_UTILS_H */
@@ -0,0 +1,252 @@
+/*
+ * Spill policies: placing working sets larger than one slice on the primary slice and the closest other slices
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <string.h>
+#include "spill-utils.h"
+
+#ifdef SKYLAKE
+#define SPILL_PHYSICAL_SLICES 18	/* Xeon Gold 6134, grouped into virtual slices by virtualSlice() */
+#endif
+
+/*
+ * Lines a (virtual) slice can hold: sets * ways of each of its physical slices
+ */
+
+unsigned long spill_slice_capacity(int slice) {
+
+	unsigned long nPhysical = 1;
+
+	#ifdef SKYLAKE
+	int s;
+	nPhysical = 0;
+	for (s=0; s<SPILL_PHYSICAL_SLICES; s++) {
+		if (virtualSlice(s) == slice) {
+			nPhysical++;
+		}
+	}
+	#else
+	(void)slice;
+	#endif
+	return nPhysical * L3_SETS_PER_SLICE * LLC_WAYS;
+}
+
+
+/*
+ * Policy of a core: its own slice, then the other slices by their latency from the core
+ * table can be NULL (ring model); maxSlices <= 0 -> all slices
+ */
+
+int spill_policy_init(struct spill_policy *p, int mode, int core, const struct latency_table *table, int maxSlices) {
+
+	struct latency_table ring;
+	int order[NUMBER_VIRTUAL_SLICES];
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	if (table == NULL) {
+		latency_table_ring(&ring, NUMBER_VIRTUAL_SLICES, NUMBER_VIRTUAL_SLICES);
+		table = &ring;
+	}
+	if (mode < SPILL_SINGLE || mode > SPILL_WEIGHTED || core < 0 || core >= table->nCores || core >= table->nSlices) {
+		return SA_ERR_INVALID;
+	}
+	p->mode = mode;
+	p->core = core;
+
+	/* The primary slice comes first even if the table says otherwise */
+	latency_order(table, core, order);
+	p->slices[p->nSlices++] = core;
+	for (i=0; i<table->nSlices; i++) {
+		if (order[i] != core) {
+			p->slices[p->nSlices++] = order[i];
+		}
+	}
+	if (mode == SPILL_SINGLE) {
+		p->nSlices = 1;
+	} else if (maxSlices > 0 && maxSlices < p->nSlices) {
+		p->nSlices = maxSlices;
+	}
+
+	for (i=0; i<p->nSlices; i++) {
+		int slice = p->slices[i];
+		double latency = table->latency[core][slice];
+		p->weights[i] = 1.0/((latency > 0 ? latency : 0) + 1);
+		p->capacity[i] = spill_slice_capacity(slice);
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Count the lines of the policy in a budget shared with other policies (NUMBER_VIRTUAL_SLICES entries, zeroed by the caller)
+ * Must be called before the first allocation.
+ */
+
+void spill_policy_share(struct spill_policy *p, unsigned long long *budget) {
+	p->used = budget;
+}
+
+
+/* Lines counted against the capacity of the slices */
+
+static inline unsigned long long* spill_used(struct spill_policy *p) {
+	return (p->used != NULL) ? p->used : p->nLines;
+}
+
+
+/*
+ * Spread n lines over the slices from first on, in proportion to their weights
+ * (capped by their free capacity if capped is set); returns the lines that could not be placed
+ */
+
+static size_t spill_spread(struct spill_policy *p, size_t *plan, int first, size_t n, int capped) {
+
+	while (n > 0) {
+		double total = 0;
+		size_t placed = 0;
+		int i, last = -1;
+		for (i=first; i<p->nSlices; i++) {
+			if (!capped || spill_used(p)[p->slices[i]] + plan[i] < p->capacity[i]) {
+				total += p->weights[i];
+				last = i;
+			}
+		}
+		if (last < 0) {
+			break;
+		}
+		for (i=first; i<p->nSlices && placed < n; i++) {
+			size_t share, room = (size_t)-1;
+			if (capped) {
+				if (spill_used(p)[p->slices[i]] + plan[i] >= p->capacity[i]) {
+					continue;
+				}
+				room = p->capacity[i] - spill_used(p)[p->slices[i]] - plan[i];
+			}
+			/* Rounding leftovers go to the last slice with room, so every round places something */
+			share = (i == last) ? n - placed : (size_t)(n*p->weights[i]/total);
+			if (share > n - placed) {
+				share = n - placed;
+			}
+			if (share > room) {
+				share = room;
+			}
+			plan[i] += share;
+			placed += share;
+		}
+		n -= placed;
+		if (placed == 0) {
+			break;
+		}
+	}
+	return n;
+}
+
+
+/*
+ * Allocate nLines lines according to the policy (all or nothing)
+ * The lines of the primary slice come first, then the spilled ones, slice by slice in the order of the policy.
+ */
+
+int spill_alloc_lines(sa_context_t *ctx, struct spill_policy *p, void **lines, size_t nLines) {
+
+	size_t plan[NUMBER_VIRTUAL_SLICES] = {0};
+	size_t remaining = nLines, offset = 0, overCapacity = 0;
+	int i, j, error;
+
+	if (lines == NULL && nLines != 0) {
+		return SA_ERR_INVALID;
+	}
+
+	if (p->mode == SPILL_SINGLE) {
+		plan[0] = nLines;
+		if (spill_used(p)[p->slices[0]] + nLines > p->capacity[0]) {
+			overCapacity = spill_used(p)[p->slices[0]] + nLines - p->capacity[0];
+			if (overCapacity > nLines) {
+				overCapacity = nLines;
+			}
+		}
+		remaining = 0;
+	} else if (p->mode == SPILL_FILL) {
+		for (i=0; i<p->nSlices && remaining > 0; i++) {
+			size_t room = (spill_used(p)[p->slices[i]] < p->capacity[i]) ? p->capacity[i] - spill_used(p)[p->slices[i]] : 0;
+			plan[i] = (remaining < room) ? remaining : room;
+			remaining -= plan[i];
+		}
+	} else {
+		size_t room = (spill_used(p)[p->slices[0]] < p->capacity[0]) ? p->capacity[0] - spill_used(p)[p->slices[0]] : 0;
+		plan[0] = (remaining < room) ? remaining : room;
+		remaining -= plan[0];
+		remaining = spill_spread(p, plan, 1, remaining, 1);
+	}
+	if (remaining > 0) {
+		overCapacity = remaining;
+		spill_spread(p, plan, 0, remaining, 0);
+	}
+
+	for (i=0; i<p->nSlices; i++) {
+		if (plan[i] == 0) {
+			continue;
+		}
+		if ((error = sa_alloc_lines(ctx, p->slices[i], lines + offset, plan[i]))) {
+			/* Release the lines of the previous slices */
+			offset = 0;
+			for (j=0; j<i; j++) {
+				sa_free_lines(ctx, p->slices[j], lines + offset, plan[j]);
+				offset += plan[j];
+			}
+			return error;
+		}
+		offset += plan[i];
+	}
+
+	for (i=0; i<p->nSlices; i++) {
+		p->nLines[p->slices[i]] += plan[i];
+		if (p->used != NULL) {
+			p->used[p->slices[i]] += plan[i];
+		}
+	}
+	p->nAllocations++;
+	p->nOverCapacity += overCapacity;
+	return SA_OK;
+}
+
+
+/*
+ * Give lines allocated with the policy back (their slices are looked up again)
+ */
+
+void spill_free_lines(sa_context_t *ctx, struct spill_policy *p, void **lines, size_t nLines) {
+
+	size_t i;
+
+	for (i=0; i<nLines; i++) {
+		int slice = sa_slice_of(ctx, lines[i]);
+		if (slice < 0) {
+			continue;
+		}
+		sa_free_lines(ctx, slice, &lines[i], 1);
+		if (p->nLines[slice] > 0) {
+			p->nLines[slice]--;
+			if (p->used != NULL && p->used[slice] > 0) {
+				p->used[slice]--;
+			}
+		}
+	}
+}
+
+
+const char* spill_mode_name(int mode) {
+	switch (mode) {
+	case SPILL_SINGLE:
+		return "single";
+	case SPILL_FILL:
+		return "fill";
+	case SPILL_WEIGHTED:
+		return "weighted";
+	default:
+		return "unknown";
+	}
+}
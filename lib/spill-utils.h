@@ -0,0 +1,62 @@
+/*
+ * Spill policies: placing working sets larger than one slice on the primary slice and the closest other slices
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef SPILL_UTILS_H
+#define SPILL_UTILS_H
+
+#include "sliceaware.h"
+#include "latency-utils.h"
+#include "coloring-utils.h"
+
+/*
+ * A core has one primary slice (the closest one), which holds about SLICE_SIZE bytes
+ * (2.5MB on Haswell; on SkyLake a virtual slice is a group of 1.375MB slices, see other/skylake-slice-core-mapping.txt).
+ * A policy places the lines of a core as follows:
+ *
+ * - SPILL_SINGLE: every line on the primary slice, whatever its size (the default of the library).
+ * - SPILL_FILL: the primary slice is filled up to its capacity, then the next-closest slice according to
+ *   the latency table, and so on.
+ * - SPILL_WEIGHTED: the primary slice is filled up to its capacity, and the rest is spread over the
+ *   other slices in proportion to 1/latency (capped by their capacity), so cheap slices get more lines.
+ *
+ * At most maxSlices slices are used (primary included). Lines beyond the capacity of all of them are spread
+ * in the same proportions and counted as nOverCapacity. Lines are returned in placement order, so the hottest
+ * lines should come first.
+ *
+ * By default, a policy only counts its own lines against the capacity of the slices. Policies of several
+ * cores can share a budget (spill_policy_share()), so a core does not spill into the space already used by
+ * the others; they must not allocate at the same time, and the primary lines of every core should be
+ * allocated before the spilled ones (e.g., in two rounds), otherwise the first cores take the primary slices of the others.
+ */
+
+#define SPILL_SINGLE 0
+#define SPILL_FILL 1
+#define SPILL_WEIGHTED 2
+
+struct spill_policy {
+	int mode;
+	int core;
+	int nSlices;								/* Slices used by the policy, primary first */
+	int slices[NUMBER_VIRTUAL_SLICES];			/* Closest first */
+	double weights[NUMBER_VIRTUAL_SLICES];		/* Share of the spilled lines of each used slice */
+	unsigned long capacity[NUMBER_VIRTUAL_SLICES];	/* Lines each used slice can hold */
+
+	unsigned long long *used;					/* Shared budget: lines of all its policies on each slice (NULL -> nLines) */
+
+	/* Statistics, indexed by slice */
+	unsigned long long nLines[NUMBER_VIRTUAL_SLICES];	/* Lines of the policy currently placed on each slice */
+	unsigned long long nAllocations;
+	unsigned long long nOverCapacity;			/* Lines placed beyond the capacity of the slices */
+};
+
+unsigned long spill_slice_capacity(int slice);
+int spill_policy_init(struct spill_policy *p, int mode, int core, const struct latency_table *table, int maxSlices);
+void spill_policy_share(struct spill_policy *p, unsigned long long *budget);
+int spill_alloc_lines(sa_context_t *ctx, struct spill_policy *p, void **lines, size_t nLines);
+void spill_free_lines(sa_context_t *ctx, struct spill_policy *p, void **lines, size_t nLines);
+const char* spill_mode_name(int mode);
+
+#endif /* SPILL_UTILS_H */
@@ -0,0 +1,276 @@
+/*
+ * Per-slice LLC activity telemetry: sampling CHA/CBo LLC_LOOKUP counters and exporting per-slice rates
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "telemetry-utils.h"
+
+/*
+ * Seconds between two timestamps
+ */
+
+double telemetry_elapsed(struct timespec *start, struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+
+/*
+ * Read the raw counters of all slices
+ */
+
+static int telemetry_read(struct telemetry *t, uint64_t *values) {
+
+	int i;
+
+	if (t->backend == TELEMETRY_BACKEND_MSR) {
+		if (read_CHA_CBO(t->msr, values, t->nSlices)) {
+			return SA_ERR_MSR;
+		}
+		for (i=0; i<t->nSlices; i++) {
+			values[i] &= UNCORE_COUNTER_MASK;
+		}
+		return SA_OK;
+	}
+
+	/* Simulated: advance the counters by the configured rates (+-10% noise) */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = telemetry_elapsed(&t->last, &now);
+	for (i=0; i<t->nSlices; i++) {
+		double noise = 0.9 + 0.2*((double)rand_r(&t->seed)/RAND_MAX);
+		values[i] = (t->previous[i] + (uint64_t)(t->simulatedRate[i]*elapsed*noise)) & UNCORE_COUNTER_MASK;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Initialize the sampler for the first nSlices CHA/CBo counters (at most NUMBER_SLICES)
+ * The MSR backend programs the CHA/CBo counters of msr's socket with uncore_init()
+ */
+
+int telemetry_init(struct telemetry *t, int backend, int nSlices, struct msr_device *msr) {
+
+	memset(t, 0, sizeof(*t));
+	t->backend = backend;
+	t->msr = msr;
+	t->nSlices = (nSlices > 0 && nSlices < NUMBER_SLICES) ? nSlices : NUMBER_SLICES;
+	t->seed = 1;
+	t->hottestSlice = -1;
+
+	if (backend == TELEMETRY_BACKEND_MSR && uncore_init(msr)) {
+		return SA_ERR_MSR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t->last);
+	return telemetry_read(t, t->previous);
+}
+
+
+/*
+ * Set the lookup rate of a slice for the simulated backend
+ */
+
+void telemetry_simulate_rate(struct telemetry *t, int slice, double lookupsPerSecond) {
+	t->simulatedRate[slice] = lookupsPerSecond;
+}
+
+
+/*
+ * Take a sample: per-slice rates since the previous sample + imbalance metrics
+ */
+
+int telemetry_sample(struct telemetry *t) {
+
+	int i;
+	uint64_t values[NUMBER_SLICES];
+	struct timespec now;
+
+	if (telemetry_read(t, values)) {
+		return SA_ERR_MSR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t->interval = telemetry_elapsed(&t->last, &now);
+	t->last = now;
+
+	double sum = 0, max = 0;
+	t->hottestSlice = 0;
+	for (i=0; i<t->nSlices; i++) {
+		/* Counters may wrap around between two samples */
+		uint64_t delta = (values[i] - t->previous[i]) & UNCORE_COUNTER_MASK;
+		t->previous[i] = values[i];
+		t->total[i] += delta;
+		t->rate[i] = (t->interval > 0) ? delta/t->interval : 0;
+		sum += t->rate[i];
+		if (t->rate[i] > max) {
+			max = t->rate[i];
+			t->hottestSlice = i;
+		}
+	}
+
+	double mean = sum/t->nSlices;
+	double variance = 0;
+	for (i=0; i<t->nSlices; i++) {
+		variance += (t->rate[i]-mean)*(t->rate[i]-mean);
+	}
+	variance /= t->nSlices;
+	t->maxMeanRatio = (mean > 0) ? max/mean : 0;
+	t->cv = (mean > 0) ? sqrt(variance)/mean : 0;
+	t->nSamples++;
+	return SA_OK;
+}
+
+
+/*
+ * CSV output: header + one line per sample
+ * time,interval,rate_s0,...,rate_sN,max_mean,cv,hottest
+ */
+
+void telemetry_csv_header(struct telemetry *t, FILE *out) {
+
+	int i;
+
+	fprintf(out, "time,interval");
+	for (i=0; i<t->nSlices; i++) {
+		fprintf(out, ",rate_s%d", i);
+	}
+	fprintf(out, ",max_mean,cv,hottest\n");
+}
+
+void telemetry_csv_sample(struct telemetry *t, FILE *out) {
+
+	int i;
+
+	fprintf(out, "%ld.%09ld,%.6f", (long)t->last.tv_sec, t->last.tv_nsec, t->interval);
+	for (i=0; i<t->nSlices; i++) {
+		fprintf(out, ",%.0f", t->rate[i]);
+	}
+	fprintf(out, ",%.4f,%.4f,%d\n", t->maxMeanRatio, t->cv, t->hottestSlice);
+	fflush(out);
+}
+
+
+/*
+ * Prometheus text exposition format
+ */
+
+void telemetry_prometheus(struct telemetry *t, FILE *out) {
+
+	int i;
+
+	fprintf(out, "# HELP sliceaware_llc_lookups_total LLC lookups served by each slice since the sampler started.\n");
+	fprintf(out, "# TYPE sliceaware_llc_lookups_total counter\n");
+	for (i=0; i<t->nSlices; i++) {
+		fprintf(out, "sliceaware_llc_lookups_total{slice=\"%d\"} %"PRIu64"\n", i, t->total[i]);
+	}
+	fprintf(out, "# HELP sliceaware_llc_lookup_rate LLC lookups per second of each slice during the last interval.\n");
+	fprintf(out, "# TYPE sliceaware_llc_lookup_rate gauge\n");
+	for (i=0; i<t->nSlices; i++) {
+		fprintf(out, "sliceaware_llc_lookup_rate{slice=\"%d\"} %.0f\n", i, t->rate[i]);
+	}
+	fprintf(out, "# HELP sliceaware_slice_imbalance_ratio Highest per-slice lookup rate divided by the mean rate.\n");
+	fprintf(out, "# TYPE sliceaware_slice_imbalance_ratio gauge\n");
+	fprintf(out, "sliceaware_slice_imbalance_ratio %.4f\n", t->maxMeanRatio);
+	fprintf(out, "# HELP sliceaware_slice_imbalance_cv Coefficient of variation of the per-slice lookup rates.\n");
+	fprintf(out, "# TYPE sliceaware_slice_imbalance_cv gauge\n");
+	fprintf(out, "sliceaware_slice_imbalance_cv %.4f\n", t->cv);
+	fprintf(out, "# HELP sliceaware_hottest_slice Slice with the highest lookup rate during the last interval.\n");
+	fprintf(out, "# TYPE sliceaware_hottest_slice gauge\n");
+	fprintf(out, "sliceaware_hottest_slice %d\n", t->hottestSlice);
+}
+
+
+/*
+ * Write the Prometheus metrics to a file
+ * The file is replaced atomically, so a scraper never reads a partial file
+ */
+
+int telemetry_prometheus_file(struct telemetry *t, const char *path) {
+
+	char tmpPath[512];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+	FILE *out = fopen(tmpPath, "w");
+	if (out == NULL) {
+		return SA_ERR_IO;
+	}
+	telemetry_prometheus(t, out);
+	if (fclose(out) == EOF || rename(tmpPath, path)) {
+		return SA_ERR_IO;
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Sleep until the next sampling point
+ * Sampling points are absolute, so the interval does not drift with the time spent in sampling/exporting
+ */
+
+static void telemetry_wait(struct timespec *next, unsigned long intervalMs) {
+	next->tv_nsec += (intervalMs%1000)*1000000;
+	next->tv_sec += intervalMs/1000 + next->tv_nsec/1000000000;
+	next->tv_nsec %= 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL) == EINTR);
+}
+
+
+/*
+ * Sample every intervalMs milliseconds, nSamples times (0 -> until telemetry_stop())
+ * Each sample is written to csv (if not NULL) and promPath (if not NULL)
+ * Returns SA_OK, or the error code that stopped sampling
+ */
+
+int telemetry_run(struct telemetry *t, unsigned long intervalMs, unsigned long long nSamples, FILE *csv, const char *promPath) {
+
+	struct timespec next;
+	unsigned long long i;
+	int error;
+
+	if (csv != NULL) {
+		telemetry_csv_header(t, csv);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i=0; (nSamples == 0 || i<nSamples) && !t->stop; i++) {
+		telemetry_wait(&next, intervalMs);
+		if ((error = telemetry_sample(t))) {
+			return error;
+		}
+		if (csv != NULL) {
+			telemetry_csv_sample(t, csv);
+		}
+		if (promPath != NULL && (error = telemetry_prometheus_file(t, promPath))) {
+			return error;
+		}
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Background sampling (library mode): a thread samples the counters while the application runs
+ */
+
+static void* telemetry_thread(void *arg) {
+	struct telemetry *t = arg;
+	telemetry_run(t, t->intervalMs, 0, t->csv, t->promPath);
+	return NULL;
+}
+
+int telemetry_start(struct telemetry *t, unsigned long intervalMs, FILE *csv, const char *promPath) {
+	t->intervalMs = intervalMs;
+	t->csv = csv;
+	t->promPath = promPath;
+	t->stop = 0;
+	return pthread_create(&t->thread, NULL, telemetry_thread, t);
+}
+
+void telemetry_stop(struct telemetry *t) {
+	t->stop = 1;
+	pthread_join(t->thread, NULL);
+}
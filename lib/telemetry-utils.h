@@ -0,0 +1,74 @@
+/*
+ * Per-slice LLC activity telemetry: sampling CHA/CBo LLC_LOOKUP counters and exporting per-slice rates
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef TELEMETRY_UTILS_H
+#define TELEMETRY_UTILS_H
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "msr-utils.h"
+
+/*
+ * uncore_init() programs every CHA/CBo to count LLC_LOOKUP events, i.e., the accesses served by each slice.
+ * Instead of polling one address, the sampler reads all counters at a fixed interval and reports
+ * the lookup rate of each slice and how imbalanced the load is among the slices:
+ * - max/mean: 1.0 when the load is uniform, NUMBER_SLICES when a single slice serves all lookups
+ * - coefficient of variation (stddev/mean) of the per-slice rates
+ *
+ * Counters can be read from the MSRs (requires root + msr module) or from a simulated backend,
+ * which is useful for testing the exporters on machines without access to uncore counters.
+ *
+ * Results can be exported as CSV (one line per sample) and in the Prometheus text exposition format,
+ * e.g., for the textfile collector of node_exporter.
+ *
+ * Probing slices with calculateSlice_uncore() on the same socket resets the counters,
+ * so the rates of the interval during which probing happens are not meaningful.
+ */
+
+#define UNCORE_COUNTER_WIDTH 48	/* CHA/CBo counters are 48 bits wide */
+#define UNCORE_COUNTER_MASK ((1ULL << UNCORE_COUNTER_WIDTH) - 1)
+
+#define TELEMETRY_BACKEND_MSR 0
+#define TELEMETRY_BACKEND_SIMULATED 1
+
+struct telemetry {
+	int backend;							/* TELEMETRY_BACKEND_MSR or TELEMETRY_BACKEND_SIMULATED */
+	struct msr_device *msr;					/* MSR device of a CPU on the monitored socket */
+	int nSlices;							/* Number of CHA/CBo counters to sample */
+	uint64_t previous[NUMBER_SLICES];		/* Counter values at the previous sample */
+	uint64_t total[NUMBER_SLICES];			/* Lookups since the start of the sampler */
+	double rate[NUMBER_SLICES];				/* Lookups per second during the last interval */
+	struct timespec last;					/* Time of the previous sample */
+	double interval;						/* Length of the last interval in seconds */
+	double maxMeanRatio;					/* max/mean of the rates */
+	double cv;								/* Coefficient of variation of the rates */
+	int hottestSlice;						/* Slice with the highest rate */
+	unsigned long long nSamples;			/* Number of samples taken so far */
+	/* Simulated backend */
+	double simulatedRate[NUMBER_SLICES];	/* Lookups per second of each slice */
+	unsigned int seed;
+	/* Background sampling */
+	pthread_t thread;
+	volatile int stop;						/* Set by telemetry_stop() */
+	unsigned long intervalMs;
+	FILE *csv;
+	const char *promPath;
+};
+
+double telemetry_elapsed(struct timespec *start, struct timespec *end);
+int telemetry_init(struct telemetry *t, int backend, int nSlices, struct msr_device *msr);
+void telemetry_simulate_rate(struct telemetry *t, int slice, double lookupsPerSecond);
+int telemetry_sample(struct telemetry *t);
+void telemetry_csv_header(struct telemetry *t, FILE *out);
+void telemetry_csv_sample(struct telemetry *t, FILE *out);
+void telemetry_prometheus(struct telemetry *t, FILE *out);
+int telemetry_prometheus_file(struct telemetry *t, const char *path);
+int telemetry_run(struct telemetry *t, unsigned long intervalMs, unsigned long long nSamples, FILE *csv, const char *promPath);
+int telemetry_start(struct telemetry *t, unsigned long intervalMs, FILE *csv, const char *promPath);
+void telemetry_stop(struct telemetry *t);
+
+#endif /* TELEMETRY_UTILS_H */
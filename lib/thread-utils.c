@@ -0,0 +1,246 @@
+/*
+ * Pinned threads with their own stacks and slice-local thread-local storage
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "thread-utils.h"
+
+/* Pinned thread of the calling thread (NULL for other threads) */
+static pthread_key_t self_key;
+static pthread_once_t self_once = PTHREAD_ONCE_INIT;
+
+static void self_key_create(void) {
+	pthread_key_create(&self_key, NULL);
+}
+
+/*
+ * Map a stack of (at least) size bytes with an unmapped guard below it
+ * page_size selects 1GB/2MB/4KB-pages, or PAGE_SIZE_AUTO; smaller pages are used if the requested ones are not available.
+ * Returns SA_OK, or SA_ERR_MAP if no pages can be mapped
+ */
+
+int thread_stack_create(struct thread_stack *st, size_t size, size_t page_size) {
+
+	size_t current = preferred_page_size(size, page_size);
+	int flags;
+
+	memset(st, 0, sizeof(*st));
+	if (size == 0) {
+		return SA_ERR_INVALID;
+	}
+	while (current != 0) {
+		/* Reserve the guard, the stack and room to align the stack to its pages */
+		st->size = (size + current - 1) & ~(current - 1);
+		st->reserved = THREAD_GUARD_SIZE + st->size + current;
+		st->reservation = mmap(ADDR, st->reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (st->reservation == MAP_FAILED) {
+			break;
+		}
+		st->base = (void*)(((uintptr_t)st->reservation + THREAD_GUARD_SIZE + current - 1) & ~(current - 1));
+
+		flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+		if (current == PAGE_SIZE_1GB) {
+			flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+		} else if (current == PAGE_SIZE_2MB) {
+			flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+		}
+		if (mmap(st->base, st->size, PROTECTION, flags, -1, 0) != MAP_FAILED) {
+			st->page_size = current;
+			return SA_OK;
+		}
+		munmap(st->reservation, st->reserved);
+		current = fallback_page_size(current);
+	}
+	memset(st, 0, sizeof(*st));
+	return SA_ERR_MAP;
+}
+
+
+void thread_stack_destroy(struct thread_stack *st) {
+	if (st->reservation != NULL) {
+		/* The stack first: munmap() of hugepages must cover whole pages */
+		munmap(st->base, st->size);
+		munmap(st->reservation, st->reserved);
+	}
+	memset(st, 0, sizeof(*st));
+}
+
+
+/*
+ * Fault in and lock a stack from a CPU, so its pages come from the node of that CPU (first touch)
+ * pthread_create() writes the thread descriptor at the top of the stack from the creator, so this must run first.
+ * The caller is pinned to the CPU meanwhile and gets its affinity back.
+ * Returns SA_OK, or SA_ERR_INVALID if the caller cannot run on the CPU
+ */
+
+static int thread_stack_fault(struct thread_stack *st, int cpu) {
+
+	cpu_set_t set, saved;
+	size_t offset;
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved)) {
+		return SA_ERR_INVALID;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+		return SA_ERR_INVALID;
+	}
+	for (offset=0; offset<st->size; offset+=st->page_size) {
+		*((volatile char*)st->base + offset) = 0;
+	}
+	/* Hugepages cannot be swapped anyway, so only 4KB-pages may move if this fails */
+	mlock(st->base, st->size);
+	pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+	return SA_OK;
+}
+
+
+/*
+ * Entry point of a pinned thread: warm its TLS arena from its core, then run fn
+ */
+
+static void* thread_main(void *arg) {
+
+	struct pinned_thread *t = arg;
+	size_t l;
+
+	pthread_setspecific(self_key, t);
+	for (l=0; l<t->nTlsLines; l++) {
+		memset(t->tlsLines[l], 0, LINE);
+	}
+	return t->fn(t->arg);
+}
+
+
+/*
+ * Start fn(arg) on a CPU with a stack of stackSize bytes (0 -> THREAD_DEFAULT_STACK) and a TLS arena of
+ * nTlsLines lines on the slice of the CPU (ctx NULL or nTlsLines 0 -> no arena)
+ * t must stay valid until thread_join_pinned()
+ * Returns SA_OK or an error code
+ */
+
+int thread_create_pinned(struct pinned_thread *t, sa_context_t *ctx, int cpu, size_t stackSize, size_t nTlsLines,
+	void *(*fn)(void *), void *arg) {
+
+	pthread_attr_t attr;
+	cpu_set_t set;
+	int error;
+
+	pthread_once(&self_once, self_key_create);
+	memset(t, 0, sizeof(*t));
+	if (cpu < 0 || cpu >= CPU_SETSIZE || fn == NULL) {
+		return SA_ERR_INVALID;
+	}
+	t->cpu = cpu;
+	t->slice = sa_cpu_slice(cpu);
+	t->fn = fn;
+	t->arg = arg;
+	if ((error = thread_stack_create(&t->stack, stackSize ? stackSize : THREAD_DEFAULT_STACK, PAGE_SIZE_AUTO))) {
+		return error;
+	}
+	if ((error = thread_stack_fault(&t->stack, cpu))) {
+		thread_stack_destroy(&t->stack);
+		memset(t, 0, sizeof(*t));
+		return error;
+	}
+
+	if (ctx != NULL && nTlsLines > 0) {
+		t->tlsLines = malloc(nTlsLines * sizeof(*t->tlsLines));
+		if (t->tlsLines == NULL) {
+			thread_stack_destroy(&t->stack);
+			return SA_ERR_NOMEM;
+		}
+		if ((error = sa_alloc_lines(ctx, t->slice, t->tlsLines, nTlsLines))) {
+			free(t->tlsLines);
+			thread_stack_destroy(&t->stack);
+			memset(t, 0, sizeof(*t));
+			return error;
+		}
+		t->ctx = ctx;
+		t->nTlsLines = nTlsLines;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_attr_init(&attr)) {
+		error = SA_ERR_NOMEM;
+	} else {
+		if (pthread_attr_setstack(&attr, t->stack.base, t->stack.size) ||
+			pthread_attr_setaffinity_np(&attr, sizeof(set), &set)) {
+			error = SA_ERR_INVALID;
+		} else if ((errno = pthread_create(&t->thread, &attr, thread_main, t))) {
+			error = (errno == EINVAL) ? SA_ERR_INVALID : SA_ERR_NOMEM;
+		}
+		pthread_attr_destroy(&attr);
+	}
+	if (error) {
+		if (t->ctx != NULL) {
+			sa_free_lines(t->ctx, t->slice, t->tlsLines, t->nTlsLines);
+		}
+		free(t->tlsLines);
+		thread_stack_destroy(&t->stack);
+		memset(t, 0, sizeof(*t));
+	}
+	return error;
+}
+
+
+/*
+ * Wait for a pinned thread and release its stack and TLS arena
+ */
+
+int thread_join_pinned(struct pinned_thread *t, void **ret) {
+
+	if (pthread_join(t->thread, ret)) {
+		return SA_ERR_INVALID;
+	}
+	if (t->ctx != NULL) {
+		sa_free_lines(t->ctx, t->slice, t->tlsLines, t->nTlsLines);
+	}
+	free(t->tlsLines);
+	thread_stack_destroy(&t->stack);
+	memset(t, 0, sizeof(*t));
+	return SA_OK;
+}
+
+
+/*
+ * Zeroed object of up to 64 Bytes from the TLS arena of the calling thread, aligned to its size
+ * (up to 64 Bytes, at least 8); the whole object lies on one line of the slice of the thread's core
+ * Returns NULL if the arena is full or the caller is not a pinned thread. Objects are released with the thread.
+ */
+
+void* thread_tls_alloc(size_t size) {
+
+	struct pinned_thread *t = thread_self();
+	size_t align = 8, offset;
+
+	if (t == NULL || size == 0 || size > LINE) {
+		return NULL;
+	}
+	while (align < size) {
+		align *= 2;
+	}
+	for (; t->tlsLine < t->nTlsLines; t->tlsLine++, t->tlsOffset = 0) {
+		offset = (t->tlsOffset + align - 1) & ~(align - 1);
+		if (offset + size <= LINE) {
+			t->tlsOffset = offset + size;
+			return (char*)t->tlsLines[t->tlsLine] + offset;
+		}
+	}
+	return NULL;
+}
+
+
+/* Pinned thread of the caller, or NULL */
+struct pinned_thread* thread_self(void) {
+	pthread_once(&self_once, self_key_create);
+	return pthread_getspecific(self_key);
+}
@@ -0,0 +1,66 @@
+/*
+ * Pinned threads with their own stacks and slice-local thread-local storage
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef THREAD_UTILS_H
+#define THREAD_UTILS_H
+
+#include <pthread.h>
+#include "memory-utils.h"
+#include "cache-utils.h"
+
+/*
+ * A pinned thread starts on its CPU (the affinity is set before it runs) and gets:
+ *
+ * - a stack mapped by this library: hugepages if available (4KB-pages otherwise), faulted in and locked before
+ *   the thread is created, so deep call chains neither miss in the TLB nor fault. The creator faults it in while
+ *   temporarily pinned to the core of the thread, so the pages come from the node of that core and not from the
+ *   creator's (pthread_create() already writes to the top of the stack). Below the stack, at least THREAD_GUARD_SIZE Bytes stay unmapped (PROT_NONE) to catch overflows.
+ *   A stack is contiguous virtual memory, so its lines are spread over all slices by the hash function
+ *   (every page has lines of every slice); only the TLS arena below can be slice-local.
+ *   glibc keeps the thread descriptor and the static TLS block (__thread variables) at the top of a stack that
+ *   it did not allocate, so they share these pages.
+ * - a TLS arena: cache lines of the slice of its core (sa_alloc_lines()), handed out by thread_tls_alloc() for
+ *   the hot per-thread variables (counters, cursors, small buffers) that would otherwise be __thread variables
+ *   in the static TLS block, which malloc/mmap places without regard to the slice.
+ */
+
+#define THREAD_DEFAULT_STACK (2*1024UL*1024)	/* Stack size if none is given */
+#define THREAD_GUARD_SIZE (64*1024UL)			/* Minimum unmapped gap below a stack */
+
+/* A stack and the reservation around it */
+struct thread_stack {
+	void *reservation;		/* PROT_NONE mapping holding the guard and the stack */
+	size_t reserved;
+	void *base;				/* Lowest address of the stack */
+	size_t size;
+	size_t page_size;		/* Size of the pages backing the stack */
+};
+
+struct pinned_thread {
+	pthread_t thread;
+	int cpu;
+	int slice;
+	sa_context_t *ctx;
+	struct thread_stack stack;
+	void **tlsLines;		/* TLS arena */
+	size_t nTlsLines;
+	size_t tlsLine;			/* Line the next objects are taken from */
+	size_t tlsOffset;		/* Bytes of that line in use */
+	void *(*fn)(void *);
+	void *arg;
+};
+
+int thread_stack_create(struct thread_stack *st, size_t size, size_t page_size);
+void thread_stack_destroy(struct thread_stack *st);
+
+int thread_create_pinned(struct pinned_thread *t, sa_context_t *ctx, int cpu, size_t stackSize, size_t nTlsLines,
+	void *(*fn)(void *), void *arg);
+int thread_join_pinned(struct pinned_thread *t, void **ret);
+
+void* thread_tls_alloc(size_t size);
+struct pinned_thread* thread_self(void);
+
+#endif /* THREAD_UTILS_H */
@@ -0,0 +1,190 @@
+/*
+ * Cycle timing: fenced TSC reads, overhead calibration, TSC frequency and per-thread latency histograms
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <string.h>
+#include <time.h>
+#include <cpuid.h>
+#include <pthread.h>
+#include "timing-utils.h"
+
+#define TIMING_MEASURE_NS 50000000	/* Length of the frequency measurement */
+
+static struct timing machine;
+static pthread_once_t machine_once = PTHREAD_ONCE_INIT;
+
+
+/* Overhead: the fastest empty pair, i.e., without interrupts and cache misses */
+static uint64_t timing_calibrate_overhead(void) {
+
+	uint64_t best = UINT64_MAX, start, stop;
+	int i;
+
+	for (i=0; i<TIMING_CALIBRATION_ROUNDS; i++) {
+		start = timing_start();
+		stop = timing_stop();
+		if (stop - start < best) {
+			best = stop - start;
+		}
+	}
+	return best;
+}
+
+
+/* TSC frequency: nominal one from CPUID 0x15 (crystal clock * ratio), or TSC ticks during TIMING_MEASURE_NS */
+static double timing_calibrate_frequency(int *fromCpuid) {
+
+	unsigned eax, ebx, ecx, edx;
+	struct timespec begin, now;
+	uint64_t tscBegin, tscEnd;
+	double ns;
+
+	*fromCpuid = 0;
+	if (__get_cpuid_max(0, NULL) >= 0x15) {
+		__cpuid(0x15, eax, ebx, ecx, edx);
+		if (eax != 0 && ebx != 0 && ecx != 0) {
+			*fromCpuid = 1;
+			return (double)ecx * ebx / eax / 1e9;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+	tscBegin = timing_start();
+	do {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		ns = (now.tv_sec-begin.tv_sec)*1e9 + (now.tv_nsec-begin.tv_nsec);
+	} while (ns < TIMING_MEASURE_NS);
+	tscEnd = timing_stop();
+	return (tscEnd - tscBegin) / ns;
+}
+
+
+static void timing_calibrate(void) {
+
+	unsigned eax, ebx, ecx, edx;
+
+	machine.overhead = timing_calibrate_overhead();
+	machine.tscGHz = timing_calibrate_frequency(&machine.fromCpuid);
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+		machine.invariant = (edx >> 8) & 1;
+	}
+}
+
+
+/*
+ * Calibration of this machine, done once by the first caller
+ */
+
+const struct timing* timing_get(void) {
+	pthread_once(&machine_once, timing_calibrate);
+	return &machine;
+}
+
+
+/*
+ * Print the calibration, e.g., at the start of a benchmark
+ */
+
+void timing_print(FILE *file) {
+	const struct timing *t = timing_get();
+	fprintf(file, "TSC: %.3f GHz (%s), %sinvariant, timer overhead %llu cycles\n", t->tscGHz,
+		t->fromCpuid ? "CPUID" : "measured", t->invariant ? "" : "NOT ", (unsigned long long)t->overhead);
+}
+
+
+void timing_hist_init(struct timing_hist *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+
+/*
+ * Add the samples of src to dst, e.g., the histograms of all threads to one
+ */
+
+void timing_hist_merge(struct timing_hist *dst, const struct timing_hist *src) {
+
+	int i;
+
+	for (i=0; i<TIMING_HIST_BUCKETS; i++) {
+		dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+	}
+	dst->nSamples += src->nSamples;
+	dst->sum += src->sum;
+	if (src->min < dst->min) {
+		dst->min = src->min;
+	}
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+}
+
+
+/* Largest value of a bucket */
+static uint64_t timing_hist_highest(unsigned index) {
+	unsigned group = index >> TIMING_HIST_SUB_BITS;
+	uint64_t sub = index & (TIMING_HIST_SUB_BUCKETS - 1);
+	if (group == 0) {
+		return index;
+	}
+	return ((TIMING_HIST_SUB_BUCKETS + sub) << (group - 1)) + ((1ULL << (group - 1)) - 1);
+}
+
+
+/*
+ * Value below which percentile% of the samples are (0 <= percentile <= 100)
+ * The result is the largest value of the bucket, but not more than the largest sample.
+ */
+
+uint64_t timing_hist_percentile(const struct timing_hist *h, double percentile) {
+
+	uint64_t nSamples = __atomic_load_n(&h->nSamples, __ATOMIC_RELAXED), target, seen = 0;
+	unsigned i;
+
+	if (nSamples == 0) {
+		return 0;
+	}
+	target = (uint64_t)(percentile / 100 * nSamples + 0.5);
+	if (target < 1) {
+		target = 1;
+	}
+	for (i=0; i<TIMING_HIST_BUCKETS; i++) {
+		seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+		if (seen >= target) {
+			uint64_t value = timing_hist_highest(i);
+			return (value < h->max) ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+
+double timing_hist_mean(const struct timing_hist *h) {
+	return h->nSamples ? (double)h->sum / h->nSamples : 0;
+}
+
+
+/*
+ * One line per histogram: samples, then min/mean/percentiles/max in cycles and ns
+ */
+
+void timing_hist_print(FILE *file, const char *label, const struct timing_hist *h) {
+
+	static const double percentiles[] = {50, 90, 99, 99.9};
+	unsigned i;
+
+	if (h->nSamples == 0) {
+		fprintf(file, "%s: no samples\n", label);
+		return;
+	}
+	fprintf(file, "%s: %llu samples, cycles (ns): min %llu (%.1f) mean %.1f (%.1f)", label,
+		(unsigned long long)h->nSamples, (unsigned long long)h->min, timing_ns(h->min),
+		timing_hist_mean(h), timing_hist_mean(h) / timing_get()->tscGHz);
+	for (i=0; i<sizeof(percentiles)/sizeof(percentiles[0]); i++) {
+		uint64_t value = timing_hist_percentile(h, percentiles[i]);
+		fprintf(file, " p%g %llu (%.1f)", percentiles[i], (unsigned long long)value, timing_ns(value));
+	}
+	fprintf(file, " max %llu (%.1f)\n", (unsigned long long)h->max, timing_ns(h->max));
+}
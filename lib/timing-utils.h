@@ -0,0 +1,122 @@
+/*
+ * Cycle timing: fenced TSC reads, overhead calibration, TSC frequency and per-thread latency histograms
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef TIMING_UTILS_H
+#define TIMING_UTILS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * timing_start()/timing_stop() read the TSC as in "How to Benchmark Code Execution Times on Intel IA-32 and IA-64"
+ * (Paoloni): CPUID; RDTSC before the measured code and RDTSCP; CPUID after it, so the code cannot move outside
+ * of the two reads. Each pair costs some cycles by itself (the overhead), which timing_cycles() subtracts.
+ *
+ * timing_get() calibrates once per process:
+ * - overhead: the minimum of many empty start/stop pairs
+ * - TSC frequency: from CPUID leaf 0x15 when the CPU reports it, otherwise measured against CLOCK_MONOTONIC_RAW
+ * The TSC only measures time if it is invariant (CPUID 0x80000007), which is the case on Haswell and later.
+ *
+ * A histogram is log-linear (as HdrHistogram): values below 2^TIMING_HIST_SUB_BITS have their own bucket,
+ * larger ones fall into 2^TIMING_HIST_SUB_BITS buckets per power of two, i.e., within 1/2^TIMING_HIST_SUB_BITS (3%)
+ * of their value, from 0 to 2^64-1. Recording is a few instructions and takes no lock: each thread records
+ * into its own histogram, and the histograms are merged (timing_hist_merge()) once the threads are done.
+ * Counters are updated with relaxed atomic stores, so another thread can print a histogram while it is recorded.
+ */
+
+#define TIMING_HIST_SUB_BITS 5
+#define TIMING_HIST_SUB_BUCKETS (1 << TIMING_HIST_SUB_BITS)
+#define TIMING_HIST_BUCKETS ((64 - TIMING_HIST_SUB_BITS + 1) << TIMING_HIST_SUB_BITS)
+#define TIMING_CALIBRATION_ROUNDS 100000
+
+struct timing {
+	uint64_t overhead;		/* Cycles of an empty timing_start()/timing_stop() pair */
+	double tscGHz;			/* TSC ticks per ns */
+	int fromCpuid;			/* Frequency reported by CPUID 0x15, otherwise measured */
+	int invariant;			/* TSC runs at a constant rate in all C/P-states */
+};
+
+struct timing_hist {
+	uint64_t counts[TIMING_HIST_BUCKETS];
+	uint64_t nSamples;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+/*
+ * Fenced TSC reads
+ */
+
+static inline uint64_t timing_start(void) {
+	unsigned high, low;
+	asm volatile ("CPUID\n\t"
+		"RDTSC\n\t"
+		"mov %%edx, %0\n\t"
+		"mov %%eax, %1\n\t": "=r" (high), "=r" (low):: "rax", "rbx", "rcx", "rdx", "memory");
+	return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t timing_stop(void) {
+	unsigned high, low;
+	asm volatile ("RDTSCP\n\t"
+		"mov %%edx, %0\n\t"
+		"mov %%eax, %1\n\t"
+		"CPUID\n\t": "=r" (high), "=r" (low):: "rax", "rbx", "rcx", "rdx", "memory");
+	return ((uint64_t)high << 32) | low;
+}
+
+const struct timing* timing_get(void);
+
+/* Cycles between a start and a stop, without the overhead of the reads */
+static inline uint64_t timing_cycles(uint64_t start, uint64_t stop) {
+	uint64_t cycles = stop - start, overhead = timing_get()->overhead;
+	return (cycles > overhead) ? cycles - overhead : 0;
+}
+
+static inline double timing_ns(uint64_t cycles) {
+	return cycles / timing_get()->tscGHz;
+}
+
+static inline double timing_seconds(uint64_t cycles) {
+	return timing_ns(cycles) / 1e9;
+}
+
+/*
+ * Histograms
+ */
+
+static inline unsigned timing_hist_index(uint64_t value) {
+	unsigned msb;
+	if (value < TIMING_HIST_SUB_BUCKETS) {
+		return value;
+	}
+	msb = 63 - __builtin_clzll(value);
+	return ((msb - TIMING_HIST_SUB_BITS + 1) << TIMING_HIST_SUB_BITS) +
+		((value >> (msb - TIMING_HIST_SUB_BITS)) & (TIMING_HIST_SUB_BUCKETS - 1));
+}
+
+static inline void timing_hist_record(struct timing_hist *h, uint64_t value) {
+	unsigned i = timing_hist_index(value);
+	__atomic_store_n(&h->counts[i], h->counts[i] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->nSamples, h->nSamples + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+	if (value < h->min) {
+		__atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+	}
+	if (value > h->max) {
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+void timing_hist_init(struct timing_hist *h);
+void timing_hist_merge(struct timing_hist *dst, const struct timing_hist *src);
+uint64_t timing_hist_percentile(const struct timing_hist *h, double percentile);
+double timing_hist_mean(const struct timing_hist *h);
+void timing_hist_print(FILE *file, const char *label, const struct timing_hist *h);
+void timing_print(FILE *file);
+
+#endif /* TIMING_UTILS_H */
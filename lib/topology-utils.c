@@ -0,0 +1,216 @@
+/*
+ * CPU topology from sysfs: packages, physical cores and SMT siblings, and core lists for the applications
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "topology-utils.h"
+#include "cache-utils.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+/* Read a number from a sysfs file */
+static int topology_read(const char *path, int *value) {
+	FILE *file = fopen(path, "r");
+	int n;
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	n = fscanf(file, "%d", value);
+	fclose(file);
+	return (n == 1) ? SA_OK : SA_ERR_IO;
+}
+
+
+/*
+ * Parse a CPU list (e.g., "0,2,4-7", as in sysfs and taskset)
+ * Returns the number of CPUs or SA_ERR_INVALID
+ */
+
+int topology_parse_list(const char *list, int *cpus, int maxCpus) {
+
+	const char *p = list;
+	char *end;
+	int n = 0;
+
+	while (*p != '\0' && *p != '\n') {
+		long first = strtol(p, &end, 10), last, cpu;
+		if (end == p || first < 0) {
+			return SA_ERR_INVALID;
+		}
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first) {
+				return SA_ERR_INVALID;
+			}
+			p = end;
+		}
+		for (cpu=first; cpu<=last; cpu++) {
+			if (n == maxCpus || cpu >= TOPOLOGY_MAX_CPUS) {
+				return SA_ERR_INVALID;
+			}
+			cpus[n++] = cpu;
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p != '\0' && *p != '\n') {
+			return SA_ERR_INVALID;
+		}
+	}
+	return n;
+}
+
+
+/*
+ * Read the topology of the online CPUs
+ */
+
+int topology_load(struct cpu_topology *t) {
+
+	char line[TOPOLOGY_LINE_LENGTH], path[256];
+	int cpus[TOPOLOGY_MAX_CPUS];
+	int i, j, n, error;
+	FILE *file;
+
+	memset(t, 0, sizeof(*t));
+	file = fopen(SYSFS_CPU "/online", "r");
+	if (file == NULL) {
+		return SA_ERR_IO;
+	}
+	if (fgets(line, sizeof(line), file) == NULL) {
+		fclose(file);
+		return SA_ERR_IO;
+	}
+	fclose(file);
+	if ((n = topology_parse_list(line, cpus, TOPOLOGY_MAX_CPUS)) <= 0) {
+		return SA_ERR_IO;
+	}
+
+	for (i=0; i<n; i++) {
+		int cpu = cpus[i];
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+		if ((error = topology_read(path, &t->package[cpu]))) {
+			return error;
+		}
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+		if ((error = topology_read(path, &t->core[cpu]))) {
+			return error;
+		}
+		t->online[cpu] = 1;
+		if (cpu >= t->nCpus) {
+			t->nCpus = cpu + 1;
+		}
+		if (t->package[cpu] >= t->nPackages) {
+			t->nPackages = t->package[cpu] + 1;
+		}
+	}
+
+	/* Ranks: siblings by CPU number within their core, then cores by core_id within their package */
+	for (i=0; i<t->nCpus; i++) {
+		for (j=0; j<i && t->online[i]; j++) {
+			t->thread[i] += (t->online[j] && t->package[j] == t->package[i] && t->core[j] == t->core[i]);
+		}
+	}
+	for (i=0; i<t->nCpus; i++) {
+		for (j=0; j<t->nCpus && t->online[i]; j++) {
+			t->coreIndex[i] += (t->online[j] && t->thread[j] == 0 && t->package[j] == t->package[i] && t->core[j] < t->core[i]);
+		}
+	}
+	return SA_OK;
+}
+
+
+/*
+ * Topology of this machine, read once (NULL if sysfs is not available)
+ */
+
+static struct cpu_topology machine;
+static int machineError;
+static pthread_once_t machine_once = PTHREAD_ONCE_INIT;
+
+static void topology_load_machine(void) {
+	machineError = topology_load(&machine);
+}
+
+const struct cpu_topology* topology_get(void) {
+	pthread_once(&machine_once, topology_load_machine);
+	return machineError ? NULL : &machine;
+}
+
+
+/* One CPU per core of a package (thread 0), optionally followed by the siblings; package < 0 -> all packages */
+static int topology_cores(const struct cpu_topology *t, int package, int smt, int *cpus, int maxCpus) {
+
+	int cpu, thread, n = 0, found = 1;
+
+	for (thread=0; found && (thread == 0 || smt); thread++) {
+		found = 0;
+		for (cpu=0; cpu<t->nCpus; cpu++) {
+			if (!t->online[cpu] || t->thread[cpu] != thread || (package >= 0 && t->package[cpu] != package)) {
+				continue;
+			}
+			if (n == maxCpus) {
+				return n;
+			}
+			cpus[n++] = cpu;
+			found = 1;
+		}
+	}
+	return n;
+}
+
+
+/*
+ * CPUs of a core set (see topology-utils.h); spec NULL -> default
+ * Returns the number of CPUs, or SA_ERR_INVALID for an unknown set or an offline CPU
+ */
+
+int topology_select(const struct cpu_topology *t, const char *spec, int *cpus, int maxCpus) {
+
+	int package = 0, i, n;
+
+	if (spec == NULL || strcmp(spec, "default") == 0) {
+		n = topology_cores(t, 0, 0, cpus, maxCpus);
+	} else if (strcmp(spec, "all") == 0) {
+		n = topology_cores(t, -1, 0, cpus, maxCpus);
+	} else if (sscanf(spec, "socket%d", &package) == 1) {
+		n = topology_cores(t, package, 0, cpus, maxCpus);
+	} else if (strncmp(spec, "smt", 3) == 0) {
+		if (spec[3] != '\0' && sscanf(spec + 3, "%d", &package) != 1) {
+			return SA_ERR_INVALID;
+		}
+		n = topology_cores(t, package, 1, cpus, maxCpus);
+	} else {
+		n = topology_parse_list(spec, cpus, maxCpus);
+		for (i=0; i<n; i++) {
+			if (cpus[i] >= t->nCpus || !t->online[cpus[i]]) {
+				return SA_ERR_INVALID;
+			}
+		}
+	}
+	return (n > 0) ? n : SA_ERR_INVALID;
+}
+
+
+/*
+ * Slice closest to a CPU: the rank of its core in the package
+ * Returns SA_ERR_IO if the topology is not available, SA_ERR_INVALID for an offline CPU
+ */
+
+int topology_cpu_slice(int cpu) {
+	const struct cpu_topology *t = topology_get();
+	if (t == NULL) {
+		return SA_ERR_IO;
+	}
+	if (cpu < 0 || cpu >= t->nCpus || !t->online[cpu]) {
+		return SA_ERR_INVALID;
+	}
+	return t->coreIndex[cpu] % NUMBER_VIRTUAL_SLICES;
+}
@@ -0,0 +1,44 @@
+/*
+ * CPU topology from sysfs: packages, physical cores and SMT siblings, and core lists for the applications
+ *
+ * Copyright (c) 2019, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef TOPOLOGY_UTILS_H
+#define TOPOLOGY_UTILS_H
+
+#include "sliceaware.h"
+
+/*
+ * Read from /sys/devices/system/cpu: the online CPUs and, for each, topology/physical_package_id and topology/core_id.
+ * core_id is only unique within a package and is not contiguous on every CPU (e.g., SkyLake-SP),
+ * so the cores of a package are numbered by their rank (coreIndex), which is also the slice closest to them.
+ * SMT siblings share a physical core; thread is 0 for the lowest CPU of a core, 1 for the next one, etc.
+ *
+ * Core sets (topology_select()):
+ *	default | socketN	one CPU per physical core of package 0 (or N), i.e., no SMT siblings
+ *	all					one CPU per physical core of all packages
+ *	smt | smtN			all CPUs of package 0 (or N): the first thread of every core, then the siblings
+ *	0,2,4-7				an explicit list of online CPUs
+ */
+
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_LINE_LENGTH 4096
+
+struct cpu_topology {
+	int nCpus;							/* Highest online CPU + 1 */
+	int nPackages;
+	int online[TOPOLOGY_MAX_CPUS];
+	int package[TOPOLOGY_MAX_CPUS];
+	int core[TOPOLOGY_MAX_CPUS];		/* core_id */
+	int coreIndex[TOPOLOGY_MAX_CPUS];	/* Rank of the core within its package */
+	int thread[TOPOLOGY_MAX_CPUS];		/* Rank of the CPU among the SMT siblings of its core */
+};
+
+int topology_load(struct cpu_topology *t);
+const struct cpu_topology* topology_get(void);
+int topology_parse_list(const char *list, int *cpus, int maxCpus);
+int topology_select(const struct cpu_topology *t, const char *spec, int *cpus, int maxCpus);
+int topology_cpu_slice(int cpu);
+
+#endif /* TOPOLOGY_UTILS_H */